@@ -46,6 +46,10 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <stdarg.h>
+#if defined(USE_SSL_DIRECT) && !defined(_WIN32)
+#include <sys/uio.h>
+#define ASOCK_SEND_GATHER
+#endif
 
 #include "str.h"
 
@@ -96,6 +100,14 @@
 
 #define PORT_STRING_LEN 6 /* "12345\0" or ":12345" */
 
+#ifdef ASOCK_SEND_GATHER
+/*
+ * Maximum number of queued send buffers gathered into one writev() on
+ * unencrypted sockets.
+ */
+#define ASOCK_SEND_IOV_MAX 64
+#endif
+
 #define IN_IPOLL_RECV (1 << 0)
 #define IN_IPOLL_SEND (1 << 1)
 
@@ -3327,6 +3339,74 @@ AsyncSocketDispatchSentBuffer(AsyncSocket *s)
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketDispatchSentBuffers --
+ *
+ *      Account for sent bytes written from the head of the send buffer
+ *      list. All buffers that are now completely sent are popped off
+ *      the list first and their callbacks are then fired in order.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Send callbacks may close the socket.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+AsyncSocketDispatchSentBuffers(AsyncSocket *s,  // IN:
+                               int sent)        // IN: bytes written
+{
+   SendBufList *done = NULL;
+   SendBufList **doneTail = &done;
+
+   /*
+    * Do the list management *first*, so that the list is in a consistent
+    * state when the callbacks run.
+    */
+
+   while (sent > 0) {
+      SendBufList *head = s->sendBufList;
+      int left = head->len - s->sendPos;
+
+      if (sent < left) {
+         s->sendPos += sent;
+         break;
+      }
+      sent -= left;
+      s->sendBufList = head->next;
+      s->sendPos = 0;
+      head->next = NULL;
+      *doneTail = head;
+      doneTail = &head->next;
+   }
+   if (s->sendBufList == NULL) {
+      s->sendBufTail = &(s->sendBufList);
+   }
+
+   while (done != NULL) {
+      SendBufList *cur = done;
+
+      done = cur->next;
+      free(cur->encodedBuf);
+
+      /*
+       * See AsyncSocketDispatchSentBuffer: the callback may close the
+       * socket, our caller holds a reference so it is not freed under us.
+       */
+
+      if (cur->sendFn) {
+         cur->sendFn(cur->buf, cur->len, s, cur->clientData);
+      }
+      free(cur);
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -3336,6 +3416,10 @@ AsyncSocketDispatchSentBuffer(AsyncSocket *s)
  *      actually writes to the wire assuming there's space in the buffers
  *      for the socket.
  *
+ *      On unencrypted sockets all queued buffers, up to ASOCK_SEND_IOV_MAX,
+ *      are gathered into a single writev() so that many small sends cost
+ *      one system call. Encrypted sockets write one buffer at a time.
+ *
  * Results:
  *      ASOCKERR_SUCESS if everything worked, else ASOCKERR_GENERIC.
  *
@@ -3349,6 +3433,9 @@ static int
 AsyncSocketWriteBuffers(AsyncSocket *s)
 {
    int result;
+#ifdef ASOCK_SEND_GATHER
+   Bool gather;
+#endif
 
    ASSERT(s->asockType != ASYNCSOCKET_TYPE_NAMEDPIPE);
    ASSERT(AsyncSocketIsLocked(s));
@@ -3365,13 +3452,38 @@ AsyncSocketWriteBuffers(AsyncSocket *s)
 
    AsyncSocketAddRef(s);
 
+#ifdef ASOCK_SEND_GATHER
+   gather = !SSL_IsEncrypted(s->sslSock);
+#endif
+
    while (s->sendBufList && s->state == AsyncSocketConnected) {
       SendBufList *head = s->sendBufList;
       int error = 0;
       int sent = 0;
       int left = head->len - s->sendPos;
-      int sizeToSend = head->len;
 
+#ifdef ASOCK_SEND_GATHER
+      if (gather && head->next != NULL) {
+         struct iovec iov[ASOCK_SEND_IOV_MAX];
+         SendBufList *cur = head;
+         int pos = s->sendPos;
+         int iovcnt = 0;
+
+         left = 0;
+         do {
+            char *base = cur->encodedBuf ? cur->encodedBuf : cur->buf;
+
+            iov[iovcnt].iov_base = base + pos;
+            iov[iovcnt].iov_len = cur->len - pos;
+            left += cur->len - pos;
+            iovcnt++;
+            pos = 0;
+            cur = cur->next;
+         } while (cur != NULL && iovcnt < ARRAYSIZE(iov));
+
+         sent = SSL_WriteV(s->sslSock, iov, iovcnt);
+      } else
+#endif
       if (head->encodedBuf) {
          sent = SSL_Write(s->sslSock,
                           (uint8 *) head->encodedBuf + s->sendPos, left);
@@ -3384,9 +3496,7 @@ AsyncSocketWriteBuffers(AsyncSocket *s)
       if (sent > 0) {
          s->sendBufFull = FALSE;
          s->sslConnected = TRUE;
-         if ((s->sendPos += sent) == sizeToSend) {
-            AsyncSocketDispatchSentBuffer(s);
-         }
+         AsyncSocketDispatchSentBuffers(s, sent);
       } else if (sent == 0) {
          ASOCKLG0(s, ("socket write() should never return 0.\n"));
          NOT_REACHED();
@@ -34,6 +34,17 @@
 #  include <unistd.h>
 #endif
 
+/*
+ * Asynchronous mode: messages are appended to an in-memory buffer and
+ * written by a background thread, either every FILE_LOGGER_FLUSH_INTERVAL
+ * milliseconds or as soon as FILE_LOGGER_FLUSH_SIZE bytes are pending.
+ * Messages that would grow the buffer past FILE_LOGGER_MAX_PENDING bytes
+ * are dropped (and counted) instead of blocking the caller.
+ */
+#define FILE_LOGGER_FLUSH_INTERVAL  1000
+#define FILE_LOGGER_FLUSH_SIZE      (64 * 1024)
+#define FILE_LOGGER_MAX_PENDING     (1024 * 1024)
+
 
 typedef struct FileLogger {
    GlibLogger     handler;
@@ -45,6 +56,17 @@ typedef struct FileLogger {
    gboolean       append;
    gboolean       error;
    GStaticMutex   lock;
+
+   /* Asynchronous mode; the fields below are protected by "lock". */
+   gboolean       async;
+   GThread       *writer;
+   GCond         *wakeup;    /* Signalled when the writer has work to do. */
+   GCond         *flushed;   /* Signalled when the writer finished a batch. */
+   GString       *pending;   /* Messages not yet handed to the writer. */
+   guint          dropped;   /* Messages dropped since the last batch. */
+   gboolean       writing;   /* The writer is writing a batch. */
+   gboolean       flushNow;  /* Write the pending messages right away. */
+   gboolean       stop;      /* The writer should exit. */
 } FileLogger;
 
 
@@ -305,51 +327,47 @@ FileLoggerOpen(FileLogger *data)
 
 /*
  *******************************************************************************
- * FileLoggerLog --                                                       */ /**
+ * FileLoggerWrite --                                                     */ /**
  *
- * Logs a message to the configured destination file. Also opens the file for
- * writing if it hasn't been done yet.
+ * Writes data to the log file, opening it first if that hasn't been done yet,
+ * and does the log rotation accounting.
  *
- * @param[in] domain    Log domain.
- * @param[in] level     Log level.
- * @param[in] message   Message to log.
- * @param[in] data      File logger.
+ * @note In synchronous mode this is called with the logger lock held; in
+ * asynchronous mode it is only called from the writer thread.
+ *
+ * @param[in] logger    File logger.
+ * @param[in] data      Data to write.
+ * @param[in] len       Length of data, or -1 if NUL-terminated.
  *
  *******************************************************************************
  */
 
 static void
-FileLoggerLog(const gchar *domain,
-              GLogLevelFlags level,
-              const gchar *message,
-              gpointer data)
+FileLoggerWrite(FileLogger *logger,
+                const gchar *data,
+                gssize len)
 {
-   FileLogger *logger = data;
    gsize written;
 
-   g_static_mutex_lock(&logger->lock);
-
    if (logger->error) {
-      goto exit;
+      return;
    }
 
    if (logger->file == NULL) {
-      if (logger->file == NULL) {
-         logger->file = FileLoggerOpen(data);
-      }
+      logger->file = FileLoggerOpen(logger);
       if (logger->file == NULL) {
          logger->error = TRUE;
-         goto exit;
+         return;
       }
    }
 
    if (!FileLoggerIsValid(logger)) {
       logger->error = TRUE;
-      goto exit;
+      return;
    }
 
    /* Write the log file and do log rotation accounting. */
-   if (g_io_channel_write_chars(logger->file, message, -1, &written, NULL) ==
+   if (g_io_channel_write_chars(logger->file, data, len, &written, NULL) ==
        G_IO_STATUS_NORMAL) {
       if (logger->maxSize > 0) {
          logger->logSize += (gint) written;
@@ -364,8 +382,235 @@ FileLoggerLog(const gchar *domain,
          g_io_channel_flush(logger->file, NULL);
       }
    }
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerWriterThread --                                              */ /**
+ *
+ * Background writer for asynchronous file loggers. Waits until enough data
+ * is pending, the flush interval expires or a flush is requested, then writes
+ * all pending messages to the file in one go, without holding the logger
+ * lock.
+ *
+ * @param[in] data      File logger.
+ *
+ * @return NULL.
+ *
+ *******************************************************************************
+ */
+
+static gpointer
+FileLoggerWriterThread(gpointer data)
+{
+   FileLogger *logger = data;
+   GMutex *mutex = g_static_mutex_get_mutex(&logger->lock);
+   GString *batch = g_string_sized_new(FILE_LOGGER_FLUSH_SIZE);
+
+   g_mutex_lock(mutex);
+
+   for (;;) {
+      guint dropped;
+      GString *tmp;
+
+      if (!logger->stop &&
+          !logger->flushNow &&
+          logger->pending->len < FILE_LOGGER_FLUSH_SIZE) {
+         GTimeVal deadline;
+
+         g_get_current_time(&deadline);
+         g_time_val_add(&deadline, FILE_LOGGER_FLUSH_INTERVAL * 1000);
+         g_cond_timed_wait(logger->wakeup, mutex, &deadline);
+      }
+
+      if (logger->pending->len == 0 && logger->dropped == 0) {
+         logger->flushNow = FALSE;
+         g_cond_broadcast(logger->flushed);
+         if (logger->stop) {
+            break;
+         }
+         continue;
+      }
+
+      tmp = logger->pending;
+      logger->pending = batch;
+      batch = tmp;
+      dropped = logger->dropped;
+      logger->dropped = 0;
+      logger->flushNow = FALSE;
+      logger->writing = TRUE;
+
+      g_mutex_unlock(mutex);
+
+      if (dropped > 0) {
+         g_string_append_printf(batch, "[%8s] Dropped %u log messages: the "
+                                "log buffer was full.\n", "warning", dropped);
+      }
+      FileLoggerWrite(logger, batch->str, batch->len);
+      g_string_truncate(batch, 0);
+
+      g_mutex_lock(mutex);
+      logger->writing = FALSE;
+      g_cond_broadcast(logger->flushed);
+   }
+
+   g_mutex_unlock(mutex);
+   g_string_free(batch, TRUE);
+
+   return NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerStartWriter --                                               */ /**
+ *
+ * Starts the background writer of an asynchronous file logger. This is done
+ * lazily, since loggers may be created before glib's thread support has been
+ * initialized (and before the process daemonizes).
+ *
+ * @note Make sure this function is called with the logger lock held.
+ *
+ * @param[in] logger    File logger.
+ *
+ * @return Whether the writer is running.
+ *
+ *******************************************************************************
+ */
+
+static gboolean
+FileLoggerStartWriter(FileLogger *logger)
+{
+   if (logger->writer == NULL && g_thread_supported()) {
+      logger->wakeup = g_cond_new();
+      logger->flushed = g_cond_new();
+      logger->pending = g_string_sized_new(FILE_LOGGER_FLUSH_SIZE);
+      logger->writer = g_thread_create(FileLoggerWriterThread, logger, TRUE,
+                                       NULL);
+      if (logger->writer == NULL) {
+         /* Stay synchronous. */
+         g_cond_free(logger->wakeup);
+         g_cond_free(logger->flushed);
+         g_string_free(logger->pending, TRUE);
+         logger->wakeup = NULL;
+         logger->flushed = NULL;
+         logger->pending = NULL;
+         logger->async = FALSE;
+      }
+   }
+
+   return logger->writer != NULL;
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerFlushLocked --                                               */ /**
+ *
+ * Waits until the writer has written all messages queued so far.
+ *
+ * @note Make sure this function is called with the logger lock held.
+ *
+ * @param[in] logger    File logger.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerFlushLocked(FileLogger *logger)
+{
+   GMutex *mutex = g_static_mutex_get_mutex(&logger->lock);
+
+   if (logger->writer == NULL || g_thread_self() == logger->writer) {
+      return;
+   }
+
+   while (logger->pending->len > 0 ||
+          logger->dropped > 0 ||
+          logger->writing) {
+      logger->flushNow = TRUE;
+      g_cond_signal(logger->wakeup);
+      g_cond_wait(logger->flushed, mutex);
+   }
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerFlush --                                                     */ /**
+ *
+ * Writes out any buffered messages before returning. Used to make sure no
+ * file I/O happens while log I/O is suspended (e.g., during quiescing).
+ *
+ * @param[in] data      File logger.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerFlush(gpointer data)
+{
+   FileLogger *logger = data;
+
+   g_static_mutex_lock(&logger->lock);
+   FileLoggerFlushLocked(logger);
+   g_static_mutex_unlock(&logger->lock);
+}
+
+
+/*
+ *******************************************************************************
+ * FileLoggerLog --                                                       */ /**
+ *
+ * Logs a message to the configured destination file. Also opens the file for
+ * writing if it hasn't been done yet.
+ *
+ * In asynchronous mode the message is only queued for the writer thread,
+ * except for fatal messages which are written out before returning.
+ *
+ * @param[in] domain    Log domain.
+ * @param[in] level     Log level.
+ * @param[in] message   Message to log.
+ * @param[in] data      File logger.
+ *
+ *******************************************************************************
+ */
+
+static void
+FileLoggerLog(const gchar *domain,
+              GLogLevelFlags level,
+              const gchar *message,
+              gpointer data)
+{
+   FileLogger *logger = data;
+
+   g_static_mutex_lock(&logger->lock);
+
+   if (logger->async && FileLoggerStartWriter(logger)) {
+      gsize len = strlen(message);
+
+      if ((level & G_LOG_FLAG_FATAL) &&
+          logger->pending->len + len > FILE_LOGGER_MAX_PENDING) {
+         /* Never drop fatal messages. */
+         FileLoggerFlushLocked(logger);
+      }
+
+      if (logger->pending->len + len > FILE_LOGGER_MAX_PENDING) {
+         logger->dropped++;
+      } else {
+         g_string_append_len(logger->pending, message, len);
+      }
+
+      if (level & G_LOG_FLAG_FATAL) {
+         FileLoggerFlushLocked(logger);
+      } else if (logger->pending->len >= FILE_LOGGER_FLUSH_SIZE) {
+         g_cond_signal(logger->wakeup);
+      }
+   } else {
+      FileLoggerWrite(logger, message, -1);
+   }
 
-exit:
    g_static_mutex_unlock(&logger->lock);
 }
 
@@ -385,6 +630,19 @@ static void
 FileLoggerDestroy(gpointer data)
 {
    FileLogger *logger = data;
+
+   if (logger->writer != NULL) {
+      g_static_mutex_lock(&logger->lock);
+      logger->stop = TRUE;
+      g_cond_signal(logger->wakeup);
+      g_static_mutex_unlock(&logger->lock);
+
+      g_thread_join(logger->writer);
+      g_cond_free(logger->wakeup);
+      g_cond_free(logger->flushed);
+      g_string_free(logger->pending, TRUE);
+   }
+
    if (logger->file != NULL) {
       g_io_channel_unref(logger->file);
    }
@@ -404,6 +662,7 @@ FileLoggerDestroy(gpointer data)
  * @param[in] append    Whether to append to existing log file.
  * @param[in] maxSize   Maximum log file size (in MB, 0 = no limit).
  * @param[in] maxFiles  Maximum number of old files to be kept.
+ * @param[in] async     Whether to write from a background thread.
  *
  * @return A new logger, or NULL on error.
  *
@@ -414,7 +673,8 @@ GlibLogger *
 GlibUtils_CreateFileLogger(const char *path,
                            gboolean append,
                            guint maxSize,
-                           guint maxFiles)
+                           guint maxFiles,
+                           gboolean async)
 {
    FileLogger *data = NULL;
 
@@ -425,6 +685,7 @@ GlibUtils_CreateFileLogger(const char *path,
    data->handler.shared = FALSE;
    data->handler.logfn = FileLoggerLog;
    data->handler.dtor = FileLoggerDestroy;
+   data->handler.flush = FileLoggerFlush;
 
    data->path = g_filename_from_utf8(path, -1, NULL, NULL, NULL);
    if (data->path == NULL) {
@@ -435,6 +696,7 @@ GlibUtils_CreateFileLogger(const char *path,
    data->append = append;
    data->maxSize = maxSize * 1024 * 1024;
    data->maxFiles = maxFiles + 1; /* To account for the active log file. */
+   data->async = async;
    g_static_mutex_init(&data->lock);
 
    return &data->handler;
@@ -92,6 +92,7 @@ struct HashMap {
    uint8 *entries;
    uint32 numEntries;
    uint32 count;
+   uint32 numDeleted;  // DELETED entries; they lengthen probes like FILLED ones
    uint32 alpha;
 
    size_t keySize;
@@ -143,6 +144,7 @@ static Bool LookupKey(struct HashMap* map, const void *key, HashMapEntryHeader *
 static Bool CompareKeys(struct HashMap *map, const void *key, const void *compare);
 static Bool NeedsResize(struct HashMap *map);
 static void Resize(struct HashMap *map);
+static Bool Rebuild(struct HashMap *map, uint32 numEntries, Bool rehash);
 INLINE void EnsureSanity(HashMap *map);
 
 /*
@@ -165,7 +167,7 @@ static INLINE Bool
 CheckSanity(HashMap *map)
 {
 #ifdef VMX86_DEBUG
-   uint32 i, cnt = 0;
+   uint32 i, cnt = 0, deleted = 0;
 
    ASSERT(map);
    for (i = 0; i < map->numEntries; i++) {
@@ -182,10 +184,12 @@ CheckSanity(HashMap *map)
          if (header->hash != ComputeHash(map, key)) {
             return FALSE;
          }
+      } else if (header->state == HashMapState_DELETED) {
+         deleted++;
       }
    }
 
-   if (cnt != map->count) {
+   if (cnt != map->count || deleted != map->numDeleted) {
       return FALSE;
    }
 
@@ -394,6 +398,10 @@ HashMap_Put(struct HashMap *map,    // IN
       GetEntry(map, freeIndex, &header, &tableKey, &tableData);
       ASSERT(header);
 
+      if (header->state == HashMapState_DELETED) {
+         ASSERT(map->numDeleted > 0);
+         map->numDeleted--;
+      }
       header->state = HashMapState_FILLED;
       header->hash = hash;
       memcpy(tableKey, key, map->keySize);
@@ -470,6 +478,7 @@ HashMap_Clear(struct HashMap *map) // IN
       header->state = HashMapState_EMPTY;
    }
    map->count = 0;
+   map->numDeleted = 0;
    EnsureSanity(map);
 }
 
@@ -503,12 +512,31 @@ HashMap_Remove(struct HashMap *map,   // IN
       return FALSE;
    }
 
-   /*
-    * XXX: This could be made slightly smarter.  We could check the next entry
-    * to see if it's EMPTY and then mark this one as empty as well.
-    */
    map->count--;
    header->state = HashMapState_DELETED;
+   map->numDeleted++;
+
+   /*
+    * If the next entry is EMPTY, no probe sequence continues past this one,
+    * so it (and any DELETED entries right before it) can be made EMPTY too.
+    */
+   {
+      uint32 index = ((uint8 *) header - map->entries) / map->entrySize;
+      HashMapEntryHeader *next;
+      void *key;
+
+      GetEntry(map, (index + 1) % map->numEntries, &next, &key, &tableData);
+
+      while (next->state == HashMapState_EMPTY &&
+             header->state == HashMapState_DELETED) {
+         header->state = HashMapState_EMPTY;
+         map->numDeleted--;
+
+         next = header;
+         index = (index + map->numEntries - 1) % map->numEntries;
+         GetEntry(map, index, &header, &key, &tableData);
+      }
+   }
 
    EnsureSanity(map);
 
@@ -692,6 +720,17 @@ HashMap_Retrieve(void      *h,         // IN
    }
 
    *retNumBytes = numBytes + (map->numEntries * map->entrySize);
+
+   /*
+    * The stored hashes (and entry positions) may come from an older hash
+    * function; rebuild the table with the current one.
+    */
+   if (!Rebuild(map, map->numEntries, TRUE)) {
+      free(map->entries);
+      free(map);
+      return NULL;
+   }
+
    if (!CheckSanity(map)) {
       free(map->entries);
       free(map);
@@ -935,21 +974,28 @@ ComputeHash(struct HashMap *map,  // IN
             const void *key)      // IN
 {
    /*
-    * djb2, with n == 33. See http://www.cse.yorku.ca/~oz/hash.html.
+    * FNV-1a, followed by the murmur3 finalizer so that small integer keys
+    * (the common case) still spread over the whole table.
     *
-    * This hash function is largely borrowed from the emmet library in bora/lib
     * This hash table implementation does a hash compare before comparing the
     * keys so it's inappropriate for the hash function to take the modulo before
     * returning.
     */
-   uint32 h = 5381;
+   uint32 h = 2166136261U;
    const uint8 *keyByte;
    size_t i = 0;
 
    for (keyByte = key, i = 0; i < map->keySize; keyByte++, i++) {
-      h *= 33;
-      h += *keyByte;
+      h ^= *keyByte;
+      h *= 16777619U;
    }
+
+   h ^= h >> 16;
+   h *= 0x85ebca6b;
+   h ^= h >> 13;
+   h *= 0xc2b2ae35;
+   h ^= h >> 16;
+
    return h;
 }
 
@@ -987,7 +1033,8 @@ CompareKeys(struct HashMap *map,    // IN
  *
  *    Determine if adding another element to the map will require that the map
  *    be resized.  This takes into account the maximum load factor that is
- *    allowed for this map.
+ *    allowed for this map.  DELETED entries count towards the load since
+ *    probes have to step over them.
  *
  * Results:
  *    Returns TRUE if the map should be resized.
@@ -1003,7 +1050,7 @@ NeedsResize(struct HashMap *map)
 {
    uint32 required;
 
-   Clamped_UMul32(&required, map->count, map->alpha);
+   Clamped_UMul32(&required, map->count + map->numDeleted, map->alpha);
 
    return required >= map->numEntries;
 }
@@ -1031,8 +1078,8 @@ NeedsResize(struct HashMap *map)
 void
 Resize(struct HashMap *map)   // IN
 {
-   struct HashMap oldHashMap = *map;
-   int i;
+   uint32 numEntries = map->numEntries;
+   uint32 required;
 
    if (map->numEntries == MAX_UINT32) {
       if (map->count < MAX_UINT32) {
@@ -1051,25 +1098,70 @@ Resize(struct HashMap *map)   // IN
    }
 
    /*
+    * If most of the load is DELETED entries, dropping them is enough; the
+    * table is rebuilt at its current size.  Otherwise it grows
+    * geometrically until the maximum load factor is no longer exceeded.
+    *
     * We might, at some point, want to look at making this grow geometrically
     * until we hit some threshold and then grow arithmetically after that.  To
     * keep it simple for now, however, we'll just grow geometrically all the
     * time.
     */
-   map->entries = calloc(oldHashMap.numEntries * 2, oldHashMap.entrySize);
+   Clamped_UMul32(&required, map->count + 1, map->alpha);
+   if (required > map->numEntries / 2) {
+      do {
+         if (!Clamped_UMul32(&numEntries, numEntries, 2)) {
+            /* Prevent overflow and */
+            break;
+         }
+      } while (required >= numEntries);
+   }
+
+   Rebuild(map, numEntries, FALSE);
+}
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Rebuild --
+ *
+ *    Reinsert all the FILLED entries of the map into a new entries array of
+ *    the given size, dropping all DELETED entries.  Keys are known to be
+ *    unique, so each entry simply goes into the first non-FILLED slot of its
+ *    probe sequence; the stored hash is reused unless rehash is TRUE.
+ *
+ * Results:
+ *    TRUE on success, FALSE if the memory allocation failed (the map is
+ *    unchanged).
+ *
+ * Side Effects:
+ *    Callers should not assume that the locations that were valid before this
+ *    was called are still valid as all entries may appear at different
+ *    locations after this function completes.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+static Bool
+Rebuild(struct HashMap *map,   // IN
+        uint32 numEntries,     // IN
+        Bool rehash)           // IN
+{
+   struct HashMap oldHashMap = *map;
+   uint32 i;
+
+   ASSERT(numEntries >= map->count);
+
+   map->entries = calloc(numEntries, oldHashMap.entrySize);
    if (!map->entries) {
       map->entries = oldHashMap.entries;
-      return;
+      return FALSE;
    }
 
-   do {
-      if (!Clamped_UMul32(&map->numEntries, map->numEntries, 2)) {
-         /* Prevent overflow and */
-         break;
-      }
-   } while (NeedsResize(map));
-
+   map->numEntries = numEntries;
    map->count = 0;
+   map->numDeleted = 0;
 
    for (i = 0; i < oldHashMap.numEntries; i++) {
       HashMapEntryHeader *oldHeader;
@@ -1078,37 +1170,38 @@ Resize(struct HashMap *map)   // IN
       void *oldData;
       void *newKey;
       void *newData;
-      uint32 freeIndex;
+      uint32 hash;
+      uint32 index;
 
       GetEntry(&oldHashMap, i, &oldHeader, &oldKey, &oldData);
-      switch (oldHeader->state) {
-      case HashMapState_EMPTY:
-      case HashMapState_DELETED:
+      if (oldHeader->state != HashMapState_FILLED) {
          continue;
-      case HashMapState_FILLED:
-         if (!LookupKey(map, oldKey, &newHeader, &newData, &freeIndex)) {
-            GetEntry(map, freeIndex, &newHeader, &newKey, &newData);
+      }
 
-            newHeader->hash = oldHeader->hash;
-            newHeader->state = HashMapState_FILLED;
-            memcpy(newKey, oldKey, map->keySize);
-            memcpy(newData, oldData, map->dataSize);
+      hash = rehash ? ComputeHash(map, oldKey) : oldHeader->hash;
+      index = hash % map->numEntries;
 
-            map->count++;
-         } else {
-            /*
-             * There is only one way that this could happen; the key is in the
-             * old map twice.  That's clearly an error.
-             */
-            ASSERT(FALSE);
-            continue;
+      for (;;) {
+         GetEntry(map, index, &newHeader, &newKey, &newData);
+         if (newHeader->state != HashMapState_FILLED) {
+            break;
          }
+         index = (index + 1) % map->numEntries;
       }
+
+      newHeader->hash = hash;
+      newHeader->state = HashMapState_FILLED;
+      memcpy(newKey, oldKey, map->keySize);
+      memcpy(newData, oldData, map->dataSize);
+
+      map->count++;
    }
 
    ASSERT(oldHashMap.count == map->count);
    free(oldHashMap.entries);
    EnsureSanity(map);
+
+   return TRUE;
 }
 
 
@@ -1157,6 +1250,10 @@ HashMap_Iterate(HashMap *map,             // IN
       }
    }
 
+   if (clear) {
+      map->numDeleted = 0;
+   }
+
    ASSERT(map->count == 0 || !clear);
 }
 
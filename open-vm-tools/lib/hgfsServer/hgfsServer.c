@@ -571,6 +571,1081 @@ HgfsServerGetNextHandleCounter(void)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSlabInit --
+ *
+ *    Initialize an empty slab of objSize byte objects. No chunk is allocated
+ *    until the first object is requested.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsSlabInit(HgfsSlab *slab,       // OUT: slab
+             size_t objSize,       // IN: object size
+             size_t linksOffset,   // IN: offset of the free list links
+             size_t indexOffset)   // IN: offset of the slab index
+{
+   slab->objSize = objSize;
+   slab->linksOffset = linksOffset;
+   slab->indexOffset = indexOffset;
+   slab->chunks = NULL;
+   slab->chunkInUse = NULL;
+   slab->numChunks = 0;
+   slab->numAllocated = 0;
+   slab->numFree = 0;
+   DblLnkLst_Init(&slab->freeList);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSlabDestroy --
+ *
+ *    Release all chunks of a slab. The objects must have been cleaned up by
+ *    the caller.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsSlabDestroy(HgfsSlab *slab)  // IN/OUT: slab
+{
+   uint32 i;
+
+   for (i = 0; i < slab->numChunks; i++) {
+      free(slab->chunks[i]);
+   }
+   free(slab->chunks);
+   free(slab->chunkInUse);
+   HgfsSlabInit(slab, slab->objSize, slab->linksOffset, slab->indexOffset);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSlabCapacity --
+ *
+ *    Upper bound (exclusive) of the object indices of a slab.
+ *
+ * Results:
+ *    The number of object slots covered by the chunk table.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE uint32
+HgfsSlabCapacity(HgfsSlab const *slab)  // IN: slab
+{
+   return slab->numChunks << HGFS_SLAB_CHUNK_SHIFT;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSlabGet --
+ *
+ *    Retrieve the object at a given slab index.
+ *
+ * Results:
+ *    The object, or NULL if its chunk is not allocated.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE void *
+HgfsSlabGet(HgfsSlab const *slab,  // IN: slab
+            uint32 index)          // IN: object index
+{
+   char *chunk;
+
+   ASSERT(index < HgfsSlabCapacity(slab));
+
+   chunk = slab->chunks[index >> HGFS_SLAB_CHUNK_SHIFT];
+   if (chunk == NULL) {
+      return NULL;
+   }
+
+   return chunk + (index & (HGFS_SLAB_CHUNK_SIZE - 1)) * slab->objSize;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSlabLinks --
+ * HgfsSlabIndex --
+ *
+ *    Access the free list links and the slab index embedded in an object.
+ *
+ * Results:
+ *    Pointer to the field.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE DblLnkLst_Links *
+HgfsSlabLinks(HgfsSlab const *slab,  // IN: slab
+              void *obj)             // IN: object
+{
+   return (DblLnkLst_Links *)((char *)obj + slab->linksOffset);
+}
+
+static INLINE uint32 *
+HgfsSlabIndex(HgfsSlab const *slab,  // IN: slab
+              void *obj)             // IN: object
+{
+   return (uint32 *)((char *)obj + slab->indexOffset);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSlabAddChunk --
+ *
+ *    Allocate a zeroed chunk in the first free slot of the chunk table,
+ *    growing the table if needed, and put its objects on the free list.
+ *
+ * Results:
+ *    TRUE on success, FALSE on memory allocation failure.
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsSlabAddChunk(HgfsSlab *slab)  // IN/OUT: slab
+{
+   uint32 chunkNum;
+   char *chunk;
+   uint32 i;
+
+   for (chunkNum = 0; chunkNum < slab->numChunks; chunkNum++) {
+      if (slab->chunks[chunkNum] == NULL) {
+         break;
+      }
+   }
+
+   if (chunkNum == slab->numChunks) {
+      uint32 newNumChunks = slab->numChunks == 0 ? 1 : 2 * slab->numChunks;
+      char **newChunks;
+      uint32 *newChunkInUse;
+
+      newChunks = realloc(slab->chunks, newNumChunks * sizeof *newChunks);
+      if (newChunks == NULL) {
+         return FALSE;
+      }
+      slab->chunks = newChunks;
+
+      newChunkInUse = realloc(slab->chunkInUse,
+                              newNumChunks * sizeof *newChunkInUse);
+      if (newChunkInUse == NULL) {
+         return FALSE;
+      }
+      slab->chunkInUse = newChunkInUse;
+
+      for (i = slab->numChunks; i < newNumChunks; i++) {
+         slab->chunks[i] = NULL;
+         slab->chunkInUse[i] = 0;
+      }
+      slab->numChunks = newNumChunks;
+   }
+
+   chunk = calloc(HGFS_SLAB_CHUNK_SIZE, slab->objSize);
+   if (chunk == NULL) {
+      return FALSE;
+   }
+
+   LOG(4, ("%s: adding chunk %u\n", __FUNCTION__, chunkNum));
+
+   slab->chunks[chunkNum] = chunk;
+   slab->chunkInUse[chunkNum] = 0;
+   for (i = 0; i < HGFS_SLAB_CHUNK_SIZE; i++) {
+      void *obj = chunk + i * slab->objSize;
+
+      *HgfsSlabIndex(slab, obj) = (chunkNum << HGFS_SLAB_CHUNK_SHIFT) | i;
+      DblLnkLst_Init(HgfsSlabLinks(slab, obj));
+      /* Append at the end of the list. */
+      DblLnkLst_LinkLast(&slab->freeList, HgfsSlabLinks(slab, obj));
+   }
+   slab->numAllocated += HGFS_SLAB_CHUNK_SIZE;
+   slab->numFree += HGFS_SLAB_CHUNK_SIZE;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSlabAlloc --
+ *
+ *    Remove an object from the free list and return it, adding a chunk if
+ *    the free list is empty. Objects from a new chunk are zeroed; recycled
+ *    objects keep whatever the caller left in them when freeing.
+ *
+ * Results:
+ *    An object on success, NULL on failure.
+ *
+ * Side effects:
+ *    Memory allocation (potentially).
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void *
+HgfsSlabAlloc(HgfsSlab *slab)  // IN/OUT: slab
+{
+   DblLnkLst_Links *links;
+   void *obj;
+
+   if (!DblLnkLst_IsLinked(&slab->freeList) && !HgfsSlabAddChunk(slab)) {
+      LOG(4, ("%s: can't allocate a new chunk\n", __FUNCTION__));
+
+      return NULL;
+   }
+
+   /* Remove the first item from the list */
+   links = slab->freeList.next;
+   DblLnkLst_Unlink1(links);
+   obj = (char *)links - slab->linksOffset;
+
+   slab->chunkInUse[*HgfsSlabIndex(slab, obj) >> HGFS_SLAB_CHUNK_SHIFT]++;
+   slab->numFree--;
+
+   return obj;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsSlabFree --
+ *
+ *    Return an object to the free list. If this leaves its chunk idle and
+ *    at least half a chunk of free objects remains elsewhere, the chunk is
+ *    given back to the system; the slack avoids allocating and releasing a
+ *    chunk repeatedly when the number of objects hovers around a chunk
+ *    boundary.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The memory of obj may be released.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsSlabFree(HgfsSlab *slab,  // IN/OUT: slab
+             void *obj)       // IN: object
+{
+   uint32 chunkNum = *HgfsSlabIndex(slab, obj) >> HGFS_SLAB_CHUNK_SHIFT;
+   char *chunk;
+   uint32 i;
+
+   ASSERT(chunkNum < slab->numChunks);
+   ASSERT(slab->chunkInUse[chunkNum] > 0);
+
+   /* Prepend at the beginning of the list */
+   DblLnkLst_LinkFirst(&slab->freeList, HgfsSlabLinks(slab, obj));
+   slab->chunkInUse[chunkNum]--;
+   slab->numFree++;
+
+   if (slab->chunkInUse[chunkNum] != 0 ||
+       slab->numFree < HGFS_SLAB_CHUNK_SIZE + HGFS_SLAB_CHUNK_SIZE / 2) {
+      return;
+   }
+
+   LOG(4, ("%s: releasing chunk %u\n", __FUNCTION__, chunkNum));
+
+   chunk = slab->chunks[chunkNum];
+   for (i = 0; i < HGFS_SLAB_CHUNK_SIZE; i++) {
+      DblLnkLst_Unlink1(HgfsSlabLinks(slab, chunk + i * slab->objSize));
+   }
+   free(chunk);
+   slab->chunks[chunkNum] = NULL;
+   slab->numAllocated -= HGFS_SLAB_CHUNK_SIZE;
+   slab->numFree -= HGFS_SLAB_CHUNK_SIZE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeIndexHash --
+ *
+ *    Compute the home slot of a key in a node index. Multiplicative hashing
+ *    spreads the sequentially allocated handles and small file descriptors
+ *    evenly over the table.
+ *
+ * Results:
+ *    Slot number in the range [0, capacity).
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE uint32
+HgfsNodeIndexHash(uint64 key,       // IN: handle or file descriptor
+                  uint32 capacity)  // IN: index capacity (power of 2)
+{
+   return (uint32)((key * CONST64U(0x9E3779B97F4A7C15)) >> 32) & (capacity - 1);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeIndexCapacity --
+ *
+ *    Compute the index capacity needed to hold numNodes entries at a load
+ *    factor of at most one half.
+ *
+ * Results:
+ *    The capacity, a power of 2.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+HgfsNodeIndexCapacity(uint32 numNodes)  // IN: number of nodes to index
+{
+   uint32 capacity = 16;
+
+   while (capacity < 2 * numNodes) {
+      capacity *= 2;
+   }
+
+   return capacity;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeIndexInit --
+ *
+ *    Initialize an empty node index large enough for numNodes nodes.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNodeIndexInit(HgfsNodeIndex *index,  // OUT: node index
+                  uint32 numNodes)       // IN: number of nodes to index
+{
+   index->capacity = HgfsNodeIndexCapacity(numNodes);
+   index->entries = Util_SafeCalloc(index->capacity, sizeof *index->entries);
+   index->count = 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeIndexDestroy --
+ *
+ *    Free the memory held by a node index.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNodeIndexDestroy(HgfsNodeIndex *index)  // IN/OUT: node index
+{
+   free(index->entries);
+   index->entries = NULL;
+   index->capacity = 0;
+   index->count = 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeIndexInsert --
+ *
+ *    Map key to node, replacing any previous mapping of key. The index must
+ *    have been sized for the node slab, so there is always a free slot.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNodeIndexInsert(HgfsNodeIndex *index,  // IN/OUT: node index
+                    uint64 key,            // IN: handle or file descriptor
+                    HgfsFileNode *node)    // IN: file node
+{
+   uint32 i = HgfsNodeIndexHash(key, index->capacity);
+
+   ASSERT(node);
+   ASSERT(index->count < index->capacity);
+
+   while (index->entries[i].node != NULL) {
+      if (index->entries[i].key == key) {
+         index->entries[i].node = node;
+         return;
+      }
+      i = (i + 1) & (index->capacity - 1);
+   }
+
+   index->entries[i].key = key;
+   index->entries[i].node = node;
+   index->count++;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeIndexFindSlot --
+ *
+ *    Find the slot holding key.
+ *
+ * Results:
+ *    TRUE and the slot if key is in the index, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNodeIndexFindSlot(HgfsNodeIndex const *index,  // IN: node index
+                      uint64 key,                  // IN: handle or file descriptor
+                      uint32 *slot)                // OUT: slot holding key
+{
+   uint32 i = HgfsNodeIndexHash(key, index->capacity);
+
+   while (index->entries[i].node != NULL) {
+      if (index->entries[i].key == key) {
+         *slot = i;
+         return TRUE;
+      }
+      i = (i + 1) & (index->capacity - 1);
+   }
+
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeIndexLookup --
+ *
+ *    Look up the node mapped to key.
+ *
+ * Results:
+ *    The node if key is in the index, NULL otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsFileNode *
+HgfsNodeIndexLookup(HgfsNodeIndex const *index,  // IN: node index
+                    uint64 key)                  // IN: handle or file descriptor
+{
+   uint32 slot;
+
+   if (!HgfsNodeIndexFindSlot(index, key, &slot)) {
+      return NULL;
+   }
+
+   return index->entries[slot].node;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeIndexRemove --
+ *
+ *    Remove the mapping of key if it refers to node. Later
+ *    entries of the probe sequence are shifted back so lookups never need
+ *    tombstones.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsNodeIndexRemove(HgfsNodeIndex *index,  // IN/OUT: node index
+                    uint64 key,            // IN: handle or file descriptor
+                    HgfsFileNode *node)    // IN: file node
+{
+   uint32 mask = index->capacity - 1;
+   uint32 hole;
+   uint32 i;
+
+   if (!HgfsNodeIndexFindSlot(index, key, &hole) ||
+       index->entries[hole].node != node) {
+      return;
+   }
+
+   for (i = (hole + 1) & mask;
+        index->entries[i].node != NULL;
+        i = (i + 1) & mask) {
+      uint32 home = HgfsNodeIndexHash(index->entries[i].key, index->capacity);
+
+      /* Move the entry into the hole unless its home lies in (hole, i]. */
+      if (((i - home) & mask) >= ((i - hole) & mask)) {
+         index->entries[hole] = index->entries[i];
+         hole = i;
+      }
+   }
+
+   index->entries[hole].node = NULL;
+   index->count--;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsNodeIndexResize --
+ *
+ *    Grow a node index so it can hold numNodes nodes, rehashing the existing
+ *    entries.
+ *
+ * Results:
+ *    TRUE on success, FALSE if memory could not be allocated (the index is
+ *    left unchanged).
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsNodeIndexResize(HgfsNodeIndex *index,  // IN/OUT: node index
+                    uint32 numNodes)       // IN: number of nodes to index
+{
+   HgfsNodeIndex newIndex;
+   uint32 i;
+
+   newIndex.capacity = HgfsNodeIndexCapacity(numNodes);
+   if (newIndex.capacity <= index->capacity) {
+      return TRUE;
+   }
+
+   newIndex.entries = calloc(newIndex.capacity, sizeof *newIndex.entries);
+   if (newIndex.entries == NULL) {
+      return FALSE;
+   }
+   newIndex.count = 0;
+
+   for (i = 0; i < index->capacity; i++) {
+      if (index->entries[i].node != NULL) {
+         HgfsNodeIndexInsert(&newIndex, index->entries[i].key,
+                             index->entries[i].node);
+      }
+   }
+   ASSERT(newIndex.count == index->count);
+
+   free(index->entries);
+   *index = newIndex;
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsFileDesc2Key --
+ *
+ *    Convert a file descriptor (a HANDLE on Windows) to a node index key.
+ *
+ * Results:
+ *    The key.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE uint64
+HgfsFileDesc2Key(fileDesc fd)  // IN: OS handle (file descriptor)
+{
+   return (uint64)(uintptr_t)fd;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPathIndexKey --
+ *
+ *    Make the path index key for a path: a copy of the path without trailing
+ *    separators, so "dir" and "dir/" share an entry.
+ *
+ * Results:
+ *    The key, to be freed by the caller.
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+HgfsPathIndexKey(const char *path)  // IN: path
+{
+   char *key = Util_SafeStrdup(path);
+   size_t len = strlen(key);
+
+   while (len > 1 && key[len - 1] == DIRSEPC) {
+      key[--len] = '\0';
+   }
+
+   return key;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPathEntryMatches --
+ *
+ *    Compare the path of an entry with a path, ignoring trailing separators
+ *    of the latter.
+ *
+ * Results:
+ *    TRUE if they name the same path, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsPathEntryMatches(HgfsPathEntry const *entry,  // IN: entry
+                     const char *path)            // IN: path
+{
+   size_t len = strlen(path);
+
+   while (len > 1 && path[len - 1] == DIRSEPC) {
+      len--;
+   }
+
+   return len == entry->pathLen && memcmp(entry->path, path, len) == 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPathIndexInit --
+ * HgfsPathIndexDestroy --
+ *
+ *    Set up and tear down an empty path index.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsPathIndexInit(HgfsPathIndex *index)  // OUT: path index
+{
+   index->entries = HashTable_Alloc(1024, HASH_STRING_KEY, NULL);
+   DblLnkLst_Init(&index->shareRoots);
+}
+
+static void
+HgfsPathIndexDestroy(HgfsPathIndex *index)  // IN/OUT: path index
+{
+   ASSERT(HashTable_GetNumElements(index->entries) == 0);
+   ASSERT(!DblLnkLst_IsLinked(&index->shareRoots));
+
+   HashTable_Free(index->entries);
+   index->entries = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPathIndexGetEntry --
+ *
+ *    Find the entry for key, creating it and any missing entries of its
+ *    parent directories.
+ *
+ * Results:
+ *    The entry.
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsPathEntry *
+HgfsPathIndexGetEntry(HgfsPathIndex *index,  // IN/OUT: path index
+                      const char *key)       // IN: path index key
+{
+   HgfsPathEntry *entry;
+   const char *sep;
+
+   if (HashTable_Lookup(index->entries, key, (void **)&entry)) {
+      return entry;
+   }
+
+   entry = Util_SafeCalloc(1, sizeof *entry);
+   entry->path = Util_SafeStrdup(key);
+   entry->pathLen = strlen(key);
+   DblLnkLst_Init(&entry->siblingLinks);
+   DblLnkLst_Init(&entry->children);
+   DblLnkLst_Init(&entry->nodes);
+   DblLnkLst_Init(&entry->rootedNodes);
+   DblLnkLst_Init(&entry->shareRootLinks);
+
+   sep = strrchr(key, DIRSEPC);
+   if (sep != NULL && entry->pathLen > 1) {
+      /* The parent of a top level directory is the root directory itself. */
+      size_t parentLen = sep == key ? 1 : sep - key;
+      char *parentKey = Util_SafeMalloc(parentLen + 1);
+
+      memcpy(parentKey, key, parentLen);
+      parentKey[parentLen] = '\0';
+      entry->parent = HgfsPathIndexGetEntry(index, parentKey);
+      free(parentKey);
+
+      DblLnkLst_LinkLast(&entry->parent->children, &entry->siblingLinks);
+   }
+
+   HashTable_Insert(index->entries, entry->path, entry);
+
+   return entry;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPathEntryFreeIfUnused --
+ *
+ *    Free an entry that has no nodes, no share root nodes and no children.
+ *
+ * Results:
+ *    TRUE if the entry was freed, FALSE if it is still in use.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsPathEntryFreeIfUnused(HgfsPathIndex *index,  // IN/OUT: path index
+                          HgfsPathEntry *entry)  // IN: entry
+{
+   if (DblLnkLst_IsLinked(&entry->nodes) ||
+       DblLnkLst_IsLinked(&entry->rootedNodes) ||
+       DblLnkLst_IsLinked(&entry->children)) {
+      return FALSE;
+   }
+
+   DblLnkLst_Unlink1(&entry->siblingLinks);
+   HashTable_Delete(index->entries, entry->path);
+   free(entry->path);
+   free(entry);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPathIndexRelease --
+ *
+ *    Free an entry and then its ancestors for as long as they are unused.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsPathIndexRelease(HgfsPathIndex *index,  // IN/OUT: path index
+                     HgfsPathEntry *entry)  // IN: entry
+{
+   while (entry != NULL) {
+      HgfsPathEntry *parent = entry->parent;
+
+      if (!HgfsPathEntryFreeIfUnused(index, entry)) {
+         break;
+      }
+      entry = parent;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPathIndexLinkName --
+ *
+ *    Add a file node to the entry of its utf8Name.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsPathIndexLinkName(HgfsPathIndex *index,  // IN/OUT: path index
+                      HgfsFileNode *node)    // IN: file node
+{
+   char *key = HgfsPathIndexKey(node->utf8Name);
+
+   ASSERT(node->pathEntry == NULL);
+
+   node->pathEntry = HgfsPathIndexGetEntry(index, key);
+   DblLnkLst_Init(&node->pathLinks);
+   DblLnkLst_LinkLast(&node->pathEntry->nodes, &node->pathLinks);
+   free(key);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPathIndexAddNode --
+ *
+ *    Add a file node to the path index, under its name and under its share
+ *    root directory.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsPathIndexAddNode(HgfsPathIndex *index,  // IN/OUT: path index
+                     HgfsFileNode *node)    // IN: file node
+{
+   char *key;
+
+   ASSERT(node->rootEntry == NULL);
+
+   HgfsPathIndexLinkName(index, node);
+
+   key = HgfsPathIndexKey(node->shareInfo.rootDir);
+   node->rootEntry = HgfsPathIndexGetEntry(index, key);
+   free(key);
+
+   if (!DblLnkLst_IsLinked(&node->rootEntry->rootedNodes)) {
+      DblLnkLst_LinkLast(&index->shareRoots, &node->rootEntry->shareRootLinks);
+   }
+   DblLnkLst_Init(&node->rootLinks);
+   DblLnkLst_LinkLast(&node->rootEntry->rootedNodes, &node->rootLinks);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPathIndexRemoveNode --
+ *
+ *    Remove a file node from the path index, freeing the entries that are no
+ *    longer used. Nodes which were never added are ignored.
+ *
+ *    The session's nodeArrayLock should be acquired prior to calling this
+ *    function.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsPathIndexRemoveNode(HgfsPathIndex *index,  // IN/OUT: path index
+                        HgfsFileNode *node)    // IN: file node
+{
+   if (node->pathEntry != NULL) {
+      DblLnkLst_Unlink1(&node->pathLinks);
+      HgfsPathIndexRelease(index, node->pathEntry);
+      node->pathEntry = NULL;
+   }
+
+   if (node->rootEntry != NULL) {
+      DblLnkLst_Unlink1(&node->rootLinks);
+      if (!DblLnkLst_IsLinked(&node->rootEntry->rootedNodes)) {
+         DblLnkLst_Unlink1(&node->rootEntry->shareRootLinks);
+      }
+      HgfsPathIndexRelease(index, node->rootEntry);
+      node->rootEntry = NULL;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPathIndexDetachSubtree --
+ *
+ *    Move the nodes of an entry and of all entries below it to the detached
+ *    list, leaving their entries in place.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsPathIndexDetachSubtree(HgfsPathEntry *entry,       // IN: entry
+                           DblLnkLst_Links *detached)  // IN/OUT: node list
+{
+   DblLnkLst_Links *l;
+
+   while (DblLnkLst_IsLinked(&entry->nodes)) {
+      HgfsFileNode *node = DblLnkLst_Container(entry->nodes.next, HgfsFileNode,
+                                               pathLinks);
+
+      DblLnkLst_Unlink1(&node->pathLinks);
+      DblLnkLst_LinkLast(detached, &node->pathLinks);
+      node->pathEntry = NULL;
+   }
+
+   DblLnkLst_ForEach(l, &entry->children) {
+      HgfsPathIndexDetachSubtree(DblLnkLst_Container(l, HgfsPathEntry,
+                                                     siblingLinks),
+                                 detached);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPathIndexPruneSubtree --
+ *
+ *    Free the unused entries at and below an entry, children first.
+ *
+ * Results:
+ *    TRUE if entry itself was freed.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsPathIndexPruneSubtree(HgfsPathIndex *index,  // IN/OUT: path index
+                          HgfsPathEntry *entry)  // IN: entry
+{
+   DblLnkLst_Links *l;
+   DblLnkLst_Links *next;
+
+   DblLnkLst_ForEachSafe(l, next, &entry->children) {
+      HgfsPathIndexPruneSubtree(index, DblLnkLst_Container(l, HgfsPathEntry,
+                                                           siblingLinks));
+   }
+
+   return HgfsPathEntryFreeIfUnused(index, entry);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -596,20 +1671,14 @@ static HgfsFileNode *
 HgfsHandle2FileNode(HgfsHandle handle,        // IN: Hgfs file handle
                     HgfsSessionInfo *session) // IN: Session info
 {
-   unsigned int i;
-   HgfsFileNode *fileNode = NULL;
+   HgfsFileNode *fileNode;
 
    ASSERT(session);
-   ASSERT(session->nodeArray);
 
-   /* XXX: This O(n) lookup can and should be optimized. */
-   for (i = 0; i < session->numNodes; i++) {
-      if (session->nodeArray[i].state != FILENODE_STATE_UNUSED &&
-          session->nodeArray[i].handle == handle) {
-         fileNode = &session->nodeArray[i];
-         break;
-      }
-   }
+   fileNode = HgfsNodeIndexLookup(&session->nodeHandleIndex, handle);
+   ASSERT(fileNode == NULL ||
+          (fileNode->state != FILENODE_STATE_UNUSED &&
+           fileNode->handle == handle));
 
    return fileNode;
 }
@@ -648,7 +1717,7 @@ HgfsFileNode2Handle(HgfsFileNode const *fileNode) // IN
  *
  * HgfsDumpAllNodes --
  *
- *    Debugging routine; print all nodes in the nodeArray.
+ *    Debugging routine; print all nodes in the node slab.
  *
  *    The session's nodeArrayLock should be acquired prior to calling this
  *    function.
@@ -668,16 +1737,20 @@ HgfsDumpAllNodes(HgfsSessionInfo *session)  // IN: session info
    unsigned int i;
 
    ASSERT(session);
-   ASSERT(session->nodeArray);
 
    Log("Dumping all nodes\n");
-   for (i = 0; i < session->numNodes; i++) {
+   for (i = 0; i < HgfsSlabCapacity(&session->nodeSlab); i++) {
+      HgfsFileNode *node = HgfsSlabGet(&session->nodeSlab, i);
+
+      if (node == NULL) {
+         continue;
+      }
       Log("handle %u, name \"%s\", localdev %"FMT64"u, localInum %"FMT64"u %u\n",
-          session->nodeArray[i].handle,
-          session->nodeArray[i].utf8Name ? session->nodeArray[i].utf8Name : "NULL",
-          session->nodeArray[i].localId.volumeId,
-          session->nodeArray[i].localId.fileId,
-          session->nodeArray[i].fileDesc);
+          node->handle,
+          node->utf8Name ? node->utf8Name : "NULL",
+          node->localId.volumeId,
+          node->localId.fileId,
+          node->fileDesc);
    }
    Log("Done\n");
 }
@@ -839,23 +1912,21 @@ HgfsFileDesc2Handle(fileDesc fd,              // IN: OS handle (file descriptor)
                     HgfsSessionInfo *session, // IN: Session info
                     HgfsHandle *handle)       // OUT: Hgfs file handle
 {
-   unsigned int i;
    Bool found = FALSE;
    HgfsFileNode *existingFileNode = NULL;
 
    ASSERT(session);
-   ASSERT(session->nodeArray);
 
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
-   for (i = 0; i < session->numNodes; i++) {
-      existingFileNode = &session->nodeArray[i];
-      if ((existingFileNode->state == FILENODE_STATE_IN_USE_CACHED) &&
-          (existingFileNode->fileDesc == fd)) {
-         *handle = HgfsFileNode2Handle(existingFileNode);
-         found = TRUE;
-         break;
-      }
+   /* Only cached nodes hold an open fd, so only those are indexed by fd. */
+   existingFileNode = HgfsNodeIndexLookup(&session->nodeFdIndex,
+                                          HgfsFileDesc2Key(fd));
+   if (existingFileNode != NULL) {
+      ASSERT(existingFileNode->state == FILENODE_STATE_IN_USE_CACHED &&
+             existingFileNode->fileDesc == fd);
+      *handle = HgfsFileNode2Handle(existingFileNode);
+      found = TRUE;
    }
 
    MXUser_ReleaseExclLock(session->nodeArrayLock);
@@ -1246,6 +2317,11 @@ HgfsUpdateNodeFileDesc(HgfsHandle handle,        // IN: Hgfs file handle
       goto exit;
    }
 
+   if (node->state == FILENODE_STATE_IN_USE_CACHED) {
+      HgfsNodeIndexRemove(&session->nodeFdIndex,
+                          HgfsFileDesc2Key(node->fileDesc), node);
+      HgfsNodeIndexInsert(&session->nodeFdIndex, HgfsFileDesc2Key(fd), node);
+   }
    node->fileDesc = fd;
    node->fileCtx = fileCtx;
    updated = TRUE;
@@ -1280,24 +2356,22 @@ HgfsUpdateNodeServerLock(fileDesc fd,                // IN: OS handle
                          HgfsSessionInfo *session,   // IN: Session info
                          HgfsLockType serverLock)    // IN: new oplock
 {
-   unsigned int i;
-   HgfsFileNode *existingFileNode = NULL;
+   HgfsFileNode *existingFileNode;
    Bool updated = FALSE;
 
    ASSERT(session);
-   ASSERT(session->nodeArray);
 
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
-   for (i = 0; i < session->numNodes; i++) {
-      existingFileNode = &session->nodeArray[i];
-      if (existingFileNode->state != FILENODE_STATE_UNUSED) {
-         if (existingFileNode->fileDesc == fd) {
-            existingFileNode->serverLock = serverLock;
-            updated = TRUE;
-            break;
-         }
-      }
+   /*
+    * Nodes holding a server lock are always cached, and only cached nodes
+    * have an open fd, so the fd index finds the right node.
+    */
+   existingFileNode = HgfsNodeIndexLookup(&session->nodeFdIndex,
+                                          HgfsFileDesc2Key(fd));
+   if (existingFileNode != NULL) {
+      existingFileNode->serverLock = serverLock;
+      updated = TRUE;
    }
 
    MXUser_ReleaseExclLock(session->nodeArrayLock);
@@ -1428,7 +2502,7 @@ exit:
  *
  * HgfsDumpAllSearches --
  *
- *    Debugging routine; print all searches in the searchArray.
+ *    Debugging routine; print all searches in the search slab.
  *
  *    Caller should hold the session's searchArrayLock.
  *
@@ -1447,14 +2521,17 @@ HgfsDumpAllSearches(HgfsSessionInfo *session)   // IN: session info
    unsigned int i;
 
    ASSERT(session);
-   ASSERT(session->searchArray);
 
    Log("Dumping all searches\n");
-   for (i = 0; i < session->numSearches; i++) {
+   for (i = 0; i < HgfsSlabCapacity(&session->searchSlab); i++) {
+      HgfsSearch *search = HgfsSlabGet(&session->searchSlab, i);
+
+      if (search == NULL) {
+         continue;
+      }
       Log("handle %u, baseDir \"%s\"\n",
-          session->searchArray[i].handle,
-          session->searchArray[i].utf8Dir ?
-          session->searchArray[i].utf8Dir : "(NULL)");
+          search->handle,
+          search->utf8Dir ? search->utf8Dir : "(NULL)");
    }
    Log("Done\n");
 }
@@ -1465,12 +2542,11 @@ HgfsDumpAllSearches(HgfsSessionInfo *session)   // IN: session info
  *
  * HgfsGetNewNode --
  *
- *    Remove a node from the free list and return it. Nodes on
- *    the free list should already be initialized.
+ *    Remove a node from the free list of the node slab and return it.
+ *    Nodes on the free list should already be initialized.
  *
- *    If the free list is empty, reallocates more memory,
- *    initializes it appropriately, adds the new entries to the
- *    free list, and then returns one off the free list.
+ *    If the free list is empty, the slab adds a chunk of zeroed nodes;
+ *    existing nodes never move.
  *
  *    The session's nodeArrayLock should be acquired prior to calling this
  *    function.
@@ -1488,105 +2564,38 @@ HgfsDumpAllSearches(HgfsSessionInfo *session)   // IN: session info
 static HgfsFileNode *
 HgfsGetNewNode(HgfsSessionInfo *session)  // IN: session info
 {
+   HgfsSlab *slab;
    HgfsFileNode *node;
-   HgfsFileNode *newMem;
-   unsigned int newNumNodes;
-   unsigned int i;
 
    ASSERT(session);
-   ASSERT(session->nodeArray);
 
    LOG(4, ("%s: entered\n", __FUNCTION__));
 
-   if (!DblLnkLst_IsLinked(&session->nodeFreeList)) {
-      /*
-       * This has to be unsigned and with maximum bit length. This is
-       * required to take care of "negative" differences as well.
-       */
-      uintptr_t ptrDiff;
+   slab = &session->nodeSlab;
+   if (slab->numFree == 0) {
+      uint32 numNodes = slab->numAllocated + HGFS_SLAB_CHUNK_SIZE;
 
       if (DOLOG(4)) {
-         Log("Dumping nodes before realloc\n");
+         Log("Dumping nodes before adding a chunk\n");
          HgfsDumpAllNodes(session);
       }
 
-      /* Try to get twice as much memory as we had */
-      newNumNodes = 2 * session->numNodes;
-      newMem = (HgfsFileNode *)realloc(session->nodeArray,
-                                       newNumNodes * sizeof *(session->nodeArray));
-      if (!newMem) {
-         LOG(4, ("%s: can't realloc more nodes\n", __FUNCTION__));
+      /* Make room in the indices for the nodes of the new chunk. */
+      if (!HgfsNodeIndexResize(&session->nodeHandleIndex, numNodes) ||
+          !HgfsNodeIndexResize(&session->nodeFdIndex, numNodes)) {
+         LOG(4, ("%s: can't grow node indices\n", __FUNCTION__));
 
          return NULL;
       }
-
-      ptrDiff = (char *)newMem - (char *)session->nodeArray;
-      if (ptrDiff) {
-         size_t const oldSize = session->numNodes * sizeof *(session->nodeArray);
-
-         /*
-          * The portion of memory that contains all our file nodes moved.
-          * All pointers that pointed inside the previous portion of memory
-          * must be updated to point to the new portion of memory.
-          *
-          * We'll need to lock this if we multithread.
-          */
-
-         LOG(4, ("Rebasing pointers, diff is %"FMTSZ"u, sizeof node is "
-                  "%"FMTSZ"u\n", ptrDiff, sizeof(HgfsFileNode)));
-         LOG(4, ("old: %p new: %p\n", session->nodeArray, newMem));
-         ASSERT(newMem == (HgfsFileNode *)((char*)session->nodeArray + ptrDiff));
-
-#define HgfsServerRebase(_ptr, _type)                                   \
-   if ((size_t)((char *)_ptr - (char *)session->nodeArray) < oldSize) { \
-      _ptr = (_type *)((char *)_ptr + ptrDiff);                         \
    }
 
-         /*
-          * Rebase the links of all file nodes
-          */
-         for (i = 0; i < session->numNodes; i++) {
-            HgfsServerRebase(newMem[i].links.prev, DblLnkLst_Links)
-            HgfsServerRebase(newMem[i].links.next, DblLnkLst_Links)
-         }
-
-         /*
-          * There is no need to rebase the anchor of the file node free list
-          * because if we are here, it is empty.
-          */
-
-         /* Rebase the anchor of the cached file nodes list. */
-         HgfsServerRebase(session->nodeCachedList.prev, DblLnkLst_Links)
-         HgfsServerRebase(session->nodeCachedList.next, DblLnkLst_Links)
-
-#undef HgfsServerRebase
-      }
-
-      /* Initialize the new nodes */
-      LOG(4, ("numNodes was %u, now is %u\n", session->numNodes, newNumNodes));
-      for (i = session->numNodes; i < newNumNodes; i++) {
-         DblLnkLst_Init(&newMem[i].links);
-
-         newMem[i].state = FILENODE_STATE_UNUSED;
-         newMem[i].utf8Name = NULL;
-         newMem[i].utf8NameLen = 0;
-         newMem[i].fileCtx = NULL;
-
-         /* Append at the end of the list */
-         DblLnkLst_LinkLast(&session->nodeFreeList, &newMem[i].links);
-      }
-      session->nodeArray = newMem;
-      session->numNodes = newNumNodes;
+   node = HgfsSlabAlloc(slab);
+   if (node == NULL) {
+      LOG(4, ("%s: can't allocate more nodes\n", __FUNCTION__));
 
-      if (DOLOG(4)) {
-         Log("Dumping nodes after pointer changes\n");
-         HgfsDumpAllNodes(session);
-      }
+      return NULL;
    }
-
-   /* Remove the first item from the list */
-   node = DblLnkLst_Container(session->nodeFreeList.next, HgfsFileNode, links);
-   DblLnkLst_Unlink1(&node->links);
+   ASSERT(node->state == FILENODE_STATE_UNUSED);
 
    return node;
 }
@@ -1621,6 +2630,16 @@ HgfsRemoveFileNode(HgfsFileNode *node,        // IN: file node
    LOG(4, ("%s: handle %u, name %s, fileId %"FMT64"u\n", __FUNCTION__,
            HgfsFileNode2Handle(node), node->utf8Name, node->localId.fileId));
 
+   /*
+    * Nodes failing HgfsAddNewFileNode may not have been indexed yet; removal
+    * only drops entries that refer to this node.
+    */
+   HgfsNodeIndexRemove(&session->nodeHandleIndex, HgfsFileNode2Handle(node),
+                       node);
+   HgfsNodeIndexRemove(&session->nodeFdIndex, HgfsFileDesc2Key(node->fileDesc),
+                       node);
+   HgfsPathIndexRemoveNode(&session->nodePathIndex, node);
+
    if (node->shareName) {
       free(node->shareName);
       node->shareName = NULL;
@@ -1640,8 +2659,7 @@ HgfsRemoveFileNode(HgfsFileNode *node,        // IN: file node
       node->shareInfo.rootDir = NULL;
    }
 
-   /* Prepend at the beginning of the list */
-   DblLnkLst_LinkFirst(&session->nodeFreeList, &node->links);
+   HgfsSlabFree(&session->nodeSlab, node);
 }
 
 
@@ -1793,6 +2811,8 @@ HgfsAddNewFileNode(HgfsFileOpenInfo *openInfo,  // IN: open info struct
    newNode->shareInfo.rootDir = rootDir;
 
    newNode->handle = HgfsServerGetNextHandleCounter();
+   HgfsNodeIndexInsert(&session->nodeHandleIndex, newNode->handle, newNode);
+   HgfsPathIndexAddNode(&session->nodePathIndex, newNode);
    newNode->localId = *localId;
    newNode->fileDesc = fileDesc;
    newNode->shareAccess = (openInfo->mask & HGFS_OPEN_VALID_SHARE_ACCESS) ?
@@ -1875,6 +2895,8 @@ HgfsAddToCacheInternal(HgfsHandle handle,         // IN: HGFS file handle
 
    node->state = FILENODE_STATE_IN_USE_CACHED;
    session->numCachedOpenNodes++;
+   HgfsNodeIndexInsert(&session->nodeFdIndex, HgfsFileDesc2Key(node->fileDesc),
+                       node);
 
    /*
     * Keep track of how many open nodes we have with
@@ -1935,6 +2957,8 @@ HgfsRemoveFromCacheInternal(HgfsHandle handle,        // IN: Hgfs handle to the
       DblLnkLst_Unlink1(&node->links);
       node->state = FILENODE_STATE_IN_USE_NOT_CACHED;
       session->numCachedOpenNodes--;
+      HgfsNodeIndexRemove(&session->nodeFdIndex,
+                          HgfsFileDesc2Key(node->fileDesc), node);
       LOG(4, ("%s: cache entries %u remove node %s id %"FMT64"u fd %u .\n",
               __FUNCTION__, session->numCachedOpenNodes, node->utf8Name,
               node->localId.fileId, node->fileDesc));
@@ -2061,12 +3085,11 @@ HgfsIsServerLockAllowed(HgfsSessionInfo *session)  // IN: session info
  *
  * HgfsGetNewSearch --
  *
- *    Remove a search from the free list and return it. Searches on
- *    the free list should already be initialized.
+ *    Remove a search from the free list of the search slab and return it.
+ *    Searches on the free list should already be initialized.
  *
- *    If the free list is empty, reallocates more memory,
- *    initializes it appropriately, adds the new entries to the
- *    free list, and then returns one off the free list.
+ *    If the free list is empty, the slab adds a chunk of zeroed searches;
+ *    existing searches never move.
  *
  *    Caller should hold the session's searchArrayLock.
  *
@@ -2084,106 +3107,23 @@ static HgfsSearch *
 HgfsGetNewSearch(HgfsSessionInfo *session)  // IN: session info
 {
    HgfsSearch *search;
-   HgfsSearch *newMem;
-   unsigned int newNumSearches;
-   unsigned int i;
 
    ASSERT(session);
-   ASSERT(session->searchArray);
 
    LOG(4, ("%s: entered\n", __FUNCTION__));
 
-   if (!DblLnkLst_IsLinked(&session->searchFreeList)) {
-      /*
-       * This has to be unsigned and with maximum bit length. This is
-       * required to take care of "negative" differences as well.
-       */
-
-      uintptr_t ptrDiff;
-
-      if (DOLOG(4)) {
-         Log("Dumping searches before realloc\n");
-         HgfsDumpAllSearches(session);
-      }
-
-      /* Try to get twice as much memory as we had */
-      newNumSearches = 2 * session->numSearches;
-      newMem = (HgfsSearch *)realloc(session->searchArray,
-                                     newNumSearches * sizeof *(session->searchArray));
-      if (!newMem) {
-         LOG(4, ("%s: can't realloc more searches\n", __FUNCTION__));
-
-         return NULL;
-      }
-
-      ptrDiff = (char *)newMem - (char *)session->searchArray;
-      if (ptrDiff) {
-         size_t const oldSize = session->numSearches * sizeof *(session->searchArray);
-
-         /*
-          * The portion of memory that contains all our searches moved.
-          * All pointers that pointed inside the previous portion of memory
-          * must be updated to point to the new portion of memory.
-          */
-
-         LOG(4, ("Rebasing pointers, diff is %"FMTSZ"u, sizeof search is "
-                 "%"FMTSZ"u\n", ptrDiff, sizeof(HgfsSearch)));
-         LOG(4, ("old: %p new: %p\n", session->searchArray, newMem));
-         ASSERT(newMem == (HgfsSearch*)((char*)session->searchArray + ptrDiff));
-
-#define HgfsServerRebase(_ptr, _type)                                     \
-   if ((size_t)((char *)_ptr - (char *)session->searchArray) < oldSize) { \
-      _ptr = (_type *)((char *)_ptr + ptrDiff);                           \
+   if (session->searchSlab.numFree == 0 && DOLOG(4)) {
+      Log("Dumping searches before adding a chunk\n");
+      HgfsDumpAllSearches(session);
    }
 
-         /*
-          * Rebase the links of all searches
-          */
-
-         for (i = 0; i < session->numSearches; i++) {
-            HgfsServerRebase(newMem[i].links.prev, DblLnkLst_Links)
-            HgfsServerRebase(newMem[i].links.next, DblLnkLst_Links)
-         }
-
-         /*
-          * There is no need to rebase the links of the search free list
-          * because if we are here, it is empty
-          */
-
-#undef HgfsServerRebase
-      }
-
-      /* Initialize the new searches */
-      LOG(4, ("numSearches was %u, now is %u\n", session->numSearches,
-               newNumSearches));
-
-      for (i = session->numSearches; i < newNumSearches; i++) {
-         DblLnkLst_Init(&newMem[i].links);
-         newMem[i].utf8Dir = NULL;
-         newMem[i].utf8DirLen = 0;
-         newMem[i].utf8ShareName = NULL;
-         newMem[i].utf8ShareNameLen = 0;
-         newMem[i].shareInfo.rootDir = NULL;
-         newMem[i].shareInfo.rootDirLen = 0;
-         newMem[i].dents = NULL;
-         newMem[i].numDents = 0;
-
-         /* Append at the end of the list */
-         DblLnkLst_LinkLast(&session->searchFreeList, &newMem[i].links);
-      }
-      session->searchArray = newMem;
-      session->numSearches = newNumSearches;
+   search = HgfsSlabAlloc(&session->searchSlab);
+   if (search == NULL) {
+      LOG(4, ("%s: can't allocate more searches\n", __FUNCTION__));
 
-      if (DOLOG(4)) {
-         Log("Dumping searches after pointer changes\n");
-         HgfsDumpAllSearches(session);
-      }
+      return NULL;
    }
 
-   /* Remove the first item from the list */
-   search = DblLnkLst_Container(session->searchFreeList.next, HgfsSearch, links);
-   DblLnkLst_Unlink1(&search->links);
-
    return search;
 }
 
@@ -2443,8 +3383,7 @@ HgfsRemoveSearchInternal(HgfsSearch *search,       // IN: search
    search->shareInfo.rootDirLen = 0;
    search->shareInfo.rootDir = NULL;
 
-   /* Prepend at the beginning of the list */
-   DblLnkLst_LinkFirst(&session->searchFreeList, &search->links);
+   HgfsSlabFree(&session->searchSlab, search);
 }
 
 
@@ -2656,13 +3595,15 @@ HgfsSearchHandle2Search(HgfsHandle handle,         // IN: handle
    HgfsSearch *search = NULL;
 
    ASSERT(session);
-   ASSERT(session->searchArray);
 
    /* XXX: This O(n) lookup can and should be optimized. */
-   for (i = 0; i < session->numSearches; i++) {
-      if (!DblLnkLst_IsLinked(&session->searchArray[i].links) &&
-          session->searchArray[i].handle == handle) {
-         search = &session->searchArray[i];
+   for (i = 0; i < HgfsSlabCapacity(&session->searchSlab); i++) {
+      HgfsSearch *existingSearch = HgfsSlabGet(&session->searchSlab, i);
+
+      if (existingSearch != NULL &&
+          !DblLnkLst_IsLinked(&existingSearch->links) &&
+          existingSearch->handle == handle) {
+         search = existingSearch;
          break;
       }
    }
@@ -2676,8 +3617,9 @@ HgfsSearchHandle2Search(HgfsHandle handle,         // IN: handle
  *
  * HgfsUpdateNodeNames --
  *
- *    Walk the node array and update all nodes that have the old file name to
- *    store the new file name.
+ *    Update all nodes that have the old file name, or a name below it if the
+ *    old name is a directory, to store the new file name. Only the nodes
+ *    found under the old name in the session's path index are visited.
  *
  * Results:
  *    None
@@ -2694,35 +3636,60 @@ HgfsUpdateNodeNames(const char *oldLocalName,  // IN: Name of file to look for
                     const char *newLocalName,  // IN: Name to replace with
                     HgfsSessionInfo *session)  // IN: Session info
 {
-   HgfsFileNode *fileNode;
-   unsigned int i;
-   char *newBuffer;
-   size_t newBufferLen;
+   HgfsPathEntry *entry;
+   HgfsPathEntry *parent;
+   DblLnkLst_Links renamed;
+   DblLnkLst_Links *l;
+   DblLnkLst_Links *next;
+   char *oldKey;
+   char *newKey;
+   size_t oldKeyLen;
+   size_t newKeyLen;
 
    ASSERT(oldLocalName);
    ASSERT(newLocalName);
    ASSERT(session);
-   ASSERT(session->nodeArray);
 
-   newBufferLen = strlen(newLocalName);
+   oldKey = HgfsPathIndexKey(oldLocalName);
+   oldKeyLen = strlen(oldKey);
+   newKey = HgfsPathIndexKey(newLocalName);
+   newKeyLen = strlen(newKey);
+   DblLnkLst_Init(&renamed);
 
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
-   for (i = 0; i < session->numNodes; i++) {
-      fileNode = &session->nodeArray[i];
+   if (!HashTable_Lookup(session->nodePathIndex.entries, oldKey,
+                         (void **)&entry)) {
+      goto exit;
+   }
 
-      /* If the node is on the free list, skip it. */
-      if (fileNode->state == FILENODE_STATE_UNUSED) {
-         continue;
-      }
+   /*
+    * Take the nodes opened at or below the old name out of the index, and
+    * drop the entries that are left empty.
+    */
+   HgfsPathIndexDetachSubtree(entry, &renamed);
+   parent = entry->parent;
+   if (HgfsPathIndexPruneSubtree(&session->nodePathIndex, entry)) {
+      HgfsPathIndexRelease(&session->nodePathIndex, parent);
+   }
 
-      if (strcmp(fileNode->utf8Name, oldLocalName) == 0) {
-         newBuffer = malloc(newBufferLen + 1);
-         if (!newBuffer) {
-            LOG(4, ("%s: Failed to update a node name.\n", __FUNCTION__));
-            continue;
-         }
-         memcpy(newBuffer, newLocalName, newBufferLen);
+   DblLnkLst_ForEachSafe(l, next, &renamed) {
+      HgfsFileNode *fileNode = DblLnkLst_Container(l, HgfsFileNode, pathLinks);
+      size_t tailLen = fileNode->utf8NameLen - oldKeyLen;
+      size_t newBufferLen = newKeyLen + tailLen;
+      char *newBuffer;
+
+      ASSERT(strncmp(fileNode->utf8Name, oldKey, oldKeyLen) == 0);
+
+      DblLnkLst_Unlink1(&fileNode->pathLinks);
+
+      newBuffer = malloc(newBufferLen + 1);
+      if (!newBuffer) {
+         LOG(4, ("%s: Failed to update a node name.\n", __FUNCTION__));
+      } else {
+         /* Keep whatever followed the old name: the path below a directory. */
+         memcpy(newBuffer, newKey, newKeyLen);
+         memcpy(newBuffer + newKeyLen, fileNode->utf8Name + oldKeyLen, tailLen);
          newBuffer[newBufferLen] = '\0';
 
          /* Update this name to the new name. */
@@ -2730,9 +3697,15 @@ HgfsUpdateNodeNames(const char *oldLocalName,  // IN: Name of file to look for
          fileNode->utf8Name = newBuffer;
          fileNode->utf8NameLen = newBufferLen;
       }
+
+      HgfsPathIndexLinkName(&session->nodePathIndex, fileNode);
    }
 
+exit:
    MXUser_ReleaseExclLock(session->nodeArrayLock);
+
+   free(oldKey);
+   free(newKey);
 }
 
 
@@ -4185,8 +5158,8 @@ HgfsServerSessionConnect(void *transportData,                         // IN: tra
  *
  *    Initialize a new Hgfs session.
  *
- *    Allocate HgfsSessionInfo and initialize it. Create the nodeArray and
- *    searchArray for the session.
+ *    Allocate HgfsSessionInfo and initialize it. Set up the node and search
+ *    slabs for the session.
  *
  * Results:
  *    TRUE on success, FALSE otherwise.
@@ -4201,7 +5174,6 @@ static Bool
 HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
                           HgfsSessionInfo **sessionData)              // OUT:
 {
-   int i;
    HgfsSessionInfo *session;
 
    LOG(8, ("%s: entered\n", __FUNCTION__));
@@ -4255,46 +5227,31 @@ HgfsServerAllocateSession(HgfsTransportSessionInfo *transportSession, // IN:
     * Initialize the node handling components.
     */
 
-   DblLnkLst_Init(&session->nodeFreeList);
    DblLnkLst_Init(&session->nodeCachedList);
 
-   /* Allocate array of FileNodes and add them to free list. */
-   session->numNodes = NUM_FILE_NODES;
-   session->nodeArray = Util_SafeCalloc(session->numNodes,
-                                        sizeof (HgfsFileNode));
+   /* File nodes are allocated from the slab as they are needed. */
+   HgfsSlabInit(&session->nodeSlab, sizeof (HgfsFileNode),
+                vmw_offsetof(HgfsFileNode, links),
+                vmw_offsetof(HgfsFileNode, slabIndex));
    session->numCachedOpenNodes = 0;
    session->numCachedLockedNodes = 0;
-
-   for (i = 0; i < session->numNodes; i++) {
-      DblLnkLst_Init(&session->nodeArray[i].links);
-      /* Append at the end of the list. */
-      DblLnkLst_LinkLast(&session->nodeFreeList, &session->nodeArray[i].links);
-   }
+   HgfsNodeIndexInit(&session->nodeHandleIndex, HGFS_SLAB_CHUNK_SIZE);
+   HgfsNodeIndexInit(&session->nodeFdIndex, HGFS_SLAB_CHUNK_SIZE);
+   HgfsPathIndexInit(&session->nodePathIndex);
 
    /*
     * Initialize the search handling components.
     */
 
-   /* Initialize search freelist. */
-   DblLnkLst_Init(&session->searchFreeList);
+   HgfsSlabInit(&session->searchSlab, sizeof (HgfsSearch),
+                vmw_offsetof(HgfsSearch, links),
+                vmw_offsetof(HgfsSearch, slabIndex));
 
    Atomic_Write(&session->refCount, 0);
 
    /* Give our session a reference to hold while we are open. */
    HgfsServerSessionGet(session);
 
-   /* Allocate array of searches and add them to free list. */
-   session->numSearches = NUM_SEARCHES;
-   session->searchArray = Util_SafeCalloc(session->numSearches,
-                                          sizeof (HgfsSearch));
-
-   for (i = 0; i < session->numSearches; i++) {
-      DblLnkLst_Init(&session->searchArray[i].links);
-      /* Append at the end of the list. */
-      DblLnkLst_LinkLast(&session->searchFreeList,
-                         &session->searchArray[i].links);
-   }
-
    /* Get common to all sessions capabiities. */
    HgfsServerGetDefaultCapabilities(session->hgfsSessionCapabilities,
                                     &session->numberOfCapabilities);
@@ -4359,8 +5316,6 @@ HgfsDisconnectSessionInt(HgfsSessionInfo *session)    // IN: session context
    LOG(8, ("%s: entered\n", __FUNCTION__));
 
    ASSERT(session);
-   ASSERT(session->nodeArray);
-   ASSERT(session->searchArray);
 
    session->state = HGFS_SESSION_STATE_CLOSED;
    LOG(8, ("%s: exit\n", __FUNCTION__));
@@ -4419,8 +5374,8 @@ HgfsServerSessionDisconnect(void *clientData)    // IN: session context
  *
  *    Closes a client session.
  *
- *    Remvoing the final reference will free the session's nodeArray
- *    and seachArrary, and finally free the session object.
+ *    Remvoing the final reference will free the session's node and search
+ *    slabs, and finally free the session object.
  *
  * Results:
  *    None.
@@ -4451,7 +5406,7 @@ HgfsServerSessionClose(void *clientData)    // IN: session context
  *
  *    Destroys a session.
  *
- *    Free the session's nodeArray and seachArrary. Free the session.
+ *    Free the session's node and search slabs. Free the session.
  *
  *    The caller must have previously acquired the global sessions lock.
  *
@@ -4470,8 +5425,6 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
    int i;
 
    ASSERT(session);
-   ASSERT(session->nodeArray);
-   ASSERT(session->searchArray);
 
    ASSERT(session->state == HGFS_SESSION_STATE_CLOSED);
 
@@ -4493,19 +5446,23 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
    Log("%s: exit session %p id %"FMT64"x\n", __FUNCTION__, session, session->sessionId);
 
    /* Recycle all nodes that are still in use, then destroy the node pool. */
-   for (i = 0; i < session->numNodes; i++) {
+   for (i = 0; i < HgfsSlabCapacity(&session->nodeSlab); i++) {
+      HgfsFileNode *node = HgfsSlabGet(&session->nodeSlab, i);
       HgfsHandle handle;
 
-      if (session->nodeArray[i].state == FILENODE_STATE_UNUSED) {
+      if (node == NULL || node->state == FILENODE_STATE_UNUSED) {
          continue;
       }
 
-      handle = HgfsFileNode2Handle(&session->nodeArray[i]);
+      handle = HgfsFileNode2Handle(node);
       HgfsRemoveFromCacheInternal(handle, session);
       HgfsFreeFileNodeInternal(handle, session);
    }
-   free(session->nodeArray);
-   session->nodeArray = NULL;
+   ASSERT(session->nodeHandleIndex.count == 0);
+   HgfsNodeIndexDestroy(&session->nodeHandleIndex);
+   HgfsNodeIndexDestroy(&session->nodeFdIndex);
+   HgfsPathIndexDestroy(&session->nodePathIndex);
+   HgfsSlabDestroy(&session->nodeSlab);
 
    MXUser_ReleaseExclLock(session->nodeArrayLock);
 
@@ -4516,14 +5473,15 @@ HgfsServerExitSessionInternal(HgfsSessionInfo *session)    // IN: session contex
 
    MXUser_AcquireExclLock(session->searchArrayLock);
 
-   for (i = 0; i < session->numSearches; i++) {
-      if (DblLnkLst_IsLinked(&session->searchArray[i].links)) {
+   for (i = 0; i < HgfsSlabCapacity(&session->searchSlab); i++) {
+      HgfsSearch *search = HgfsSlabGet(&session->searchSlab, i);
+
+      if (search == NULL || DblLnkLst_IsLinked(&search->links)) {
          continue;
       }
-      HgfsRemoveSearchInternal(&session->searchArray[i], session);
+      HgfsRemoveSearchInternal(search, session);
    }
-   free(session->searchArray);
-   session->searchArray = NULL;
+   HgfsSlabDestroy(&session->searchSlab);
 
    MXUser_ReleaseExclLock(session->searchArrayLock);
 
@@ -4745,8 +5703,8 @@ HgfsPacketSend(HgfsPacket *packet,            // IN/OUT: Hgfs Packet
  *
  * HgfsInvalidateSessionObjects --
  *
- *      Iterates over all nodes and searches, invalidating and removing those
- *      that are no longer within a share.
+ *      Iterates over the share roots of the open nodes and over all searches,
+ *      invalidating and removing those that are no longer within a share.
  *
  * Results:
  *      None
@@ -4762,53 +5720,67 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
                              HgfsSessionInfo *session) // IN: Session info
 {
    unsigned int i;
+   DblLnkLst_Links *rootLink;
+   DblLnkLst_Links *nextRootLink;
 
    ASSERT(shares);
    ASSERT(session);
-   ASSERT(session->nodeArray);
-   ASSERT(session->searchArray);
    LOG(4, ("%s: Beginning\n", __FUNCTION__));
 
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
    /*
-    * Iterate over each node, skipping those that are unused. For each node,
-    * if its filename is no longer within a share, remove it.
+    * Iterate over the share root directories of the open nodes. For each one
+    * that is no longer a share, remove the nodes opened through it.
     */
-   for (i = 0; i < session->numNodes; i++) {
-      HgfsHandle handle;
+   DblLnkLst_ForEachSafe(rootLink, nextRootLink,
+                         &session->nodePathIndex.shareRoots) {
+      HgfsPathEntry *rootEntry = DblLnkLst_Container(rootLink, HgfsPathEntry,
+                                                     shareRootLinks);
+      DblLnkLst_Links *nodeLink;
       DblLnkLst_Links *l;
+      Bool last;
 
-      if (session->nodeArray[i].state == FILENODE_STATE_UNUSED) {
-         continue;
-      }
-
-      handle = HgfsFileNode2Handle(&session->nodeArray[i]);
-      LOG(4, ("%s: Examining node with fd %d (%s)\n", __FUNCTION__,
-              handle, session->nodeArray[i].utf8Name));
+      LOG(4, ("%s: Examining share root %s\n", __FUNCTION__, rootEntry->path));
 
-      /* For each share, is the node within the share? */
+      /* For each share, is this its root directory? */
       for (l = shares->next; l != shares; l = l->next) {
          HgfsSharedFolder *share;
 
          share = DblLnkLst_Container(l, HgfsSharedFolder, links);
          ASSERT(share);
-         if (strcmp(session->nodeArray[i].shareInfo.rootDir, share->path) == 0) {
-            LOG(4, ("%s: Node is still valid\n", __FUNCTION__));
+         if (HgfsPathEntryMatches(rootEntry, share->path)) {
+            LOG(4, ("%s: Share root is still valid\n", __FUNCTION__));
             break;
          }
       }
 
-      /* If the node wasn't found in any share, remove it. */
-      if (l == shares) {
-         LOG(4, ("%s: Node is invalid, removing\n", __FUNCTION__));
+      if (l != shares) {
+         continue;
+      }
+
+      /*
+       * The share was removed, so remove all its nodes. Freeing the last one
+       * frees rootEntry, so the end of the list is detected beforehand.
+       */
+      nodeLink = rootEntry->rootedNodes.next;
+      do {
+         HgfsFileNode *node = DblLnkLst_Container(nodeLink, HgfsFileNode,
+                                                  rootLinks);
+         HgfsHandle handle = HgfsFileNode2Handle(node);
+
+         nodeLink = nodeLink->next;
+         last = nodeLink == &rootEntry->rootedNodes;
+
+         LOG(4, ("%s: Node with fd %d (%s) is invalid, removing\n",
+                 __FUNCTION__, handle, node->utf8Name));
          if (!HgfsRemoveFromCacheInternal(handle, session)) {
             LOG(4, ("%s: Could not remove node with "
                     "fh %d from the cache.\n", __FUNCTION__, handle));
          } else {
             HgfsFreeFileNodeInternal(handle, session);
          }
-      }
+      } while (!last);
    }
 
    MXUser_ReleaseExclLock(session->nodeArrayLock);
@@ -4819,20 +5791,21 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
     * Iterate over each search, skipping those that are on the free list. For
     * each search, if its base name is no longer within a share, remove it.
     */
-   for (i = 0; i < session->numSearches; i++) {
+   for (i = 0; i < HgfsSlabCapacity(&session->searchSlab); i++) {
+      HgfsSearch *search = HgfsSlabGet(&session->searchSlab, i);
       DblLnkLst_Links *l;
 
-      if (DblLnkLst_IsLinked(&session->searchArray[i].links)) {
+      if (search == NULL || DblLnkLst_IsLinked(&search->links)) {
          continue;
       }
 
-      if (HgfsSearchIsBaseNameSpace(&session->searchArray[i])) {
+      if (HgfsSearchIsBaseNameSpace(search)) {
          /* Skip search of the base name space. Maybe stale but it is okay. */
          continue;
       }
 
       LOG(4, ("%s: Examining search (%s)\n", __FUNCTION__,
-              session->searchArray[i].utf8Dir));
+              search->utf8Dir));
 
       /* For each share, is the search within the share? */
       for (l = shares->next; l != shares; l = l->next) {
@@ -4840,7 +5813,7 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
 
          share = DblLnkLst_Container(l, HgfsSharedFolder, links);
          ASSERT(share);
-         if (strcmp(session->searchArray[i].shareInfo.rootDir, share->path) == 0) {
+         if (strcmp(search->shareInfo.rootDir, share->path) == 0) {
             LOG(4, ("%s: Search is still valid\n", __FUNCTION__));
             break;
          }
@@ -4849,7 +5822,7 @@ HgfsInvalidateSessionObjects(DblLnkLst_Links *shares,  // IN: List of new shares
       /* If the node wasn't found in any share, remove it. */
       if (l == shares) {
          LOG(4, ("%s: Search is invalid, removing\n", __FUNCTION__));
-         HgfsRemoveSearchInternal(&session->searchArray[i], session);
+         HgfsRemoveSearchInternal(search, session);
       }
    }
 
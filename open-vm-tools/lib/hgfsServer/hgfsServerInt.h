@@ -39,6 +39,7 @@ struct DirectoryEntry;
 #include "vm_atomic.h"
 #include "userlock.h"
 #include "hgfsServer.h" // for the server public types
+#include "hashTable.h"
 
 #define HGFS_DEBUG_ASYNC   (0)
 
@@ -127,6 +128,17 @@ typedef struct HgfsFileNode {
    /* Links to place the object on various lists */
    DblLnkLst_Links links;
 
+   /* Position of the node in the session's node slab. */
+   uint32 slabIndex;
+
+   /* Path index entry for utf8Name and link on its list of nodes. */
+   struct HgfsPathEntry *pathEntry;
+   DblLnkLst_Links pathLinks;
+
+   /* Path index entry for shareInfo.rootDir and link on its list of nodes. */
+   struct HgfsPathEntry *rootEntry;
+   DblLnkLst_Links rootLinks;
+
    /* HGFS handle uniquely identifying this node. */
    HgfsHandle handle;
 
@@ -176,6 +188,89 @@ typedef struct HgfsFileNode {
 } HgfsFileNode;
 
 
+/*
+ * Open-addressed index mapping a key (an HGFS handle or an OS file descriptor)
+ * to a file node. File nodes never move once allocated (see HgfsSlab), so the
+ * index can hold node pointers.
+ */
+typedef struct HgfsNodeIndexEntry {
+   uint64 key;
+   struct HgfsFileNode *node;   /* NULL if the slot is empty. */
+} HgfsNodeIndexEntry;
+
+typedef struct HgfsNodeIndex {
+   HgfsNodeIndexEntry *entries;
+   uint32 capacity;     /* Always a power of 2 and at least twice the nodes. */
+   uint32 count;
+} HgfsNodeIndex;
+
+/*
+ * Path index of the open file nodes of a session.
+ *
+ * Every path that has an open node at or below it, and every share root
+ * directory of an open node, has an entry. Entries form a tree following
+ * the path components, and are also hashed by their full path so any entry
+ * is found in one lookup. A rename of a file or a directory then only visits
+ * the entries below the renamed path, and share invalidation only visits the
+ * nodes opened through a removed share.
+ */
+typedef struct HgfsPathEntry {
+   /* Full path without trailing separators, the key in the hash table. */
+   char *path;
+   size_t pathLen;
+
+   /* Entry of the parent directory, NULL for the top entry. */
+   struct HgfsPathEntry *parent;
+
+   /* Link on the parent's children list. */
+   DblLnkLst_Links siblingLinks;
+
+   /* Entries one path component below this one. */
+   DblLnkLst_Links children;
+
+   /* File nodes whose utf8Name is this path. */
+   DblLnkLst_Links nodes;
+
+   /* File nodes whose share root directory is this path. */
+   DblLnkLst_Links rootedNodes;
+
+   /* Link on the session's list of share root entries. */
+   DblLnkLst_Links shareRootLinks;
+} HgfsPathEntry;
+
+typedef struct HgfsPathIndex {
+   /* Entries by path. */
+   HashTable *entries;
+
+   /* Entries that are the share root directory of at least one node. */
+   DblLnkLst_Links shareRoots;
+} HgfsPathIndex;
+
+/*
+ * Chunked allocator for file nodes and searches.
+ *
+ * Objects live in fixed size chunks which are allocated when the free list
+ * runs dry and released once all their objects are free again. Objects never
+ * move, so growing the pool does not have to rebase any pointers into it.
+ * Each object embeds the DblLnkLst_Links used for the free list and its
+ * index within the slab, at the offsets given at initialization.
+ */
+#define HGFS_SLAB_CHUNK_SHIFT   7
+#define HGFS_SLAB_CHUNK_SIZE    (1U << HGFS_SLAB_CHUNK_SHIFT)
+
+typedef struct HgfsSlab {
+   size_t objSize;              /* Size of an object. */
+   size_t linksOffset;          /* Offset of the free list links in an object. */
+   size_t indexOffset;          /* Offset of the uint32 slab index in an object. */
+   char **chunks;               /* Chunk table, NULL for released chunks. */
+   uint32 *chunkInUse;          /* Objects in use in each chunk. */
+   uint32 numChunks;            /* Entries in the chunk table. */
+   uint32 numAllocated;         /* Objects in allocated chunks. */
+   uint32 numFree;              /* Objects on the free list. */
+   DblLnkLst_Links freeList;    /* Free objects. LIFO to be cache-friendly. */
+} HgfsSlab;
+
+
 /* HgfsFileNode flags. */
 
 /* TRUE if opened in append mode */
@@ -196,6 +291,9 @@ typedef struct HgfsSearch {
    /* Links to place the object on various lists */
    DblLnkLst_Links links;
 
+   /* Position of the search in the session's search slab. */
+   uint32 slabIndex;
+
    /* Flags to track state and information: see below. */
    uint32 flags;
 
@@ -279,19 +377,22 @@ typedef struct HgfsSessionInfo {
    /*
     ** START NODE ARRAY **************************************************
     *
-    * Lock for the following 6 fields: the node array,
+    * Lock for the following 7 fields: the node slab, its indices,
     * counters and lists for this session.
     */
    MXUserExclLock *nodeArrayLock;
 
-   /* Open file nodes of this session. */
-   HgfsFileNode *nodeArray;
+   /* Open file nodes of this session, with their free list. */
+   HgfsSlab nodeSlab;
 
-   /* Number of nodes in the nodeArray. */
-   uint32 numNodes;
+   /* Index of in-use nodes by HGFS handle. */
+   HgfsNodeIndex nodeHandleIndex;
 
-   /* Free list of file nodes. LIFO to be cache-friendly. */
-   DblLnkLst_Links nodeFreeList;
+   /* Index of cached nodes by their open file descriptor. */
+   HgfsNodeIndex nodeFdIndex;
+
+   /* Index of in-use nodes by name and by share root directory. */
+   HgfsPathIndex nodePathIndex;
 
    /* List of cached open nodes. */
    DblLnkLst_Links nodeCachedList;
@@ -306,19 +407,13 @@ typedef struct HgfsSessionInfo {
    /*
     ** START SEARCH ARRAY ************************************************
     *
-    * Lock for the following three fields: for the search array
-    * and it's counter and list, for this session.
+    * Lock for the following field: the search slab and its free list,
+    * for this session.
     */
    MXUserExclLock *searchArrayLock;
 
    /* Directory entry cache for this session. */
-   HgfsSearch *searchArray;
-
-   /* Number of entries in searchArray. */
-   uint32 numSearches;
-
-   /* Free list of searches. LIFO. */
-   DblLnkLst_Links searchFreeList;
+   HgfsSlab searchSlab;
    /** END SEARCH ARRAY ****************************************************/
 
    /* Array of session specific capabiities. */
@@ -66,7 +66,9 @@
 #include "su.h"
 #include "codeset.h"
 #include "unicodeOperations.h"
+#include "unicodeTransforms.h"
 #include "userlock.h"
+#include "mutexRankLib.h"
 
 #if defined(linux) && !defined(SYS_getdents64)
 /* For DT_UNKNOWN */
@@ -382,6 +384,102 @@ static HgfsInternalStatus HgfsWriteCheckIORange(off_t offset,
                                                 uint32 bytesToWrite);
 #endif
 
+/*
+ * Size limits of the buffer HgfsPlatformScandir reads directory entries into.
+ * The buffer is sized from the directory itself within these limits. The
+ * getdents fallback for kernels without getdents64 allocates a translation
+ * buffer on the stack, so it keeps the historic size.
+ */
+#if defined(linux) && !defined(SYS_getdents64)
+#define HGFS_SCANDIR_BUFFER_MIN     8192
+#define HGFS_SCANDIR_BUFFER_MAX     8192
+#else
+#define HGFS_SCANDIR_BUFFER_MIN     (32 * 1024)
+#define HGFS_SCANDIR_BUFFER_MAX     (256 * 1024)
+#endif
+
+#if defined(linux)
+/*
+ * Directory snapshot cache.
+ *
+ * HgfsPlatformScandir keeps the entries it read, together with the open
+ * directory, keyed by the directory's device and inode and validated by its
+ * modification and change times. Another search on the unchanged directory
+ * copies the entries instead of reading the directory again, and
+ * HgfsPlatformSetDirEntry stats entries relative to the open directory
+ * instead of resolving the full path of every entry.
+ */
+#define HGFS_DIR_CACHE_MAX_SNAPSHOTS   8
+#define HGFS_DIR_CACHE_MAX_BYTES       (32 * 1024 * 1024)
+
+/*
+ * Directories modified less than this many seconds ago are not cached, as a
+ * further change within the timestamp granularity would go unnoticed.
+ */
+#define HGFS_DIR_CACHE_SETTLE_TIME     2
+
+/*
+ * How often, in seconds, the name of a snapshot is checked to still refer
+ * to the snapshot's directory before entries are stat'ed relative to it.
+ */
+#define HGFS_DIR_CACHE_REVALIDATE_TIME 1
+
+typedef struct HgfsDirSnapshot {
+   DblLnkLst_Links links;     /* Cache LRU list, most recently used first */
+   char *dirName;             /* Name the directory was scanned by */
+   int dirFd;                 /* Open directory, for the *at() calls */
+   dev_t dev;
+   ino_t ino;
+   struct timespec mtime;
+   struct timespec ctime;
+   time_t validated;          /* When dirName was last checked */
+   char *buf;                 /* Packed DirectoryEntry records */
+   size_t bufLen;
+   uint32 *offsets;           /* Offset of each record in buf */
+   uint32 numDents;
+   uint32 refCount;           /* References handed out by the cache */
+   Bool cached;               /* Linked on the cache LRU list */
+} HgfsDirSnapshot;
+
+static MXUserExclLock *gHgfsDirCacheLock = NULL;
+static DblLnkLst_Links gHgfsDirCacheList;
+static uint32 gHgfsDirCacheCount = 0;
+static size_t gHgfsDirCacheBytes = 0;
+
+static void HgfsDirCacheExit(void);
+
+/*
+ * Case-folding cache for case-insensitive lookups.
+ *
+ * Maps directory names to the folded names of their entries, so that
+ * HgfsConvertComponentCase need not read and compare the whole directory for
+ * every component of every lookup. A mapping is used only while the
+ * directory's inode and change times are unchanged, which makes a miss in a
+ * valid mapping an authoritative "no such entry".
+ */
+#define HGFS_CASE_CACHE_MAX_DIRS       64
+#define HGFS_CASE_CACHE_MAX_NAMES      65536
+#define HGFS_CASE_CACHE_NAME_BUCKETS   1024
+
+typedef struct HgfsCaseDir {
+   DblLnkLst_Links links;     /* Cache LRU list, most recently used first */
+   char *dirPath;             /* Key in gHgfsCaseCacheDirs */
+   dev_t dev;
+   ino_t ino;
+   struct timespec mtime;
+   struct timespec ctime;
+   HashTable *names;          /* Folded name -> folded and on-disk names */
+} HgfsCaseDir;
+
+static MXUserExclLock *gHgfsCaseCacheLock = NULL;
+static HashTable *gHgfsCaseCacheDirs = NULL;
+static DblLnkLst_Links gHgfsCaseCacheList;
+static uint32 gHgfsCaseCacheCount = 0;
+
+static void HgfsCaseDirFree(void *clientData);
+static void HgfsCaseCacheExit(void);
+#endif
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -555,6 +653,26 @@ HgfsServerGetOpenFlags(HgfsOpenFlags flagsIn, // IN
 Bool
 HgfsPlatformInit(void)
 {
+#if defined(linux)
+   DblLnkLst_Init(&gHgfsDirCacheList);
+   gHgfsDirCacheLock = MXUser_CreateExclLock("dirCacheLock",
+                                             RANK_hgfsDirCacheLock);
+   if (NULL == gHgfsDirCacheLock) {
+      /* Searches will then read and stat the directory every time. */
+      LOG(4, ("%s: Could not create the directory cache lock\n", __FUNCTION__));
+   }
+
+   DblLnkLst_Init(&gHgfsCaseCacheList);
+   gHgfsCaseCacheLock = MXUser_CreateExclLock("caseCacheLock",
+                                              RANK_hgfsCaseCacheLock);
+   if (NULL != gHgfsCaseCacheLock) {
+      gHgfsCaseCacheDirs = HashTable_Alloc(2 * HGFS_CASE_CACHE_MAX_DIRS,
+                                           HASH_STRING_KEY, HgfsCaseDirFree);
+   } else {
+      /* Case-insensitive lookups will then read every directory. */
+      LOG(4, ("%s: Could not create the case cache lock\n", __FUNCTION__));
+   }
+#endif
    return TRUE;
 }
 
@@ -578,6 +696,10 @@ HgfsPlatformInit(void)
 void
 HgfsPlatformDestroy(void)
 {
+#if defined(linux)
+   HgfsDirCacheExit();
+   HgfsCaseCacheExit();
+#endif
 }
 
 
@@ -1396,6 +1518,310 @@ HgfsGetHiddenAttr(char const *fileName,         // IN:  Input filename
 }
 
 
+#if defined(linux)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseDirFree --
+ *
+ *    Frees a directory case mapping. Used as the free function of the cache.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCaseDirFree(void *clientData)  // IN: HgfsCaseDir
+{
+   HgfsCaseDir *caseDir = clientData;
+
+   HashTable_Free(caseDir->names);
+   free(caseDir->dirPath);
+   free(caseDir);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseCacheRemove --
+ *
+ *    Removes and frees a directory case mapping. Called with the cache lock
+ *    held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCaseCacheRemove(HgfsCaseDir *caseDir)  // IN: directory mapping
+{
+   DblLnkLst_Unlink1(&caseDir->links);
+   gHgfsCaseCacheCount--;
+
+   /* The cache table frees the mapping. */
+   HashTable_Delete(gHgfsCaseCacheDirs, caseDir->dirPath);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseDirConvert --
+ *
+ *    Looks up a folded component name in a directory case mapping. Called with
+ *    the cache lock held.
+ *
+ * Results:
+ *    0 and the on-disk name in convertedComponent if the directory has an
+ *    entry matching the component, ENOENT if it has none, or ENOMEM.
+ *
+ * Side effects:
+ *    On success, allocated memory is returned in convertedComponent and needs
+ *    to be freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+HgfsCaseDirConvert(HgfsCaseDir *caseDir,              // IN: directory mapping
+                   const char *foldedComponent,       // IN: folded name
+                   const char **convertedComponent,   // OUT
+                   size_t *convertedComponentSize)    // OUT
+{
+   char *names;
+   char *diskName;
+
+   if (!HashTable_Lookup(caseDir->names, foldedComponent, (void **)&names)) {
+      return ENOENT;
+   }
+
+   /* The entry holds the folded name followed by the name on disk. */
+   diskName = names + strlen(names) + 1;
+   *convertedComponent = strdup(diskName);
+   if (NULL == *convertedComponent) {
+      return ENOMEM;
+   }
+   *convertedComponentSize = strlen(diskName) + 1;
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseCacheLookup --
+ *
+ *    Resolves a component of dirPath case-insensitively from the cached case
+ *    mapping of the directory, provided the directory has not changed since
+ *    the mapping was built.
+ *
+ * Results:
+ *    TRUE if the cache answered, with the result in *ret and, on success, the
+ *    on-disk name in convertedComponent. FALSE if the directory has to be read.
+ *
+ * Side effects:
+ *    A stale mapping is removed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsCaseCacheLookup(const char *dirPath,               // IN: directory
+                    const char *foldedComponent,       // IN: folded name
+                    int *ret,                          // OUT: result
+                    const char **convertedComponent,   // OUT
+                    size_t *convertedComponentSize)    // OUT
+{
+   HgfsCaseDir *caseDir;
+   struct stat stats;
+   Bool answered = FALSE;
+
+   if (NULL == gHgfsCaseCacheLock || Posix_Stat(dirPath, &stats) != 0) {
+      return FALSE;
+   }
+
+   MXUser_AcquireExclLock(gHgfsCaseCacheLock);
+   if (HashTable_Lookup(gHgfsCaseCacheDirs, dirPath, (void **)&caseDir)) {
+      if (caseDir->dev == stats.st_dev &&
+          caseDir->ino == stats.st_ino &&
+          caseDir->mtime.tv_sec == stats.st_mtim.tv_sec &&
+          caseDir->mtime.tv_nsec == stats.st_mtim.tv_nsec &&
+          caseDir->ctime.tv_sec == stats.st_ctim.tv_sec &&
+          caseDir->ctime.tv_nsec == stats.st_ctim.tv_nsec) {
+         *ret = HgfsCaseDirConvert(caseDir, foldedComponent,
+                                   convertedComponent, convertedComponentSize);
+         DblLnkLst_Unlink1(&caseDir->links);
+         DblLnkLst_LinkFirst(&gHgfsCaseCacheList, &caseDir->links);
+         answered = TRUE;
+      } else {
+         LOG(4, ("%s: dropping stale case mapping of \"%s\"\n", __FUNCTION__,
+                 dirPath));
+         HgfsCaseCacheRemove(caseDir);
+      }
+   }
+   MXUser_ReleaseExclLock(gHgfsCaseCacheLock);
+
+   return answered;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseCacheFill --
+ *
+ *    Reads the whole open directory into a new case mapping, adds it to the
+ *    cache and resolves the component from it. Directories which changed
+ *    too recently or hold too many entries are not cached.
+ *
+ * Results:
+ *    TRUE if the component was resolved from the new mapping, with the result
+ *    in *ret. FALSE if the directory was not cached; it is then rewound for
+ *    the caller to search it.
+ *
+ * Side effects:
+ *    The least recently used mappings are evicted as needed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsCaseCacheFill(DIR *dir,                          // IN: open directory
+                  const char *dirPath,               // IN: directory
+                  const char *foldedComponent,       // IN: folded name
+                  int *ret,                          // OUT: result
+                  const char **convertedComponent,   // OUT
+                  size_t *convertedComponentSize)    // OUT
+{
+   HgfsCaseDir *caseDir;
+   HgfsCaseDir *oldCaseDir;
+   struct dirent *dirent;
+   struct stat stats;
+   time_t now = time(NULL);
+
+   if (NULL == gHgfsCaseCacheLock || fstat(dirfd(dir), &stats) != 0) {
+      return FALSE;
+   }
+
+   /* A directory changed just now may change again unnoticed. */
+   if (now - stats.st_mtim.tv_sec < HGFS_DIR_CACHE_SETTLE_TIME ||
+       now - stats.st_ctim.tv_sec < HGFS_DIR_CACHE_SETTLE_TIME) {
+      return FALSE;
+   }
+
+   caseDir = Util_SafeCalloc(1, sizeof *caseDir);
+   caseDir->dirPath = Util_SafeStrdup(dirPath);
+   caseDir->dev = stats.st_dev;
+   caseDir->ino = stats.st_ino;
+   caseDir->mtime = stats.st_mtim;
+   caseDir->ctime = stats.st_ctim;
+   caseDir->names = HashTable_Alloc(HGFS_CASE_CACHE_NAME_BUCKETS,
+                                    HASH_STRING_KEY, free);
+
+   while ((dirent = readdir(dir))) {
+      char *dentryNameU;
+      char *folded;
+      char *names;
+      size_t foldedLen;
+      size_t dentryNameLen = strlen(dirent->d_name);
+
+      if (!Unicode_IsBufferValid(dirent->d_name, dentryNameLen,
+                                 STRING_ENCODING_DEFAULT)) {
+         /* Invalid unicode string, skip the entry. */
+         continue;
+      }
+
+      if (HashTable_GetNumElements(caseDir->names) == HGFS_CASE_CACHE_MAX_NAMES) {
+         LOG(4, ("%s: \"%s\" has too many entries to cache\n", __FUNCTION__,
+                 dirPath));
+         HgfsCaseDirFree(caseDir);
+         rewinddir(dir);
+         return FALSE;
+      }
+
+      dentryNameU = Unicode_Alloc(dirent->d_name, STRING_ENCODING_DEFAULT);
+      folded = Unicode_FoldCase(dentryNameU);
+      free(dentryNameU);
+
+      /* Keep the folded name (the key) and the name on disk together. */
+      foldedLen = strlen(folded);
+      names = Util_SafeMalloc(foldedLen + 1 + dentryNameLen + 1);
+      memcpy(names, folded, foldedLen + 1);
+      memcpy(names + foldedLen + 1, dirent->d_name, dentryNameLen + 1);
+      free(folded);
+
+      /* Like the directory search, the first matching entry wins. */
+      if (!HashTable_Insert(caseDir->names, names, names)) {
+         free(names);
+      }
+   }
+
+   MXUser_AcquireExclLock(gHgfsCaseCacheLock);
+   if (HashTable_Lookup(gHgfsCaseCacheDirs, dirPath, (void **)&oldCaseDir)) {
+      HgfsCaseCacheRemove(oldCaseDir);
+   }
+   while (gHgfsCaseCacheCount >= HGFS_CASE_CACHE_MAX_DIRS) {
+      HgfsCaseCacheRemove(DblLnkLst_Container(gHgfsCaseCacheList.prev,
+                                              HgfsCaseDir, links));
+   }
+   DblLnkLst_Init(&caseDir->links);
+   DblLnkLst_LinkFirst(&gHgfsCaseCacheList, &caseDir->links);
+   HashTable_Insert(gHgfsCaseCacheDirs, caseDir->dirPath, caseDir);
+   gHgfsCaseCacheCount++;
+
+   *ret = HgfsCaseDirConvert(caseDir, foldedComponent,
+                             convertedComponent, convertedComponentSize);
+   MXUser_ReleaseExclLock(gHgfsCaseCacheLock);
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsCaseCacheExit --
+ *
+ *    Frees all cached case mappings and the cache itself.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsCaseCacheExit(void)
+{
+   if (NULL == gHgfsCaseCacheLock) {
+      return;
+   }
+
+   HashTable_Free(gHgfsCaseCacheDirs);
+   gHgfsCaseCacheDirs = NULL;
+   DblLnkLst_Init(&gHgfsCaseCacheList);
+   gHgfsCaseCacheCount = 0;
+
+   MXUser_DestroyExclLock(gHgfsCaseCacheLock);
+   gHgfsCaseCacheLock = NULL;
+}
+#endif // linux
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -1432,6 +1858,9 @@ HgfsConvertComponentCase(char *currentComponent,           // IN
    size_t dentryNameLen;
    char *myConvertedComponent = NULL;
    size_t myConvertedComponentSize;
+#if defined(linux)
+   char *foldedComponent = NULL;
+#endif
    int ret;
 
    ASSERT(currentComponent);
@@ -1439,6 +1868,16 @@ HgfsConvertComponentCase(char *currentComponent,           // IN
    ASSERT(convertedComponent);
    ASSERT(convertedComponentSize);
 
+#if defined(linux)
+   if (Unicode_IsBufferValid(currentComponent, -1, STRING_ENCODING_UTF8)) {
+      foldedComponent = Unicode_FoldCase(currentComponent);
+      if (HgfsCaseCacheLookup(dirPath, foldedComponent, &ret,
+                              convertedComponent, convertedComponentSize)) {
+         goto exit;
+      }
+   }
+#endif
+
    /* Open the specified directory. */
    dir = Posix_OpenDir(dirPath);
    if (!dir) {
@@ -1456,6 +1895,17 @@ HgfsConvertComponentCase(char *currentComponent,           // IN
       goto exit;
    }
 
+#if defined(linux)
+   /*
+    * Resolve the component from the case mapping of the whole directory,
+    * which later lookups in this directory can reuse.
+    */
+   if (HgfsCaseCacheFill(dir, dirPath, foldedComponent, &ret,
+                         convertedComponent, convertedComponentSize)) {
+      goto exit;
+   }
+#endif
+
    /*
     * Read all of the directory entries. For each one, convert the name
     * to lower case and then compare it to the lower case component.
@@ -1514,6 +1964,9 @@ exit:
    if (dir) {
       closedir(dir);
    }
+#if defined(linux)
+   free(foldedComponent);
+#endif
    if (ret) {
       *convertedComponent = NULL;
       *convertedComponentSize = 0;
@@ -3450,17 +3903,16 @@ HgfsConvertToUtf8FormC(char *buffer,         // IN/OUT: name to normalize
 }
 
 
+#if defined(linux)
 /*
  *-----------------------------------------------------------------------------
  *
- * HgfsPlatformGetDirEntry --
+ * HgfsDirSnapshotFree --
  *
- *    Returns the directory entry (or a copy) at the given index. If remove is set
- *    to TRUE, the existing result is also pruned and the remaining results
- *    are shifted up in the result array.
+ *    Closes the snapshot's directory and frees the snapshot.
  *
  * Results:
- *    HGFS_ERROR_SUCCESS or an appropriate error code.
+ *    None.
  *
  * Side effects:
  *    None.
@@ -3468,38 +3920,554 @@ HgfsConvertToUtf8FormC(char *buffer,         // IN/OUT: name to normalize
  *-----------------------------------------------------------------------------
  */
 
-HgfsInternalStatus
-HgfsPlatformGetDirEntry(HgfsSearch *search,               // IN: search
-                        HgfsSessionInfo *session,         // IN: Session info
-                        uint32 index,                     // IN: Offset to retrieve at
-                        Bool remove,                      // IN: If true, removes the result
-                        struct DirectoryEntry **dirEntry) // OUT: dirent
+static void
+HgfsDirSnapshotFree(HgfsDirSnapshot *snapshot)  // IN: snapshot
 {
-   DirectoryEntry *dent = NULL;
-   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+   ASSERT(!snapshot->cached);
+   ASSERT(0 == snapshot->refCount);
 
-   if (index >= search->numDents) {
-      goto out;
+   if (snapshot->dirFd >= 0) {
+      close(snapshot->dirFd);
    }
+   free(snapshot->dirName);
+   free(snapshot->buf);
+   free(snapshot->offsets);
+   free(snapshot);
+}
 
-   /* If we're not removing the result, we need to make a copy of it. */
-   if (remove) {
-      /*
-       * We're going to shift the dents array, overwriting the dent pointer at
-       * offset, so first we need to save said pointer so that we can return it
-       * later to the caller.
-       */
-      dent = search->dents[index];
 
-      if (index < search->numDents - 1) {
-         /* Shift up the remaining results */
-         memmove(&search->dents[index], &search->dents[index + 1],
-                 (search->numDents - (index + 1)) * sizeof search->dents[0]);
-      }
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDirCacheUnlink --
+ *
+ *    Removes a snapshot from the cache. The snapshot is freed once the last
+ *    reference to it is dropped. Called with the cache lock held.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-      /* Decrement the number of results */
-      search->numDents--;
-   } else {
+static void
+HgfsDirCacheUnlink(HgfsDirSnapshot *snapshot)  // IN: snapshot
+{
+   ASSERT(snapshot->cached);
+
+   DblLnkLst_Unlink1(&snapshot->links);
+   snapshot->cached = FALSE;
+   gHgfsDirCacheCount--;
+   gHgfsDirCacheBytes -= snapshot->bufLen;
+
+   if (0 == snapshot->refCount) {
+      HgfsDirSnapshotFree(snapshot);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDirCachePut --
+ *
+ *    Drops a reference obtained from HgfsDirCacheLookup or
+ *    HgfsDirCacheGetByName.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    The snapshot is freed if it was evicted meanwhile.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsDirCachePut(HgfsDirSnapshot *snapshot)  // IN: snapshot
+{
+   MXUser_AcquireExclLock(gHgfsDirCacheLock);
+   ASSERT(snapshot->refCount > 0);
+   snapshot->refCount--;
+   if (0 == snapshot->refCount && !snapshot->cached) {
+      HgfsDirSnapshotFree(snapshot);
+   }
+   MXUser_ReleaseExclLock(gHgfsDirCacheLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDirCacheLookup --
+ *
+ *    Finds the snapshot of the directory described by stats. A snapshot of
+ *    the same directory which is out of date is removed.
+ *
+ * Results:
+ *    The snapshot with a reference held, or NULL.
+ *
+ * Side effects:
+ *    The snapshot becomes the most recently used one.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsDirSnapshot *
+HgfsDirCacheLookup(const struct stat *stats)  // IN: directory attributes
+{
+   DblLnkLst_Links *link;
+   HgfsDirSnapshot *found = NULL;
+
+   if (NULL == gHgfsDirCacheLock) {
+      return NULL;
+   }
+
+   MXUser_AcquireExclLock(gHgfsDirCacheLock);
+   DblLnkLst_ForEach(link, &gHgfsDirCacheList) {
+      HgfsDirSnapshot *snapshot = DblLnkLst_Container(link, HgfsDirSnapshot,
+                                                      links);
+
+      if (snapshot->dev != stats->st_dev || snapshot->ino != stats->st_ino) {
+         continue;
+      }
+
+      if (snapshot->mtime.tv_sec == stats->st_mtim.tv_sec &&
+          snapshot->mtime.tv_nsec == stats->st_mtim.tv_nsec &&
+          snapshot->ctime.tv_sec == stats->st_ctim.tv_sec &&
+          snapshot->ctime.tv_nsec == stats->st_ctim.tv_nsec) {
+         found = snapshot;
+         found->refCount++;
+         DblLnkLst_Unlink1(&found->links);
+         DblLnkLst_LinkFirst(&gHgfsDirCacheList, &found->links);
+      } else {
+         LOG(4, ("%s: dropping stale snapshot of \"%s\"\n", __FUNCTION__,
+                 snapshot->dirName));
+         HgfsDirCacheUnlink(snapshot);
+      }
+      break;
+   }
+   MXUser_ReleaseExclLock(gHgfsDirCacheLock);
+
+   return found;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDirCacheGetByName --
+ *
+ *    Finds the snapshot of the directory currently known by dirName. The name
+ *    is checked to still refer to the snapshot's directory at most every
+ *    HGFS_DIR_CACHE_REVALIDATE_TIME seconds.
+ *
+ * Results:
+ *    The snapshot with a reference held, or NULL.
+ *
+ * Side effects:
+ *    A snapshot whose name now refers to another directory is removed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsDirSnapshot *
+HgfsDirCacheGetByName(const char *dirName)  // IN: directory name
+{
+   DblLnkLst_Links *link;
+   HgfsDirSnapshot *found = NULL;
+   time_t now;
+   struct stat stats;
+
+   if (NULL == gHgfsDirCacheLock) {
+      return NULL;
+   }
+
+   now = time(NULL);
+
+   MXUser_AcquireExclLock(gHgfsDirCacheLock);
+   DblLnkLst_ForEach(link, &gHgfsDirCacheList) {
+      HgfsDirSnapshot *snapshot = DblLnkLst_Container(link, HgfsDirSnapshot,
+                                                      links);
+
+      if (strcmp(snapshot->dirName, dirName) == 0) {
+         found = snapshot;
+         found->refCount++;
+         break;
+      }
+   }
+   MXUser_ReleaseExclLock(gHgfsDirCacheLock);
+
+   if (NULL == found || now - found->validated < HGFS_DIR_CACHE_REVALIDATE_TIME) {
+      return found;
+   }
+
+   if (Posix_Stat(dirName, &stats) == 0 &&
+       stats.st_dev == found->dev &&
+       stats.st_ino == found->ino) {
+      MXUser_AcquireExclLock(gHgfsDirCacheLock);
+      found->validated = now;
+      MXUser_ReleaseExclLock(gHgfsDirCacheLock);
+
+      return found;
+   }
+
+   LOG(4, ("%s: \"%s\" no longer refers to the cached directory\n",
+           __FUNCTION__, dirName));
+   MXUser_AcquireExclLock(gHgfsDirCacheLock);
+   if (found->cached) {
+      HgfsDirCacheUnlink(found);
+   }
+   MXUser_ReleaseExclLock(gHgfsDirCacheLock);
+   HgfsDirCachePut(found);
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDirCacheInsert --
+ *
+ *    Builds a snapshot from the entries just read from the open directory and
+ *    adds it to the cache, evicting the least recently used snapshots as
+ *    needed. On success the snapshot owns dirFd.
+ *
+ * Results:
+ *    TRUE if the snapshot was cached and took dirFd, FALSE otherwise.
+ *
+ * Side effects:
+ *    Any other snapshot of the same directory or name is removed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsDirCacheInsert(const char *dirName,        // IN: directory name
+                   int dirFd,                  // IN: open directory
+                   const struct stat *stats,   // IN: directory attributes
+                   DirectoryEntry **dents,     // IN: entries read
+                   uint32 numDents)            // IN: number of entries
+{
+   HgfsDirSnapshot *snapshot;
+   DblLnkLst_Links *link;
+   DblLnkLst_Links *next;
+   size_t bufLen = 0;
+   size_t offset = 0;
+   time_t now = time(NULL);
+   uint32 i;
+
+   if (NULL == gHgfsDirCacheLock) {
+      return FALSE;
+   }
+
+   /* A directory changed just now may change again unnoticed. */
+   if (now - stats->st_mtim.tv_sec < HGFS_DIR_CACHE_SETTLE_TIME ||
+       now - stats->st_ctim.tv_sec < HGFS_DIR_CACHE_SETTLE_TIME) {
+      return FALSE;
+   }
+
+   for (i = 0; i < numDents; i++) {
+      bufLen += dents[i]->d_reclen;
+   }
+   if (bufLen > HGFS_DIR_CACHE_MAX_BYTES / 2) {
+      return FALSE;
+   }
+
+   snapshot = calloc(1, sizeof *snapshot);
+   if (NULL == snapshot) {
+      return FALSE;
+   }
+   snapshot->dirFd = -1;
+   snapshot->dirName = strdup(dirName);
+   snapshot->buf = malloc(MAX(bufLen, 1));
+   snapshot->offsets = malloc(MAX(numDents, 1) * sizeof *snapshot->offsets);
+   if (NULL == snapshot->dirName ||
+       NULL == snapshot->buf ||
+       NULL == snapshot->offsets) {
+      HgfsDirSnapshotFree(snapshot);
+      return FALSE;
+   }
+
+   for (i = 0; i < numDents; i++) {
+      memcpy(snapshot->buf + offset, dents[i], dents[i]->d_reclen);
+      snapshot->offsets[i] = offset;
+      offset += dents[i]->d_reclen;
+   }
+   snapshot->bufLen = bufLen;
+   snapshot->numDents = numDents;
+   snapshot->dev = stats->st_dev;
+   snapshot->ino = stats->st_ino;
+   snapshot->mtime = stats->st_mtim;
+   snapshot->ctime = stats->st_ctim;
+   snapshot->validated = now;
+   snapshot->dirFd = dirFd;
+
+   MXUser_AcquireExclLock(gHgfsDirCacheLock);
+   DblLnkLst_ForEachSafe(link, next, &gHgfsDirCacheList) {
+      HgfsDirSnapshot *old = DblLnkLst_Container(link, HgfsDirSnapshot, links);
+
+      if ((old->dev == snapshot->dev && old->ino == snapshot->ino) ||
+          strcmp(old->dirName, snapshot->dirName) == 0) {
+         HgfsDirCacheUnlink(old);
+      }
+   }
+
+   while (gHgfsDirCacheCount > 0 &&
+          (gHgfsDirCacheCount >= HGFS_DIR_CACHE_MAX_SNAPSHOTS ||
+           gHgfsDirCacheBytes + bufLen > HGFS_DIR_CACHE_MAX_BYTES)) {
+      HgfsDirCacheUnlink(DblLnkLst_Container(gHgfsDirCacheList.prev,
+                                             HgfsDirSnapshot, links));
+   }
+
+   DblLnkLst_Init(&snapshot->links);
+   DblLnkLst_LinkFirst(&gHgfsDirCacheList, &snapshot->links);
+   snapshot->cached = TRUE;
+   gHgfsDirCacheCount++;
+   gHgfsDirCacheBytes += bufLen;
+   MXUser_ReleaseExclLock(gHgfsDirCacheLock);
+
+   LOG(4, ("%s: cached %u entries of \"%s\"\n", __FUNCTION__, numDents,
+           dirName));
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDirSnapshotCopyDents --
+ *
+ *    Copies the snapshot entries into a newly allocated DirectoryEntry array
+ *    as returned by HgfsPlatformScandir.
+ *
+ * Results:
+ *    Zero on success, ENOMEM on failure.
+ *
+ * Side effects:
+ *    Memory allocation.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsDirSnapshotCopyDents(const HgfsDirSnapshot *snapshot,  // IN: snapshot
+                         DirectoryEntry ***dents,          // OUT: entries
+                         int *numDents)                    // OUT: count
+{
+   DirectoryEntry **myDents;
+   uint32 i;
+
+   myDents = malloc(MAX(snapshot->numDents, 1) * sizeof *myDents);
+   if (NULL == myDents) {
+      return ENOMEM;
+   }
+
+   for (i = 0; i < snapshot->numDents; i++) {
+      const DirectoryEntry *dent =
+         (const DirectoryEntry *)(snapshot->buf + snapshot->offsets[i]);
+
+      myDents[i] = malloc(dent->d_reclen);
+      if (NULL == myDents[i]) {
+         while (i-- > 0) {
+            free(myDents[i]);
+         }
+         free(myDents);
+         return ENOMEM;
+      }
+      memcpy(myDents[i], dent, dent->d_reclen);
+   }
+
+   *dents = myDents;
+   *numDents = snapshot->numDents;
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDirSnapshotGetattr --
+ *
+ *    Gets the attributes of a directory entry relative to the snapshot's
+ *    open directory. Produces the same attributes as
+ *    HgfsPlatformGetattrFromName for fullName without resolving it.
+ *
+ * Results:
+ *    Zero on success.
+ *    Non-zero on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static HgfsInternalStatus
+HgfsDirSnapshotGetattr(const HgfsDirSnapshot *snapshot,  // IN: snapshot
+                       const char *entryName,            // IN: entry name
+                       const char *fullName,             // IN: full entry name
+                       HgfsShareOptions configOptions,   // IN: share options
+                       const char *shareName,            // IN: share name
+                       HgfsFileAttrInfo *attr)           // OUT: attributes
+{
+   struct stat stats;
+   uint64 creationTime;
+   Bool followSymlinks;
+   int openFlags;
+   int fd;
+
+   followSymlinks = HgfsServerPolicy_IsShareOptionSet(configOptions,
+                                                      HGFS_SHARE_FOLLOW_SYMLINKS);
+
+   if (fstatat(snapshot->dirFd, entryName, &stats,
+               followSymlinks ? 0 : AT_SYMLINK_NOFOLLOW) < 0) {
+      HgfsInternalStatus status = errno;
+
+      LOG(4, ("%s: error stating file: %s\n", __FUNCTION__, strerror(status)));
+      return status;
+   }
+
+   if (S_ISDIR(stats.st_mode)) {
+      attr->type = HGFS_FILE_TYPE_DIRECTORY;
+   } else if (S_ISLNK(stats.st_mode)) {
+      attr->type = HGFS_FILE_TYPE_SYMLINK;
+   } else {
+      attr->type = HGFS_FILE_TYPE_REGULAR;
+   }
+
+   creationTime = HgfsGetCreationTime(&stats);
+   HgfsStatToFileAttr(&stats, &creationTime, attr);
+   HgfsGetHiddenAttr(fullName, attr);
+
+   HgfsServerGetOpenFlags(0, &openFlags);
+   if (followSymlinks) {
+      openFlags &= ~O_NOFOLLOW;
+   }
+   fd = openat(snapshot->dirFd, entryName, openFlags | O_RDONLY);
+   if (fd >= 0) {
+      HgfsGetSequentialOnlyFlagFromFd(fd, attr);
+      close(fd);
+   }
+
+   if (!S_ISLNK(stats.st_mode)) {
+      HgfsOpenMode shareMode;
+      HgfsNameStatus nameStatus;
+
+      nameStatus = HgfsServerPolicy_GetShareMode(shareName, strlen(shareName),
+                                                 &shareMode);
+      if (nameStatus == HGFS_NAME_STATUS_COMPLETE) {
+         uint32 permissions = 0;
+
+         if (faccessat(snapshot->dirFd, entryName, R_OK, 0) == 0) {
+            permissions |= HGFS_PERM_READ;
+         }
+         if (faccessat(snapshot->dirFd, entryName, X_OK, 0) == 0) {
+            permissions |= HGFS_PERM_EXEC;
+         }
+         if (shareMode != HGFS_OPEN_MODE_READ_ONLY &&
+             faccessat(snapshot->dirFd, entryName, W_OK, 0) == 0) {
+            permissions |= HGFS_PERM_WRITE;
+         }
+         attr->mask |= HGFS_ATTR_VALID_EFFECTIVE_PERMS;
+         attr->effectivePerms = permissions;
+      }
+   }
+
+   return 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsDirCacheExit --
+ *
+ *    Empties the directory snapshot cache and destroys its lock.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+HgfsDirCacheExit(void)
+{
+   if (NULL == gHgfsDirCacheLock) {
+      return;
+   }
+
+   MXUser_AcquireExclLock(gHgfsDirCacheLock);
+   while (DblLnkLst_IsLinked(&gHgfsDirCacheList)) {
+      HgfsDirCacheUnlink(DblLnkLst_Container(gHgfsDirCacheList.next,
+                                             HgfsDirSnapshot, links));
+   }
+   MXUser_ReleaseExclLock(gHgfsDirCacheLock);
+
+   MXUser_DestroyExclLock(gHgfsDirCacheLock);
+   gHgfsDirCacheLock = NULL;
+}
+#endif // linux
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HgfsPlatformGetDirEntry --
+ *
+ *    Returns the directory entry (or a copy) at the given index. If remove is set
+ *    to TRUE, the existing result is also pruned and the remaining results
+ *    are shifted up in the result array.
+ *
+ * Results:
+ *    HGFS_ERROR_SUCCESS or an appropriate error code.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+HgfsInternalStatus
+HgfsPlatformGetDirEntry(HgfsSearch *search,               // IN: search
+                        HgfsSessionInfo *session,         // IN: Session info
+                        uint32 index,                     // IN: Offset to retrieve at
+                        Bool remove,                      // IN: If true, removes the result
+                        struct DirectoryEntry **dirEntry) // OUT: dirent
+{
+   DirectoryEntry *dent = NULL;
+   HgfsInternalStatus status = HGFS_ERROR_SUCCESS;
+
+   if (index >= search->numDents) {
+      goto out;
+   }
+
+   /* If we're not removing the result, we need to make a copy of it. */
+   if (remove) {
+      /*
+       * We're going to shift the dents array, overwriting the dent pointer at
+       * offset, so first we need to save said pointer so that we can return it
+       * later to the caller.
+       */
+      dent = search->dents[index];
+
+      if (index < search->numDents - 1) {
+         /* Shift up the remaining results */
+         memmove(&search->dents[index], &search->dents[index + 1],
+                 (search->numDents - (index + 1)) * sizeof search->dents[0]);
+      }
+
+      /* Decrement the number of results */
+      search->numDents--;
+   } else {
       DirectoryEntry *originalDent;
       size_t nameLen;
 
@@ -3614,6 +4582,17 @@ HgfsPlatformSetDirEntry(HgfsSearch *search,              // IN: partially valid
                         "to avoid oplock break deadlock\n", __FUNCTION__));
                status = HgfsPlatformGetattrFromFd(fileDesc, session, entryAttr);
             } else {
+#if defined(linux)
+               HgfsDirSnapshot *snapshot = HgfsDirCacheGetByName(search->utf8Dir);
+
+               if (NULL != snapshot) {
+                  status = HgfsDirSnapshotGetattr(snapshot, dirEntry->d_name,
+                                                  fullName, configOptions,
+                                                  search->utf8ShareName,
+                                                  entryAttr);
+                  HgfsDirCachePut(snapshot);
+               } else
+#endif
                status = HgfsPlatformGetattrFromName(fullName, configOptions,
                                                     search->utf8ShareName,
                                                     entryAttr, NULL);
@@ -3763,17 +4742,16 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
 #else
    int fd = -1;
    int openFlags = O_NONBLOCK | O_RDONLY | O_DIRECTORY | O_NOFOLLOW;
+   struct stat dirStats;
+   Bool haveDirStats = FALSE;
 #endif
    int result;
    DirectoryEntry **myDents = NULL;
    int myNumDents = 0;
+   int myMaxDents = 0;
    HgfsInternalStatus status = 0;
-
-   /*
-    * XXX: glibc uses 8192 (BUFSIZ) when it can't get st_blksize from a stat.
-    * Should we follow its lead and use stat to get st_blksize?
-    */
-   char buffer[8192];
+   char *buffer = NULL;
+   size_t bufferSize = HGFS_SCANDIR_BUFFER_MIN;
 
 #if defined(__APPLE__)
    /*
@@ -3817,29 +4795,69 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
       goto exit;
    }
    fd = result;
+
+   if (fstat(fd, &dirStats) == 0) {
+      haveDirStats = TRUE;
+
+      /*
+       * The directory size approximates the space its entries take, so a
+       * buffer of that size typically reads them all in one call.
+       */
+      bufferSize = MAX(bufferSize, (size_t)dirStats.st_blksize);
+      if (dirStats.st_size > 0) {
+         bufferSize = MAX(bufferSize, (size_t)MIN(dirStats.st_size,
+                                                  HGFS_SCANDIR_BUFFER_MAX));
+      }
+      bufferSize = MIN(bufferSize, HGFS_SCANDIR_BUFFER_MAX);
+   }
+
+#if defined(linux)
+   if (haveDirStats) {
+      HgfsDirSnapshot *snapshot = HgfsDirCacheLookup(&dirStats);
+
+      if (NULL != snapshot) {
+         LOG(4, ("%s: using cached entries of \"%s\"\n", __FUNCTION__, baseDir));
+         status = HgfsDirSnapshotCopyDents(snapshot, &myDents, &myNumDents);
+         HgfsDirCachePut(snapshot);
+         goto exit;
+      }
+   }
+#endif
 #endif
 
+   buffer = malloc(bufferSize);
+   if (NULL == buffer) {
+      status = ENOMEM;
+      goto exit;
+   }
+
    /*
     * Rather than read a single dent at a time, batch up multiple dents
     * in each call by using a buffer substantially larger than one dent.
     */
-   while ((result = getdents(fd, (void *)buffer, sizeof buffer)) > 0) {
+   while ((result = getdents(fd, (void *)buffer, bufferSize)) > 0) {
       size_t offset = 0;
       while (offset < result) {
-         DirectoryEntry *newDent, **newDents;
+         DirectoryEntry *newDent;
 
          newDent = (DirectoryEntry *)(buffer + offset);
 
          /* This dent had better fit in the actual space we've got left. */
          ASSERT(newDent->d_reclen <= result - offset);
 
-         /* Add another dent pointer to the dents array. */
-         newDents = realloc(myDents, sizeof *myDents * (myNumDents + 1));
-         if (newDents == NULL) {
-            status = ENOMEM;
-            goto exit;
+         /* Make room for another dent pointer in the dents array. */
+         if (myNumDents == myMaxDents) {
+            DirectoryEntry **newDents;
+            int newMaxDents = MAX(2 * myMaxDents, 64);
+
+            newDents = realloc(myDents, sizeof *myDents * newMaxDents);
+            if (newDents == NULL) {
+               status = ENOMEM;
+               goto exit;
+            }
+            myDents = newDents;
+            myMaxDents = newMaxDents;
          }
-         myDents = newDents;
 
          /*
           * Allocate the new dent and set it up. We do a straight memcpy of
@@ -3881,7 +4899,16 @@ HgfsPlatformScandir(char const *baseDir,            // IN: Directory to search i
       goto exit;
    }
 
+#if defined(linux)
+   /* Keep the entries, and the directory open for stat'ing them. */
+   if (haveDirStats &&
+       HgfsDirCacheInsert(baseDir, fd, &dirStats, myDents, myNumDents)) {
+      fd = -1;
+   }
+#endif
+
   exit:
+   free(buffer);
 #if defined(__APPLE__)
    if (NULL != fd && closedir(fd) < 0) {
 #else
@@ -185,17 +185,18 @@ HgfsFileHasServerLock(const char *utf8Name,             // IN: Name in UTF8
                       fileDesc   *fileDesc)             // OUT: Existing fd
 {
 #ifdef HGFS_OPLOCKS
-   unsigned int i;
+   DblLnkLst_Links *link;
    Bool found = FALSE;
    ASSERT(utf8Name);
 
    ASSERT(session);
-   ASSERT(session->nodeArray);
 
    MXUser_AcquireExclLock(session->nodeArrayLock);
 
-   for (i = 0; i < session->numNodes; i++) {
-      HgfsFileNode *existingFileNode = &session->nodeArray[i];
+   /* Nodes holding a server lock are always on the cached list. */
+   DblLnkLst_ForEach(link, &session->nodeCachedList) {
+      HgfsFileNode *existingFileNode = DblLnkLst_Container(link, HgfsFileNode,
+                                                           links);
 
       if ((existingFileNode->state == FILENODE_STATE_IN_USE_CACHED) &&
           (existingFileNode->serverLock != HGFS_LOCK_NONE) &&
@@ -77,6 +77,15 @@
  */
 #define CONFNAME_GUESTINFO_DISABLEQUERYDISKINFO "disable-query-diskinfo"
 
+/**
+ * Define how much the free space of a partition must change, as a percentage
+ * of its size, before DiskInfo is sent to the host again.
+ *
+ * @param int   Threshold in percent (0-100).  The default, 0, sends DiskInfo
+ *              on any change.
+ */
+#define CONFNAME_GUESTINFO_DISKINFOTHRESHOLD "diskinfo-threshold"
+
 /**
  * Define a custom GuestInfo poll interval (in seconds).
  *
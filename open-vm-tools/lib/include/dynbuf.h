@@ -34,8 +34,16 @@ typedef struct DynBuf {
    char   *data;
    size_t  size;
    size_t  allocated;
+   size_t  maxGrowth;  // 0: DYNBUF_DEFAULT_MAX_GROWTH
 } DynBuf;
 
+/*
+ * Buffers double when they are enlarged, but grow by at most this much
+ * unless DynBuf_SetMaxGrowth() says otherwise.
+ */
+#define DYNBUF_DEFAULT_MAX_GROWTH  (256 * 1024)
+#define DYNBUF_UNBOUNDED_GROWTH    ((size_t)-1)
+
 
 void
 DynBuf_Init(DynBuf *b); // OUT
@@ -54,6 +62,10 @@ DynBuf_Attach(DynBuf *b,    // IN
 void *
 DynBuf_Detach(DynBuf *b); // IN/OUT
 
+void
+DynBuf_SetMaxGrowth(DynBuf *b,         // IN/OUT
+                    size_t maxGrowth); // IN
+
 Bool
 DynBuf_Enlarge(DynBuf *b,        // IN/OUT
                size_t min_size); // IN
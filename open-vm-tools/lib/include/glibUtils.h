@@ -50,6 +50,7 @@ typedef struct GlibLogger {
    gboolean          addsTimestamp; /**< Output adds timestamp automatically. */
    GLogFunc          logfn;         /**< The function that writes to the output. */
    GDestroyNotify    dtor;          /**< Destructor. */
+   void            (*flush)(gpointer data); /**< Flush buffered output. */
 } GlibLogger;
 
 
@@ -57,7 +58,8 @@ GlibLogger *
 GlibUtils_CreateFileLogger(const char *path,
                            gboolean append,
                            guint maxSize,
-                           guint maxFiles);
+                           guint maxFiles,
+                           gboolean async);
 
 GlibLogger *
 GlibUtils_CreateStdLogger(void);
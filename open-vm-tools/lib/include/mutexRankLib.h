@@ -58,7 +58,9 @@
 #define RANK_hgfsNotifyLock          (RANK_libLockBase + 0x4040)
 #define RANK_hgfsFileIOLock          (RANK_libLockBase + 0x4050)
 #define RANK_hgfsSearchArrayLock     (RANK_libLockBase + 0x4060)
+#define RANK_hgfsDirCacheLock        (RANK_libLockBase + 0x4065)
 #define RANK_hgfsNodeArrayLock       (RANK_libLockBase + 0x4070)
+#define RANK_hgfsCaseCacheLock       (RANK_libLockBase + 0x4090)
 
 /*
  * vigor (must be < VMDB range and < disklib, see bug 741290)
@@ -33,6 +33,7 @@
 #include "dynarray.h"
 #if !defined(_WIN32)
 #  include <sys/types.h>
+#  include <glib.h>
 #endif
 #include <time.h>
 
@@ -134,6 +135,11 @@ typedef int Selectable;
 #endif
 
 ProcMgrProcInfoArray *ProcMgr_ListProcesses(void);
+#if defined(linux)
+ProcMgrProcInfoArray *ProcMgr_ListProcessesForPids(const ProcMgr_Pid *pids,
+                                                   size_t numPids);
+ProcMgrProcInfoArray *ProcMgr_ListProcessesAt(int procFd);
+#endif
 void ProcMgr_FreeProcList(ProcMgrProcInfoArray *procList);
 Bool ProcMgr_KillByPid(ProcMgr_Pid procId);
 
@@ -149,6 +155,7 @@ Bool ProcMgr_IsAsyncProcRunning(ProcMgr_AsyncProc *asyncProc);
 int ProcMgr_GetExitCode(ProcMgr_AsyncProc *asyncProc, int *result);
 void ProcMgr_Free(ProcMgr_AsyncProc *asyncProc);
 #if !defined(_WIN32)
+GSource *ProcMgr_NewAsyncProcSource(ProcMgr_AsyncProc *asyncProc);
 Bool ProcMgr_ImpersonateUserStart(const char *user,      // UTF-8
                                   AuthToken token);
 Bool ProcMgr_ImpersonateUserStop(void);
@@ -45,6 +45,11 @@ int SSL_Shutdown(SSLSock ssl);
 int SSL_GetFd(SSLSock sSock);
 int SSL_Pending(SSLSock ssl);
 int SSL_WantRead(const SSLSock ssl);
+Bool SSL_IsEncrypted(const SSLSock ssl);
+#ifndef _WIN32
+struct iovec;
+ssize_t SSL_WriteV(SSLSock ssl, const struct iovec *iov, int iovcnt);
+#endif
 
 
 #ifdef _WIN32
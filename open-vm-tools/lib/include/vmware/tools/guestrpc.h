@@ -125,6 +125,16 @@ typedef void (*RpcChannelResetCb)(RpcChannel *chan,
                                   gboolean success,
                                   gpointer data);
 
+/** Dispatch statistics kept for each registered RPC. */
+typedef struct RpcChannelCallbackStats {
+   /** Number of times the handler was called, including a running call. */
+   guint64           calls;
+   /** Total time spent in the handler, in microseconds. */
+   guint64           totalTimeUs;
+   /** Longest single call to the handler, in microseconds. */
+   guint64           maxTimeUs;
+} RpcChannelCallbackStats;
+
 gboolean
 RpcChannel_Start(RpcChannel *chan);
 
@@ -189,6 +199,11 @@ void
 RpcChannel_UnregisterCallback(RpcChannel *chan,
                               RpcChannelCallback *rpc);
 
+gboolean
+RpcChannel_GetCallbackStats(RpcChannel *chan,
+                            const char *name,
+                            RpcChannelCallbackStats *stats);
+
 gboolean
 RpcChannel_SendOneRaw(const char *data,
                       size_t dataLen,
@@ -52,6 +52,10 @@
  *      default, at most 10 backed up log files will be kept. Value should be >= 1.
  *    - maxLogSize: maximum size of each log file, defaults to 10 (MB). A value of
  *      0 disables log rotation.
+ *    - asyncLog: whether messages are written to the file by a background
+ *      thread, in batches, instead of by the thread logging them. Defaults to
+ *      false. When the in-memory buffer is full, messages are dropped and the
+ *      number of dropped messages is logged once the buffer is written.
  *
  * When using syslog on Unix, the following options are available:
  *
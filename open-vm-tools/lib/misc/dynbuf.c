@@ -55,6 +55,7 @@ DynBuf_Init(DynBuf *b)  // OUT:
    b->data = NULL;
    b->size = 0;
    b->allocated = 0;
+   b->maxGrowth = 0;
 }
 
 
@@ -217,6 +218,39 @@ DynBufRealloc(DynBuf *b,            // IN/OUT:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynBuf_SetMaxGrowth --
+ *
+ *      Set by how much a dynamic buffer grows at most when it is enlarged.
+ *
+ *      A buffer doubles until it reaches 'maxGrowth' bytes, then grows by
+ *      'maxGrowth' bytes at a time. 0 restores the default,
+ *      DYNBUF_DEFAULT_MAX_GROWTH. DYNBUF_UNBOUNDED_GROWTH makes the buffer
+ *      always double, which only pays off for very large buffers where
+ *      realloc() can't grow blocks in place. DynBuf_Init() and
+ *      DynBuf_Destroy() restore the default.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+DynBuf_SetMaxGrowth(DynBuf *b,         // IN/OUT:
+                    size_t maxGrowth)  // IN:
+{
+   ASSERT(b);
+
+   b->maxGrowth = maxGrowth;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -251,10 +285,13 @@ DynBuf_Enlarge(DynBuf *b,       // IN/OUT:
 #else
                         /*
                          * Double the previously allocated size if it is less
-                         * than 256KB; otherwise grow it linearly by 256KB
+                         * than the maximum growth; otherwise grow it linearly
+                         * by that much (256KB by default)
                          */
-                        (b->allocated < 256 * 1024 ? b->allocated * 2
-                                                   : b->allocated + 256 * 1024)
+                        b->allocated +
+                        MIN(b->allocated,
+                            b->maxGrowth ? b->maxGrowth
+                                         : DYNBUF_DEFAULT_MAX_GROWTH)
 #endif
                       :
 #if defined(DYNBUF_DEBUG)
@@ -432,6 +469,7 @@ DynBuf_Copy(DynBuf *src,   // IN:
 
    dest->size = src->size;
    dest->allocated = src->allocated;
+   dest->maxGrowth = src->maxGrowth;
 
    memcpy(dest->data, src->data, src->size);
 
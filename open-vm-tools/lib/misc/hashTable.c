@@ -21,6 +21,12 @@
  *
  *      An implementation of hashtable with no removals.
  *      For string keys.
+ *
+ *      Non-atomic tables grow automatically. When the load exceeds one
+ *      element per bucket, a bucket array twice as large is allocated and
+ *      the entries are moved over a few buckets at a time by subsequent
+ *      insertions and deletions, so no single operation pays for
+ *      rehashing the whole table. Atomic tables keep their initial size.
  */
 
 #include <stdio.h>
@@ -39,7 +45,22 @@
 #include "vm_atomic.h"
 
 
-#define HASH_ROTATE     5
+/*
+ * FNV-1a for string keys, followed by the murmur3 finalizer so that all bits
+ * of the hash (and hence of the bucket index) depend on all bits of the key.
+ */
+#define HASH_FNV_BASIS     2166136261U
+#define HASH_FNV_PRIME     16777619U
+
+/*
+ * Number of old buckets moved to the new bucket array by each insertion or
+ * deletion while a resize is in progress. Must be at least 1 so that a
+ * resize always completes before the table needs to grow again.
+ */
+#define HASH_REHASH_STEP   4
+
+/* Upper bound on the number of buckets of a growing table. */
+#define HASH_MAX_BUCKETS   (1U << 30)
 
 
 /*
@@ -71,6 +92,7 @@ typedef struct HashTableEntry {
    HashTableLink     next;
    const void       *keyStr;
    Atomic_Ptr        clientData;
+   uint32            hash;
 } HashTableEntry;
 
 /*
@@ -86,6 +108,14 @@ struct HashTable {
    HashTableFreeEntryFn   freeEntryFn;
    HashTableLink         *buckets;
 
+   /*
+    * While a resize is in progress, the entries of the old bucket array
+    * below rehashIndex have been moved to "buckets"; the others have not.
+    */
+   HashTableLink         *oldBuckets;
+   uint32                 oldNumEntries;
+   uint32                 rehashIndex;
+
    size_t                 numElements;
 };
 
@@ -104,7 +134,8 @@ HashTableEntry *HashTableLookupOrInsert(HashTable *ht,
  *
  * HashTableComputeHash --
  *
- *      Compute hash value based on key type and hash size.
+ *      Compute hash value based on key type. The bucket index is taken from
+ *      the low bits of the hash; see HashTableBucket.
  *
  * Results:
  *      The hash value.
@@ -116,29 +147,31 @@ HashTableEntry *HashTableLookupOrInsert(HashTable *ht,
  */
 
 static INLINE uint32
-HashTableComputeHash(HashTable *ht,  // IN: hash table
-                     const void *s)  // IN: string to hash
+HashTableComputeHash(const HashTable *ht,  // IN: hash table
+                     const void *s)        // IN: string to hash
 {
-   uint32 h = 0;
+   uint32 h;
 
    switch (ht->keyType) {
    case HASH_STRING_KEY: {
          int c;
-         unsigned char *keyPtr = (unsigned char *) s;
+         const unsigned char *keyPtr = (const unsigned char *) s;
 
+         h = HASH_FNV_BASIS;
          while ((c = *keyPtr++)) {
             h ^= c;
-            h = h << HASH_ROTATE | h >> (32 - HASH_ROTATE);
+            h *= HASH_FNV_PRIME;
          }
       }
       break;
    case HASH_ISTRING_KEY: {
          int c;
-         unsigned char *keyPtr = (unsigned char *) s;
+         const unsigned char *keyPtr = (const unsigned char *) s;
 
+         h = HASH_FNV_BASIS;
          while ((c = tolower(*keyPtr++))) {
             h ^= c;
-            h = h << HASH_ROTATE | h >> (32 - HASH_ROTATE);
+            h *= HASH_FNV_PRIME;
          }
       }
       break;
@@ -150,23 +183,75 @@ HashTableComputeHash(HashTable *ht,  // IN: hash table
       } else {
          h = (uint32) (uintptr_t) s ^ (uint32) ((uint64) (uintptr_t) s >> 32);
       }
-      h *= 48271;  // http://www.google.com/search?q=48271+pseudorandom
       break;
    default:
       NOT_REACHED();
    }
 
-   {
-      int numBits = ht->numBits;
-      uint32 mask = MASK(numBits);
+   h ^= h >> 16;
+   h *= 0x85ebca6b;
+   h ^= h >> 13;
+   h *= 0xc2b2ae35;
+   h ^= h >> 16;
 
-      for (; h > mask; h = (h & mask) ^ (h >> numBits)) {
-      }
-   }
+   return h;
+}
 
-   ASSERT(h < ht->numEntries);
 
-   return h;
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableBucket --
+ *
+ *      Map a hash value to a bucket index of a bucket array.
+ *
+ * Results:
+ *      The bucket index.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE uint32
+HashTableBucket(uint32 hash,        // IN:
+                uint32 numBuckets)  // IN: a power of 2
+{
+   return hash & (numBuckets - 1);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * HashTableGetBuckets --
+ *
+ *      Helper to walk all the entries of a hash table, including the ones
+ *      that have not been moved yet by an in-progress resize: index 0
+ *      returns the current bucket array, index 1 the old one (if any).
+ *
+ * Results:
+ *      The bucket array (NULL if none) and its size in *numBuckets.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE HashTableLink *
+HashTableGetBuckets(const HashTable *ht,   // IN:
+                    int index,             // IN: 0 or 1
+                    uint32 *numBuckets)    // OUT:
+{
+   if (index == 0) {
+      *numBuckets = ht->numEntries;
+      return ht->buckets;
+   }
+
+   *numBuckets = ht->oldNumEntries;
+   return ht->oldBuckets;
 }
 
 
@@ -209,7 +294,8 @@ HashTableEqualKeys(HashTable *ht,     // IN: hash table
  *
  * HashTable_Alloc --
  *
- *      Create a hash table.
+ *      Create a hash table. Unless it is atomic, the table grows as
+ *      elements are added.
  *
  * Results:
  *      The new hashtable.
@@ -221,7 +307,7 @@ HashTableEqualKeys(HashTable *ht,     // IN: hash table
  */
 
 HashTable *
-HashTable_Alloc(uint32 numEntries,        // IN: must be a power of 2
+HashTable_Alloc(uint32 numEntries,        // IN: initial size, a power of 2
                 int keyType,              // IN: whether keys are strings
                 HashTableFreeEntryFn fn)  // IN: free entry function
 {
@@ -247,6 +333,9 @@ HashTable_Alloc(uint32 numEntries,        // IN: must be a power of 2
    ht->copyKey = (keyType & HASH_FLAG_COPYKEY) != 0;
    ht->freeEntryFn = fn;
    ht->buckets = Util_SafeCalloc(ht->numEntries, sizeof *ht->buckets);
+   ht->oldBuckets = NULL;
+   ht->oldNumEntries = 0;
+   ht->rehashIndex = 0;
    ht->numElements = 0;
 
 #ifndef NO_ATOMIC_HASHTABLE
@@ -323,24 +412,35 @@ HashTable_AllocOnce(Atomic_Ptr *var,          // IN/OUT: the atomic var
 static void
 HashTableClearInternal(HashTable *ht)  // IN/OUT:
 {
-   int i;
+   int b;
 
    ht->numElements = 0;
 
-   for (i = 0; i < ht->numEntries; i++) {
-      HashTableEntry *entry;
-
-      while ((entry = ENTRY(ht->buckets[i])) != NULL) {
-         SETENTRY(ht->buckets[i], ENTRY(entry->next));
-         if (ht->copyKey) {
-            free((void *) entry->keyStr);
+   for (b = 0; b < 2; b++) {
+      uint32 numBuckets;
+      HashTableLink *buckets = HashTableGetBuckets(ht, b, &numBuckets);
+      uint32 i;
+
+      for (i = 0; i < numBuckets; i++) {
+         HashTableEntry *entry;
+
+         while ((entry = ENTRY(buckets[i])) != NULL) {
+            SETENTRY(buckets[i], ENTRY(entry->next));
+            if (ht->copyKey) {
+               free((void *) entry->keyStr);
+            }
+            if (ht->freeEntryFn) {
+               ht->freeEntryFn(Atomic_ReadPtr(&entry->clientData));
+            }
+            free(entry);
          }
-         if (ht->freeEntryFn) {
-            ht->freeEntryFn(Atomic_ReadPtr(&entry->clientData));
-         }
-         free(entry);
       }
    }
+
+   free(ht->oldBuckets);
+   ht->oldBuckets = NULL;
+   ht->oldNumEntries = 0;
+   ht->rehashIndex = 0;
 }
 
 
@@ -436,13 +536,24 @@ HashTableLookup(HashTable *ht,       // IN:
                 const void *keyStr,  // IN:
                 uint32 hash)         // IN:
 {
-   HashTableEntry *entry;
+   int b;
+
+   for (b = 0; b < 2; b++) {
+      uint32 numBuckets;
+      HashTableLink *buckets = HashTableGetBuckets(ht, b, &numBuckets);
+      HashTableEntry *entry;
 
-   for (entry = ENTRY(ht->buckets[hash]);
-        entry != NULL;
-        entry = ENTRY(entry->next)) {
-      if (HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
-         return entry;
+      if (buckets == NULL) {
+         break;
+      }
+
+      for (entry = ENTRY(buckets[HashTableBucket(hash, numBuckets)]);
+           entry != NULL;
+           entry = ENTRY(entry->next)) {
+         if (entry->hash == hash &&
+             HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
+            return entry;
+         }
       }
    }
 
@@ -450,6 +561,89 @@ HashTableLookup(HashTable *ht,       // IN:
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashTableRehashStep --
+ *
+ *      If a resize is in progress, move a few more buckets' worth of
+ *      entries from the old bucket array to the new one, and free the
+ *      old array once it is empty.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HashTableRehashStep(HashTable *ht)  // IN/OUT:
+{
+   uint32 step;
+
+   for (step = 0; step < HASH_REHASH_STEP && ht->oldBuckets != NULL; step++) {
+      HashTableLink *oldLink = &ht->oldBuckets[ht->rehashIndex];
+      HashTableEntry *entry;
+
+      while ((entry = ENTRY(*oldLink)) != NULL) {
+         HashTableLink *link =
+            &ht->buckets[HashTableBucket(entry->hash, ht->numEntries)];
+
+         SETENTRY(*oldLink, ENTRY(entry->next));
+         SETENTRY(entry->next, ENTRY(*link));
+         SETENTRY(*link, entry);
+      }
+
+      if (++ht->rehashIndex == ht->oldNumEntries) {
+         free(ht->oldBuckets);
+         ht->oldBuckets = NULL;
+         ht->oldNumEntries = 0;
+         ht->rehashIndex = 0;
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashTableMaybeGrow --
+ *
+ *      Start a resize if the table has more elements than buckets. The
+ *      entries are moved by HashTableRehashStep.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HashTableMaybeGrow(HashTable *ht)  // IN/OUT:
+{
+   if (ht->atomic ||
+       ht->oldBuckets != NULL ||
+       ht->numElements <= ht->numEntries ||
+       ht->numEntries >= HASH_MAX_BUCKETS) {
+      return;
+   }
+
+   ht->oldBuckets = ht->buckets;
+   ht->oldNumEntries = ht->numEntries;
+   ht->rehashIndex = 0;
+
+   ht->numEntries *= 2;
+   ht->numBits++;
+   ht->buckets = Util_SafeCalloc(ht->numEntries, sizeof *ht->buckets);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -539,28 +733,41 @@ HashTable_LookupAndDelete(HashTable *ht,       // IN/OUT: the hash table
                           void **clientData)   // OUT: return data
 {
    uint32 hash = HashTableComputeHash(ht, keyStr);
-   HashTableLink *linkp;
-   HashTableEntry *entry;
+   int b;
 
    ASSERT(!ht->atomic);
 
-   for (linkp = &ht->buckets[hash];
-        (entry = ENTRY(*linkp)) != NULL;
-        linkp = &entry->next) {
-      if (HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
-         SETENTRY(*linkp, ENTRY(entry->next));
-         ht->numElements--;
-         if (ht->copyKey) {
-            free((void *) entry->keyStr);
-         }
-         if (clientData != NULL) {
-            *clientData = Atomic_ReadPtr(&entry->clientData);
-         } else if (ht->freeEntryFn) {
-            ht->freeEntryFn(Atomic_ReadPtr(&entry->clientData));
-         }
-         free(entry);
+   HashTableRehashStep(ht);
 
-         return TRUE;
+   for (b = 0; b < 2; b++) {
+      uint32 numBuckets;
+      HashTableLink *buckets = HashTableGetBuckets(ht, b, &numBuckets);
+      HashTableLink *linkp;
+      HashTableEntry *entry;
+
+      if (buckets == NULL) {
+         break;
+      }
+
+      for (linkp = &buckets[HashTableBucket(hash, numBuckets)];
+           (entry = ENTRY(*linkp)) != NULL;
+           linkp = &entry->next) {
+         if (entry->hash == hash &&
+             HashTableEqualKeys(ht, entry->keyStr, keyStr)) {
+            SETENTRY(*linkp, ENTRY(entry->next));
+            ht->numElements--;
+            if (ht->copyKey) {
+               free((void *) entry->keyStr);
+            }
+            if (clientData != NULL) {
+               *clientData = Atomic_ReadPtr(&entry->clientData);
+            } else if (ht->freeEntryFn) {
+               ht->freeEntryFn(Atomic_ReadPtr(&entry->clientData));
+            }
+            free(entry);
+
+            return TRUE;
+         }
       }
    }
 
@@ -762,9 +969,17 @@ HashTableLookupOrInsert(HashTable *ht,       // IN/OUT:
    HashTableEntry *entry = NULL;
    HashTableEntry *oldEntry = NULL;
    HashTableEntry *head;
+   HashTableLink *bucket;
+
+   if (!ht->atomic) {
+      HashTableRehashStep(ht);
+   }
+
+   /* Atomic tables never resize, so the bucket does not move. */
+   bucket = &ht->buckets[HashTableBucket(hash, ht->numEntries)];
 
 again:
-   head = ENTRY(ht->buckets[hash]);
+   head = ENTRY(*bucket);
 
    oldEntry = HashTableLookup(ht, keyStr, hash);
    if (oldEntry != NULL) {
@@ -785,18 +1000,20 @@ again:
       } else {
          entry->keyStr = keyStr;
       }
+      entry->hash = hash;
       Atomic_WritePtr(&entry->clientData, clientData);
    }
    SETENTRY(entry->next, head);
    if (ht->atomic) {
-      if (!SETENTRYATOMIC(ht->buckets[hash], head, entry)) {
+      if (!SETENTRYATOMIC(*bucket, head, entry)) {
          goto again;
       }
    } else {
-      SETENTRY(ht->buckets[hash], entry);
+      SETENTRY(*bucket, entry);
    }
 
    ht->numElements++;
+   HashTableMaybeGrow(ht);
 
    return NULL;
 }
@@ -857,6 +1074,7 @@ HashTable_KeyArray(const HashTable *ht,  // IN:
 {
    uint32 i;
    size_t j;
+   int b;
 
    ASSERT(ht);
    ASSERT(keys);
@@ -875,13 +1093,18 @@ HashTable_KeyArray(const HashTable *ht,  // IN:
    *keys = Util_SafeMalloc(*size * sizeof **keys);
 
    /* fill array */
-   for (i = 0, j = 0; i < ht->numEntries; i++) {
-      HashTableEntry *entry;
+   for (b = 0, j = 0; b < 2; b++) {
+      uint32 numBuckets;
+      HashTableLink *buckets = HashTableGetBuckets(ht, b, &numBuckets);
 
-      for (entry = ENTRY(ht->buckets[i]);
-           entry != NULL;
-           entry = ENTRY(entry->next)) {
-         (*keys)[j++] = entry->keyStr;
+      for (i = 0; i < numBuckets; i++) {
+         HashTableEntry *entry;
+
+         for (entry = ENTRY(buckets[i]);
+              entry != NULL;
+              entry = ENTRY(entry->next)) {
+            (*keys)[j++] = entry->keyStr;
+         }
       }
    }
 }
@@ -913,6 +1136,7 @@ HashTable_ToArray(const HashTable *ht,  // IN:
 {
    uint32 i;
    size_t j;
+   int b;
 
    ASSERT(ht);
    ASSERT(clientDatas);
@@ -931,13 +1155,19 @@ HashTable_ToArray(const HashTable *ht,  // IN:
    *clientDatas = Util_SafeMalloc(*size * sizeof **clientDatas);
 
    /* fill array */
-   for (i = 0, j = 0; i < ht->numEntries; i++) {
-      HashTableEntry *entry;
-
-      for (entry = ENTRY(ht->buckets[i]);
-           entry != NULL;
-           entry = ENTRY(entry->next)) {
-         (*clientDatas)[j++] = Atomic_ReadPtr(&entry->clientData);
+   for (b = 0, j = 0; b < 2; b++) {
+      uint32 numBuckets;
+      HashTableLink *buckets = HashTableGetBuckets(ht, b, &numBuckets);
+
+      for (i = 0; i < numBuckets; i++) {
+         HashTableEntry *entry;
+
+         for (entry = ENTRY(buckets[i]);
+              entry != NULL;
+              entry = ENTRY(entry->next)) {
+            (*clientDatas)[j++] =
+               Atomic_ReadPtr(&entry->clientData);
+         }
       }
    }
 }
@@ -967,22 +1197,29 @@ HashTable_ForEach(const HashTable *ht,          // IN:
                   HashTableForEachCallback cb,  // IN:
                   void *clientData)             // IN:
 {
-   int i;
+   int b;
 
    ASSERT(ht);
    ASSERT(cb);
 
-   for (i = 0; i < ht->numEntries; i++) {
-      HashTableEntry *entry;
+   for (b = 0; b < 2; b++) {
+      uint32 numBuckets;
+      HashTableLink *buckets = HashTableGetBuckets(ht, b, &numBuckets);
+      uint32 i;
 
-      for (entry = ENTRY(ht->buckets[i]);
-           entry != NULL;
-           entry = ENTRY(entry->next)) {
-         int result = (*cb)(entry->keyStr, Atomic_ReadPtr(&entry->clientData),
-                            clientData);
+      for (i = 0; i < numBuckets; i++) {
+         HashTableEntry *entry;
+
+         for (entry = ENTRY(buckets[i]);
+              entry != NULL;
+              entry = ENTRY(entry->next)) {
+            int result = (*cb)(entry->keyStr,
+                               Atomic_ReadPtr(&entry->clientData),
+                               clientData);
 
-         if (result) {
-            return result;
+            if (result) {
+               return result;
+            }
          }
       }
    }
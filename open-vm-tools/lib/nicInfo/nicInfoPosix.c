@@ -115,6 +115,8 @@
 #include "guestInfo.h"
 #include "xdrutil.h"
 #ifdef USE_SLASH_PROC
+#   include <linux/netlink.h>
+#   include <linux/rtnetlink.h>
 #   include "slashProc.h"
 #endif
 #include "netutil.h"
@@ -391,6 +393,7 @@ RecordNetworkAddress(GuestNicV3 *nic,           // IN: operand NIC
  * @note New GuestNicV3 structures are added to the NicInfoV3 structure.
  *
  * @retval 0    Success.
+ * @retval 1    NIC limit reached, stop iterating.
  * @retval -1   Failure.
  *
  ******************************************************************************
@@ -425,8 +428,9 @@ ReadInterfaceDetails(const struct intf_entry *entry,  // IN: current interface e
          if (NULL == nic) {
             /*
              * We reached maximum number of NICs we can report to the host.
+             * Stop the walk, there's no point querying the rest of them.
              */
-            return 0;
+            return 1;
          }
 
          /* Record the "primary" address. */
@@ -623,6 +627,654 @@ RecordResolverNS(DnsConfigInfo *dnsConfigInfo) // IN
 
 
 #ifdef USE_SLASH_PROC
+/*
+ * Routing table as dumped over rtnetlink, kept between gathers.
+ *
+ * Hosts acting as routers or container nodes may have thousands of routes
+ * and interfaces, and re-reading and regex-parsing /proc/net/route and
+ * /proc/net/ipv6_route on every gather is expensive. Instead, the routes
+ * are dumped once over rtnetlink and cached. A second netlink socket
+ * subscribed to route notifications keeps the cache current; link and
+ * address notifications only matter when they may have removed routes
+ * without notice. The /proc parsers remain as a fallback when netlink
+ * isn't usable.
+ *
+ * Only routes come from netlink. NICs and their addresses are still
+ * enumerated through libdnet on every gather.
+ */
+
+typedef struct NicInfoRoute {
+   int family;                   // AF_INET or AF_INET6
+   int ifIndex;                  // Kernel interface index
+   uint32 table;
+   uint32 metric;
+   uint8 pfxLen;
+   Bool hasGateway;
+   union {
+      struct in_addr in4;
+      struct in6_addr in6;
+   } dst, gateway;
+} NicInfoRoute;
+
+#define NICINFO_NETLINK_BUFSIZE  (32 * 1024)
+
+static GArray *gRouteCache = NULL;
+static int gRouteMonitorFd = -1;
+
+
+/*
+ ******************************************************************************
+ * NetlinkParseNextHops --                                               */ /**
+ *
+ * @brief Append one route per live next hop of a RTA_MULTIPATH attribute.
+ *
+ * @param[in]  rta      The RTA_MULTIPATH attribute.
+ * @param[in]  base     Route with the fields shared by all next hops.
+ * @param[out] routes   Array of NicInfoRoute the routes are appended to.
+ *
+ ******************************************************************************
+ */
+
+static void
+NetlinkParseNextHops(const struct rtattr *rta,       // IN
+                     const NicInfoRoute *base,       // IN
+                     GArray *routes)                 // OUT
+{
+   const struct rtnexthop *rtnh = RTA_DATA(rta);
+   int rtnhLen = RTA_PAYLOAD(rta);
+   size_t addrLen = base->family == AF_INET ? sizeof base->gateway.in4
+                                            : sizeof base->gateway.in6;
+
+   for (; RTNH_OK(rtnh, rtnhLen);
+        rtnhLen -= RTNH_ALIGN(rtnh->rtnh_len), rtnh = RTNH_NEXT(rtnh)) {
+      NicInfoRoute route = *base;
+      const struct rtattr *attr;
+      int attrLen = rtnh->rtnh_len - sizeof *rtnh;
+
+      if ((rtnh->rtnh_flags & RTNH_F_DEAD) || rtnh->rtnh_ifindex <= 0) {
+         continue;
+      }
+
+      route.ifIndex = rtnh->rtnh_ifindex;
+      route.hasGateway = FALSE;
+      for (attr = RTNH_DATA(rtnh);
+           RTA_OK(attr, attrLen);
+           attr = RTA_NEXT(attr, attrLen)) {
+         if (attr->rta_type == RTA_GATEWAY && RTA_PAYLOAD(attr) == addrLen) {
+            memcpy(&route.gateway, RTA_DATA(attr), addrLen);
+            route.hasGateway = TRUE;
+         }
+      }
+      g_array_append_val(routes, route);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * NetlinkParseRoute --                                                  */ /**
+ *
+ * @brief Convert a RTM_NEWROUTE or RTM_DELROUTE message into NicInfoRoutes.
+ *
+ * Only routes that /proc/net/route (main table, IPv4) or
+ * /proc/net/ipv6_route (IPv6) would report through an interface are kept.
+ * A multipath (ECMP) route yields one route per next hop, the way the
+ * kernel reports IPv6 multipath routes in /proc/net/ipv6_route.
+ *
+ * @param[in]  nlh      The netlink message.
+ * @param[out] routes   Array of NicInfoRoute the routes are appended to.
+ *
+ ******************************************************************************
+ */
+
+static void
+NetlinkParseRoute(const struct nlmsghdr *nlh,   // IN
+                  GArray *routes)               // OUT
+{
+   const struct rtmsg *rtm = NLMSG_DATA(nlh);
+   const struct rtattr *rta;
+   const struct rtattr *multipath = NULL;
+   int rtaLen = RTM_PAYLOAD(nlh);
+   NicInfoRoute route;
+   size_t addrLen;
+   uint32 table = rtm->rtm_table;
+
+   if (rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6) {
+      return;
+   }
+   if (rtm->rtm_flags & RTM_F_CLONED) {
+      return;
+   }
+
+   memset(&route, 0, sizeof route);
+   route.family = rtm->rtm_family;
+   route.pfxLen = rtm->rtm_dst_len;
+   addrLen = route.family == AF_INET ? sizeof route.dst.in4
+                                     : sizeof route.dst.in6;
+
+   for (rta = RTM_RTA(rtm); RTA_OK(rta, rtaLen); rta = RTA_NEXT(rta, rtaLen)) {
+      switch (rta->rta_type) {
+      case RTA_DST:
+         if (RTA_PAYLOAD(rta) == addrLen) {
+            memcpy(&route.dst, RTA_DATA(rta), addrLen);
+         }
+         break;
+      case RTA_GATEWAY:
+         if (RTA_PAYLOAD(rta) == addrLen) {
+            memcpy(&route.gateway, RTA_DATA(rta), addrLen);
+            route.hasGateway = TRUE;
+         }
+         break;
+      case RTA_OIF:
+         route.ifIndex = *(int *)RTA_DATA(rta);
+         break;
+      case RTA_PRIORITY:
+         route.metric = *(uint32 *)RTA_DATA(rta);
+         break;
+      case RTA_TABLE:
+         table = *(uint32 *)RTA_DATA(rta);
+         break;
+      case RTA_MULTIPATH:
+         multipath = rta;
+         break;
+      default:
+         break;
+      }
+   }
+
+   if (route.family == AF_INET && table != RT_TABLE_MAIN) {
+      return;
+   }
+   route.table = table;
+
+   if (multipath != NULL) {
+      NetlinkParseNextHops(multipath, &route, routes);
+   } else if (route.ifIndex > 0) {
+      g_array_append_val(routes, route);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * NetlinkDumpRoutes --                                                  */ /**
+ *
+ * @brief Dump the routing table of the given family over rtnetlink.
+ *
+ * @param[in]  family   AF_INET or AF_INET6.
+ * @param[out] routes   Array of NicInfoRoute the routes are appended to.
+ *
+ * @retval TRUE         The whole table was dumped.
+ * @retval FALSE        Something went wrong.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+NetlinkDumpRoutes(int family,       // IN
+                  GArray *routes)   // OUT
+{
+   struct {
+      struct nlmsghdr nlh;
+      struct rtmsg rtm;
+   } req;
+   struct sockaddr_nl snl;
+   char *buf;
+   Bool done = FALSE;
+   Bool ret = FALSE;
+   int fd;
+
+   fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+   if (fd == -1) {
+      g_debug("%s: socket: %s\n", __FUNCTION__, strerror(errno));
+      return FALSE;
+   }
+
+   memset(&snl, 0, sizeof snl);
+   snl.nl_family = AF_NETLINK;
+
+   memset(&req, 0, sizeof req);
+   req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof req.rtm);
+   req.nlh.nlmsg_type = RTM_GETROUTE;
+   req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+   req.nlh.nlmsg_seq = 1;
+   req.rtm.rtm_family = family;
+
+   if (sendto(fd, &req, req.nlh.nlmsg_len, 0, (struct sockaddr *)&snl,
+              sizeof snl) == -1) {
+      g_debug("%s: sendto: %s\n", __FUNCTION__, strerror(errno));
+      close(fd);
+      return FALSE;
+   }
+
+   buf = Util_SafeMalloc(NICINFO_NETLINK_BUFSIZE);
+
+   while (!done) {
+      struct nlmsghdr *nlh;
+      ssize_t len = recv(fd, buf, NICINFO_NETLINK_BUFSIZE, 0);
+
+      if (len == -1 && errno == EINTR) {
+         continue;
+      }
+      if (len <= 0) {
+         g_debug("%s: recv: %s\n", __FUNCTION__, strerror(errno));
+         goto exit;
+      }
+
+      for (nlh = (struct nlmsghdr *)buf;
+           NLMSG_OK(nlh, len);
+           nlh = NLMSG_NEXT(nlh, len)) {
+         if (nlh->nlmsg_type == NLMSG_DONE) {
+            done = TRUE;
+            break;
+         }
+         if (nlh->nlmsg_type == NLMSG_ERROR) {
+            goto exit;
+         }
+         if (nlh->nlmsg_type == RTM_NEWROUTE) {
+            NetlinkParseRoute(nlh, routes);
+         }
+      }
+   }
+
+   ret = TRUE;
+
+exit:
+   free(buf);
+   close(fd);
+   return ret;
+}
+
+
+/*
+ ******************************************************************************
+ * NicInfoRouteSameDest --                                               */ /**
+ *
+ * @brief Tell whether two routes are next hops of the same route, i.e. have
+ * the same table, destination and metric.
+ *
+ * @param[in]  a        A route.
+ * @param[in]  b        Another route.
+ *
+ * @retval TRUE         Same route.
+ * @retval FALSE        Different routes.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+NicInfoRouteSameDest(const NicInfoRoute *a,   // IN
+                     const NicInfoRoute *b)   // IN
+{
+   size_t addrLen = a->family == AF_INET ? sizeof a->dst.in4
+                                         : sizeof a->dst.in6;
+
+   return a->family == b->family &&
+          a->table == b->table &&
+          a->pfxLen == b->pfxLen &&
+          a->metric == b->metric &&
+          memcmp(&a->dst, &b->dst, addrLen) == 0;
+}
+
+
+/*
+ ******************************************************************************
+ * NicInfoRouteEqual --                                                  */ /**
+ *
+ * @brief Tell whether two routes are the same next hop of the same route.
+ *
+ * @param[in]  a        A route.
+ * @param[in]  b        Another route.
+ *
+ * @retval TRUE         Same route and next hop.
+ * @retval FALSE        Otherwise.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+NicInfoRouteEqual(const NicInfoRoute *a,   // IN
+                  const NicInfoRoute *b)   // IN
+{
+   size_t addrLen = a->family == AF_INET ? sizeof a->gateway.in4
+                                         : sizeof a->gateway.in6;
+
+   return NicInfoRouteSameDest(a, b) &&
+          a->ifIndex == b->ifIndex &&
+          a->hasGateway == b->hasGateway &&
+          (!a->hasGateway || memcmp(&a->gateway, &b->gateway, addrLen) == 0);
+}
+
+
+/*
+ ******************************************************************************
+ * RouteCacheApply --                                                    */ /**
+ *
+ * @brief Apply a RTM_NEWROUTE or RTM_DELROUTE notification to the cached
+ * routes.
+ *
+ * New next hops are appended, deleted ones removed. A route replacing
+ * another one (NLM_F_REPLACE) first drops all next hops of the old route.
+ *
+ * @param[in]     nlh      The netlink message.
+ * @param[in,out] routes   Array of NicInfoRoute.
+ *
+ * @retval TRUE         The notification was applied.
+ * @retval FALSE        A route was replaced by one that isn't reported, so
+ *                      the old one can't be told apart; dump the routes.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+RouteCacheApply(const struct nlmsghdr *nlh,   // IN
+                GArray *routes)               // IN/OUT
+{
+   GArray *changed = g_array_new(FALSE, FALSE, sizeof (NicInfoRoute));
+   Bool replace = nlh->nlmsg_type == RTM_NEWROUTE &&
+                  (nlh->nlmsg_flags & NLM_F_REPLACE) != 0;
+   guint i;
+   guint j;
+
+   NetlinkParseRoute(nlh, changed);
+
+   if (replace) {
+      const NicInfoRoute *route;
+
+      if (changed->len == 0) {
+         g_array_free(changed, TRUE);
+         return FALSE;
+      }
+
+      route = &g_array_index(changed, NicInfoRoute, 0);
+      for (j = routes->len; j-- > 0;) {
+         if (NicInfoRouteSameDest(&g_array_index(routes, NicInfoRoute, j),
+                                  route)) {
+            g_array_remove_index(routes, j);
+         }
+      }
+   }
+
+   for (i = 0; i < changed->len; i++) {
+      const NicInfoRoute *route = &g_array_index(changed, NicInfoRoute, i);
+
+      for (j = 0; j < routes->len; j++) {
+         if (NicInfoRouteEqual(&g_array_index(routes, NicInfoRoute, j),
+                               route)) {
+            break;
+         }
+      }
+
+      if (nlh->nlmsg_type == RTM_DELROUTE) {
+         if (j < routes->len) {
+            g_array_remove_index(routes, j);
+         }
+      } else if (j == routes->len) {
+         g_array_append_val(routes, *route);
+      }
+   }
+
+   g_array_free(changed, TRUE);
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * RouteMonitorUpdate --                                                 */ /**
+ *
+ * @brief Apply the route notifications received since the last call to the
+ * cached routes.
+ *
+ * Routes added, replaced and deleted are applied to @a routes one by one.
+ * The kernel does not notify every route it drops, though: routes through
+ * a link that goes down or away, or through an address that is removed,
+ * disappear silently. Such events ask for the routes to be dumped afresh,
+ * as do dropped notifications and a monitor socket that fails.
+ *
+ * The monitor socket is opened on first use. Everything queued on it is
+ * read before returning, so a dump that follows does not miss changes.
+ *
+ * @param[in,out] routes   The cached routes, NULL if there are none.
+ *
+ * @retval TRUE         @a routes may be stale, dump the routes.
+ * @retval FALSE        @a routes is up to date.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+RouteMonitorUpdate(GArray *routes)   // IN/OUT
+{
+   Bool needDump = routes == NULL;
+   char *buf;
+
+   if (gRouteMonitorFd == -1) {
+      struct sockaddr_nl snl;
+      int fd;
+
+      fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                  NETLINK_ROUTE);
+      if (fd == -1) {
+         return TRUE;
+      }
+
+      memset(&snl, 0, sizeof snl);
+      snl.nl_family = AF_NETLINK;
+      snl.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR |
+                      RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+      if (bind(fd, (struct sockaddr *)&snl, sizeof snl) == -1) {
+         g_debug("%s: bind: %s\n", __FUNCTION__, strerror(errno));
+         close(fd);
+         return TRUE;
+      }
+
+      gRouteMonitorFd = fd;
+      return TRUE;
+   }
+
+   buf = Util_SafeMalloc(NICINFO_NETLINK_BUFSIZE);
+
+   for (;;) {
+      struct nlmsghdr *nlh;
+      ssize_t len = recv(gRouteMonitorFd, buf, NICINFO_NETLINK_BUFSIZE,
+                         MSG_DONTWAIT | MSG_TRUNC);
+
+      if (len == -1 && errno == EINTR) {
+         continue;
+      }
+      if (len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+         break;
+      }
+      if (len == -1 && errno == ENOBUFS) {
+         /* Notifications were dropped. */
+         needDump = TRUE;
+         continue;
+      }
+      if (len <= 0) {
+         g_debug("%s: recv: %s\n", __FUNCTION__, strerror(errno));
+         close(gRouteMonitorFd);
+         gRouteMonitorFd = -1;
+         needDump = TRUE;
+         break;
+      }
+      if (len > NICINFO_NETLINK_BUFSIZE) {
+         /* Truncated. */
+         needDump = TRUE;
+      }
+
+      /* Keep draining, but there is no point in applying more changes. */
+      if (needDump) {
+         continue;
+      }
+
+      for (nlh = (struct nlmsghdr *)buf;
+           NLMSG_OK(nlh, len);
+           nlh = NLMSG_NEXT(nlh, len)) {
+         const struct ifinfomsg *ifi;
+
+         switch (nlh->nlmsg_type) {
+         case RTM_NEWROUTE:
+         case RTM_DELROUTE:
+            if (!RouteCacheApply(nlh, routes)) {
+               needDump = TRUE;
+            }
+            break;
+         case RTM_NEWLINK:
+            ifi = NLMSG_DATA(nlh);
+            if ((ifi->ifi_flags & (IFF_UP | IFF_RUNNING)) !=
+                (IFF_UP | IFF_RUNNING)) {
+               needDump = TRUE;
+            }
+            break;
+         case RTM_DELLINK:
+         case RTM_DELADDR:
+            needDump = TRUE;
+            break;
+         default:
+            /* The routes a new address brings are notified themselves. */
+            break;
+         }
+      }
+   }
+
+   free(buf);
+   return needDump;
+}
+
+
+/*
+ ******************************************************************************
+ * GetCachedRoutes --                                                    */ /**
+ *
+ * @brief Return the IPv4 and IPv6 routes, kept current from the route
+ * monitor, dumping them over rtnetlink only when that isn't possible.
+ *
+ * @return The cached routes, or NULL if netlink isn't usable.
+ *
+ ******************************************************************************
+ */
+
+static GArray *
+GetCachedRoutes(void)
+{
+   GArray *routes;
+
+   if (!RouteMonitorUpdate(gRouteCache)) {
+      return gRouteCache;
+   }
+
+   routes = g_array_new(FALSE, FALSE, sizeof (NicInfoRoute));
+   if (!NetlinkDumpRoutes(AF_INET, routes) ||
+       !NetlinkDumpRoutes(AF_INET6, routes)) {
+      g_array_free(routes, TRUE);
+      routes = NULL;
+   }
+
+   if (gRouteCache != NULL) {
+      g_array_free(gRouteCache, TRUE);
+   }
+   gRouteCache = routes;
+
+   return gRouteCache;
+}
+
+
+/*
+ ******************************************************************************
+ * RecordRoutingInfoNetlink --                                           */ /**
+ *
+ * @brief Pack up the cached netlink routes into InetCidrRouteEntries.
+ *
+ * @param[in]  routes   Array of NicInfoRoute.
+ * @param[out] nicInfo  NicInfoV3 container.
+ *
+ * @note Do not call this routine without first populating @a nicInfo 's NIC
+ * list.
+ *
+ ******************************************************************************
+ */
+
+static void
+RecordRoutingInfoNetlink(GArray *routes,        // IN
+                         NicInfoV3 *nicInfo)    // OUT
+{
+   /*
+    * Kernel interface index -> NIC index + 1, 0 if the interface isn't one
+    * of our NICs. Resolving an interface takes a few ioctls, and all routes
+    * usually go through a handful of interfaces.
+    */
+   GHashTable *nicIndexes = g_hash_table_new(NULL, NULL);
+   guint i;
+
+   for (i = 0; i < routes->len; i++) {
+      const NicInfoRoute *route = &g_array_index(routes, NicInfoRoute, i);
+      struct sockaddr_storage ss;
+      InetCidrRouteEntry *icre;
+      gpointer value;
+      int ifIndex;
+
+      /* Check to see if we're going above our limit. See bug 605821. */
+      if (nicInfo->routes.routes_len == NICINFO_MAX_ROUTES) {
+         g_message("%s: route limit (%d) reached, skipping overflow.",
+                   __FUNCTION__, NICINFO_MAX_ROUTES);
+         break;
+      }
+
+      if (!g_hash_table_lookup_extended(nicIndexes,
+                                        GINT_TO_POINTER(route->ifIndex),
+                                        NULL, &value)) {
+         value = GuestInfoGetNicInfoIfIndex(nicInfo, route->ifIndex, &ifIndex) ?
+                 GINT_TO_POINTER(ifIndex + 1) : GINT_TO_POINTER(0);
+         g_hash_table_insert(nicIndexes, GINT_TO_POINTER(route->ifIndex),
+                             value);
+      }
+      if (GPOINTER_TO_INT(value) == 0) {
+         continue;
+      }
+      ifIndex = GPOINTER_TO_INT(value) - 1;
+
+      icre = XDRUTIL_ARRAYAPPEND(nicInfo, routes, 1);
+      ASSERT_MEM_ALLOC(icre);
+
+      memset(&ss, 0, sizeof ss);
+      if (route->family == AF_INET) {
+         struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+
+         sin->sin_family = AF_INET;
+         sin->sin_addr = route->dst.in4;
+         GuestInfoSockaddrToTypedIpAddress((struct sockaddr *)sin,
+                                           &icre->inetCidrRouteDest);
+         if (route->hasGateway) {
+            TypedIpAddress *ip = Util_SafeCalloc(1, sizeof *ip);
+            sin->sin_addr = route->gateway.in4;
+            GuestInfoSockaddrToTypedIpAddress((struct sockaddr *)sin, ip);
+            icre->inetCidrRouteNextHop = ip;
+         }
+      } else {
+         struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+
+         sin6->sin6_family = AF_INET6;
+         sin6->sin6_addr = route->dst.in6;
+         GuestInfoSockaddrToTypedIpAddress((struct sockaddr *)sin6,
+                                           &icre->inetCidrRouteDest);
+         if (route->hasGateway) {
+            TypedIpAddress *ip = Util_SafeCalloc(1, sizeof *ip);
+            sin6->sin6_addr = route->gateway.in6;
+            GuestInfoSockaddrToTypedIpAddress((struct sockaddr *)sin6, ip);
+            icre->inetCidrRouteNextHop = ip;
+         }
+      }
+
+      icre->inetCidrRoutePfxLen = route->pfxLen;
+      icre->inetCidrRouteIfIndex = ifIndex;
+      icre->inetCidrRouteMetric = route->metric;
+   }
+
+   g_hash_table_destroy(nicIndexes);
+}
+
+
 /*
  ******************************************************************************
  * RecordRoutingInfoIPv4 --                                              */ /**
@@ -825,6 +1477,12 @@ RecordRoutingInfo(NicInfoV3 *nicInfo)
 {
    Bool retIPv4 = TRUE;
    Bool retIPv6 = TRUE;
+   GArray *routes = GetCachedRoutes();
+
+   if (routes != NULL) {
+      RecordRoutingInfoNetlink(routes, nicInfo);
+      return TRUE;
+   }
 
    if (File_Exists("/proc/net/route") && !RecordRoutingInfoIPv4(nicInfo)) {
       g_warning("%s: Unable to collect IPv4 routing table.\n", __func__);
@@ -47,6 +47,7 @@
 #include <time.h>
 #include <grp.h>
 #include <sys/syscall.h>
+#include <glib.h>
 #if defined(linux) || defined(__FreeBSD__) || defined(HAVE_SYS_USER_H)
 // sys/param.h is required on FreeBSD before sys/user.h
 #   include <sys/param.h>
@@ -166,12 +167,27 @@ setresgid(gid_t ruid,
 #endif
 
 
+#if defined(linux)
+/*
+ * Per enumeration state of ProcMgrListProcesses.
+ */
+typedef struct ProcMgrListState {
+   int procFd;               // fd of /proc
+   char *buf;                // reused for every /proc/<pid>/ file
+   size_t bufSize;
+   GHashTable *owners;       // uid -> owner name
+   time_t hostStartTime;
+   unsigned long long hertz;
+} ProcMgrListState;
+
+
 /*
  *----------------------------------------------------------------------
  *
- * ProcMgr_ReadProcFile --
+ * ProcMgrReadProcFile --
  *
- *    Read the contents of a file in /proc/<pid>.
+ *    Read the contents of a file in /proc/<pid> into the buffer of the
+ *    enumeration state, growing it as needed.
  *
  *    The size is essentially unbounded because of cmdline arguments.
  *    The only way to figure out the content size is to keep reading;
@@ -189,109 +205,201 @@ setresgid(gid_t ruid,
  *
  * Side effects:
  *
- *    The returned contents must be freed by caller.
+ *    None.
  *
  *----------------------------------------------------------------------
  */
 
-#if defined(linux)
-int
-ProcMgr_ReadProcFile(int fd,                       // IN
-                     char **contents)              // OUT
+static int
+ProcMgrReadProcFile(ProcMgrListState *state,  // IN/OUT
+                    int pidFd,                // IN: fd of /proc/<pid>
+                    const char *fileName)     // IN
 {
-   int size = 0;
-   char tmp[512];
-   int numRead;
+   size_t size = 0;
+   int result = -1;
+   int fd;
+
+   fd = openat(pidFd, fileName, O_RDONLY | O_CLOEXEC);
+   if (-1 == fd) {
+      return -1;
+   }
+
+   for (;;) {
+      ssize_t numRead;
 
-   *contents = NULL;
-   numRead = read(fd, tmp, sizeof(tmp));
-   size = numRead;
+      /*
+       * Keep room for the NUL terminator.
+       */
+      if (state->bufSize - size < 2) {
+         char *newBuf = realloc(state->buf, state->bufSize * 2);
 
-   if (numRead <= 0) {
-      goto done;
+         if (NULL == newBuf) {
+            goto exit;
+         }
+         state->buf = newBuf;
+         state->bufSize *= 2;
+      }
+
+      numRead = read(fd, state->buf + size, state->bufSize - size - 1);
+      if (numRead > 0) {
+         size += numRead;
+      } else if (0 == numRead || size > 0) {
+         break;
+      } else if (EINTR != errno) {
+         goto exit;
+      }
    }
 
+   state->buf[size] = '\0';
+   result = (int) size;
+
+exit:
+   close(fd);
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrParseStartTime --
+ *
+ *    Extract the start time (field 22) from the contents of
+ *    /proc/<pid>/stat.
+ *
+ * Results:
+ *
+ *    TRUE on success.
+ *
+ * Side effects:
+ *
+ *    None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrParseStartTime(const char *stat,                       // IN
+                      unsigned long long *relativeStartTime)  // OUT
+{
    /*
-    * handle the 99% case
+    * Skip over initial process id and process name.  "123 (bash) [...]".
+    * The name may itself contain ')', so look for the last one.
     */
-   if (sizeof(tmp) > numRead) {
-      char *result;
+   const char *p = strrchr(stat, ')');
+   int field;
+   unsigned long long value = 0;
 
-      result = malloc(numRead + 1);
-      if (NULL == result) {
-         size = -1;
-         goto done;
+   if (NULL == p) {
+      return FALSE;
+   }
+   p++;
+
+   /*
+    * The process name was field 2; skip over fields 3 to 21.
+    */
+   for (field = 2; field < 22; field++) {
+      while (' ' == *p) {
+         p++;
       }
-      memcpy(result, tmp, numRead);
-      result[numRead] = '\0';
-      *contents = result;
-      goto done;
-   } else {
-      DynBuf dbuf;
-
-      DynBuf_Init(&dbuf);
-      DynBuf_Append(&dbuf, tmp, numRead);
-      do {
-         numRead = read(fd, tmp, sizeof(tmp));
-         if (numRead > 0) {
-            DynBuf_Append(&dbuf, tmp, numRead);
+      if ('\0' == *p) {
+         return FALSE;
+      }
+      if (field < 21) {
+         while ('\0' != *p && ' ' != *p) {
+            p++;
          }
-         size += numRead;
-      } while (numRead > 0);
-      // add the NUL term
-      DynBuf_Append(&dbuf, "", 1);
-      DynBuf_Trim(&dbuf);
-      *contents = DynBuf_Detach(&dbuf);
-      DynBuf_Destroy(&dbuf);
-   }
-done:
-   return size;
+      }
+   }
+
+   if (*p < '0' || *p > '9') {
+      return FALSE;
+   }
+
+   for (; *p >= '0' && *p <= '9'; p++) {
+      value = value * 10 + (*p - '0');
+   }
+
+   *relativeStartTime = value;
+   return TRUE;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * ProcMgr_ListProcesses --
+ * ProcMgrGetOwner --
  *
- *      List all the processes that the calling client has privilege to
- *      enumerate. The strings in the returned structure should be all
- *      UTF-8 encoded, although we do not enforce it right now.
+ *    Get the name of the user owning a process. Lookups are cached for
+ *    the duration of the enumeration, as most processes are owned by a
+ *    handful of users.
  *
  * Results:
- *      
- *      A ProcMgrProcInfoArray.
+ *
+ *    The owner name, or the uid as a string if it has no name. Must be
+ *    freed by the caller.
  *
  * Side effects:
  *
+ *    None.
+ *
  *----------------------------------------------------------------------
  */
 
-ProcMgrProcInfoArray *
-ProcMgr_ListProcesses(void)
+static char *
+ProcMgrGetOwner(ProcMgrListState *state,  // IN/OUT
+                uid_t uid)                // IN
+{
+   char *owner = g_hash_table_lookup(state->owners, GUINT_TO_POINTER(uid));
+
+   if (NULL == owner) {
+      struct passwd *pwd = getpwuid(uid);
+
+      owner = (NULL == pwd)
+              ? Str_SafeAsprintf(NULL, "%d", (int) uid)
+              : Unicode_Alloc(pwd->pw_name, STRING_ENCODING_DEFAULT);
+      g_hash_table_insert(state->owners, GUINT_TO_POINTER(uid), owner);
+   }
+
+   return Util_SafeStrdup(owner);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrGetHostStartTime --
+ *
+ *    Figure out when the system started.  We need this number to
+ *    compute process start times, which are relative to this number.
+ *    We grab the first float in /proc/uptime, convert it to an integer,
+ *    and then subtract that from the current time.  That leaves us
+ *    with the seconds since epoch that the system booted up.
+ *
+ *    Also figure out the "hertz" value, which may be radically
+ *    different than the actual CPU frequency of the machine.
+ *    The process start time is expressed in terms of this value.
+ *
+ *    Both are computed once and kept in static variables.
+ *
+ * Results:
+ *
+ *    None.
+ *
+ * Side effects:
+ *
+ *    None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ProcMgrGetHostStartTime(time_t *startTime,         // OUT
+                        unsigned long long *hz)    // OUT
 {
-   ProcMgrProcInfoArray *procList = NULL;
-   ProcMgrProcInfo procInfo;
-   Bool failed = TRUE;
-   DIR *dir;
-   struct dirent *ent;
    static time_t hostStartTime = 0;
    static unsigned long long hertz = 100;
-   int numberFound;
-
-   procList = Util_SafeCalloc(1, sizeof *procList);
-   ProcMgrProcInfoArray_Init(procList, 0);
-   procInfo.procCmdName = NULL;
-   procInfo.procCmdLine = NULL;
-   procInfo.procOwner = NULL;
 
-   /*
-    * Figure out when the system started.  We need this number to
-    * compute process start times, which are relative to this number.
-    * We grab the first float in /proc/uptime, convert it to an integer,
-    * and then subtract that from the current time.  That leaves us
-    * with the seconds since epoch that the system booted up.
-    */
    if (0 == hostStartTime) {
       FILE *uptimeFile = NULL;
 
@@ -299,6 +407,7 @@ ProcMgr_ListProcesses(void)
       if (NULL != uptimeFile) {
          double secondsSinceBoot;
          char *realLocale;
+         int numberFound;
 
          /*
           * Set the locale such that floats are delimited with ".".
@@ -317,12 +426,6 @@ ProcMgr_ListProcesses(void)
          fclose(uptimeFile);
       }
 
-      /*
-       * Figure out the "hertz" value, which may be radically
-       * different than the actual CPU frequency of the machine.
-       * The process start time is expressed in terms of this value,
-       * so let's compute it now and keep it in a static variable.
-       */
 #ifdef HZ
       hertz = (unsigned long long) HZ;
 #else
@@ -332,274 +435,298 @@ ProcMgr_ListProcesses(void)
 #endif
    } // if (0 == hostStartTime)
 
+   *startTime = hostStartTime;
+   *hz = hertz;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrGetProcInfo --
+ *
+ *    Collect the information of one process. Everything is read
+ *    relative to /proc/<pid>, so the path is only resolved once.
+ *
+ * Results:
+ *
+ *    TRUE if the process info was filled in. FALSE if the process went
+ *    away or we lack the permission to look at it.
+ *
+ * Side effects:
+ *
+ *    None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+ProcMgrGetProcInfo(ProcMgrListState *state,   // IN/OUT
+                   const char *pidName,       // IN: /proc entry name
+                   ProcMgrProcInfo *procInfo) // OUT
+{
+   struct stat fileStat;
+   int pidFd;
+   int numRead;
+   unsigned long long relativeStartTime;
+   Bool success = FALSE;
+
+   procInfo->procCmdName = NULL;
+   procInfo->procCmdLine = NULL;
+   procInfo->procOwner = NULL;
+
+   pidFd = openat(state->procFd, pidName, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (-1 == pidFd) {
+      return FALSE;
+   }
+
    /*
-    * Scan /proc for any directory that is all numbers.
-    * That represents a process id.
+    * Read in the command and its arguments.  Arguments are separated
+    * by \0, which we convert to ' '.  Then we add a NULL terminator
+    * at the end.  Example: "perl -cw try.pl" is read in as
+    * "perl\0-cw\0try.pl\0", which we convert to "perl -cw try.pl\0".
+    * It would have been nice to preserve the NUL character so it is easy
+    * to determine what the command line arguments are without
+    * using a quote and space parsing heuristic.  But we do this
+    * to have parity with how Windows reports the command line.
+    * In the future, we could keep the NUL version around and pass it
+    * back to the client for easier parsing when retrieving individual
+    * command line parameters is needed.
+    *
+    * We may not be able to open the file due to the security reason.
+    * In that case, just ignore the process.
     */
-   dir = opendir("/proc");
-   if (NULL == dir) {
-      Warning("ProcMgr_ListProcesses unable to open /proc\n");
-      goto abort;
+   numRead = ProcMgrReadProcFile(state, pidFd, "cmdline");
+   if (numRead < 0) {
+      goto exit;
    }
 
-   while ((ent = readdir(dir))) {
-      struct stat fileStat;
-      char cmdFilePath[1024];
-      int statResult;
-      int numRead = 0;   /* number of bytes that read() actually read */
-      int cmdFd;
+   if (numRead > 0) {
+      char *cmdLine = state->buf;
       int replaceLoop;
-      struct passwd *pwd;
-      char *cmdLineTemp = NULL;
-      char *cmdStatTemp = NULL;
-      size_t strLen = 0;
-      unsigned long long dummy;
-      unsigned long long relativeStartTime;
-      char *stringBegin;
-      char *cmdNameBegin;
-      Bool cmdNameLookup = TRUE;
 
       /*
-       * We only care about dirs that look like processes.
+       * Stop before we hit the final '\0'; want to leave it alone.
        */
-      if (strspn(ent->d_name, "0123456789") != strlen(ent->d_name)) {
-         continue;
-      }
+      for (replaceLoop = 0 ; replaceLoop < (numRead - 1) ; replaceLoop++) {
+         if ('\0' == cmdLine[replaceLoop]) {
+            if (NULL == procInfo->procCmdName) {
+               /*
+                * Store the command name.
+                * Find the last path separator, to get the cmd name.
+                * If no separator is found, then use the whole name.
+                */
+               char *cmdNameBegin = strrchr(cmdLine, '/');
 
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/cmdline",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         continue;
-      }
-      
-      cmdFd = open(cmdFilePath, O_RDONLY);
-      if (-1 == cmdFd) {
-         /*
-          * We may not be able to open the file due to the security reason.
-          * In that case, just ignore and continue.
-          */
-         continue;
+               if (NULL == cmdNameBegin) {
+                  cmdNameBegin = cmdLine;
+               } else {
+                  /*
+                   * Skip over the last separator.
+                   */
+                  cmdNameBegin++;
+               }
+               procInfo->procCmdName = Unicode_Alloc(cmdNameBegin,
+                                                     STRING_ENCODING_DEFAULT);
+            }
+            cmdLine[replaceLoop] = ' ';
+         }
       }
 
+      procInfo->procCmdLine = Unicode_Alloc(cmdLine, STRING_ENCODING_DEFAULT);
+   } else {
       /*
-       * Read in the command and its arguments.  Arguments are separated
-       * by \0, which we convert to ' '.  Then we add a NULL terminator
-       * at the end.  Example: "perl -cw try.pl" is read in as
-       * "perl\0-cw\0try.pl\0", which we convert to "perl -cw try.pl\0".
-       * It would have been nice to preserve the NUL character so it is easy
-       * to determine what the command line arguments are without
-       * using a quote and space parsing heuristic.  But we do this
-       * to have parity with how Windows reports the command line.
-       * In the future, we could keep the NUL version around and pass it
-       * back to the client for easier parsing when retrieving individual
-       * command line parameters is needed.
+       * Some procs don't have a command line text, so read a name from
+       * the 'status' file (should be the first line), and use it as the
+       * command line too. If unable to get a name, the process is still
+       * real, so it should be included in the list, just without a name.
        */
-      numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
-      close(cmdFd);
+      if (ProcMgrReadProcFile(state, pidFd, "status") > 0) {
+         /*
+          * Extract the part with just the name, by reading until the first
+          * space, then reading the next non-space word after that, and
+          * ignoring everything else. The format looks like this:
+          *     "^Name:[ \t]*(.*)$"
+          * for example:
+          *     "Name:    nfsd"
+          */
+         char *nameStart;
+         char *nameEnd;
 
-      if (numRead < 0) {
-         continue;
-      }
+         nameStart = state->buf + strcspn(state->buf, " \t\n");
+         nameStart += strspn(nameStart, " \t\n");
+         nameEnd = nameStart + strcspn(nameStart, "\n");
+         *nameEnd = '\0';
 
-      if (numRead > 0) {
          /*
-          * Stop before we hit the final '\0'; want to leave it alone.
+          * Store the command name.
           */
-         for (replaceLoop = 0 ; replaceLoop < (numRead - 1) ; replaceLoop++) {
-            if ('\0' == cmdLineTemp[replaceLoop]) {
-               if (cmdNameLookup) {
-                  /*
-                   * Store the command name.
-                   * Find the last path separator, to get the cmd name.
-                   * If no separator is found, then use the whole name.
-                   */
-                  cmdNameBegin = strrchr(cmdLineTemp, '/');
-                  if (NULL == cmdNameBegin) {
-                     cmdNameBegin = cmdLineTemp;
-                  } else {
-                     /*
-                      * Skip over the last separator.
-                      */
-                     cmdNameBegin++;
-                  }
-                  procInfo.procCmdName = Unicode_Alloc(cmdNameBegin, STRING_ENCODING_DEFAULT);
-                  cmdNameLookup = FALSE;
-               }
-               cmdLineTemp[replaceLoop] = ' ';
-            }
-         }
+         procInfo->procCmdName = Unicode_Alloc(nameStart,
+                                               STRING_ENCODING_DEFAULT);
+         procInfo->procCmdLine = Unicode_Alloc(nameStart,
+                                               STRING_ENCODING_DEFAULT);
       } else {
-         /*
-          * Some procs don't have a command line text, so read a name from
-          * the 'status' file (should be the first line). If unable to get a name,
-          * the process is still real, so it should be included in the list, just 
-          * without a name.
-          */
-         cmdFd = -1;
-         numRead = 0;
-
-         if (snprintf(cmdFilePath,
-                      sizeof cmdFilePath,
-                      "/proc/%s/status",
-                      ent->d_name) != -1) {
-            cmdFd = open(cmdFilePath, O_RDONLY);
-         }
-         if (cmdFd != -1) {
-            numRead = ProcMgr_ReadProcFile(cmdFd, &cmdLineTemp);
-            close(cmdFd);
-         }
-         if (numRead > 0) {
-            /*
-             * Extract the part with just the name, by reading until the first
-             * space, then reading the next non-space word after that, and
-             * ignoring everything else. The format looks like this:
-             *     "^Name:[ \t]*(.*)$"
-             * for example:
-             *     "Name:    nfsd"
-             */
-            const char *nameStart;
-            char *copyItr;
-
-            /* Skip non-whitespace. */
-            for (nameStart = cmdLineTemp; *nameStart && 
-                                          *nameStart != ' ' &&
-                                          *nameStart != '\t' &&
-                                          *nameStart != '\n'; ++nameStart);
-            /* Skip whitespace. */
-            for (;*nameStart && 
-                  (*nameStart == ' ' ||
-                   *nameStart == '\t' ||
-                   *nameStart == '\n'); ++nameStart);
-            /* Copy the name to the start of the string and null term it. */
-            for (copyItr = cmdLineTemp; *nameStart && *nameStart != '\n';) {
-               *(copyItr++) = *(nameStart++);
-            }
-            *copyItr = '\0';
-            /*
-             * Store the command name.
-             */
-            procInfo.procCmdName = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
-         }
+         procInfo->procCmdLine = Unicode_Alloc("", STRING_ENCODING_UTF8);
       }
+   }
 
-      /*
-       * Get the inode information for this process.  This gives us
-       * the process owner.
-       */
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         goto next_entry;
-      }
+   /*
+    * fstat() /proc/<pid> to get the owner.  If we can't, ignore the
+    * process.  Maybe we don't have enough permission.
+    */
+   if (0 != fstat(pidFd, &fileStat)) {
+      goto exit;
+   }
 
-      /*
-       * stat() /proc/<pid> to get the owner.  We use fileStat.st_uid
-       * later in this code.  If we can't stat(), ignore and continue.
-       * Maybe we don't have enough permission.
-       */
-      statResult = stat(cmdFilePath, &fileStat);
-      if (0 != statResult) {
-         goto next_entry;
-      }
+   /*
+    * Figure out the process start time.  Read /proc/<pid>/stat
+    * and compute the start time in absolute time.
+    */
+   if (0 >= ProcMgrReadProcFile(state, pidFd, "stat") ||
+       !ProcMgrParseStartTime(state->buf, &relativeStartTime)) {
+      goto exit;
+   }
 
-      /*
-       * Figure out the process start time.  Open /proc/<pid>/stat
-       * and read the start time and compute it in absolute time.
-       */
-      if (snprintf(cmdFilePath,
-                   sizeof cmdFilePath,
-                   "/proc/%s/stat",
-                   ent->d_name) == -1) {
-         Debug("Giant process id '%s'\n", ent->d_name);
-         goto next_entry;
-      }
-      cmdFd = open(cmdFilePath, O_RDONLY);
-      if (-1 == cmdFd) {
-         goto next_entry;
-      }
-      numRead = ProcMgr_ReadProcFile(cmdFd, &cmdStatTemp);
-      close(cmdFd);
-      if (0 >= numRead) {
-         goto next_entry;
-      }
-      /*
-       * Skip over initial process id and process name.  "123 (bash) [...]".
-       */
-      stringBegin = strchr(cmdStatTemp, ')') + 2;
-
-      numberFound = sscanf(stringBegin, "%c %d %d %d %d %d "
-                           "%lu %lu %lu %lu %lu %Lu %Lu %Lu %Lu %ld %ld "
-                           "%d %ld %Lu",
-                           (char *) &dummy, (int *) &dummy, (int *) &dummy,
-                           (int *) &dummy, (int *) &dummy,  (int *) &dummy,
-                           (unsigned long *) &dummy, (unsigned long *) &dummy,
-                           (unsigned long *) &dummy, (unsigned long *) &dummy,
-                           (unsigned long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (unsigned long long *) &dummy,
-                           (long *) &dummy, (long *) &dummy,
-                           (int *) &dummy, (long *) &dummy,
-                           &relativeStartTime);
-      if (20 != numberFound) {
-         goto next_entry;
-      }
+   procInfo->procId = (pid_t) atoi(pidName);
+   procInfo->procOwner = ProcMgrGetOwner(state, fileStat.st_uid);
+   procInfo->procStartTime = state->hostStartTime +
+                             (relativeStartTime / state->hertz);
+   success = TRUE;
 
-      /*
-       * Store the command line string pointer in dynbuf.
-       */
-      if (cmdLineTemp) {
-         procInfo.procCmdLine = Unicode_Alloc(cmdLineTemp, STRING_ENCODING_DEFAULT);
-      } else {
-         procInfo.procCmdLine = Unicode_Alloc("", STRING_ENCODING_UTF8);
-      }
+exit:
+   close(pidFd);
 
-      /*
-       * Store the pid in dynbuf.
-       */
-      procInfo.procId = (pid_t) atoi(ent->d_name);
+   if (!success) {
+      free(procInfo->procCmdName);
+      free(procInfo->procCmdLine);
+      procInfo->procCmdName = NULL;
+      procInfo->procCmdLine = NULL;
+   }
 
-      /*
-       * Store the owner of the process.
-       */
-      pwd = getpwuid(fileStat.st_uid);
-      procInfo.procOwner = (NULL == pwd)
-                           ? Str_SafeAsprintf(&strLen, "%d", (int) fileStat.st_uid)
-                           : Unicode_Alloc(pwd->pw_name, STRING_ENCODING_DEFAULT);
+   return success;
+}
 
-      /*
-       * Store the time that the process started.
-       */
-      procInfo.procStartTime = hostStartTime + (relativeStartTime / hertz);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrListProcesses --
+ *
+ *      List the given processes, or all of them if pids is NULL, that
+ *      the calling client has privilege to enumerate. The processes are
+ *      read from the /proc style tree open at procFd, which stays open.
+ *
+ * Results:
+ *
+ *      A ProcMgrProcInfoArray, NULL on failure. When listing all
+ *      processes, finding none is a failure.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ProcMgrProcInfoArray *
+ProcMgrListProcesses(int procFd,               // IN: fd of /proc
+                     const ProcMgr_Pid *pids,  // IN/OPT
+                     size_t numPids)           // IN
+{
+   ProcMgrProcInfoArray *procList = NULL;
+   ProcMgrProcInfo procInfo;
+   ProcMgrListState state;
+   Bool failed = TRUE;
+   DIR *dir = NULL;
+
+   procInfo.procCmdName = NULL;
+   procInfo.procCmdLine = NULL;
+   procInfo.procOwner = NULL;
+
+   state.procFd = procFd;
+   state.bufSize = 4096;
+   state.buf = Util_SafeMalloc(state.bufSize);
+   state.owners = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                        NULL, free);
+   ProcMgrGetHostStartTime(&state.hostStartTime, &state.hertz);
+
+   procList = Util_SafeCalloc(1, sizeof *procList);
+   ProcMgrProcInfoArray_Init(procList, 0);
+
+   if (NULL != pids) {
+      size_t i;
+
+      for (i = 0; i < numPids; i++) {
+         char pidName[32];
+
+         Str_Sprintf(pidName, sizeof pidName, "%"FMTPID, pids[i]);
+         if (!ProcMgrGetProcInfo(&state, pidName, &procInfo)) {
+            continue;
+         }
+
+         if (!ProcMgrProcInfoArray_Push(procList, procInfo)) {
+            Warning("%s: failed to expand DynArray - out of memory\n",
+                    __FUNCTION__);
+            goto abort;
+         }
+         procInfo.procCmdName = NULL;
+         procInfo.procCmdLine = NULL;
+         procInfo.procOwner = NULL;
+      }
+
+      failed = FALSE;
+   } else {
+      struct dirent *ent;
 
       /*
-       * Store the process info pointer into a list buffer.
+       * Scan /proc for any directory that is all numbers.
+       * That represents a process id. The directory stream gets its own
+       * fd, so the /proc fd stays usable for openat(). The dup shares
+       * the file offset with procFd, so rewind in case procFd was listed
+       * before.
        */
-      if (!ProcMgrProcInfoArray_Push(procList, procInfo)) {
-         Warning("%s: failed to expand DynArray - out of memory\n",
-                 __FUNCTION__);
+      dir = fdopendir(dup(state.procFd));
+      if (NULL == dir) {
+         Warning("ProcMgr_ListProcesses unable to open /proc\n");
          goto abort;
       }
-      procInfo.procCmdName = NULL;
-      procInfo.procCmdLine = NULL;
-      procInfo.procOwner = NULL;
+      rewinddir(dir);
 
-next_entry:
-      free(cmdLineTemp);
-      free(cmdStatTemp);
-   } // while readdir
+      while ((ent = readdir(dir))) {
+         /*
+          * We only care about dirs that look like processes.
+          */
+         if (ent->d_name[0] < '0' || ent->d_name[0] > '9' ||
+             ent->d_name[strspn(ent->d_name, "0123456789")] != '\0') {
+            continue;
+         }
 
-   if (0 < ProcMgrProcInfoArray_Count(procList)) {
-      failed = FALSE;
+         if (!ProcMgrGetProcInfo(&state, ent->d_name, &procInfo)) {
+            continue;
+         }
+
+         /*
+          * Store the process info pointer into a list buffer.
+          */
+         if (!ProcMgrProcInfoArray_Push(procList, procInfo)) {
+            Warning("%s: failed to expand DynArray - out of memory\n",
+                    __FUNCTION__);
+            goto abort;
+         }
+         procInfo.procCmdName = NULL;
+         procInfo.procCmdLine = NULL;
+         procInfo.procOwner = NULL;
+      }
+
+      if (0 < ProcMgrProcInfoArray_Count(procList)) {
+         failed = FALSE;
+      }
    }
 
 abort:
-   closedir(dir);
+   if (NULL != dir) {
+      closedir(dir);
+   }
+   free(state.buf);
+   g_hash_table_destroy(state.owners);
 
    free(procInfo.procCmdName);
    free(procInfo.procCmdLine);
@@ -612,6 +739,123 @@ abort:
 
    return procList;
 }
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrListProcFs --
+ *
+ *      ProcMgrListProcesses on /proc.
+ *
+ * Results:
+ *
+ *      A ProcMgrProcInfoArray, NULL on failure.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ProcMgrProcInfoArray *
+ProcMgrListProcFs(const ProcMgr_Pid *pids,  // IN/OPT
+                  size_t numPids)           // IN
+{
+   ProcMgrProcInfoArray *procList;
+   int procFd;
+
+   procFd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (-1 == procFd) {
+      Warning("ProcMgr_ListProcesses unable to open /proc\n");
+      return NULL;
+   }
+
+   procList = ProcMgrListProcesses(procFd, pids, numPids);
+   close(procFd);
+
+   return procList;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_ListProcesses --
+ *
+ *      List all the processes that the calling client has privilege to
+ *      enumerate. The strings in the returned structure should be all
+ *      UTF-8 encoded, although we do not enforce it right now.
+ *
+ * Results:
+ *      
+ *      A ProcMgrProcInfoArray.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
+
+ProcMgrProcInfoArray *
+ProcMgr_ListProcesses(void)
+{
+   return ProcMgrListProcFs(NULL, 0);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_ListProcessesAt --
+ *
+ *      List all the processes of the /proc style tree open at procFd,
+ *      as ProcMgr_ListProcesses() does for /proc. This lets tests and
+ *      benchmarks run the enumeration on a synthetic tree.
+ *
+ * Results:
+ *
+ *      A ProcMgrProcInfoArray, NULL on failure.
+ *
+ * Side effects:
+ *
+ *      None. procFd is not closed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+ProcMgrProcInfoArray *
+ProcMgr_ListProcessesAt(int procFd)  // IN: fd of the tree
+{
+   return ProcMgrListProcesses(procFd, NULL, 0);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_ListProcessesForPids --
+ *
+ *      List the given processes. Only the /proc entries of the requested
+ *      pids are read; pids that do not exist or that the calling client
+ *      has no privilege to enumerate are left out of the result.
+ *      The strings are encoded as for ProcMgr_ListProcesses().
+ *
+ * Results:
+ *      
+ *      A ProcMgrProcInfoArray, possibly empty. NULL on failure.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
+
+ProcMgrProcInfoArray *
+ProcMgr_ListProcessesForPids(const ProcMgr_Pid *pids,  // IN
+                             size_t numPids)           // IN
+{
+   ASSERT(pids != NULL);
+
+   return ProcMgrListProcFs(pids, numPids);
+}
 #endif // defined(linux)
 
 
@@ -1987,6 +2231,158 @@ exit:
 }
 
 
+/*
+ * Event source that fires once when an async process exits.
+ */
+typedef struct ProcMgrAsyncProcSource {
+   GSource src;
+   GPollFD pollFd;
+   ProcMgr_AsyncProc *asyncProc;
+} ProcMgrAsyncProcSource;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrAsyncProcSourcePrepare --
+ *
+ *      Prepare callback of the async process source. We only rely on
+ *      the poll fd; there is no timeout.
+ *
+ * Results:
+ *      FALSE.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static gboolean
+ProcMgrAsyncProcSourcePrepare(GSource *src,   // IN
+                              gint *timeout)  // OUT
+{
+   *timeout = -1;
+   return FALSE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrAsyncProcSourceCheck --
+ *
+ *      Check callback of the async process source. The waiter writes
+ *      the exit status to the pipe (or dies and closes it) only once
+ *      the child is gone, so any event on the fd means completion.
+ *
+ * Results:
+ *      TRUE if the process has exited.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static gboolean
+ProcMgrAsyncProcSourceCheck(GSource *src)  // IN
+{
+   ProcMgrAsyncProcSource *procSrc = (ProcMgrAsyncProcSource *) src;
+
+   return (procSrc->pollFd.revents & (G_IO_IN | G_IO_HUP | G_IO_ERR)) != 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgrAsyncProcSourceDispatch --
+ *
+ *      Dispatch callback of the async process source. Collects the exit
+ *      code right away, so that the waiter is reaped as soon as the
+ *      child is gone, and then calls the user callback.
+ *
+ * Results:
+ *      FALSE, the source is always destroyed after firing.
+ *
+ * Side effects:
+ *      See ProcMgr_GetExitCode().
+ *
+ *----------------------------------------------------------------------
+ */
+
+static gboolean
+ProcMgrAsyncProcSourceDispatch(GSource *src,          // IN
+                               GSourceFunc callback,  // IN
+                               gpointer data)         // IN
+{
+   ProcMgrAsyncProcSource *procSrc = (ProcMgrAsyncProcSource *) src;
+   int exitCode;
+
+   g_source_remove_poll(src, &procSrc->pollFd);
+   ProcMgr_GetExitCode(procSrc->asyncProc, &exitCode);
+
+   if (callback != NULL) {
+      callback(data);
+   }
+
+   return FALSE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcMgr_NewAsyncProcSource --
+ *
+ *      Create an event source that fires once, as soon as the given
+ *      async process exits. This lets callers wait for the process in
+ *      their main loop instead of polling ProcMgr_IsAsyncProcRunning().
+ *
+ *      The exit code is collected (see ProcMgr_GetExitCode()) before the
+ *      callback runs, so the callback can fetch it again cheaply. The
+ *      callback's return value is ignored. The caller must keep the
+ *      async proc alive until the source fires or is destroyed.
+ *
+ * Results:
+ *      A new GSource; attach it with g_source_attach() and release it
+ *      with g_source_unref().
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+GSource *
+ProcMgr_NewAsyncProcSource(ProcMgr_AsyncProc *asyncProc)  // IN
+{
+   static GSourceFuncs srcFuncs = {
+      ProcMgrAsyncProcSourcePrepare,
+      ProcMgrAsyncProcSourceCheck,
+      ProcMgrAsyncProcSourceDispatch,
+      NULL,
+      NULL,
+      NULL,
+   };
+   ProcMgrAsyncProcSource *procSrc;
+
+   ASSERT(asyncProc);
+   ASSERT(asyncProc->fd != -1);
+
+   procSrc = (ProcMgrAsyncProcSource *) g_source_new(&srcFuncs,
+                                                     sizeof *procSrc);
+   procSrc->asyncProc = asyncProc;
+   procSrc->pollFd.fd = asyncProc->fd;
+   procSrc->pollFd.events = G_IO_IN | G_IO_HUP | G_IO_ERR;
+   procSrc->pollFd.revents = 0;
+   g_source_add_poll(&procSrc->src, &procSrc->pollFd);
+
+   return &procSrc->src;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
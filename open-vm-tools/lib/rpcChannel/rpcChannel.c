@@ -27,11 +27,23 @@
 #include "dynxdr.h"
 #include "rpcChannelInt.h"
 #include "str.h"
-#include "strutil.h"
 #include "vmxrpc.h"
 #include "xdrutil.h"
 #include "rpcin.h"
 #include "debug.h"
+#include "hostinfo.h"
+
+/**
+ * Entry of the RPC dispatch table. The entry is both the key and the value
+ * of the hash table; the key is the (name, nameLen) pair, so lookups can be
+ * done on a name that is not NUL terminated.
+ */
+typedef struct RpcChannelEntry {
+   const char             *name;
+   size_t                  nameLen;
+   RpcChannelCallback     *rpc;
+   RpcChannelCallbackStats stats;
+} RpcChannelEntry;
 
 /** Internal state of a channel. */
 typedef struct RpcChannelInt {
@@ -84,6 +96,76 @@ RpcChannelPing(RpcInData *data)
 }
 
 
+/**
+ * Hash function for the RPC dispatch table (FNV-1a).
+ *
+ * @param[in]  key      A RpcChannelEntry.
+ *
+ * @return The hash of the entry's name.
+ */
+
+static guint
+RpcChannelEntryHash(gconstpointer key)
+{
+   const RpcChannelEntry *entry = key;
+   guint32 hash = 2166136261U;
+   size_t i;
+
+   for (i = 0; i < entry->nameLen; i++) {
+      hash = (hash ^ (unsigned char) entry->name[i]) * 16777619U;
+   }
+   return hash;
+}
+
+
+/**
+ * Equality function for the RPC dispatch table.
+ *
+ * @param[in]  a        A RpcChannelEntry.
+ * @param[in]  b        A RpcChannelEntry.
+ *
+ * @return Whether both entries have the same name.
+ */
+
+static gboolean
+RpcChannelEntryEqual(gconstpointer a,
+                     gconstpointer b)
+{
+   const RpcChannelEntry *ea = a;
+   const RpcChannelEntry *eb = b;
+
+   return ea->nameLen == eb->nameLen &&
+          memcmp(ea->name, eb->name, ea->nameLen) == 0;
+}
+
+
+/**
+ * Looks up the dispatch table entry for the given RPC name.
+ *
+ * @param[in]  chan     The RPC channel.
+ * @param[in]  name     Name of the RPC, not necessarily NUL terminated.
+ * @param[in]  nameLen  Length of the name.
+ *
+ * @return The entry, or NULL if the RPC is not registered.
+ */
+
+static RpcChannelEntry *
+RpcChannelLookupEntry(RpcChannelInt *chan,
+                      const char *name,
+                      size_t nameLen)
+{
+   RpcChannelEntry key;
+
+   if (chan->rpcs == NULL) {
+      return NULL;
+   }
+
+   key.name = name;
+   key.nameLen = nameLen;
+   return g_hash_table_lookup(chan->rpcs, &key);
+}
+
+
 /**
  * Callback for restarting the RPC channel.
  *
@@ -367,49 +449,72 @@ RpcChannel_Create(void)
 gboolean
 RpcChannel_Dispatch(RpcInData *data)
 {
-   char *name = NULL;
-   unsigned int index = 0;
+   const char *name;
    size_t nameLen;
    Bool status;
-   RpcChannelCallback *rpc = NULL;
+   RpcChannelEntry *entry;
+   RpcChannelCallback *rpc;
    RpcChannelInt *chan = data->clientData;
+   VmTimeType start;
+   VmTimeType elapsed;
 
-   name = StrUtil_GetNextToken(&index, data->args, " ");
-   if (name == NULL) {
-      Debug(LGPFX "Bad command (null) received.\n");
-      status = RPCIN_SETRETVALS(data, "Bad command", FALSE);
-      goto exit;
+   /*
+    * Find the command name in place (same tokenization as
+    * StrUtil_GetNextToken), so that dispatching does not allocate.
+    */
+   name = data->args;
+   while (name < data->args + data->argsSize && *name == ' ') {
+      name++;
+   }
+   for (nameLen = 0;
+        name + nameLen < data->args + data->argsSize &&
+        name[nameLen] != ' ' && name[nameLen] != '\0';
+        nameLen++) {
    }
 
-   if (chan->rpcs != NULL) {
-      rpc = g_hash_table_lookup(chan->rpcs, name);
+   if (nameLen == 0) {
+      Debug(LGPFX "Bad command (null) received.\n");
+      return RPCIN_SETRETVALS(data, "Bad command", FALSE);
    }
 
-   if (rpc == NULL) {
-      Debug(LGPFX "Unknown Command '%s': Handler not registered.\n", name);
-      status = RPCIN_SETRETVALS(data, "Unknown Command", FALSE);
-      goto exit;
+   entry = RpcChannelLookupEntry(chan, name, nameLen);
+   if (entry == NULL) {
+      Debug(LGPFX "Unknown Command '%.*s': Handler not registered.\n",
+            (int) nameLen, name);
+      return RPCIN_SETRETVALS(data, "Unknown Command", FALSE);
    }
+   rpc = entry->rpc;
 
    /* Adjust the RPC arguments. */
-   nameLen = strlen(name);
-   data->name = name;
-   data->args = data->args + nameLen;
-   data->argsSize -= nameLen;
+   data->name = rpc->name;
+   data->argsSize -= (name + nameLen) - data->args;
+   data->args = name + nameLen;
    data->appCtx = chan->appCtx;
    data->clientData = rpc->clientData;
 
+   /* Count the call up front, so a handler that never returns shows up. */
+   entry->stats.calls++;
+   start = Hostinfo_SystemTimerUS();
    if (rpc->xdrIn != NULL || rpc->xdrOut != NULL) {
       status = RpcChannelXdrWrapper(data, rpc);
    } else {
       status = rpc->callback(data);
    }
+   elapsed = Hostinfo_SystemTimerUS() - start;
+
+   /*
+    * The handler may have unregistered itself, which frees the entry, so
+    * look it up again before recording the time.
+    */
+   entry = RpcChannelLookupEntry(chan, name, nameLen);
+   if (entry != NULL) {
+      entry->stats.totalTimeUs += elapsed;
+      entry->stats.maxTimeUs = MAX(entry->stats.maxTimeUs, (guint64) elapsed);
+   }
 
    ASSERT(data->result != NULL);
 
-exit:
    data->name = NULL;
-   free(name);
    return status;
 }
 
@@ -611,16 +716,25 @@ RpcChannel_RegisterCallback(RpcChannel *chan,
                             RpcChannelCallback *rpc)
 {
    RpcChannelInt *cdata = (RpcChannelInt *) chan;
+   RpcChannelEntry *entry;
+
    ASSERT(rpc->name != NULL && strlen(rpc->name) > 0);
    ASSERT(rpc->callback);
    ASSERT(rpc->xdrIn == NULL || rpc->xdrInSize > 0);
    if (cdata->rpcs == NULL) {
-      cdata->rpcs = g_hash_table_new(g_str_hash, g_str_equal);
+      cdata->rpcs = g_hash_table_new_full(RpcChannelEntryHash,
+                                          RpcChannelEntryEqual,
+                                          g_free, NULL);
    }
-   if (g_hash_table_lookup(cdata->rpcs, rpc->name) != NULL) {
+   if (RpcChannelLookupEntry(cdata, rpc->name, strlen(rpc->name)) != NULL) {
       Panic("Trying to overwrite existing RPC registration for %s!\n", rpc->name);
    }
-   g_hash_table_insert(cdata->rpcs, (gpointer) rpc->name, rpc);
+
+   entry = g_new0(RpcChannelEntry, 1);
+   entry->name = rpc->name;
+   entry->nameLen = strlen(rpc->name);
+   entry->rpc = rpc;
+   g_hash_table_insert(cdata->rpcs, entry, entry);
 }
 
 
@@ -638,11 +752,43 @@ RpcChannel_UnregisterCallback(RpcChannel *chan,
 {
    RpcChannelInt *cdata = (RpcChannelInt *) chan;
    if (cdata->rpcs != NULL) {
-      g_hash_table_remove(cdata->rpcs, rpc->name);
+      RpcChannelEntry key;
+
+      key.name = rpc->name;
+      key.nameLen = strlen(rpc->name);
+      g_hash_table_remove(cdata->rpcs, &key);
    }
 }
 
 
+/**
+ * Returns the dispatch statistics of a registered RPC. This function is not
+ * thread-safe.
+ *
+ * @param[in]  chan     The channel instance.
+ * @param[in]  name     Name of the RPC.
+ * @param[out] stats    Where to store the statistics.
+ *
+ * @return Whether the RPC is registered in the channel.
+ */
+
+gboolean
+RpcChannel_GetCallbackStats(RpcChannel *chan,
+                            const char *name,
+                            RpcChannelCallbackStats *stats)
+{
+   RpcChannelEntry *entry;
+
+   entry = RpcChannelLookupEntry((RpcChannelInt *) chan, name, strlen(name));
+   if (entry == NULL) {
+      return FALSE;
+   }
+
+   *stats = entry->stats;
+   return TRUE;
+}
+
+
 /**
  * Force to create backdoor channels only.
  * This provides a kill-switch to disable vsocket channels if needed.
@@ -99,6 +99,9 @@ typedef struct RpcInCallbackList {
    void *clientData;
 } RpcInCallbackList;
 
+/* Number of hash buckets for the TCLO command callbacks, a power of 2 */
+#define RPCIN_CALLBACK_BUCKETS 32
+
 #endif /* VMTOOLS_USE_GLIB */
 
 #if defined(VMTOOLS_USE_VSOCKET)
@@ -122,13 +125,14 @@ typedef struct _ConnInfo {
    Bool recvStopped;
    int sendQueueLen;
 
-   VmTimeType timestamp;
+   VmTimeType timestamp;   /* msecs, time of the last send */
 
    struct RpcIn *in;
 } ConnInfo;
 
 static void RpcInConnRecvHeader(ConnInfo *conn);
 static Bool RpcInConnRecvPacket(ConnInfo *conn, const char **errmsg);
+static gboolean RpcInHeartbeatCallback(void *clientData);
 #endif  /* VMTOOLS_USE_VSOCKET */
 
 
@@ -139,7 +143,7 @@ struct RpcIn {
    RpcIn_Callback dispatch;
    gpointer clientData;
 #else
-   RpcInCallbackList *callbacks;
+   RpcInCallbackList *callbacks[RPCIN_CALLBACK_BUCKETS];
    Event *nextEvent;
 #endif
 
@@ -253,12 +257,45 @@ RpcIn_Construct(DblLnkLst_Links *eventQueue)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcInCallbackBucket --
+ *
+ *      Hash a command name (FNV-1a) to its callback bucket.
+ *
+ * Results:
+ *      The bucket head.
+ *
+ * Side effects:
+ *	None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static RpcInCallbackList **
+RpcInCallbackBucket(RpcIn *in,        // IN
+                    const char *name, // IN: not necessarily NUL terminated
+                    size_t length)    // IN
+{
+   uint32 hash = 2166136261U;
+   size_t i;
+
+   for (i = 0; i < length; i++) {
+      hash = (hash ^ (unsigned char)name[i]) * 16777619U;
+   }
+
+   return &in->callbacks[hash & (RPCIN_CALLBACK_BUCKETS - 1)];
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * RpcInLookupCallback --
  *
- *      Lookup a callback struct in our list.
+ *      Lookup a callback struct in our table. The name does not need to be
+ *      NUL terminated, so it can point straight into the received command.
  *
  * Results:
  *      The callback if found
@@ -272,15 +309,16 @@ RpcIn_Construct(DblLnkLst_Links *eventQueue)
 
 static RpcInCallbackList *
 RpcInLookupCallback(RpcIn *in,        // IN
-                    const char *name) // IN
+                    const char *name, // IN
+                    size_t length)    // IN
 {
    RpcInCallbackList *p;
 
    ASSERT(in);
    ASSERT(name);
 
-   for (p = in->callbacks; p; p = p->next) {
-      if (strcmp(name, p->name) == 0) {
+   for (p = *RpcInCallbackBucket(in, name, length); p; p = p->next) {
+      if (p->length == length && memcmp(name, p->name, length) == 0) {
          return p;
       }
    }
@@ -317,13 +355,14 @@ RpcIn_RegisterCallback(RpcIn *in,               // IN
                        void *clientData)        // IN
 {
    RpcInCallbackList *p;
+   RpcInCallbackList **bucket;
 
    Debug("RpcIn: Registering callback '%s'\n", name);
 
    ASSERT(in);
    ASSERT(name);
    ASSERT(cb);
-   ASSERT(RpcInLookupCallback(in, name) == NULL); // not there yet
+   ASSERT(RpcInLookupCallback(in, name, strlen(name)) == NULL); // not there yet
 
    p = (RpcInCallbackList *) malloc(sizeof(RpcInCallbackList));
    ASSERT_NOT_IMPLEMENTED(p);
@@ -333,9 +372,10 @@ RpcIn_RegisterCallback(RpcIn *in,               // IN
    p->callback = cb;
    p->clientData = clientData;
 
-   p->next = in->callbacks;
+   bucket = RpcInCallbackBucket(in, p->name, p->length);
+   p->next = *bucket;
 
-   in->callbacks = p;
+   *bucket = p;
 }
 
 
@@ -360,13 +400,15 @@ RpcIn_UnregisterCallback(RpcIn *in,               // IN
                          const char *name)        // IN
 {
    RpcInCallbackList *cur, *prev;
+   RpcInCallbackList **bucket;
 
    ASSERT(in);
    ASSERT(name);
 
    Debug("RpcIn: Unregistering callback '%s'\n", name);
 
-   for (cur = in->callbacks, prev = NULL; cur && strcmp(cur->name, name);
+   bucket = RpcInCallbackBucket(in, name, strlen(name));
+   for (cur = *bucket, prev = NULL; cur && strcmp(cur->name, name);
         prev = cur, cur = cur->next);
 
    /*
@@ -376,7 +418,7 @@ RpcIn_UnregisterCallback(RpcIn *in,               // IN
    ASSERT(cur != NULL);
 
    if (prev == NULL) {
-      in->callbacks = cur->next;
+      *bucket = cur->next;
    } else {
       prev->next = cur->next;
    }
@@ -469,13 +511,19 @@ RpcIn_Destruct(RpcIn *in) // IN
 #endif
 
 #if !defined(VMTOOLS_USE_GLIB)
-   while (in->callbacks) {
-      RpcInCallbackList *p;
+   {
+      unsigned int i;
 
-      p = in->callbacks->next;
-      free((void *) in->callbacks->name);
-      free(in->callbacks);
-      in->callbacks = p;
+      for (i = 0; i < RPCIN_CALLBACK_BUCKETS; i++) {
+         while (in->callbacks[i]) {
+            RpcInCallbackList *p;
+
+            p = in->callbacks[i]->next;
+            free((void *) in->callbacks[i]->name);
+            free(in->callbacks[i]);
+            in->callbacks[i] = p;
+         }
+      }
    }
 
    gTimerEventQueue = NULL;
@@ -718,6 +766,7 @@ RpcInConnSend(ConnInfo *conn,              // IN
       return FALSE;
    } else {
       conn->sendQueueLen += packetLen;
+      conn->timestamp = System_GetTimeMonotonic() * 10;
       return TRUE;
    }
 }
@@ -750,6 +799,40 @@ RpcInCloseChannel(RpcIn *in,               // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RpcInScheduleHeartbeat --
+ *
+ *      Arm the heartbeat timer to fire after the given delay, replacing any
+ *      timer that is already armed. HA monitoring depends on the heartbeat.
+ *
+ * Result:
+ *      None.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RpcInScheduleHeartbeat(RpcIn *in,             // IN
+                       unsigned int delay)    // IN: msecs
+{
+   if (in->heartbeatSrc != NULL) {
+      g_source_unref(in->heartbeatSrc);
+   }
+   in->heartbeatSrc = VMTools_CreateTimer(delay);
+   if (in->heartbeatSrc != NULL) {
+      g_source_set_callback(in->heartbeatSrc, RpcInHeartbeatCallback, in, NULL);
+      g_source_attach(in->heartbeatSrc, in->mainCtx);
+   } else {
+      Debug("RpcIn: error in scheduling heartbeat callback.\n");
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -757,6 +840,11 @@ RpcInCloseChannel(RpcIn *in,               // IN
  *
  *      Callback function to send a heartbeat message to VMX.
  *
+ *      Any packet we send on the connection tells VMX we are alive, so the
+ *      ping is only sent once the connection has been silent for a whole
+ *      heartbeat interval. Otherwise the timer is re-armed for the rest of
+ *      the interval.
+ *
  * Result:
  *      TRUE to keep the callback, FALSE otherwise.
  *
@@ -772,10 +860,18 @@ RpcInHeartbeatCallback(void *clientData)      // IN
    RpcIn *in = (RpcIn *)clientData;
    ASSERT(in);
    if (in->conn) {
+      VmTimeType idle = System_GetTimeMonotonic() * 10 - in->conn->timestamp;
+
       ASSERT(!in->mustSend);
       ASSERT(in->last_result == NULL);
       ASSERT(in->last_resultLen == 0);
 
+      if (idle >= 0 && idle < RPCIN_HEARTBEAT_INTERVAL) {
+         RpcInScheduleHeartbeat(in,
+                                RPCIN_HEARTBEAT_INTERVAL - (unsigned int)idle);
+         return FALSE;
+      }
+
       in->mustSend = TRUE;
       if (RpcInSend(in, RPCIN_TCLO_PING)) {
          return TRUE;
@@ -790,37 +886,6 @@ RpcInHeartbeatCallback(void *clientData)      // IN
 }
 
 
-/*
- *-----------------------------------------------------------------------------
- *
- * RpcInRegisterHeartbeatCallback --
- *
- *      Register a callback so we can send heartbeat messages periodically, HA
- *      monitoring depends on this.
- *
- * Result:
- *      None.
- *
- * Side-effects:
- *      None
- *
- *-----------------------------------------------------------------------------
- */
-
-static void
-RpcInRegisterHeartbeatCallback(RpcIn *in)      // IN
-{
-   ASSERT(in->heartbeatSrc == NULL);
-   in->heartbeatSrc = VMTools_CreateTimer(RPCIN_HEARTBEAT_INTERVAL);
-   if (in->heartbeatSrc != NULL) {
-      g_source_set_callback(in->heartbeatSrc, RpcInHeartbeatCallback, in, NULL);
-      g_source_attach(in->heartbeatSrc, in->mainCtx);
-   } else {
-      Debug("RpcIn: error in scheduling heartbeat callback.\n");
-   }
-}
-
-
 /*
  *-----------------------------------------------------------------------------
  *
@@ -892,6 +957,12 @@ exit:
  *
  *    AsyncSocket callback function after data is recved.
  *
+ *    Over vsocket the host pushes TCLO commands to us, so they are dispatched
+ *    straight from here and the reply goes back on the same connection.
+ *    Unlike the backdoor, there is no RpcInLoop polling timer and no
+ *    back-off: a command costs one round trip, and an idle connection only
+ *    wakes up for the heartbeat.
+ *
  * Result:
  *    None
  *
@@ -942,7 +1013,7 @@ RpcInConnRecvedCb(void *buf,            // IN
             if (conn->in->heartbeatSrc == NULL) {
                /* Register heartbeat callback after the first successful send
                 * so we do not mess with TCLO protocol. */
-               RpcInRegisterHeartbeatCallback(conn->in);
+               RpcInScheduleHeartbeat(conn->in, RPCIN_HEARTBEAT_INTERVAL);
             }
             RpcInConnRecvHeader(conn);
             free(payload);
@@ -1113,6 +1184,10 @@ RpcInConnectDone(AsyncSocket *asock,   // IN
       goto exit;
    }
 
+   /* Push mode: the backdoor polling loop must not be running. */
+   ASSERT(in->nextEvent == NULL);
+   ASSERT(in->channel == NULL);
+
    conn->connected = TRUE;
    RpcInConnRecvHeader(conn);
    return;
@@ -1319,26 +1394,36 @@ RpcInExecRpc(RpcIn *in,            // IN
    resultLen = data.resultLen;
    freeResult = data.freeResult;
 #else
-   char *cmd;
-   unsigned int index = 0;
+   size_t start = 0;
+   size_t cmdLen;
    RpcInCallbackList *cb = NULL;
 
-   cmd = StrUtil_GetNextToken(&index, reply, " ");
-   if (cmd != NULL) {
-      cb = RpcInLookupCallback(in, cmd);
+   /* Find the command name in place, the way StrUtil_GetNextToken would. */
+   while (start < repLen && reply[start] == ' ') {
+      start++;
+   }
+   for (cmdLen = 0;
+        start + cmdLen < repLen && reply[start + cmdLen] != ' ' &&
+        reply[start + cmdLen] != '\0';
+        cmdLen++) {
+   }
+
+   if (cmdLen > 0) {
+      cb = RpcInLookupCallback(in, reply + start, cmdLen);
       if (cb) {
          result = NULL;
          status = cb->callback((char const **) &result, &resultLen, cb->name,
-                               reply + cb->length, repLen - cb->length,
+                               reply + start + cb->length,
+                               repLen - start - cb->length,
                                cb->clientData);
          ASSERT(result);
       } else {
-         Debug("RpcIn: Unknown Command '%s': No matching callback\n", cmd);
+         Debug("RpcIn: Unknown Command '%.*s': No matching callback\n",
+               (int)cmdLen, reply + start);
          status = FALSE;
          result = "Unknown Command";
          resultLen = strlen(result);
       }
-      free(cmd);
    } else {
       Debug("RpcIn: Bad command (null) received\n");
       status = FALSE;
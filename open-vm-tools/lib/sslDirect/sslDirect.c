@@ -33,6 +33,7 @@
 #include <winsock2.h>
 #else
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 #endif
@@ -589,6 +590,69 @@ SSL_Write(SSLSock ssl,   // IN
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * SSL_WriteV()
+ *
+ *    Functional equivalent of the writev() syscall. Encrypted
+ *    connections only write the first buffer.
+ *
+ * Results:
+ *    Returns the number of bytes written, or -1 on error.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
+
+#ifndef _WIN32
+ssize_t
+SSL_WriteV(SSLSock ssl,                  // IN
+           const struct iovec *iov,      // IN
+           int iovcnt)                   // IN
+{
+   ASSERT(ssl);
+   ASSERT(iovcnt > 0);
+
+   if (ssl->encrypted) {
+      return SSL_Write(ssl, iov[0].iov_base, iov[0].iov_len);
+   }
+   if (ssl->connectionFailed) {
+      SSLSetSystemError(SSL_SOCK_LOST_CONNECTION);
+      return SOCKET_ERROR;
+   }
+
+   return writev(ssl->fd, iov, iovcnt);
+}
+#endif
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SSL_IsEncrypted()
+ *
+ *    Whether data written to the socket goes through SSL.
+ *
+ * Results:
+ *    TRUE if the connection is encrypted.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+SSL_IsEncrypted(const SSLSock ssl) // IN
+{
+   ASSERT(ssl);
+
+   return ssl->encrypted;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
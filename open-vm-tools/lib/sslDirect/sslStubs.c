@@ -33,6 +33,7 @@
 #include <winsock2.h>
 #else
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 #endif
@@ -80,6 +81,55 @@ SSL_Write(SSLSock sslSock,   // IN
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * SSL_WriteV()
+ *
+ *    Functional equivalent of the writev() syscall.
+ *
+ * Results:
+ *    Returns the number of bytes written, or -1 on error.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
+
+#ifndef _WIN32
+ssize_t
+SSL_WriteV(SSLSock sslSock,              // IN
+           const struct iovec *iov,      // IN
+           int iovcnt)                   // IN
+{
+   return writev(sslSock->fd, iov, iovcnt);
+}
+#endif
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SSL_IsEncrypted()
+ *
+ *    Always FALSE for non-SSL socket.
+ *
+ * Results:
+ *    FALSE
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+SSL_IsEncrypted(const SSLSock sslSock) // IN
+{
+   return FALSE;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -59,6 +59,12 @@
 
 #define MAX_DOMAIN_LEN                 (64)
 
+/*
+ * Size of the stack buffer log messages are formatted into; longer messages
+ * are formatted into an allocated buffer.
+ */
+#define LOG_FORMAT_BUF_SIZE            (1024)
+
 /*
  * Default max number of log messages to be cached when log IO
  * has been frozen. In case of cache overflow, only the most
@@ -236,6 +242,48 @@ VMToolsAsprintf(gchar **string,
 }
 
 
+/**
+ * Formats a string into the given buffer if it fits, or into a newly
+ * allocated string otherwise.
+ *
+ * @param[out] string   Where to store the result: either @a buf, or a string
+ *                      that should be g_free()'d.
+ * @param[in]  buf      Buffer to use if the result fits (may be NULL).
+ * @param[in]  bufSize  Size of @a buf.
+ * @param[in]  format   String format.
+ * @param[in]  ...      String arguments.
+ *
+ * @return Number of bytes printed.
+ */
+
+static gint
+VMToolsLogPrintf(gchar **string,
+                 gchar *buf,
+                 gsize bufSize,
+                 gchar const *format,
+                 ...)
+{
+   gint cnt;
+   va_list args;
+
+   if (buf != NULL) {
+      va_start(args, format);
+      cnt = g_vsnprintf(buf, bufSize, format, args);
+      va_end(args);
+
+      if (cnt >= 0 && (gsize) cnt < bufSize) {
+         *string = buf;
+         return cnt;
+      }
+   }
+
+   va_start(args, format);
+   cnt = g_vasprintf(string, format, args);
+   va_end(args);
+   return cnt;
+}
+
+
 /**
  * Creates a formatted message to be logged. The format of the message will be:
  *
@@ -246,9 +294,12 @@ VMToolsAsprintf(gchar **string,
  * @param[in] level        Log level.
  * @param[in] data         Log handler data.
  * @param[in] cached       If the message will be cached.
+ * @param[in] buf          Buffer to format the message into, if it fits
+ *                         (may be NULL).
+ * @param[in] bufSize      Size of @a buf.
  *
  * @return Formatted log message according to the log domain's config.
- *         Should be g_free()'d.
+ *         Should be g_free()'d unless it is @a buf.
  */
 
 static gchar *
@@ -256,14 +307,16 @@ VMToolsLogFormat(const gchar *message,
                  const gchar *domain,
                  GLogLevelFlags level,
                  LogHandler *data,
-                 gboolean cached)
+                 gboolean cached,
+                 gchar *buf,
+                 gsize bufSize)
 {
    char *msg = NULL;
    const char *slevel;
    size_t len = 0;
    gboolean shared = TRUE;
    gboolean addsTimestamp = TRUE;
-   char *tstamp;
+   gchar when[128] = "";
 
    if (domain == NULL) {
       domain = gLogDomain;
@@ -311,40 +364,23 @@ VMToolsLogFormat(const gchar *message,
       addsTimestamp = data->logger->addsTimestamp;
    }
 
-   tstamp = System_GetTimeAsString();
+   /*
+    * Only fetch the time when it is part of the message: loggers that add
+    * their own timestamp only need one for cached messages.
+    */
+   if (!addsTimestamp || cached) {
+      char *tstamp = System_GetTimeAsString();
 
-   if (!addsTimestamp) {
-      if (shared) {
-         len = VMToolsAsprintf(&msg, "[%s] [%8s] [%s:%s] %s\n",
-                               (tstamp != NULL) ? tstamp : "no time",
-                               slevel, gLogDomain, domain, message);
-      } else {
-         len = VMToolsAsprintf(&msg, "[%s] [%8s] [%s] %s\n",
-                               (tstamp != NULL) ? tstamp : "no time",
-                               slevel, domain, message);
-      }
-   } else {
-      if (cached) {
-         if (shared) {
-            len = VMToolsAsprintf(&msg, "[cached at %s] [%8s] [%s:%s] %s\n",
-                                  (tstamp != NULL) ? tstamp : "no time",
-                                  slevel, gLogDomain, domain, message);
-         } else {
-            len = VMToolsAsprintf(&msg, "[cached at %s] [%8s] [%s] %s\n",
-                                  (tstamp != NULL) ? tstamp : "no time",
-                                  slevel, domain, message);
-         }
-      } else {
-         if (shared) {
-            len = VMToolsAsprintf(&msg, "[%8s] [%s:%s] %s\n",
-                                  slevel, gLogDomain, domain, message);
-         } else {
-            len = VMToolsAsprintf(&msg, "[%8s] [%s] %s\n", slevel, domain, message);
-         }
-      }
+      g_snprintf(when, sizeof when,
+                 addsTimestamp ? "[cached at %s] " : "[%s] ",
+                 (tstamp != NULL) ? tstamp : "no time");
+      free(tstamp);
    }
 
-   free(tstamp);
+   len = VMToolsLogPrintf(&msg, buf, bufSize, "%s[%8s] [%s%s%s] %s\n",
+                          when, slevel,
+                          shared ? gLogDomain : "", shared ? ":" : "",
+                          domain, message);
 
    /*
     * The log messages from glib itself (and probably other libraries based
@@ -387,36 +423,53 @@ VMToolsFreeLogEntry(gpointer data)
 /**
  * Function that calls the log handler.
  *
- * Also, frees the _data to avoid having separate free call.
- *
- * @param[in] _data     LogEntry pointer.
- * @param[in] userData  User data pointer.
+ * @param[in] domain    Log domain.
+ * @param[in] level     Log level.
+ * @param[in] msg       Formatted message.
+ * @param[in] handler   LogHandler pointer.
  */
 
 static void
-VMToolsLogMsg(gpointer _data, gpointer userData)
+VMToolsLogDispatch(const gchar *domain,
+                   GLogLevelFlags level,
+                   const gchar *msg,
+                   LogHandler *handler)
 {
-   LogEntry *entry = _data;
-   GlibLogger *logger = entry->handler->logger;
+   GlibLogger *logger = handler->logger;
    gboolean usedSyslog = FALSE;
 
    if (logger != NULL) {
-       logger->logfn(entry->domain, entry->level, entry->msg, logger);
-       usedSyslog = entry->handler->isSysLog;
+       logger->logfn(domain, level, msg, logger);
+       usedSyslog = handler->isSysLog;
    } else if (gErrorData->logger != NULL) {
-      gErrorData->logger->logfn(entry->domain, entry->level, entry->msg,
-                                gErrorData->logger);
+      gErrorData->logger->logfn(domain, level, msg, gErrorData->logger);
       usedSyslog = gErrorData->isSysLog;
    }
 
    /*
     * Any fatal errors need to go to syslog no matter what.
     */
-   if (!usedSyslog && IS_FATAL(entry->level)) {
-      gErrorSyslog->logger->logfn(entry->domain, entry->level, entry->msg,
-                                  gErrorSyslog->logger);
+   if (!usedSyslog && IS_FATAL(level)) {
+      gErrorSyslog->logger->logfn(domain, level, msg, gErrorSyslog->logger);
    }
+}
+
+
+/**
+ * Function that calls the log handler for a cached message.
+ *
+ * Also, frees the _data to avoid having separate free call.
+ *
+ * @param[in] _data     LogEntry pointer.
+ * @param[in] userData  User data pointer.
+ */
 
+static void
+VMToolsLogMsg(gpointer _data, gpointer userData)
+{
+   LogEntry *entry = _data;
+
+   VMToolsLogDispatch(entry->domain, entry->level, entry->msg, entry->handler);
    VMToolsFreeLogEntry(entry);
 }
 
@@ -425,6 +478,9 @@ VMToolsLogMsg(gpointer _data, gpointer userData)
  * Log handler function that does the common processing of log messages,
  * and delegates the actual printing of the message to the given handler.
  *
+ * Messages that are not cached are formatted on the stack (unless they are
+ * unusually long), so the common path does not allocate.
+ *
  * @param[in] domain    Log domain.
  * @param[in] level     Log level.
  * @param[in] message   Message to log.
@@ -440,29 +496,23 @@ VMToolsLog(const gchar *domain,
    LogHandler *data = _data;
 
    if (SHOULD_LOG(level, data)) {
-      LogEntry *entry;
-
       data = data->inherited ? gDefaultData : data;
 
-      entry = g_malloc0(sizeof(LogEntry));
-      if (entry) {
-         entry->domain = domain ? g_strdup(domain) : NULL;
-         if (domain && !entry->domain) {
-            VMToolsLogPanic();
-         }
-         entry->handler = data;
-         entry->level = level;
-      }
-
       if (gLogIOSuspended && data->needsFileIO) {
+         LogEntry *entry;
+
          if (gMaxCacheEntries == 0) {
             /* No way to log at this point, drop it */
-            VMToolsFreeLogEntry(entry);
             gDroppedLogCount++;
             goto exit;
          }
 
-         entry->msg = VMToolsLogFormat(message, domain, level, data, TRUE);
+         entry = g_malloc0(sizeof(LogEntry));
+         entry->domain = g_strdup(domain);
+         entry->handler = data;
+         entry->level = level;
+         entry->msg = VMToolsLogFormat(message, domain, level, data, TRUE,
+                                       NULL, 0);
 
          /*
           * Cache the log message
@@ -507,8 +557,15 @@ VMToolsLog(const gchar *domain,
          }
 
       } else {
-         entry->msg = VMToolsLogFormat(message, domain, level, data, FALSE);
-         VMToolsLogMsg(entry, NULL);
+         gchar buf[LOG_FORMAT_BUF_SIZE];
+         gchar *msg = VMToolsLogFormat(message, domain, level, data, FALSE,
+                                       buf, sizeof buf);
+
+         VMToolsLogDispatch(domain, level, msg, data);
+
+         if (msg != buf) {
+            g_free(msg);
+         }
       }
    }
 
@@ -635,6 +692,7 @@ VMToolsGetLogHandler(const gchar *handler,
       gboolean append = strcmp(handler, "file+") == 0;
       guint maxSize;
       guint maxFiles;
+      gboolean async;
       GError *err = NULL;
 
       /* Use the same type name for both. */
@@ -657,7 +715,11 @@ VMToolsGetLogHandler(const gchar *handler,
             maxFiles = 10;
          }
 
-         glogger = GlibUtils_CreateFileLogger(path, append, maxSize, maxFiles);
+         g_snprintf(key, sizeof key, "%s.asyncLog", domain);
+         async = g_key_file_get_boolean(cfg, LOGGING_GROUP, key, NULL);
+
+         glogger = GlibUtils_CreateFileLogger(path, append, maxSize, maxFiles,
+                                              async);
          needsFileIO = TRUE;
       } else {
          g_warning("Missing path for domain '%s'.", domain);
@@ -1268,6 +1330,28 @@ void
 VMTools_SuspendLogIO()
 {
    gLogIOSuspended = TRUE;
+
+   /*
+    * Asynchronous file loggers may still hold messages logged before IO was
+    * suspended; write them out now, so that no file IO happens until
+    * VMTools_ResumeLogIO() is called. Messages logged from now on are cached.
+    */
+   if (gDefaultData != NULL && gDefaultData->logger != NULL &&
+       gDefaultData->logger->flush != NULL) {
+      gDefaultData->logger->flush(gDefaultData->logger);
+   }
+
+   if (gDomains != NULL) {
+      guint i;
+
+      for (i = 0; i < gDomains->len; i++) {
+         LogHandler *data = g_ptr_array_index(gDomains, i);
+
+         if (data->logger != NULL && data->logger->flush != NULL) {
+            data->logger->flush(data->logger);
+         }
+      }
+   }
 }
 
 
@@ -22,9 +22,368 @@
  * Contains POSIX-specific bits of gettting disk information.
  */
 
+#if defined(__linux__)
+#   include <errno.h>
+#   include <fcntl.h>
+#   include <sys/poll.h>
+#   include <string.h>
+#   include <unistd.h>
+#endif
+
 #include "util.h"
 #include "vmware.h"
 #include "guestInfoInt.h"
+#if defined(__linux__)
+#   include "str.h"
+#   include "wiper.h"
+#endif
+
+
+#if defined(__linux__)
+
+/*
+ * Disk info is gathered on the guestInfo gather thread, and statfs() on a
+ * mount whose backing storage stopped responding can block forever. So the
+ * mounts are stat'ed by a small pool of DISKINFO_STAT_THREADS persistent
+ * threads, and the gather only waits up to DISKINFO_STAT_TIMEOUT for them.
+ * A mount whose stat is still outstanding, queued or stuck, is reported
+ * with the last values it returned, and is not queued again until that stat
+ * returns. Stuck mounts can therefore tie up at most the pool's threads.
+ *
+ * The list of mounts is kept between gathers and only rebuilt when
+ * /proc/self/mountinfo signals (POLLPRI) that the mount table changed.
+ */
+
+#define DISKINFO_STAT_TIMEOUT    2000   /* msecs */
+#define DISKINFO_STAT_THREADS    4
+#define DISKINFO_MOUNTINFO       "/proc/self/mountinfo"
+
+typedef struct DiskInfoMount {
+   WiperPartition part;
+   Bool pending;           // A stat is queued or running for this mount.
+   Bool removed;           // Dropped from the list while pending.
+   Bool valid;             // freeBytes and totalBytes are set.
+   const char *error;      // Error of the last stat, NULL if none.
+   uint64 freeBytes;
+   uint64 totalBytes;
+} DiskInfoMount;
+
+static GMutex *gDiskInfoLock;
+static GCond *gDiskInfoCond;
+static GPtrArray *gDiskInfoMounts;     // DiskInfoMount *, under gDiskInfoLock
+static GThreadPool *gDiskInfoPool;
+static int gMountInfoFd = -1;
+
+
+/*
+ ******************************************************************************
+ * DiskInfoMountsChanged --                                              */ /**
+ *
+ * Checks whether the mount table may have changed since the last call.
+ *
+ * @retval TRUE  The mount list must be rebuilt.
+ * @retval FALSE The mount table did not change.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+DiskInfoMountsChanged(void)
+{
+   struct pollfd pfd;
+
+   if (gMountInfoFd == -1) {
+      gMountInfoFd = open(DISKINFO_MOUNTINFO, O_RDONLY | O_CLOEXEC);
+      if (gMountInfoFd == -1) {
+         g_debug("Cannot open %s: %s\n", DISKINFO_MOUNTINFO, strerror(errno));
+      }
+      return TRUE;
+   }
+
+   pfd.fd = gMountInfoFd;
+   pfd.events = POLLPRI;
+   pfd.revents = 0;
+   if (poll(&pfd, 1, 0) == -1) {
+      return TRUE;
+   }
+
+   return (pfd.revents & (POLLERR | POLLPRI)) != 0;
+}
+
+
+/*
+ ******************************************************************************
+ * DiskInfoFreeMount --                                                  */ /**
+ *
+ * Frees a mount entry, or leaves it to its stat if one is outstanding.
+ * Must be called with gDiskInfoLock held.
+ *
+ * @param[in]  mount    The mount entry.
+ *
+ ******************************************************************************
+ */
+
+static void
+DiskInfoFreeMount(DiskInfoMount *mount)
+{
+   if (mount->pending) {
+      mount->removed = TRUE;
+   } else {
+      free(mount);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * DiskInfoRefreshMounts --                                              */ /**
+ *
+ * Rebuilds the list of mounts to report from the wiper library's partition
+ * list. Entries of mounts that are still there are kept along with their
+ * last values. Must be called with gDiskInfoLock held.
+ *
+ * @retval TRUE  The list was rebuilt.
+ * @retval FALSE The partition list could not be read.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+DiskInfoRefreshMounts(void)
+{
+   WiperPartition_List pl;
+   DblLnkLst_Links *curr;
+   GPtrArray *mounts;
+   guint i;
+
+   if (!WiperPartition_Open(&pl)) {
+      g_warning("GetDiskInfo: ERROR: could not get partition list\n");
+      return FALSE;
+   }
+
+   mounts = g_ptr_array_new();
+
+   DblLnkLst_ForEach(curr, &pl.link) {
+      WiperPartition *part = DblLnkLst_Container(curr, WiperPartition, link);
+      DiskInfoMount *mount = NULL;
+
+      if (part->type == PARTITION_UNSUPPORTED) {
+         continue;
+      }
+
+      for (i = 0; gDiskInfoMounts != NULL && i < gDiskInfoMounts->len; i++) {
+         DiskInfoMount *old = g_ptr_array_index(gDiskInfoMounts, i);
+
+         if (old != NULL &&
+             strcmp(old->part.mountPoint, part->mountPoint) == 0) {
+            mount = old;
+            g_ptr_array_index(gDiskInfoMounts, i) = NULL;
+            break;
+         }
+      }
+
+      if (mount == NULL) {
+         /*
+          * Only copy what WiperSinglePartition_GetSpace needs: the list
+          * links and the comment belong to pl.
+          */
+         mount = Util_SafeCalloc(1, sizeof *mount);
+         Str_Strcpy((char *)mount->part.mountPoint,
+                    (const char *)part->mountPoint,
+                    sizeof mount->part.mountPoint);
+         mount->part.type = part->type;
+      }
+      g_ptr_array_add(mounts, mount);
+   }
+
+   WiperPartition_Close(&pl);
+
+   if (gDiskInfoMounts != NULL) {
+      for (i = 0; i < gDiskInfoMounts->len; i++) {
+         DiskInfoMount *old = g_ptr_array_index(gDiskInfoMounts, i);
+
+         if (old != NULL) {
+            DiskInfoFreeMount(old);
+         }
+      }
+      g_ptr_array_free(gDiskInfoMounts, TRUE);
+   }
+   gDiskInfoMounts = mounts;
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * DiskInfoStatWorker --                                                 */ /**
+ *
+ * Pool task that gets the space used on one mount.
+ *
+ * @param[in]  data     The DiskInfoMount.
+ * @param[in]  userData Unused.
+ *
+ ******************************************************************************
+ */
+
+static void
+DiskInfoStatWorker(gpointer data,
+                   gpointer userData)
+{
+   DiskInfoMount *mount = data;
+   uint64 freeBytes = 0;
+   uint64 totalBytes = 0;
+   const char *error;
+
+   error = (const char *)WiperSinglePartition_GetSpace(&mount->part,
+                                                       &freeBytes,
+                                                       &totalBytes);
+
+   g_mutex_lock(gDiskInfoLock);
+   mount->pending = FALSE;
+   if (mount->removed) {
+      free(mount);
+   } else {
+      if (*error == '\0') {
+         mount->freeBytes = freeBytes;
+         mount->totalBytes = totalBytes;
+         mount->valid = TRUE;
+         mount->error = NULL;
+      } else {
+         mount->valid = FALSE;
+         mount->error = error;
+      }
+      g_cond_broadcast(gDiskInfoCond);
+   }
+   g_mutex_unlock(gDiskInfoLock);
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_GetDiskInfo --                                              */ /**
+ *
+ * Gets the utilization of the mounted file systems, without blocking on
+ * mounts that don't respond.
+ *
+ * @return Pointer to a GuestDiskInfo structure on success or NULL on failure.
+ *         Caller should free returned pointer with GuestInfoFreeDiskInfo.
+ *
+ ******************************************************************************
+ */
+
+GuestDiskInfo *
+GuestInfo_GetDiskInfo(void)
+{
+   GuestDiskInfo *di = NULL;
+   GPtrArray *started;
+   GTimeVal deadline;
+   unsigned int partNameSize;
+   guint i;
+
+   if (gDiskInfoLock == NULL) {
+      gDiskInfoLock = g_mutex_new();
+      gDiskInfoCond = g_cond_new();
+   }
+
+   g_mutex_lock(gDiskInfoLock);
+
+   if (gDiskInfoPool == NULL) {
+      GError *err = NULL;
+
+      gDiskInfoPool = g_thread_pool_new(DiskInfoStatWorker, NULL,
+                                        DISKINFO_STAT_THREADS, TRUE, &err);
+      if (gDiskInfoPool == NULL) {
+         g_warning("GetDiskInfo: cannot create thread pool: %s\n",
+                   err != NULL ? err->message : "unknown error");
+         g_clear_error(&err);
+         goto exit;
+      }
+   }
+
+   if (gDiskInfoMounts == NULL || DiskInfoMountsChanged()) {
+      if (!DiskInfoRefreshMounts()) {
+         goto exit;
+      }
+   }
+
+   /* Queue a stat of every mount that has none outstanding. */
+   started = g_ptr_array_new();
+   for (i = 0; i < gDiskInfoMounts->len; i++) {
+      DiskInfoMount *mount = g_ptr_array_index(gDiskInfoMounts, i);
+      GError *err = NULL;
+
+      if (mount->pending) {
+         g_message("GetDiskInfo: %s is not responding, reporting last known "
+                   "values.\n", mount->part.mountPoint);
+         continue;
+      }
+
+      mount->pending = TRUE;
+      g_thread_pool_push(gDiskInfoPool, mount, &err);
+      if (err != NULL) {
+         g_warning("GetDiskInfo: cannot queue stat: %s\n", err->message);
+         g_clear_error(&err);
+         mount->pending = FALSE;
+         continue;
+      }
+      g_ptr_array_add(started, mount);
+   }
+
+   /* Wait for the stats started above, up to the deadline. */
+   g_get_current_time(&deadline);
+   g_time_val_add(&deadline, DISKINFO_STAT_TIMEOUT * 1000);
+
+   i = 0;
+   while (i < started->len) {
+      DiskInfoMount *mount = g_ptr_array_index(started, i);
+
+      if (!mount->pending) {
+         i++;
+      } else if (!g_cond_timed_wait(gDiskInfoCond, gDiskInfoLock, &deadline)) {
+         g_message("GetDiskInfo: timed out waiting for %s.\n",
+                   mount->part.mountPoint);
+         break;
+      }
+   }
+   g_ptr_array_free(started, TRUE);
+
+   di = Util_SafeCalloc(1, sizeof *di);
+   partNameSize = sizeof (di->partitionList)[0].name;
+
+   for (i = 0; i < gDiskInfoMounts->len; i++) {
+      DiskInfoMount *mount = g_ptr_array_index(gDiskInfoMounts, i);
+      PPartitionEntry partEntry;
+
+      if (mount->error != NULL && !mount->pending) {
+         g_warning("GetDiskInfo: ERROR: could not get space for partition "
+                   "%s: %s\n", mount->part.mountPoint, mount->error);
+         continue;
+      }
+      if (!mount->valid) {
+         continue;
+      }
+
+      if (strlen(mount->part.mountPoint) + 1 > partNameSize) {
+         g_warning("GetDiskInfo: ERROR: Partition name buffer too small\n");
+         continue;
+      }
+
+      di->partitionList = Util_SafeRealloc(di->partitionList,
+                                           (di->numEntries + 1) *
+                                           sizeof *di->partitionList);
+      partEntry = &di->partitionList[di->numEntries++];
+      Str_Strcpy(partEntry->name, mount->part.mountPoint, partNameSize);
+      partEntry->freeBytes = mount->freeBytes;
+      partEntry->totalBytes = mount->totalBytes;
+   }
+
+exit:
+   g_mutex_unlock(gDiskInfoLock);
+   return di;
+}
+
+#else
 
 
 /*
@@ -44,3 +403,5 @@ GuestInfo_GetDiskInfo(void)
 {
    return GuestInfoGetDiskInfoWiper();
 }
+
+#endif
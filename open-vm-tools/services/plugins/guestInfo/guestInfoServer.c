@@ -159,7 +159,8 @@ static Bool GuestInfoUpdateVmdb(ToolsAppCtx *ctx,
 static Bool SetGuestInfo(ToolsAppCtx *ctx, GuestInfoType key,
                          const char *value);
 static void SendUptime(ToolsAppCtx *ctx);
-static Bool DiskInfoChanged(const GuestDiskInfo *diskInfo);
+static Bool DiskInfoChanged(const GuestDiskInfo *diskInfo,
+                            int threshold);
 static void GuestInfoClearCache(void);
 static GuestNicList *NicInfoV3ToV2(const NicInfoV3 *infoV3);
 static void TweakGatherLoops(ToolsAppCtx *ctx, gboolean enable);
@@ -318,11 +319,28 @@ GuestInfoGather(gpointer data)
       if ((diskInfo = GuestInfo_GetDiskInfo()) == NULL) {
          g_warning("Failed to get disk info.\n");
       } else {
-         if (GuestInfoUpdateVmdb(ctx, INFO_DISK_FREE_SPACE, diskInfo, 0)) {
-            GuestInfo_FreeDiskInfo(gInfoCache.diskInfo);
-            gInfoCache.diskInfo = diskInfo;
+         int threshold;
+
+         threshold = g_key_file_get_integer(ctx->config,
+                                            CONFGROUPNAME_GUESTINFO,
+                                            CONFNAME_GUESTINFO_DISKINFOTHRESHOLD,
+                                            NULL);
+         threshold = CLAMP(threshold, 0, 100);
+
+         /*
+          * The cache holds what was last sent, not what was last gathered,
+          * so that small changes below the threshold still add up.
+          */
+         if (DiskInfoChanged(diskInfo, threshold)) {
+            if (GuestInfoUpdateVmdb(ctx, INFO_DISK_FREE_SPACE, diskInfo, 0)) {
+               GuestInfo_FreeDiskInfo(gInfoCache.diskInfo);
+               gInfoCache.diskInfo = diskInfo;
+            } else {
+               g_warning("Failed to update VMDB\n.");
+               GuestInfo_FreeDiskInfo(diskInfo);
+            }
          } else {
-            g_warning("Failed to update VMDB\n.");
+            g_debug("Disk info not changed.\n");
             GuestInfo_FreeDiskInfo(diskInfo);
          }
       }
@@ -908,11 +926,6 @@ GuestInfoUpdateVmdb(ToolsAppCtx *ctx,       // IN: Application context
          Bool status;
          GuestDiskInfo *pdi = info;
 
-         if (!DiskInfoChanged(pdi)) {
-            g_debug("Disk info not changed.\n");
-            break;
-         }
-
          ASSERT((pdi->numEntries && pdi->partitionList) ||
                 (!pdi->numEntries && !pdi->partitionList));
 
@@ -1096,7 +1109,11 @@ GuestInfoFindMacAddress(NicInfoV3 *nicInfo,     // IN/OUT
  * Checks whether disk info information just obtained is different from the
  * information last sent to the VMX.
  *
- * @param[in]  diskInfo New disk info.
+ * The free space of a partition is only considered changed once it moved by
+ * more than @a threshold percent of the partition size.
+ *
+ * @param[in]  diskInfo    New disk info.
+ * @param[in]  threshold   Free space change threshold, in percent.
  *
  * @retval TRUE  Data has changed.
  * @retval FALSE Data has not changed.
@@ -1105,7 +1122,8 @@ GuestInfoFindMacAddress(NicInfoV3 *nicInfo,     // IN/OUT
  */
 
 static Bool
-DiskInfoChanged(const GuestDiskInfo *diskInfo)
+DiskInfoChanged(const GuestDiskInfo *diskInfo,
+                int threshold)
 {
    int index;
    char *name;
@@ -1144,15 +1162,19 @@ DiskInfoChanged(const GuestDiskInfo *diskInfo)
          g_debug("Partition %s deleted\n", name);
          return TRUE;
       } else {
-         /* Compare the free space. */
-         if (diskInfo->partitionList[matchedPartition].freeBytes !=
-             cachedDiskInfo->partitionList[index].freeBytes) {
-            g_debug("Free space changed\n");
+         uint64 newFree = diskInfo->partitionList[matchedPartition].freeBytes;
+         uint64 oldFree = cachedDiskInfo->partitionList[index].freeBytes;
+         uint64 total = cachedDiskInfo->partitionList[index].totalBytes;
+         uint64 delta = newFree > oldFree ? newFree - oldFree
+                                          : oldFree - newFree;
+
+         if (diskInfo->partitionList[matchedPartition].totalBytes != total) {
+            g_debug("Total space changed\n");
             return TRUE;
          }
-         if (diskInfo->partitionList[matchedPartition].totalBytes !=
-            cachedDiskInfo->partitionList[index].totalBytes) {
-            g_debug("Total space changed\n");
+         /* Compare the free space. */
+         if (delta > total / 100 * threshold) {
+            g_debug("Free space changed\n");
             return TRUE;
          }
       }
@@ -20,12 +20,13 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <sys/wait.h>
 #include <string.h>
 
 #include "vm_basic_defs.h"
 #include "vmware.h"
-#include "strutil.h"
 #include "debug.h"
 #include "guestInfoInt.h"
 #include "guestStats.h"
@@ -42,6 +43,21 @@
 #define ZONEINFO_FILE    "/proc/zoneinfo"
 #define SWAPPINESS_FILE  "/proc/sys/vm/swappiness"
 
+/*
+ * The /proc files are read in chunks of this size. Lines longer than this
+ * (e.g. the "intr" line of /proc/stat on large systems) are skipped; none
+ * of the fields we look for live on such lines.
+ */
+#define GUEST_INFO_PROC_BUF_SIZE 16384
+
+/*
+ * Size of the field name lookup table. Must be a power of 2 and comfortably
+ * larger than the number of queries so that a collision free seed is found
+ * quickly.
+ */
+#define GUEST_INFO_KEY_SLOTS     128
+#define GUEST_INFO_KEY_MAX_SEEDS 4096
+
 
 /*
  * For now, all data collection is of uint64 values. Rates are always returned
@@ -99,11 +115,6 @@ typedef struct {
 } GuestInfoStat;
 
 typedef struct {
-   HashTable       *exactMatches;
-
-   uint32           numRegExps;
-   GuestInfoStat  **regExps;
-
    uint32           numStats;
    GuestInfoStat   *stats;
 
@@ -113,17 +124,59 @@ typedef struct {
    double           timeStamp;
 } GuestInfoCollector;
 
+/*
+ * The /proc files we sample. They are opened once and re-read with pread
+ * on every collection.
+ */
+
+typedef struct {
+   const char      *pathName;
+   Bool             colonTerminated;  // Field names are followed by a ':'
+   uint32           prefixLengths;    // Bit N: a prefix key of length N
+   int              fd;
+} GuestInfoProcFile;
+
+static GuestInfoProcFile guestInfoProcFiles[] = {
+   { MEMINFO_FILE,  TRUE,  0, -1 },
+   { VMSTAT_FILE,   FALSE, 0, -1 },
+   { STAT_FILE,     FALSE, 0, -1 },
+   { ZONEINFO_FILE, FALSE, 0, -1 },
+};
+
+#define N_PROC_FILES ARRAYSIZE(guestInfoProcFiles)
+
+static int guestInfoUpTimeFd = -1;
+
+/*
+ * Field name lookup table, built once from the query table. The seed is
+ * chosen so that every key lands in its own slot, so a lookup is a hash
+ * and a single compare.
+ */
+
+typedef struct {
+   const char      *name;      // NULL: slot is empty
+   uint32           nameLen;
+   uint32           source;    // Index into guestInfoProcFiles
+   Bool             isPrefix;
+   uint32           stat;      // Index into GuestInfoCollector.stats
+} GuestInfoKey;
+
+static GuestInfoKey guestInfoKeys[GUEST_INFO_KEY_SLOTS];
+static uint32 guestInfoKeySeed;
+
+static char guestInfoProcBuf[GUEST_INFO_PROC_BUF_SIZE];
+
 
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoGetUpTime --
+ * GuestInfoKeySlot --
  *
- *      What time is it?
+ *      Hash a field name of the specified source file into the lookup
+ *      table (FNV-1a).
  *
  * Results:
- *      TRUE   Success! *now is populated
- *      FALSE  Failure! *now remains unchanged
+ *      The slot index.
  *
  * Side effects:
  *      None.
@@ -131,98 +184,127 @@ typedef struct {
  *----------------------------------------------------------------------
  */
 
-static Bool
-GuestInfoGetUpTime(double *now)  // OUT:
+static INLINE uint32
+GuestInfoKeySlot(uint32 seed,       // IN:
+                 uint32 source,     // IN:
+                 const char *name,  // IN: not NUL terminated
+                 uint32 nameLen)    // IN:
 {
-   char line[512];
-   Bool result = FALSE;
-   FILE *fp = Posix_Fopen(UPTIME_FILE, "r");
+   uint32 i;
+   uint32 hash = 2166136261U ^ seed;
 
-   if (fp == NULL) {
-      return result;
+   for (i = 0; i < nameLen; i++) {
+      hash ^= (uint8)name[i];
+      hash *= 16777619U;
    }
 
-   if (fgets(line, sizeof line, fp) != NULL) {
-      double idle;
-
-      if (sscanf(line, "%lf %lf", now, &idle) == 2) {
-         result = TRUE;
-      }
-   }
+   hash ^= source;
+   hash *= 16777619U;
 
-   fclose(fp);
-
-   return result;
+   return (hash ^ (hash >> 15)) & (GUEST_INFO_KEY_SLOTS - 1);
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoStoreStat --
+ * GuestInfoBuildKeyTable --
  *
- *      Store a stat.
+ *      Build the field name lookup table from the query table. Seeds
+ *      are tried until one places every key in its own slot.
  *
  * Results:
- *      None.
+ *      TRUE   Success!
+ *      FALSE  Failure! No collision free seed was found.
  *
  * Side effects:
- *      Handles overflow detection.
+ *      Fills guestInfoKeys, guestInfoKeySeed and the prefix lengths of
+ *      guestInfoProcFiles.
  *
  *----------------------------------------------------------------------
  */
 
-static void
-GuestInfoStoreStat(const char *pathName,  // IN: file stat is in
-                   GuestInfoStat *stat,   // IN/OUT: stat
-                   uint64 value)          // IN: value to be added to stat
+static Bool
+GuestInfoBuildKeyTable(GuestInfoQuery *queries,  // IN:
+                       uint32 numQueries)        // IN:
 {
-   ASSERT(stat);
-   ASSERT(stat->query);
+   uint32 seed;
 
-   // TODO: consider supporting regexp here.
-   if (strcmp(stat->query->sourceFile, pathName) == 0) {
-      switch (stat->err) {
-      case 0:
-         ASSERT(stat->count != 0);
+   for (seed = 0; seed < GUEST_INFO_KEY_MAX_SEEDS; seed++) {
+      uint32 i;
+      Bool collision = FALSE;
 
-         if (((stat->count + 1) < stat->count) ||
-             ((stat->value + value) < stat->value)) {
-            stat->err = EOVERFLOW;
-         } else {
-            stat->count++;
-            stat->value += value;
+      memset(guestInfoKeys, 0, sizeof guestInfoKeys);
+
+      for (i = 0; i < N_PROC_FILES; i++) {
+         guestInfoProcFiles[i].prefixLengths = 0;
+      }
+
+      for (i = 0; i < numQueries && !collision; i++) {
+         GuestInfoQuery *query = &queries[i];
+         GuestInfoKey *key;
+         uint32 source;
+         uint32 nameLen;
+
+         if (!query->collect || query->locatorString == NULL) {
+            continue;
          }
-         break;
 
-      case ENOENT:
-         ASSERT(stat->count == 0);
+         for (source = 0; source < N_PROC_FILES; source++) {
+            if (strcmp(guestInfoProcFiles[source].pathName,
+                       query->sourceFile) == 0) {
+               break;
+            }
+         }
 
-         stat->err = 0;
-         stat->count = 1;
-         stat->value = value;
-         break;
+         ASSERT(source < N_PROC_FILES);
+         if (source == N_PROC_FILES) {
+            continue;
+         }
 
-      default:  // Some sort of error - sorry, thank you for playing...
-         break;
+         nameLen = strlen(query->locatorString);
+         key = &guestInfoKeys[GuestInfoKeySlot(seed, source,
+                                               query->locatorString,
+                                               nameLen)];
+
+         if (key->name != NULL) {
+            collision = TRUE;
+            break;
+         }
+
+         key->name = query->locatorString;
+         key->nameLen = nameLen;
+         key->source = source;
+         key->isPrefix = query->isRegExp;
+         key->stat = i;
+
+         if (query->isRegExp) {
+            ASSERT(nameLen > 0 && nameLen < 32);
+            guestInfoProcFiles[source].prefixLengths |= 1U << nameLen;
+         }
+      }
+
+      if (!collision) {
+         guestInfoKeySeed = seed;
+         return TRUE;
       }
    }
+
+   g_warning("%s: Unable to build the field lookup table.\n", __FUNCTION__);
+
+   return FALSE;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoCollectStat --
- *
- *      Collect a stat.
+ * GuestInfoLookupKey --
  *
- *      NOTE: Exact match data cannot be used in a regExp. This is a
- *            performance choice. We can discuss this when we have full
- *            programmability.
+ *      Look up a field name of the specified source file.
  *
  * Results:
- *      None.
+ *      The matching key or NULL.
  *
  * Side effects:
  *      None.
@@ -230,42 +312,89 @@ GuestInfoStoreStat(const char *pathName,  // IN: file stat is in
  *----------------------------------------------------------------------
  */
 
-static void
-GuestInfoCollectStat(const char *pathName,           // IN:
-                     GuestInfoCollector *collector,  // IN/OUT:
-                     const char *fieldName,          // IN:
-                     uint64 value)                   // IN:
+static INLINE GuestInfoKey *
+GuestInfoLookupKey(uint32 source,     // IN:
+                   const char *name,  // IN: not NUL terminated
+                   uint32 nameLen,    // IN:
+                   Bool isPrefix)     // IN:
 {
-   GuestInfoStat *stat = NULL;
+   GuestInfoKey *key = &guestInfoKeys[GuestInfoKeySlot(guestInfoKeySeed,
+                                                       source, name,
+                                                       nameLen)];
+
+   if ((key->name != NULL) &&
+       (key->nameLen == nameLen) &&
+       (key->source == source) &&
+       (key->isPrefix == isPrefix) &&
+       (memcmp(key->name, name, nameLen) == 0)) {
+      return key;
+   }
 
-   if (!HashTable_Lookup(collector->exactMatches, fieldName, (void **) &stat)) {
-      uint32 i;
+   return NULL;
+}
 
-      for (i = 0; i < collector->numRegExps; i++) {
-         GuestInfoStat *thisOne = collector->regExps[i];
 
-         if (StrUtil_StartsWith(fieldName, thisOne->query->locatorString)) {
-            stat = thisOne;
-         }
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoProcRead --
+ *
+ *      pread from one of our persistently open /proc files, opening it
+ *      first if necessary.
+ *
+ * Results:
+ *      The number of bytes read, or -1 on failure (the file is closed
+ *      and reopened on the next call).
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ssize_t
+GuestInfoProcRead(const char *pathName,  // IN:
+                  int *fd,               // IN/OUT:
+                  char *buf,             // OUT:
+                  size_t bufSize,        // IN:
+                  off_t offset)          // IN:
+{
+   ssize_t bytesRead;
+
+   if (*fd < 0) {
+      *fd = Posix_Open(pathName, O_RDONLY | O_CLOEXEC);
+
+      if (*fd < 0) {
+         g_warning("%s: Error opening %s.\n", __FUNCTION__, pathName);
+         return -1;
       }
    }
 
-   if (stat != NULL) {
-      GuestInfoStoreStat(pathName, stat, value);
+   do {
+      bytesRead = pread(*fd, buf, bufSize, offset);
+   } while (bytesRead < 0 && errno == EINTR);
+
+   if (bytesRead < 0) {
+      g_warning("%s: Error reading %s: %d.\n", __FUNCTION__, pathName,
+                errno);
+      close(*fd);
+      *fd = -1;
    }
+
+   return bytesRead;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * GuestInfoReadProcMemInfoData --
+ * GuestInfoGetUpTime --
  *
- *      Reads /proc/meminfo to contribute to a collection.
+ *      What time is it?
  *
  * Results:
- *      TRUE   Success!
- *      FALSE  Failure!
+ *      TRUE   Success! *now is populated
+ *      FALSE  Failure! *now remains unchanged
  *
  * Side effects:
  *      None.
@@ -274,44 +403,169 @@ GuestInfoCollectStat(const char *pathName,           // IN:
  */
 
 static Bool
-GuestInfoProcMemInfoData(GuestInfoCollector *collector)  // IN:
+GuestInfoGetUpTime(double *now)  // OUT:
 {
    char line[512];
-   FILE *fp = Posix_Fopen(MEMINFO_FILE, "r");
+   double idle;
+   ssize_t bytesRead = GuestInfoProcRead(UPTIME_FILE, &guestInfoUpTimeFd,
+                                         line, sizeof line - 1, 0);
 
-   if (fp == NULL) {
-      g_warning("%s: Error opening " MEMINFO_FILE ".\n", __FUNCTION__);
+   if (bytesRead <= 0) {
       return FALSE;
    }
 
-   while (fgets(line, sizeof line, fp) == line) {
-      char *p;
-      uint64 value = 0;
-      char *fieldName = strtok(line, " \t");
-      char *fieldData = strtok(NULL, " \t");
+   line[bytesRead] = '\0';
 
-      if (fieldName == NULL) {
-         continue;
-      }
+   return sscanf(line, "%lf %lf", now, &idle) == 2;
+}
 
-      p = strrchr(fieldName, ':');
-      if (p == NULL) {
-         continue;
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoStoreStat --
+ *
+ *      Store a stat.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Handles overflow detection.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoStoreStat(GuestInfoStat *stat,   // IN/OUT: stat
+                   uint64 value)          // IN: value to be added to stat
+{
+   ASSERT(stat);
+   ASSERT(stat->query);
+
+   switch (stat->err) {
+   case 0:
+      ASSERT(stat->count != 0);
+
+      if (((stat->count + 1) < stat->count) ||
+          ((stat->value + value) < stat->value)) {
+         stat->err = EOVERFLOW;
       } else {
-        *p = '\0';
+         stat->count++;
+         stat->value += value;
       }
+      break;
 
-      if ((fieldData == NULL) ||
-          (sscanf(fieldData, "%"FMT64"u", &value) != 1)) {
-         continue;
+   case ENOENT:
+      ASSERT(stat->count == 0);
+
+      stat->err = 0;
+      stat->count = 1;
+      stat->value = value;
+      break;
+
+   default:  // Some sort of error - sorry, thank you for playing...
+      break;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GuestInfoCollectLine --
+ *
+ *      Parse one "<name>[:] <value> ..." line of a /proc file and collect
+ *      the value if the name is one we are looking for.
+ *
+ *      Exact matches take precedence over prefix matches; if several
+ *      prefixes match, the last one in the query table wins.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GuestInfoCollectLine(uint32 source,                  // IN:
+                     GuestInfoCollector *collector,  // IN/OUT:
+                     const char *line,               // IN:
+                     const char *end)                // IN: end of line
+{
+   GuestInfoProcFile *file = &guestInfoProcFiles[source];
+   GuestInfoKey *key;
+   const char *name;
+   const char *p = line;
+   uint32 nameLen;
+   uint64 value;
+
+   while (p < end && (*p == ' ' || *p == '\t')) {
+      p++;
+   }
+
+   name = p;
+
+   while (p < end && *p != ' ' && *p != '\t') {
+      p++;
+   }
+
+   nameLen = p - name;
+
+   if (file->colonTerminated) {
+      while (nameLen > 0 && name[nameLen - 1] != ':') {
+         nameLen--;
       }
 
-      GuestInfoCollectStat(MEMINFO_FILE, collector, fieldName, value);
+      if (nameLen == 0) {
+         return;
+      }
+
+      nameLen--;
    }
 
-   fclose(fp);
+   if (nameLen == 0) {
+      return;
+   }
 
-   return TRUE;
+   key = GuestInfoLookupKey(source, name, nameLen, FALSE);
+
+   if (key == NULL && file->prefixLengths != 0) {
+      uint32 len;
+
+      for (len = 1; len <= nameLen && len < 32; len++) {
+         if ((file->prefixLengths & (1U << len)) != 0) {
+            GuestInfoKey *prefix = GuestInfoLookupKey(source, name, len,
+                                                      TRUE);
+
+            if (prefix != NULL &&
+                (key == NULL || prefix->stat > key->stat)) {
+               key = prefix;
+            }
+         }
+      }
+   }
+
+   if (key == NULL) {
+      return;
+   }
+
+   while (p < end && (*p == ' ' || *p == '\t')) {
+      p++;
+   }
+
+   if (p == end || *p < '0' || *p > '9') {
+      return;
+   }
+
+   for (value = 0; p < end && *p >= '0' && *p <= '9'; p++) {
+      value = value * 10 + (*p - '0');
+   }
+
+   GuestInfoStoreStat(&collector->stats[key->stat], value);
 }
 
 
@@ -320,7 +574,9 @@ GuestInfoProcMemInfoData(GuestInfoCollector *collector)  // IN:
  *
  * GuestInfoProcData --
  *
- *      Reads a "stat file" and contribute to the collection.
+ *      Reads a "stat file" and contribute to the collection. The file is
+ *      read in a single pass through a fixed buffer; no memory is
+ *      allocated.
  *
  * Results:
  *      TRUE   Success!
@@ -333,36 +589,56 @@ GuestInfoProcMemInfoData(GuestInfoCollector *collector)  // IN:
  */
 
 static Bool
-GuestInfoProcData(const char *pathName,           // IN: path name
+GuestInfoProcData(uint32 source,                  // IN: guestInfoProcFiles
                   GuestInfoCollector *collector)  // IN:
 {
-   char line[4096];
-   FILE *fp = Posix_Fopen(pathName, "r");
+   GuestInfoProcFile *file = &guestInfoProcFiles[source];
+   char *buf = guestInfoProcBuf;
+   Bool skipping = FALSE;
+   size_t used = 0;
+   off_t offset = 0;
+
+   for (;;) {
+      char *start = buf;
+      char *newline;
+      ssize_t bytesRead = GuestInfoProcRead(file->pathName, &file->fd,
+                                            buf + used,
+                                            GUEST_INFO_PROC_BUF_SIZE - used,
+                                            offset);
+
+      if (bytesRead < 0) {
+         return FALSE;
+      }
 
-   if (fp == NULL) {
-      g_warning("%s: Error opening %s.\n", __FUNCTION__, pathName);
-      return FALSE;
-   }
+      if (bytesRead == 0) {
+         if (used != 0 && !skipping) {
+            GuestInfoCollectLine(source, collector, buf, buf + used);
+         }
+         break;
+      }
 
-   while (fgets(line, sizeof line, fp) != NULL) {
-      uint64 value = 0;
-      char *fieldName = strtok(line, " \t");
-      char *fieldData = strtok(NULL, " \t");
+      offset += bytesRead;
+      used += bytesRead;
 
-      if (fieldName == NULL) {
-         continue;
+      while ((newline = memchr(start, '\n', buf + used - start)) != NULL) {
+         if (!skipping) {
+            GuestInfoCollectLine(source, collector, start, newline);
+         }
+         skipping = FALSE;
+         start = newline + 1;
       }
 
-      if ((fieldData == NULL) ||
-          (sscanf(fieldData, "%"FMT64"u", &value) != 1)) {
-         continue;
-      }
+      used = buf + used - start;
 
-      GuestInfoCollectStat(pathName, collector, fieldName, value);
+      if (used == GUEST_INFO_PROC_BUF_SIZE) {
+         /* A line that does not fit; drop it. */
+         skipping = TRUE;
+         used = 0;
+      } else if (used != 0) {
+         memmove(buf, start, used);
+      }
    }
 
-   fclose(fp);
-
    return TRUE;
 }
 
@@ -477,10 +753,10 @@ GuestInfoCollect(GuestInfoCollector *collector)  // IN:
    }
 
    /* Collect new values */
-   GuestInfoProcMemInfoData(collector);
-   GuestInfoProcData(VMSTAT_FILE, collector);
-   GuestInfoProcData(STAT_FILE, collector);
-   GuestInfoProcData(ZONEINFO_FILE, collector);
+   for (i = 0; i < N_PROC_FILES; i++) {
+      GuestInfoProcData(i, collector);
+   }
+
    GuestInfoDeriveSwapData(collector);
 
    collector->timeData = GuestInfoGetUpTime(&collector->timeStamp);
@@ -1008,9 +1284,7 @@ static void
 GuestInfoDestroyCollector(GuestInfoCollector *collector)  // IN:
 {
    if (collector != NULL) {
-      HashTable_Free(collector->exactMatches);
       HashTable_Free(collector->reportMap);
-      free(collector->regExps);
       free(collector->stats);
       free(collector);
    }
@@ -1039,7 +1313,6 @@ GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
                             uint32 numQueries)        // IN:
 {
    uint32 i;
-   uint32 regExp = 0;
    GuestInfoCollector *collector = calloc(1, sizeof *collector);
 
    if (collector == NULL) {
@@ -1048,36 +1321,21 @@ GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
 
    collector->reportMap = HashTable_Alloc(256, HASH_INT_KEY, NULL);
 
-   collector->exactMatches = HashTable_Alloc(256,
-                                           HASH_STRING_KEY | HASH_FLAG_COPYKEY,
-                                             NULL);
-
-   collector->numRegExps = 0;
-   for (i = 0; i < numQueries; i++) {
-      if (queries[i].isRegExp && queries[i].collect) {
-         collector->numRegExps++;
-      }
-   }
-
    collector->numStats = numQueries;
    collector->stats = calloc(numQueries, sizeof *collector->stats);
-   collector->regExps = calloc(collector->numRegExps, sizeof(GuestInfoStat *));
 
-   if ((collector->exactMatches == NULL) ||
-       (collector->reportMap == NULL) ||
-       ((collector->numRegExps != 0) && (collector->regExps == NULL)) ||
+   if ((collector->reportMap == NULL) ||
        ((collector->numStats != 0) && (collector->stats == NULL))) {
       GuestInfoDestroyCollector(collector);
       return NULL;
    }
 
-   regExp = 0;
-
    for (i = 0; i < numQueries; i++) {
       GuestInfoQuery *query = &queries[i];
       GuestInfoStat *stat = &collector->stats[i];
 
       ASSERT(query->reportID);
+      ASSERT(!query->isRegExp || query->locatorString != NULL);
 
       stat->query = query;
 
@@ -1085,17 +1343,6 @@ GuestInfoConstructCollector(GuestInfoQuery *queries,  // IN:
          continue;
       }
 
-      if (query->isRegExp) {
-         ASSERT(query->locatorString);
-
-         collector->regExps[regExp++] = stat;
-      } else {
-         if (query->locatorString != NULL) {
-            HashTable_Insert(collector->exactMatches, query->locatorString,
-                              stat);
-         }
-      }
-
       /* The report lookup */
       HashTable_Insert(collector->reportMap, INT_AS_HASHKEY(query->reportID),
                        stat);
@@ -1136,8 +1383,16 @@ GuestInfo_PerfMon(DynBuf *statBuf)  // IN/OUT: inited, ready to fill
       return FALSE;
    }
 
-   /* First time through, allocate all necessary memory */
+   /*
+    * First time through, allocate all necessary memory. The collectors, the
+    * field lookup table and the /proc file descriptors are kept for the
+    * life of the process so that sampling does not allocate.
+    */
    if (previous == NULL) {
+      if (!GuestInfoBuildKeyTable(guestInfoQuerySpecTable, N_QUERIES)) {
+         return FALSE;
+      }
+
       current = GuestInfoConstructCollector(guestInfoQuerySpecTable,
                                             N_QUERIES);
 
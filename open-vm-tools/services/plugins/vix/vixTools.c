@@ -183,6 +183,10 @@ static VGAuthUserHandle *currentUserHandle = NULL;
 char *gImpersonatedUsername = NULL;
 
 
+/*
+ * Program completion is event driven; this only paces the cleanup of
+ * finished programs while VIX commands are restricted.
+ */
 #define SECONDS_BETWEEN_POLL_TEST_FINISHED     1
 
 /*
@@ -313,6 +317,14 @@ typedef struct VixToolsStartedProgramState {
 
 static VixToolsStartedProgramState *startedProcessList = NULL;
 
+/*
+ * Index of startedProcessList by pid. If a pid shows up twice (the OS
+ * re-used it before the old record was reaped), the newest record wins.
+ */
+static GHashTable *startedProcessTable = NULL;
+
+#define STARTED_PROCESS_KEY(pid) GSIZE_TO_POINTER((gsize) (pid))
+
 /*
  * How long we keep the info of exited processes.
  */
@@ -333,9 +345,50 @@ static GHashTable *listProcessesResultsTable = NULL;
  */
 #define  SECONDS_UNTIL_LISTPROC_CACHE_CLEANUP   (10 * 60)
 
+/*
+ * One <proc> entry of the ListProcessesEx results.
+ *
+ * Entries for processes we didn't start are kept in procSnapshotTable
+ * between requests, along with the data they were generated from, so
+ * the XML for a process is only regenerated when something about it
+ * changed. 'generation' is the snapshot generation in which the entry
+ * was (re)generated, 'lastSeen' the last one in which its process was
+ * listed.
+ *
+ * Entries are reference counted; a result being paged out keeps its
+ * entries even if the snapshot drops or replaces them meanwhile.
+ */
+typedef struct VixToolsProcEntry {
+   int refCount;
+   uint32 generation;
+   uint32 lastSeen;
+   uint64 pid;
+   time_t startTime;
+   char *cmdName;
+   char *cmdLine;
+   char *owner;
+   char *xml;
+   size_t xmlLen;
+} VixToolsProcEntry;
+
+static GHashTable *procSnapshotTable = NULL;
+static uint32 procSnapshotGeneration = 0;
+
+#define PROC_SNAPSHOT_KEY(pid) GSIZE_TO_POINTER((gsize) (pid))
+
+/*
+ * The results of one ListProcessesEx request: the entries in order and
+ * their offsets in the result string. The string itself is only put
+ * together one page at a time.
+ */
+typedef struct VixToolsProcList {
+   GPtrArray *entries;
+   size_t *offsets;
+   size_t size;             // including the terminating NUL
+} VixToolsProcList;
+
 typedef struct VixToolsCachedListProcessesResult {
-   char *resultBuffer;
-   size_t resultBufferLen;
+   VixToolsProcList *procList;
    int key;
 #ifdef _WIN32
    wchar_t *userName;
@@ -351,6 +404,13 @@ static uint32 listProcessesResultsKey = 1;
 
 static void VixToolsFreeCachedResult(gpointer p);
 
+static void VixToolsProcEntryUnref(gpointer p);
+static void VixToolsFreeProcList(VixToolsProcList *procList);
+static void VixToolsProcListCopy(const VixToolsProcList *procList,
+                                 size_t offset,
+                                 size_t len,
+                                 char *dst);
+
 /*
  * This structure is designed to implemente CreateTemporaryFile,
  * CreateTemporaryDirectory VI guest operations.
@@ -361,6 +421,55 @@ typedef struct VixToolsGetTempFileCreateNameFuncData {
    char *fileSuffix;
 } VixToolsGetTempFileCreateNameFuncData;
 
+/*
+ * ListFiles cursors.
+ *
+ * Clients page through a large directory by repeating ListFiles with a
+ * growing index. The first request snapshots the entries matching the
+ * pattern; later pages of the same directory and pattern are served
+ * from that snapshot rather than listing, matching and stat()ing the
+ * whole directory again.
+ *
+ * 'fileNum' is an entry's position in the full listing (including '.'
+ * and '..'), which is what the request offset and index count.
+ */
+typedef struct VixToolsListFilesEntry {
+   int fileNum;
+   char *fileName;
+   char *info;              // extended info, filled in when first returned
+   size_t infoLen;
+} VixToolsListFilesEntry;
+
+typedef struct VixToolsListFilesCursor {
+   char *key;
+   char *dirPathName;
+   Bool listingSingleFile;
+   VixToolsListFilesEntry *entries;
+   int numEntries;
+   GSource *timer;
+   uint64 lastUse;          // listFilesCursorUses when last touched
+#ifdef _WIN32
+   wchar_t *userName;
+#else
+   uid_t euid;
+#endif
+} VixToolsListFilesCursor;
+
+static GHashTable *listFilesCursorTable = NULL;
+static uint64 listFilesCursorUses = 0;
+
+/*
+ * How long an unused ListFiles cursor is kept.
+ */
+#define  SECONDS_UNTIL_LISTFILES_CURSOR_CLEANUP   (2 * 60)
+
+/*
+ * How many ListFiles cursors are kept at most. Each one holds a
+ * directory snapshot, so when a new one would exceed this the least
+ * recently used one is dropped.
+ */
+#define  MAX_LISTFILES_CURSORS   32
+
 /*
  * Global state.
  */
@@ -408,6 +517,10 @@ static VixError VixToolsGetFileInfo(VixCommandRequestHeader *requestMsg,
 
 static VixError VixToolsSetFileAttributes(VixCommandRequestHeader *requestMsg);
 
+static void VixToolsWatchAsyncProc(ProcMgr_AsyncProc *procState,
+                                   GMainLoop *eventQueue,
+                                   GSourceFunc callback,
+                                   void *clientData);
 static gboolean VixToolsMonitorAsyncProc(void *clientData);
 static gboolean VixToolsMonitorStartProgram(void *clientData);
 static void VixToolsRegisterHgfsSessionInvalidator(void *clientData);
@@ -475,6 +588,7 @@ static void VixToolsFreeStartProgramState(VixToolsStartProgramState *asyncState)
 
 static void VixToolsUpdateStartedProgramList(VixToolsStartedProgramState *state);
 static void VixToolsFreeStartedProgramState(VixToolsStartedProgramState *state);
+VixToolsStartedProgramState *VixToolsFindStartedProgramState(uint64 pid);
 
 static VixError VixToolsStartProgramImpl(const char *requestName,
                                          const char *programPath,
@@ -534,6 +648,7 @@ static VixError VixToolsListDirectory(VixCommandRequestHeader *requestMsg,
 
 static VixError VixToolsListFiles(VixCommandRequestHeader *requestMsg,
                                   size_t maxBufferSize,
+                                  GMainLoop *eventQueue,
                                   char **result);
 
 static VixError VixToolsInitiateFileTransferFromGuest(VixCommandRequestHeader *requestMsg,
@@ -771,6 +886,16 @@ VixTools_Uninitialize(void) // IN
    }
 
    HgfsServerManager_Unregister(&gVixHgfsBkdrConn);
+
+   if (NULL != procSnapshotTable) {
+      g_hash_table_destroy(procSnapshotTable);
+      procSnapshotTable = NULL;
+   }
+
+   if (NULL != listFilesCursorTable) {
+      g_hash_table_destroy(listFilesCursorTable);
+      listFilesCursorTable = NULL;
+   }
 }
 
 
@@ -1387,7 +1512,6 @@ VixToolsRunProgramImpl(char *requestName,      // IN
    STARTUPINFO si;
    wchar_t *envBlock = NULL;
 #endif
-   GSource *timer;
 
    if (NULL != pid) {
       *pid = (int64) -1;
@@ -1520,13 +1644,11 @@ VixToolsRunProgramImpl(char *requestName,      // IN
    }
 
    /*
-    * Start a periodic procedure to check the app periodically
+    * Get notified when the program exits.
     */
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorAsyncProc, asyncState);
 
    /*
     * VixToolsMonitorAsyncProc will clean asyncState up when the program finishes.
@@ -1595,7 +1717,6 @@ VixToolsStartProgramImpl(const char *requestName,            // IN
    wchar_t *envBlock = NULL;
    Bool envBlockFromMalloc = TRUE;
 #endif
-   GSource *timer;
 
    /*
     * Initialize this here so we can call free on its member variables in abort
@@ -1776,13 +1897,11 @@ VixToolsStartProgramImpl(const char *requestName,            // IN
            __FUNCTION__, fullCommandLine, *pid);
 
    /*
-    * Start a periodic procedure to check the app periodically
+    * Get notified when the program exits.
     */
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorStartProgram, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorStartProgram, asyncState);
 
    /*
     * VixToolsMonitorStartProgram will clean asyncState up when the program
@@ -1811,12 +1930,48 @@ abort:
 } // VixToolsStartProgramImpl
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsWatchAsyncProc --
+ *
+ *    Arranges for the callback to be called from the event queue once
+ *    the given program exits.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsWatchAsyncProc(ProcMgr_AsyncProc *procState, // IN
+                       GMainLoop *eventQueue,        // IN
+                       GSourceFunc callback,         // IN
+                       void *clientData)             // IN
+{
+   GSource *watch;
+
+#if defined(_WIN32)
+   watch = VMTools_NewHandleSource(ProcMgr_GetAsyncProcSelectable(procState));
+#else
+   watch = ProcMgr_NewAsyncProcSource(procState);
+#endif
+   g_source_set_callback(watch, callback, clientData, NULL);
+   g_source_attach(watch, g_main_loop_get_context(eventQueue));
+   g_source_unref(watch);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * VixToolsMonitorAsyncProc --
  *
- *    This polls a program running in the guest to see if it has completed.
+ *    Called when a program running in the guest has completed.
  *    It is used by the test/dev code to detect when a test application
  *    completes.
  *
@@ -1835,7 +1990,6 @@ VixToolsMonitorAsyncProc(void *clientData) // IN
 {
    VixError err = VIX_OK;
    VixToolsRunProgramState *asyncState;
-   Bool procIsRunning = FALSE;
    int exitCode = 0;
    ProcMgr_Pid pid = -1;
    int result = -1;
@@ -1847,28 +2001,21 @@ VixToolsMonitorAsyncProc(void *clientData) // IN
    ASSERT(asyncState);
 
    /*
-    * Check if the program has completed and VIX commands
-    * are not being restricted. Performing cleanup involving
+    * The program has completed. Don't clean up while VIX commands
+    * are being restricted. Performing cleanup involving
     * IO would deadlock the operations like quiesce snapshot
     * that freeze the filesystem.
     */
-   procIsRunning = ProcMgr_IsAsyncProcRunning(asyncState->procState);
-   if (!procIsRunning) {
-      if (gRestrictCommands) {
-         g_debug("%s: Deferring RunScript cleanup due to IO freeze\n",
-                 __FUNCTION__);
-      } else {
-         goto cleanup;
-      }
-   }
-
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(asyncState->eventQueue));
-   g_source_unref(timer);
-   return FALSE;
+   if (gRestrictCommands) {
+      g_debug("%s: Deferring RunScript cleanup due to IO freeze\n",
+              __FUNCTION__);
 
-cleanup:
+      timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
+      g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
+      g_source_attach(timer, g_main_loop_get_context(asyncState->eventQueue));
+      g_source_unref(timer);
+      return FALSE;
+   }
 
    /*
     * We need to always check the exit code, even if there is no need to
@@ -1995,8 +2142,8 @@ VixToolsRegisterHgfsSessionInvalidator(void *clientData)    // IN:
  *
  * VixToolsMonitorStartProgram --
  *
- *    This polls a program started by StartProgram to see if it has completed.
- *    If it has, saves off its exitCode and endTime so they can be queried
+ *    Called when a program started by StartProgram has completed.
+ *    Saves off its exitCode and endTime so they can be queried
  *    via ListProcessesEx.
  *
  * Return value:
@@ -2013,32 +2160,14 @@ static gboolean
 VixToolsMonitorStartProgram(void *clientData) // IN
 {
    VixToolsStartProgramState *asyncState;
-   Bool procIsRunning = FALSE;
    int exitCode = 0;
    ProcMgr_Pid pid = -1;
    int result = -1;
    VixToolsStartedProgramState *spState;
-   GSource *timer;
 
    asyncState = (VixToolsStartProgramState *) clientData;
    ASSERT(asyncState);
 
-   /*
-    * Check if the program has completed.
-    */
-   procIsRunning = ProcMgr_IsAsyncProcRunning(asyncState->procState);
-   if (!procIsRunning) {
-      goto done;
-   }
-
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorStartProgram, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(asyncState->eventQueue));
-   g_source_unref(timer);
-   return FALSE;
-
-done:
-
    result = ProcMgr_GetExitCode(asyncState->procState, &exitCode);
    pid = ProcMgr_GetPid(asyncState->procState);
    if (0 != result) {
@@ -2104,38 +2233,33 @@ VixToolsUpdateStartedProgramList(VixToolsStartedProgramState *state)        // I
     * Update the 'running' record if the process has completed.
     */
    if (state && (state->isRunning == FALSE)) {
-      spList = startedProcessList;
-      while (spList) {
-         if (spList->pid == state->pid) {
-            /*
-             * Update the two exit fields now that we have them
-             */
-            spList->exitCode = state->exitCode;
-            spList->endTime = state->endTime;
-            spList->isRunning = FALSE;
+      spList = VixToolsFindStartedProgramState(state->pid);
+      if (spList) {
+         /*
+          * Update the two exit fields now that we have them
+          */
+         spList->exitCode = state->exitCode;
+         spList->endTime = state->endTime;
+         spList->isRunning = FALSE;
 
-            /*
-             * Don't let the procState be free'd on Windows to
-             * keep OS from reusing the pid. We need to free
-             * procState in case of Posix to avoid unnecessary
-             * caching of FDs, which might make the service run
-             * out of FDs as FDs are limited (usually 1024 by
-             * default) for a process.
-             */
+         /*
+          * Don't let the procState be free'd on Windows to
+          * keep OS from reusing the pid. We need to free
+          * procState in case of Posix to avoid unnecessary
+          * caching of FDs, which might make the service run
+          * out of FDs as FDs are limited (usually 1024 by
+          * default) for a process.
+          */
 #ifdef WIN32
-            spList->procState = state->procState;
-            state->procState = NULL;
+         spList->procState = state->procState;
+         state->procState = NULL;
 #else
-            spList->procState = NULL;
+         spList->procState = NULL;
 #endif
 
-            VixToolsFreeStartedProgramState(state);
-            // NULL it out so we don't try to add it later in this function
-            state  = NULL;
-            break;
-         } else {
-            spList = spList->next;
-         }
+         VixToolsFreeStartedProgramState(state);
+         // NULL it out so we don't try to add it later in this function
+         state  = NULL;
       }
    }
 
@@ -2167,6 +2291,11 @@ VixToolsUpdateStartedProgramList(VixToolsStartedProgramState *state)        // I
          }
          old = spList;
          spList = spList->next;
+         if (g_hash_table_lookup(startedProcessTable,
+                                 STARTED_PROCESS_KEY(old->pid)) == old) {
+            g_hash_table_remove(startedProcessTable,
+                                STARTED_PROCESS_KEY(old->pid));
+         }
          VixToolsFreeStartedProgramState(old);
       } else {
          last = spList;
@@ -2184,6 +2313,12 @@ VixToolsUpdateStartedProgramList(VixToolsStartedProgramState *state)        // I
       } else {
          startedProcessList = state;
       }
+
+      if (NULL == startedProcessTable) {
+         startedProcessTable = g_hash_table_new(g_direct_hash, g_direct_equal);
+      }
+      g_hash_table_insert(startedProcessTable,
+                          STARTED_PROCESS_KEY(state->pid), state);
    }
 
 } // VixToolsUpdateStartedProgramList
@@ -2228,8 +2363,8 @@ VixToolsFreeStartedProgramState(VixToolsStartedProgramState *spState) // IN
  *
  * VixToolsFindStartedProgramState --
  *
- *    Searches the list of running/exited apps to see if the given
- *    pid was started via StartProgram.
+ *    Looks up the given pid in the list of running/exited apps to see
+ *    if it was started via StartProgram.
  *
  * Results:
  *    Any state matching the given pid.
@@ -2243,14 +2378,19 @@ VixToolsFreeStartedProgramState(VixToolsStartedProgramState *spState) // IN
 VixToolsStartedProgramState *
 VixToolsFindStartedProgramState(uint64 pid)
 {
-   VixToolsStartedProgramState *spList;
+   VixToolsStartedProgramState *spState;
 
-   spList = startedProcessList;
-   while (spList) {
-      if (spList->pid == pid) {
-         return spList;
-      }
-      spList = spList->next;
+   if (NULL == startedProcessTable) {
+      return NULL;
+   }
+
+   /*
+    * The key may be truncated on 32-bit hosts, so check the match.
+    */
+   spState = g_hash_table_lookup(startedProcessTable,
+                                 STARTED_PROCESS_KEY(pid));
+   if ((NULL != spState) && (spState->pid == pid)) {
+      return spState;
    }
 
    return NULL;
@@ -5129,7 +5269,7 @@ VixToolsFreeCachedResult(gpointer ptr)          // IN
    VixToolsCachedListProcessesResult *p = (VixToolsCachedListProcessesResult *) ptr;
 
    if (NULL != p) {
-      free(p->resultBuffer);
+      VixToolsFreeProcList(p->procList);
 #ifdef _WIN32
       free(p->userName);
 #endif
@@ -5170,191 +5310,548 @@ VixToolsListProcCacheCleanup(void *clientData) // IN
 /*
  *-----------------------------------------------------------------------------
  *
- * VixToolsListProcessesExGenerateData --
+ * VixToolsStrEqual --
  *
- *    Does the work to generate the results into a string buffer.
+ *    Compares two strings, either of which may be NULL.
  *
  * Return value:
- *    VixError
+ *    TRUE if both are NULL or both have the same contents.
  *
  * Side effects:
- *    Allocates and creates the result buffer.
+ *    None
  *
  *-----------------------------------------------------------------------------
  */
 
-VixError
-VixToolsListProcessesExGenerateData(uint32 numPids,          // IN
-                                    const uint64 *pids,      // IN
-                                    size_t *resultSize,      // OUT
-                                    char **resultBuffer)     // OUT
+static INLINE Bool
+VixToolsStrEqual(const char *a,    // IN
+                 const char *b)    // IN
 {
-   VixError err = VIX_OK;
-   ProcMgrProcInfoArray *procList = NULL;
-   ProcMgrProcInfo *procInfo;
-   DynBuf dynBuffer;
-   VixToolsStartedProgramState *spList;
-   int numReported = 0;
-   int i;
-   int j;
-   Bool bRet;
-   size_t procCount;
+   return (a == b) || ((NULL != a) && (NULL != b) && (0 == strcmp(a, b)));
+}
 
-   DynBuf_Init(&dynBuffer);
 
-   /*
-    * First check the processes we've started via StartProgram, which
-    * will find those running and recently deceased.
-    */
-   VixToolsUpdateStartedProgramList(NULL);
-   if (numPids > 0) {
-      for (i = 0; i < numPids; i++) {
-         spList = startedProcessList;
-         while (spList) {
-            if (pids[i] == spList->pid) {
-               err = VixToolsPrintProcInfoEx(&dynBuffer,
-                                             spList->cmdName,
-                                             spList->fullCommandLine,
-                                             spList->pid,
-                                             spList->user,
-                                             (int) spList->startTime,
-                                             spList->exitCode,
-                                             (int) spList->endTime);
-               if (VIX_OK != err) {
-                  goto abort;
-               }
-               numReported++;
-               break;
-            }
-            spList = spList->next;
-         }
-      }
-   } else {
-      spList = startedProcessList;
-      while (spList) {
-         err = VixToolsPrintProcInfoEx(&dynBuffer,
-                                       spList->cmdName,
-                                       spList->fullCommandLine,
-                                       spList->pid,
-                                       spList->user,
-                                       (int) spList->startTime,
-                                       spList->exitCode,
-                                       (int) spList->endTime);
-         if (VIX_OK != err) {
-            goto abort;
-         }
-         spList = spList->next;
-      }
-   }
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsProcEntryUnref --
+ *
+ *    Drops a reference to a ListProcessesEx entry, freeing it when
+ *    it was the last one. Also used as the procSnapshotTable value
+ *    destroy func.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-   /*
-    * If we found data for all requested processes from the startedProcess
-    * list, then we're done.
-    */
-   if (numPids > 0 && (numPids == numReported)) {
-      g_debug("%s: found all %d requested pids on the startedProcess list; finished\n",
-              __FUNCTION__, numPids);
-      goto done;
-   }
+static void
+VixToolsProcEntryUnref(gpointer ptr)         // IN
+{
+   VixToolsProcEntry *entry = (VixToolsProcEntry *) ptr;
 
-   /*
-    * The startedProcess list didn't give everything we need, so
-    * ask the OS.
-    *
-    * XXX Need a smarter version of ProcMgr_ListProcesses().
-    * It should allow a list of pids for optimization, and
-    * return an error code so there's no risk of errno/LastError
-    * being clobbered.
-    */
-   procList = ProcMgr_ListProcesses();
-   if (NULL == procList) {
-      err = FoundryToolsDaemon_TranslateSystemErr();
-      goto abort;
+   if ((NULL == entry) || (--entry->refCount > 0)) {
+      return;
    }
 
+   free(entry->cmdName);
+   free(entry->cmdLine);
+   free(entry->owner);
+   free(entry->xml);
+   free(entry);
+}
+
 
-   /*
-    * Now look at the running list.  Note that we set endTime
-    * and exitCode to dummy values, since we'll be getting results on
-    * the Vix side with GetNthProperty, and can have a mix of live and
-    * dead processes.
-    */
-   procCount = ProcMgrProcInfoArray_Count(procList);
-   if (numPids > 0) {
-      for (i = 0; i < numPids; i++) {
-         // ignore it if its on the started list -- we added it above
-         if (VixToolsFindStartedProgramState(pids[i])) {
-            continue;
-         }
-         for (j = 0; j < procCount; j++) {
-            procInfo = ProcMgrProcInfoArray_AddressOf(procList, j);
-            if (pids[i] == procInfo->procId) {
-               err = VixToolsPrintProcInfoEx(&dynBuffer,
-                                             procInfo->procCmdName,
-                                             procInfo->procCmdLine,
-                                             procInfo->procId,
-                                             (NULL == procInfo->procOwner)
-                                             ? "" : procInfo->procOwner,
-                                             (int) procInfo->procStartTime,
-                                             0, 0);
-               if (VIX_OK != err) {
-                  goto abort;
-               }
-            }
-         }
-      }
-   } else {
-      for (i = 0; i < procCount; i++) {
-         procInfo = ProcMgrProcInfoArray_AddressOf(procList, i);
-         // ignore it if its on the started list -- we added it above
-         if (VixToolsFindStartedProgramState(procInfo->procId)) {
-            continue;
-         }
-         err = VixToolsPrintProcInfoEx(&dynBuffer,
-                                       procInfo->procCmdName,
-                                       procInfo->procCmdLine,
-                                       procInfo->procId,
-                                       (NULL == procInfo->procOwner)
-                                       ? "" : procInfo->procOwner,
-                                       (int) procInfo->procStartTime,
-                                       0, 0);
-         if (VIX_OK != err) {
-            goto abort;
-         }
-      }
-   }
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsProcEntryNew --
+ *
+ *    Creates a ListProcessesEx entry with a single reference.
+ *
+ * Return value:
+ *    VixError
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-done:
+static VixError
+VixToolsProcEntryNew(const char *cmd,               // IN
+                     const char *name,              // IN
+                     uint64 pid,                    // IN
+                     const char *user,              // IN
+                     int start,                     // IN
+                     int exitCode,                  // IN
+                     int exitTime,                  // IN
+                     VixToolsProcEntry **entry)     // OUT
+{
+   VixError err;
+   DynBuf dynBuffer;
 
-   // add the final NUL
-   bRet = DynBuf_Append(&dynBuffer, "", 1);
-   if (!bRet) {
-      err = VIX_E_OUT_OF_MEMORY;
-      goto abort;
+   DynBuf_Init(&dynBuffer);
+
+   err = VixToolsPrintProcInfoEx(&dynBuffer, cmd, name, pid, user, start,
+                                 exitCode, exitTime);
+   if (VIX_OK != err) {
+      DynBuf_Destroy(&dynBuffer);
+      return err;
    }
 
-   DynBuf_Trim(&dynBuffer);
-   *resultSize = DynBuf_GetSize(&dynBuffer);
-   *resultBuffer  = DynBuf_Detach(&dynBuffer);
+   *entry = Util_SafeCalloc(1, sizeof **entry);
+   (*entry)->refCount = 1;
+   (*entry)->pid = pid;
+   (*entry)->xmlLen = DynBuf_GetSize(&dynBuffer);
+   (*entry)->xml = DynBuf_Detach(&dynBuffer);
 
-abort:
-   DynBuf_Destroy(&dynBuffer);
-   ProcMgr_FreeProcList(procList);
-   return err;
+   return VIX_OK;
 }
 
 
 /*
  *-----------------------------------------------------------------------------
  *
- * VixToolsListProcessesEx --
+ * VixToolsProcSnapshotGetEntry --
  *
+ *    Returns the snapshot entry of a process, (re)generating it if the
+ *    process is new or changed since it was last listed.
  *
  * Return value:
  *    VixError
  *
  * Side effects:
- *    None
+ *    The entry is owned by the snapshot; take a reference to keep it.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VixError
+VixToolsProcSnapshotGetEntry(const ProcMgrProcInfo *procInfo,  // IN
+                             VixToolsProcEntry **result)       // OUT
+{
+   VixError err;
+   VixToolsProcEntry *entry;
+   const char *owner = (NULL == procInfo->procOwner) ? ""
+                                                     : procInfo->procOwner;
+
+   if (NULL == procSnapshotTable) {
+      procSnapshotTable = g_hash_table_new_full(g_direct_hash,
+                                                g_direct_equal,
+                                                NULL,
+                                                VixToolsProcEntryUnref);
+   }
+
+   entry = g_hash_table_lookup(procSnapshotTable,
+                               PROC_SNAPSHOT_KEY(procInfo->procId));
+   if ((NULL != entry) &&
+       (entry->pid == (uint64) procInfo->procId) &&
+       (entry->startTime == procInfo->procStartTime) &&
+       VixToolsStrEqual(entry->cmdName, procInfo->procCmdName) &&
+       VixToolsStrEqual(entry->cmdLine, procInfo->procCmdLine) &&
+       (0 == strcmp(entry->owner, owner))) {
+      entry->lastSeen = procSnapshotGeneration;
+      *result = entry;
+      return VIX_OK;
+   }
+
+   err = VixToolsProcEntryNew(procInfo->procCmdName,
+                              procInfo->procCmdLine,
+                              procInfo->procId,
+                              owner,
+                              (int) procInfo->procStartTime,
+                              0, 0,
+                              &entry);
+   if (VIX_OK != err) {
+      return err;
+   }
+
+   entry->generation = procSnapshotGeneration;
+   entry->lastSeen = procSnapshotGeneration;
+   entry->startTime = procInfo->procStartTime;
+   entry->cmdName = (NULL == procInfo->procCmdName)
+                    ? NULL : Util_SafeStrdup(procInfo->procCmdName);
+   entry->cmdLine = (NULL == procInfo->procCmdLine)
+                    ? NULL : Util_SafeStrdup(procInfo->procCmdLine);
+   entry->owner = Util_SafeStrdup(owner);
+
+   g_hash_table_replace(procSnapshotTable,
+                        PROC_SNAPSHOT_KEY(procInfo->procId), entry);
+
+   *result = entry;
+   return VIX_OK;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsProcSnapshotIsStale --
+ *
+ *    g_hash_table_foreach_remove() callback; matches the snapshot
+ *    entries of processes that were not seen in the current generation.
+ *
+ * Return value:
+ *    TRUE if the entry should be removed.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VixToolsProcSnapshotIsStale(gpointer key,         // IN
+                            gpointer value,       // IN
+                            gpointer userData)    // IN
+{
+   VixToolsProcEntry *entry = (VixToolsProcEntry *) value;
+
+   return entry->lastSeen != procSnapshotGeneration;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsProcListAdd --
+ *
+ *    Appends an entry to a ListProcessesEx result, taking a reference.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsProcListAdd(VixToolsProcList *procList,   // IN/OUT
+                    VixToolsProcEntry *entry)     // IN
+{
+   entry->refCount++;
+   g_ptr_array_add(procList->entries, entry);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsFreeProcList --
+ *
+ *    Frees a ListProcessesEx result.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsFreeProcList(VixToolsProcList *procList)   // IN
+{
+   guint i;
+
+   if (NULL == procList) {
+      return;
+   }
+
+   for (i = 0; i < procList->entries->len; i++) {
+      VixToolsProcEntryUnref(g_ptr_array_index(procList->entries, i));
+   }
+   g_ptr_array_free(procList->entries, TRUE);
+   free(procList->offsets);
+   free(procList);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsProcListCopy --
+ *
+ *    Copies a range of the result string of a ListProcessesEx result,
+ *    putting it together from the entries.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsProcListCopy(const VixToolsProcList *procList,   // IN
+                     size_t offset,                      // IN
+                     size_t len,                         // IN
+                     char *dst)                          // OUT
+{
+   guint lo = 0;
+   guint hi = procList->entries->len;
+
+   ASSERT(offset + len <= procList->size);
+
+   /*
+    * Find the entry the range starts in.
+    */
+   while (hi - lo > 1) {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (procList->offsets[mid] <= offset) {
+         lo = mid;
+      } else {
+         hi = mid;
+      }
+   }
+
+   for (; len > 0 && lo < procList->entries->len; lo++) {
+      VixToolsProcEntry *entry = g_ptr_array_index(procList->entries, lo);
+      size_t skip = offset - procList->offsets[lo];
+      size_t n = MIN(len, entry->xmlLen - skip);
+
+      memcpy(dst, entry->xml + skip, n);
+      dst += n;
+      offset += n;
+      len -= n;
+   }
+
+   /*
+    * Whatever is left is the terminating NUL.
+    */
+   memset(dst, '\0', len);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListProcessesExGenerateData --
+ *
+ *    Does the work to generate the results. Processes we didn't start
+ *    are looked up in the snapshot, so only new or changed ones have
+ *    their entries regenerated.
+ *
+ * Return value:
+ *    VixError
+ *
+ * Side effects:
+ *    Allocates and creates the result. Listing all processes drops the
+ *    snapshot entries of processes that went away.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+VixError
+VixToolsListProcessesExGenerateData(uint32 numPids,               // IN
+                                    const uint64 *pids,           // IN
+                                    VixToolsProcList **result)    // OUT
+{
+   VixError err = VIX_OK;
+   ProcMgrProcInfoArray *procList = NULL;
+   ProcMgrProcInfo *procInfo;
+   VixToolsProcList *results;
+   VixToolsProcEntry *entry;
+   VixToolsStartedProgramState *spList;
+   int numReported = 0;
+   int numChanged = 0;
+   int i;
+   int j;
+   size_t procCount;
+
+   results = Util_SafeCalloc(1, sizeof *results);
+   results->entries = g_ptr_array_new();
+
+   procSnapshotGeneration++;
+
+   /*
+    * First check the processes we've started via StartProgram, which
+    * will find those running and recently deceased. Their exit state
+    * changes, so they don't go in the snapshot.
+    */
+   VixToolsUpdateStartedProgramList(NULL);
+   if (numPids > 0) {
+      for (i = 0; i < numPids; i++) {
+         spList = startedProcessList;
+         while (spList) {
+            if (pids[i] == spList->pid) {
+               err = VixToolsProcEntryNew(spList->cmdName,
+                                          spList->fullCommandLine,
+                                          spList->pid,
+                                          spList->user,
+                                          (int) spList->startTime,
+                                          spList->exitCode,
+                                          (int) spList->endTime,
+                                          &entry);
+               if (VIX_OK != err) {
+                  goto abort;
+               }
+               g_ptr_array_add(results->entries, entry);
+               numReported++;
+               break;
+            }
+            spList = spList->next;
+         }
+      }
+   } else {
+      spList = startedProcessList;
+      while (spList) {
+         err = VixToolsProcEntryNew(spList->cmdName,
+                                    spList->fullCommandLine,
+                                    spList->pid,
+                                    spList->user,
+                                    (int) spList->startTime,
+                                    spList->exitCode,
+                                    (int) spList->endTime,
+                                    &entry);
+         if (VIX_OK != err) {
+            goto abort;
+         }
+         g_ptr_array_add(results->entries, entry);
+         spList = spList->next;
+      }
+   }
+
+   /*
+    * If we found data for all requested processes from the startedProcess
+    * list, then we're done.
+    */
+   if (numPids > 0 && (numPids == numReported)) {
+      g_debug("%s: found all %d requested pids on the startedProcess list; finished\n",
+              __FUNCTION__, numPids);
+      goto done;
+   }
+
+   /*
+    * The startedProcess list didn't give everything we need, so
+    * ask the OS.
+    *
+    * Where we can, only ask for the requested pids.
+    *
+    * XXX ProcMgr_ListProcesses() should return an error code so
+    * there's no risk of errno/LastError being clobbered.
+    */
+#if defined(linux)
+   if (numPids > 0) {
+      ProcMgr_Pid *osPids = Util_SafeMalloc(numPids * sizeof *osPids);
+
+      for (i = 0; i < numPids; i++) {
+         osPids[i] = (ProcMgr_Pid) pids[i];
+      }
+      procList = ProcMgr_ListProcessesForPids(osPids, numPids);
+      free(osPids);
+   } else
+#endif
+   {
+      procList = ProcMgr_ListProcesses();
+   }
+   if (NULL == procList) {
+      err = FoundryToolsDaemon_TranslateSystemErr();
+      goto abort;
+   }
+
+
+   /*
+    * Now look at the running list.  Note that we set endTime
+    * and exitCode to dummy values, since we'll be getting results on
+    * the Vix side with GetNthProperty, and can have a mix of live and
+    * dead processes.
+    */
+   procCount = ProcMgrProcInfoArray_Count(procList);
+   if (numPids > 0) {
+      for (i = 0; i < numPids; i++) {
+         // ignore it if its on the started list -- we added it above
+         if (VixToolsFindStartedProgramState(pids[i])) {
+            continue;
+         }
+         for (j = 0; j < procCount; j++) {
+            procInfo = ProcMgrProcInfoArray_AddressOf(procList, j);
+            if (pids[i] == procInfo->procId) {
+               err = VixToolsProcSnapshotGetEntry(procInfo, &entry);
+               if (VIX_OK != err) {
+                  goto abort;
+               }
+               VixToolsProcListAdd(results, entry);
+               numChanged += (entry->generation == procSnapshotGeneration);
+            }
+         }
+      }
+   } else {
+      for (i = 0; i < procCount; i++) {
+         procInfo = ProcMgrProcInfoArray_AddressOf(procList, i);
+         // ignore it if its on the started list -- we added it above
+         if (VixToolsFindStartedProgramState(procInfo->procId)) {
+            continue;
+         }
+         err = VixToolsProcSnapshotGetEntry(procInfo, &entry);
+         if (VIX_OK != err) {
+            goto abort;
+         }
+         VixToolsProcListAdd(results, entry);
+         numChanged += (entry->generation == procSnapshotGeneration);
+      }
+
+      /*
+       * Forget about the processes that went away.
+       */
+      if (NULL != procSnapshotTable) {
+         g_hash_table_foreach_remove(procSnapshotTable,
+                                     VixToolsProcSnapshotIsStale, NULL);
+      }
+   }
+
+   g_debug("%s: %d of %d entries regenerated in snapshot generation %u\n",
+           __FUNCTION__, numChanged, (int) results->entries->len,
+           procSnapshotGeneration);
+
+done:
+
+   /*
+    * Lay out the result string, which ends with a NUL.
+    */
+   results->offsets = Util_SafeMalloc((results->entries->len + 1) *
+                                      sizeof *results->offsets);
+   results->size = 0;
+   for (i = 0; i < results->entries->len; i++) {
+      entry = g_ptr_array_index(results->entries, i);
+      results->offsets[i] = results->size;
+      results->size += entry->xmlLen;
+   }
+   results->offsets[i] = results->size;
+   results->size++;
+
+   *result = results;
+   results = NULL;
+
+abort:
+   VixToolsFreeProcList(results);
+   ProcMgr_FreeProcList(procList);
+   return err;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListProcessesEx --
+ *
+ *
+ * Return value:
+ *    VixError
+ *
+ * Side effects:
+ *    None
  *
  *-----------------------------------------------------------------------------
  */
@@ -5366,9 +5863,8 @@ VixToolsListProcessesEx(VixCommandRequestHeader *requestMsg, // IN
                         char **result)                       // OUT
 {
    VixError err = VIX_OK;
-   char *fullResultBuffer = NULL;
+   VixToolsProcList *procList = NULL;
    char *finalResultBuffer = NULL;
-   size_t fullResultSize = 0;
    size_t curPacketLen = 0;
    int32 leftToSend = 0;
    Bool impersonatingVMWareUser = FALSE;
@@ -5446,7 +5942,7 @@ VixToolsListProcessesEx(VixCommandRequestHeader *requestMsg, // IN
       }
 
       // sanity check offset
-      if (listRequest->offset > cachedResult->resultBufferLen) {
+      if (listRequest->offset > cachedResult->procList->size) {
          /*
           * Since this isn't user-set, assume any problem is in the
           * code and return VIX_E_FAIL
@@ -5497,25 +5993,27 @@ VixToolsListProcessesEx(VixCommandRequestHeader *requestMsg, // IN
          pids = (uint64 *)((char *)requestMsg + sizeof(*listRequest));
       }
 
-      err = VixToolsListProcessesExGenerateData(numPids, pids,
-                                                &fullResultSize,
-                                                &fullResultBuffer);
+      err = VixToolsListProcessesExGenerateData(numPids, pids, &procList);
+      if (VIX_OK != err) {
+         goto abort;
+      }
 
       /*
        * Check if the result is large enough to require more than one trip.
-       * Stuff it in the hash table if so.
+       * Stuff it in the hash table if so; the pages are put together
+       * from it as they are asked for.
        */
-      if ((fullResultSize + resultHeaderSize) > maxBufferSize) {
+      if ((procList->size + resultHeaderSize) > maxBufferSize) {
          g_debug("%s: answer requires caching.  have %d bytes\n",
-                 __FUNCTION__, (int) (fullResultSize + resultHeaderSize));
+                 __FUNCTION__, (int) (procList->size + resultHeaderSize));
          /*
           * Save it off in the hashtable.
           */
          key = listProcessesResultsKey++;
          cachedResult = Util_SafeMalloc(sizeof(*cachedResult));
-         cachedResult->resultBufferLen = fullResultSize;
-         cachedResult->resultBuffer = fullResultBuffer;
+         cachedResult->procList = procList;
          cachedResult->key = key;
+         procList = NULL;
 #ifdef _WIN32
          bRet = VixToolsGetUserName(&cachedResult->userName);
          if (!bRet) {
@@ -5557,7 +6055,7 @@ VixToolsListProcessesEx(VixCommandRequestHeader *requestMsg, // IN
          hdrSize = leftHeaderSize;
       }
 
-      leftToSend = cachedResult->resultBufferLen - offset;
+      leftToSend = cachedResult->procList->size - offset;
 
       if (leftToSend > (maxBufferSize - hdrSize)) {
          curPacketLen = maxBufferSize - hdrSize;
@@ -5572,7 +6070,7 @@ VixToolsListProcessesEx(VixCommandRequestHeader *requestMsg, // IN
 
          len = Str_Sprintf(finalResultBuffer, maxBufferSize,
                            resultHeaderFormatString,
-                           key, (int) cachedResult->resultBufferLen,
+                           key, (int) cachedResult->procList->size,
                            leftToSend);
       } else {
          len = Str_Sprintf(finalResultBuffer, maxBufferSize,
@@ -5580,8 +6078,8 @@ VixToolsListProcessesEx(VixCommandRequestHeader *requestMsg, // IN
                            leftToSend);
       }
 
-      memcpy(finalResultBuffer + len,
-             cachedResult->resultBuffer + offset, curPacketLen);
+      VixToolsProcListCopy(cachedResult->procList, offset, curPacketLen,
+                           finalResultBuffer + len);
       finalResultBuffer[curPacketLen + len] = '\0';
 
       /*
@@ -5595,7 +6093,8 @@ VixToolsListProcessesEx(VixCommandRequestHeader *requestMsg, // IN
       /*
        * In the simple/common case, just return the basic proces info.
        */
-      finalResultBuffer = fullResultBuffer;
+      finalResultBuffer = Util_SafeMalloc(procList->size);
+      VixToolsProcListCopy(procList, 0, procList->size, finalResultBuffer);
    }
 
 
@@ -5607,6 +6106,7 @@ abort:
       VixToolsUnimpersonateUser(userToken);
    }
    VixToolsLogoutUser(userToken);
+   VixToolsFreeProcList(procList);
 
    *result = finalResultBuffer;
 
@@ -6067,109 +6567,489 @@ VixToolsListDirectory(VixCommandRequestHeader *requestMsg,    // IN
    }
 
    /*
-    * Calculate the size of the result buffer and keep track of the
-    * max number of entries we can store.
+    * Calculate the size of the result buffer and keep track of the
+    * max number of entries we can store.
+    */
+   resultBufferSize = 3; // truncation bool + space + '\0'
+   if (escapeStrs) {
+      resultBufferSize += strlen(VIX_XML_ESCAPED_TAG);
+   }
+   lastGoodResultBufferSize = resultBufferSize;
+   ASSERT_NOT_IMPLEMENTED(lastGoodResultBufferSize < maxBufferSize);
+   formatStringLength = strlen(fileInfoFormatString);
+
+   for (fileNum = offset; fileNum < numFiles; fileNum++) {
+      currentFileName = fileNameList[fileNum];
+
+      resultBufferSize += formatStringLength;
+      resultBufferSize += VixToolsXMLStringEscapedLen(currentFileName,
+                                                      escapeStrs);
+      resultBufferSize += 2; // DIRSEPC chars
+      resultBufferSize += 10 + 20 + 20; // properties + size + modTime
+
+      if (resultBufferSize < maxBufferSize) {
+         /*
+          * lastGoodNumFiles is a count (1 based), while fileNum is
+          * an array index (zero based).  So lastGoodNumFiles is
+          * fileNum + 1.
+          */
+         lastGoodNumFiles = fileNum + 1;
+         lastGoodResultBufferSize = resultBufferSize;
+      } else {
+         truncated = TRUE;
+         break;
+      }
+   }
+   resultBufferSize = lastGoodResultBufferSize;
+
+   /*
+    * Print the result buffer.
+    */
+   fileList = Util_SafeMalloc(resultBufferSize);
+   destPtr = fileList;
+   endDestPtr = fileList + resultBufferSize;
+
+   /*
+    * Indicate if we have a truncated buffer with "1 ", otherwise "0 ".
+    * This should only happen for non-legacy requests.
+    */
+   if (!isLegacyFormat) {
+      if ((destPtr + 2) < endDestPtr) {
+         *destPtr++ = truncated ? '1' : '0';
+         *destPtr++ = ' ';
+      } else {
+         ASSERT(0);
+         err = VIX_E_OUT_OF_MEMORY;
+         goto abort;
+      }
+   }
+
+   if (escapeStrs) {
+      destPtr += Str_Sprintf(destPtr, endDestPtr - destPtr, "%s",
+                             VIX_XML_ESCAPED_TAG);
+   }
+
+   for (fileNum = offset; fileNum < lastGoodNumFiles; fileNum++) {
+      /* File_ListDirectory never returns "." or ".." */
+      char *pathName;
+
+      currentFileName = fileNameList[fileNum];
+
+      pathName = Str_SafeAsprintf(NULL, "%s%s%s", dirPathName, DIRSEPS,
+                                  currentFileName);
+
+      VixToolsPrintFileInfo(pathName, currentFileName, escapeStrs, &destPtr,
+                            endDestPtr);
+
+      free(pathName);
+   } // for (fileNum = 0; fileNum < lastGoodNumFiles; fileNum++)
+   *destPtr = '\0';
+
+abort:
+   if (impersonatingVMWareUser) {
+      VixToolsUnimpersonateUser(userToken);
+   }
+   VixToolsLogoutUser(userToken);
+
+   if (NULL == fileList) {
+      fileList = Util_SafeStrdup("");
+   }
+   *result = fileList;
+
+   if (NULL != fileNameList) {
+      for (fileNum = 0; fileNum < numFiles; fileNum++) {
+         free(fileNameList[fileNum]);
+      }
+      free(fileNameList);
+   }
+
+   // XXX result too large for g_debug()
+
+   g_message("%s: opcode %d returning %"FMT64"d\n", __FUNCTION__,
+             requestMsg->opCode, err);
+
+   return err;
+} // VixToolsListDirectory
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsFreeListFilesCursor --
+ *
+ *    Hash table value destroy func.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    Stops the cursor's expiration timer.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsFreeListFilesCursor(gpointer ptr)          // IN
+{
+   VixToolsListFilesCursor *cursor = (VixToolsListFilesCursor *) ptr;
+   int i;
+
+   if (NULL == cursor) {
+      return;
+   }
+
+   if (NULL != cursor->timer) {
+      g_source_destroy(cursor->timer);
+      g_source_unref(cursor->timer);
+   }
+
+   for (i = 0; i < cursor->numEntries; i++) {
+      free(cursor->entries[i].fileName);
+      free(cursor->entries[i].info);
+   }
+   free(cursor->entries);
+   free(cursor->dirPathName);
+   free(cursor->key);
+#ifdef _WIN32
+   free(cursor->userName);
+#endif
+   free(cursor);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListFilesCursorCleanup --
+ *
+ *    Timer callback that drops a ListFiles cursor nobody used for
+ *    a while.
+ *
+ * Return value:
+ *    FALSE -- tells glib not to clean up
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+VixToolsListFilesCursorCleanup(void *clientData) // IN
+{
+   VixToolsListFilesCursor *cursor = (VixToolsListFilesCursor *) clientData;
+
+   g_debug("%s: list files cursor for '%s' timed out\n",
+           __FUNCTION__, cursor->dirPathName);
+
+   g_source_unref(cursor->timer);
+   cursor->timer = NULL;
+   g_hash_table_remove(listFilesCursorTable, cursor->key);
+
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListFilesCursorTouch --
+ *
+ *    (Re)starts the expiration timer of a ListFiles cursor.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsListFilesCursorTouch(VixToolsListFilesCursor *cursor,  // IN
+                             GMainLoop *eventQueue)            // IN
+{
+   if (NULL != cursor->timer) {
+      g_source_destroy(cursor->timer);
+      g_source_unref(cursor->timer);
+   }
+
+   cursor->lastUse = ++listFilesCursorUses;
+   cursor->timer =
+      g_timeout_source_new(SECONDS_UNTIL_LISTFILES_CURSOR_CLEANUP * 1000);
+   g_source_set_callback(cursor->timer, VixToolsListFilesCursorCleanup,
+                         cursor, NULL);
+   g_source_attach(cursor->timer, g_main_loop_get_context(eventQueue));
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListFilesCursorFindLRU --
+ *
+ *    g_hash_table_foreach() callback; remembers the least recently
+ *    used ListFiles cursor.
+ *
+ * Return value:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VixToolsListFilesCursorFindLRU(gpointer key,       // IN
+                               gpointer value,     // IN
+                               gpointer userData)  // IN/OUT
+{
+   VixToolsListFilesCursor *cursor = (VixToolsListFilesCursor *) value;
+   VixToolsListFilesCursor **lru = (VixToolsListFilesCursor **) userData;
+
+   if ((NULL == *lru) || (cursor->lastUse < (*lru)->lastUse)) {
+      *lru = cursor;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListFilesGetCursor --
+ *
+ *    Finds the cursor of a ListFiles paging sequence, or snapshots the
+ *    directory into a new one.
+ *
+ *    A listing starting from the first entry always takes a new
+ *    snapshot. Later pages reuse the snapshot of the same directory and
+ *    pattern taken for the same user, if there still is one.
+ *
+ *    The snapshot holds the names of the entries matching the pattern,
+ *    in the order File_ListDirectory() returned them. Their attributes
+ *    are filled in the first time they are returned.
+ *
+ * Return value:
+ *    VixError
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VixError
+VixToolsListFilesGetCursor(const char *dirPathName,           // IN
+                           const char *pattern,               // IN
+                           GRegex *regex,                     // IN
+                           uint64 start,                      // IN
+                           VixToolsListFilesCursor **result)  // OUT
+{
+   VixError err = VIX_OK;
+   VixToolsListFilesCursor *cursor;
+   char **fileNameList = NULL;
+   int numFiles = 0;
+   int fileNum;
+   char *key;
+#ifdef _WIN32
+   wchar_t *userName = NULL;
+#endif
+
+   /*
+    * The pattern length comes first, so the key is unambiguous.
     */
-   resultBufferSize = 3; // truncation bool + space + '\0'
-   if (escapeStrs) {
-      resultBufferSize += strlen(VIX_XML_ESCAPED_TAG);
-   }
-   lastGoodResultBufferSize = resultBufferSize;
-   ASSERT_NOT_IMPLEMENTED(lastGoodResultBufferSize < maxBufferSize);
-   formatStringLength = strlen(fileInfoFormatString);
+   key = Str_SafeAsprintf(NULL, "%d:%s%s",
+                          (NULL != pattern) ? (int) strlen(pattern) : -1,
+                          (NULL != pattern) ? pattern : "", dirPathName);
 
-   for (fileNum = offset; fileNum < numFiles; fileNum++) {
-      currentFileName = fileNameList[fileNum];
+#ifdef _WIN32
+   if (!VixToolsGetUserName(&userName)) {
+      g_warning("%s: VixToolsGetUserName() failed\n", __FUNCTION__);
+      err = VIX_E_FAIL;
+      goto abort;
+   }
+#endif
 
-      resultBufferSize += formatStringLength;
-      resultBufferSize += VixToolsXMLStringEscapedLen(currentFileName,
-                                                      escapeStrs);
-      resultBufferSize += 2; // DIRSEPC chars
-      resultBufferSize += 10 + 20 + 20; // properties + size + modTime
+   if (NULL == listFilesCursorTable) {
+      listFilesCursorTable =
+         g_hash_table_new_full(g_str_hash, g_str_equal,
+                               NULL, VixToolsFreeListFilesCursor);
+   }
 
-      if (resultBufferSize < maxBufferSize) {
-         /*
-          * lastGoodNumFiles is a count (1 based), while fileNum is
-          * an array index (zero based).  So lastGoodNumFiles is
-          * fileNum + 1.
-          */
-         lastGoodNumFiles = fileNum + 1;
-         lastGoodResultBufferSize = resultBufferSize;
-      } else {
-         truncated = TRUE;
-         break;
+   if (start > 0) {
+      cursor = g_hash_table_lookup(listFilesCursorTable, key);
+#ifdef _WIN32
+      if ((NULL != cursor) && (0 == wcscmp(userName, cursor->userName))) {
+#else
+      if ((NULL != cursor) && (cursor->euid == Id_GetEUid())) {
+#endif
+         *result = cursor;
+         cursor = NULL;
+         goto abort;
       }
    }
-   resultBufferSize = lastGoodResultBufferSize;
 
    /*
-    * Print the result buffer.
+    * First check for symlink -- File_IsDirectory() will lie
+    * if its a symlink to a directory.
     */
-   fileList = Util_SafeMalloc(resultBufferSize);
-   destPtr = fileList;
-   endDestPtr = fileList + resultBufferSize;
+   cursor = Util_SafeCalloc(1, sizeof *cursor);
+   if (!File_IsSymLink(dirPathName) && File_IsDirectory(dirPathName)) {
+      numFiles = File_ListDirectory(dirPathName, &fileNameList);
+      if (numFiles < 0) {
+         err = FoundryToolsDaemon_TranslateSystemErr();
+         numFiles = 0;
+         goto abort;
+      }
+      /*
+       * File_ListDirectory() doesn't return '.' and '..', but we want them,
+       * so add '.' and '..' to the list.  Place them in front since that's
+       * a more normal location.
+       */
+      numFiles += 2;
+      {
+         char **newFileNameList = NULL;
 
-   /*
-    * Indicate if we have a truncated buffer with "1 ", otherwise "0 ".
-    * This should only happen for non-legacy requests.
-    */
-   if (!isLegacyFormat) {
-      if ((destPtr + 2) < endDestPtr) {
-         *destPtr++ = truncated ? '1' : '0';
-         *destPtr++ = ' ';
+         newFileNameList = Util_SafeMalloc(numFiles * sizeof(char *));
+         newFileNameList[0] = Unicode_Alloc(".", STRING_ENCODING_UTF8);
+         newFileNameList[1] = Unicode_Alloc("..", STRING_ENCODING_UTF8);
+         memcpy(newFileNameList + 2, fileNameList, (numFiles - 2) * sizeof(char *));
+         free(fileNameList);
+         fileNameList = newFileNameList;
+      }
+   } else {
+      if (File_Exists(dirPathName)) {
+         cursor->listingSingleFile = TRUE;
+         numFiles = 1;
+         fileNameList = Util_SafeMalloc(sizeof(char *));
+         fileNameList[0] = Util_SafeStrdup(dirPathName);
       } else {
-         ASSERT(0);
-         err = VIX_E_OUT_OF_MEMORY;
+         /*
+          * We don't know what they intended to list, but we'll
+          * assume file since that gives a fairly sane error.
+          */
+         err = FoundryToolsDaemon_TranslateSystemErr();
          goto abort;
       }
    }
 
-   if (escapeStrs) {
-      destPtr += Str_Sprintf(destPtr, endDestPtr - destPtr, "%s",
-                             VIX_XML_ESCAPED_TAG);
-   }
-
-   for (fileNum = offset; fileNum < lastGoodNumFiles; fileNum++) {
-      /* File_ListDirectory never returns "." or ".." */
-      char *pathName;
+   /*
+    * Keep the entries matching the pattern, remembering where they are
+    * in the full listing since that's what the request offsets count.
+    */
+   cursor->entries = Util_SafeMalloc(numFiles * sizeof *cursor->entries);
+   for (fileNum = 0; fileNum < numFiles; fileNum++) {
+      VixToolsListFilesEntry *entry;
 
-      currentFileName = fileNameList[fileNum];
+      if (regex && !g_regex_match(regex, fileNameList[fileNum], 0, NULL)) {
+         free(fileNameList[fileNum]);
+         continue;
+      }
 
-      pathName = Str_SafeAsprintf(NULL, "%s%s%s", dirPathName, DIRSEPS,
-                                  currentFileName);
+      entry = &cursor->entries[cursor->numEntries++];
+      entry->fileNum = fileNum;
+      entry->fileName = fileNameList[fileNum];
+      entry->info = NULL;
+      entry->infoLen = 0;
+   }
+   free(fileNameList);
+   fileNameList = NULL;
+   numFiles = 0;
 
-      VixToolsPrintFileInfo(pathName, currentFileName, escapeStrs, &destPtr,
-                            endDestPtr);
+   cursor->key = key;
+   cursor->dirPathName = Util_SafeStrdup(dirPathName);
+#ifdef _WIN32
+   cursor->userName = userName;
+   userName = NULL;
+#else
+   cursor->euid = Id_GetEUid();
+#endif
+   key = NULL;
 
-      free(pathName);
-   } // for (fileNum = 0; fileNum < lastGoodNumFiles; fileNum++)
-   *destPtr = '\0';
+   /*
+    * Make room if this adds a cursor rather than replacing one.
+    */
+   if ((NULL == g_hash_table_lookup(listFilesCursorTable, cursor->key)) &&
+       (g_hash_table_size(listFilesCursorTable) >= MAX_LISTFILES_CURSORS)) {
+      VixToolsListFilesCursor *lru = NULL;
 
-abort:
-   if (impersonatingVMWareUser) {
-      VixToolsUnimpersonateUser(userToken);
+      g_hash_table_foreach(listFilesCursorTable,
+                           VixToolsListFilesCursorFindLRU, &lru);
+      g_debug("%s: dropping list files cursor for '%s'\n",
+              __FUNCTION__, lru->dirPathName);
+      g_hash_table_remove(listFilesCursorTable, lru->key);
    }
-   VixToolsLogoutUser(userToken);
 
-   if (NULL == fileList) {
-      fileList = Util_SafeStrdup("");
-   }
-   *result = fileList;
+   g_hash_table_replace(listFilesCursorTable, cursor->key, cursor);
+   *result = cursor;
+   cursor = NULL;
 
+abort:
    if (NULL != fileNameList) {
       for (fileNum = 0; fileNum < numFiles; fileNum++) {
          free(fileNameList[fileNum]);
       }
       free(fileNameList);
    }
+   VixToolsFreeListFilesCursor(cursor);
+#ifdef _WIN32
+   free(userName);
+#endif
+   free(key);
 
-   // XXX result too large for g_debug()
+   return err;
+}
 
-   g_message("%s: opcode %d returning %"FMT64"d\n", __FUNCTION__,
-             requestMsg->opCode, err);
 
-   return err;
-} // VixToolsListDirectory
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VixToolsListFilesGetEntryInfo --
+ *
+ *    Returns the extended info of a ListFiles cursor entry, looking it
+ *    up the first time it is needed.
+ *
+ * Return value:
+ *    The entry's info; owned by the cursor.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static const char *
+VixToolsListFilesGetEntryInfo(VixToolsListFilesCursor *cursor,  // IN
+                              VixToolsListFilesEntry *entry)    // IN
+{
+   if (NULL == entry->info) {
+      char *pathName;
+      char *destPtr;
+      int infoSize;
+
+      if (cursor->listingSingleFile) {
+         pathName = Util_SafeStrdup(entry->fileName);
+      } else {
+         pathName = Str_SafeAsprintf(NULL, "%s%s%s", cursor->dirPathName,
+                                     DIRSEPS, entry->fileName);
+      }
+
+      infoSize = VixToolsGetFileExtendedInfoLength(pathName,
+                                                   entry->fileName) + 1;
+      entry->info = Util_SafeMalloc(infoSize);
+      destPtr = entry->info;
+      VixToolsPrintFileExtendedInfo(pathName, entry->fileName,
+                                    &destPtr, entry->info + infoSize);
+      *destPtr = '\0';
+      entry->infoLen = destPtr - entry->info;
+
+      free(pathName);
+   }
+
+   return entry->info;
+}
 
 
 /*
@@ -6179,6 +7059,9 @@ abort:
  *
  *    This function is called to implement ListFilesInGuest VI Guest operation.
  *
+ *    The matching entries are kept in a cursor between requests, so the
+ *    pages after the first don't list the directory again.
+ *
  * Return value:
  *    VixError
  *
@@ -6191,17 +7074,13 @@ abort:
 VixError
 VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
                   size_t maxBufferSize,                   // IN
+                  GMainLoop *eventQueue,                  // IN
                   char **result)                          // OUT
 {
    VixError err = VIX_OK;
    const char *dirPathName = NULL;
    char *fileList = NULL;
-   char **fileNameList = NULL;
    size_t resultBufferSize = 0;
-   size_t lastGoodResultBufferSize = 0;
-   int numFiles = 0;
-   int fileNum;
-   char *currentFileName;
    char *destPtr;
    char *endDestPtr;
    Bool impersonatingVMWareUser = FALSE;
@@ -6209,16 +7088,18 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
    VixMsgListFilesRequest *listRequest = NULL;
    Bool truncated = FALSE;
    uint64 offset = 0;
-   Bool listingSingleFile = FALSE;
+   uint64 startNum;
    const char *pattern = NULL;
    int index = 0;
    int maxResults = 0;
    int count = 0;
    int remaining = 0;
-   int numResults;
+   int first;
+   int last;
+   int entryNum;
    GRegex *regex = NULL;
    GError *gerr = NULL;
-   char *pathName;
+   VixToolsListFilesCursor *cursor = NULL;
    VMAutomationRequestParser parser;
 
    ASSERT(NULL != requestMsg);
@@ -6280,45 +7161,25 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
       }
    }
 
+   startNum = offset + index;
+   err = VixToolsListFilesGetCursor(dirPathName, pattern, regex,
+                                    startNum, &cursor);
+   if (VIX_OK != err) {
+      goto abort;
+   }
+
    /*
-    * First check for symlink -- File_IsDirectory() will lie
-    * if its a symlink to a directory.
+    * Find the first matching entry at or after the requested position.
     */
-   if (!File_IsSymLink(dirPathName) && File_IsDirectory(dirPathName)) {
-      numFiles = File_ListDirectory(dirPathName, &fileNameList);
-      if (numFiles < 0) {
-         err = FoundryToolsDaemon_TranslateSystemErr();
-         goto abort;
-      }
-      /*
-       * File_ListDirectory() doesn't return '.' and '..', but we want them,
-       * so add '.' and '..' to the list.  Place them in front since that's
-       * a more normal location.
-       */
-      numFiles += 2;
-      {
-         char **newFileNameList = NULL;
+   first = 0;
+   last = cursor->numEntries;
+   while (first < last) {
+      int mid = first + (last - first) / 2;
 
-         newFileNameList = Util_SafeMalloc(numFiles * sizeof(char *));
-         newFileNameList[0] = Unicode_Alloc(".", STRING_ENCODING_UTF8);
-         newFileNameList[1] = Unicode_Alloc("..", STRING_ENCODING_UTF8);
-         memcpy(newFileNameList + 2, fileNameList, (numFiles - 2) * sizeof(char *));
-         free(fileNameList);
-         fileNameList = newFileNameList;
-      }
-   } else {
-      if (File_Exists(dirPathName)) {
-         listingSingleFile = TRUE;
-         numFiles = 1;
-         fileNameList = Util_SafeMalloc(sizeof(char *));
-         fileNameList[0] = Util_SafeStrdup(dirPathName);
+      if (cursor->entries[mid].fileNum < startNum) {
+         first = mid + 1;
       } else {
-         /*
-          * We don't know what they intended to list, but we'll
-          * assume file since that gives a fairly sane error.
-          */
-         err = FoundryToolsDaemon_TranslateSystemErr();
-         goto abort;
+         last = mid;
       }
    }
 
@@ -6330,48 +7191,24 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
    resultBufferSize = 3; // truncation bool + space + '\0'
    // space for the 'remaining' tag up front
    resultBufferSize += strlen(listFilesRemainingFormatString) + 10;
-   lastGoodResultBufferSize = resultBufferSize;
-   ASSERT_NOT_IMPLEMENTED(lastGoodResultBufferSize < maxBufferSize);
-
-   for (fileNum = offset + index;
-        fileNum < numFiles;
-        fileNum++) {
-
-      currentFileName = fileNameList[fileNum];
-
-      if (regex) {
-         if (!g_regex_match(regex, currentFileName, 0, NULL)) {
-            continue;
-         }
-      }
-
-      if (count < maxResults) {
-         count++;
-      } else {
-         remaining++;
-         continue;   // stop computing buffersize
-      }
+   ASSERT_NOT_IMPLEMENTED(resultBufferSize < maxBufferSize);
 
-      if (listingSingleFile) {
-         resultBufferSize += VixToolsGetFileExtendedInfoLength(currentFileName,
-                                                               currentFileName);
-      } else {
-         pathName = Str_SafeAsprintf(NULL, "%s%s%s", dirPathName, DIRSEPS,
-                                     currentFileName);
-         resultBufferSize += VixToolsGetFileExtendedInfoLength(pathName,
-                                                               currentFileName);
-         free(pathName);
-      }
+   for (entryNum = first;
+        entryNum < cursor->numEntries && count < maxResults;
+        entryNum++) {
+      VixToolsListFilesEntry *entry = &cursor->entries[entryNum];
 
-      if (resultBufferSize < maxBufferSize) {
-         lastGoodResultBufferSize = resultBufferSize;
-      } else {
+      VixToolsListFilesGetEntryInfo(cursor, entry);
+      if (resultBufferSize + entry->infoLen >= maxBufferSize) {
          truncated = TRUE;
          break;
       }
+      resultBufferSize += entry->infoLen;
+      count++;
+   }
+   if (!truncated) {
+      remaining = cursor->numEntries - first - count;
    }
-   resultBufferSize = lastGoodResultBufferSize;
-   numResults = count;
 
    /*
     * Print the result buffer.
@@ -6384,64 +7221,46 @@ VixToolsListFiles(VixCommandRequestHeader *requestMsg,    // IN
     * Indicate if we have a truncated buffer with "1 ", otherwise "0 ".
     * This should only happen for non-legacy requests.
     */
-   if ((destPtr + 2) < endDestPtr) {
-      *destPtr++ = truncated ? '1' : '0';
-      *destPtr++ = ' ';
-   } else {
-      ASSERT(0);
-      err = VIX_E_OUT_OF_MEMORY;
-      goto abort;
-   }
+   *destPtr++ = truncated ? '1' : '0';
+   *destPtr++ = ' ';
 
    destPtr += Str_Sprintf(destPtr, endDestPtr - destPtr,
                           listFilesRemainingFormatString, remaining);
 
+   for (entryNum = first; entryNum < first + count; entryNum++) {
+      VixToolsListFilesEntry *entry = &cursor->entries[entryNum];
 
-   for (fileNum = offset + index, count = 0;
-        count < numResults;
-        fileNum++) {
-
-      currentFileName = fileNameList[fileNum];
-
-      if (regex) {
-         if (!g_regex_match(regex, currentFileName, 0, NULL)) {
-            continue;
-         }
-      }
-
-      if (listingSingleFile) {
-         pathName = Util_SafeStrdup(currentFileName);
-      } else {
-         pathName = Str_SafeAsprintf(NULL, "%s%s%s", dirPathName, DIRSEPS,
-                                     currentFileName);
-      }
-
-      VixToolsPrintFileExtendedInfo(pathName, currentFileName,
-                                    &destPtr, endDestPtr);
-
-      free(pathName);
-      count++;
-   } // for (fileNum = 0; fileNum < lastGoodNumFiles; fileNum++)
+      memcpy(destPtr, entry->info, entry->infoLen);
+      destPtr += entry->infoLen;
+   }
    *destPtr = '\0';
 
+   /*
+    * Drop the cursor once the listing is complete, otherwise keep it
+    * around for the next page.
+    */
+   if (!truncated && 0 == remaining) {
+      g_hash_table_remove(listFilesCursorTable, cursor->key);
+   } else {
+      VixToolsListFilesCursorTouch(cursor, eventQueue);
+   }
+
 abort:
    if (impersonatingVMWareUser) {
       VixToolsUnimpersonateUser(userToken);
    }
    VixToolsLogoutUser(userToken);
 
+   if (NULL != regex) {
+      g_regex_unref(regex);
+   }
+   g_clear_error(&gerr);
+
    if (NULL == fileList) {
       fileList = Util_SafeStrdup("");
    }
    *result = fileList;
 
-   if (NULL != fileNameList) {
-      for (fileNum = 0; fileNum < numFiles; fileNum++) {
-         free(fileNameList[fileNum]);
-      }
-      free(fileNameList);
-   }
-
    // XXX result too large for g_debug()
 
    g_message("%s: opcode %d returning %"FMT64"d\n", __FUNCTION__,
@@ -7177,7 +7996,6 @@ VixToolsRunScript(VixCommandRequestHeader *requestMsg,  // IN
    Bool forcedRoot = FALSE;
    wchar_t *envBlock = NULL;
 #endif
-   GSource *timer;
    VMAutomationRequestParser parser;
 
    err = VMAutomationRequestParserInit(&parser,
@@ -7440,10 +8258,8 @@ VixToolsRunScript(VixCommandRequestHeader *requestMsg,  // IN
    pid = (int64) ProcMgr_GetPid(asyncState->procState);
 
    asyncState->eventQueue = eventQueue;
-   timer = g_timeout_source_new(SECONDS_BETWEEN_POLL_TEST_FINISHED * 1000);
-   g_source_set_callback(timer, VixToolsMonitorAsyncProc, asyncState, NULL);
-   g_source_attach(timer, g_main_loop_get_context(eventQueue));
-   g_source_unref(timer);
+   VixToolsWatchAsyncProc(asyncState->procState, eventQueue,
+                          VixToolsMonitorAsyncProc, asyncState);
 
    /*
     * VixToolsMonitorAsyncProc will clean asyncState up when the program finishes.
@@ -10558,6 +11374,7 @@ VixTools_ProcessVixCommand(VixCommandRequestHeader *requestMsg,   // IN
       case VIX_COMMAND_LIST_FILES:
          err = VixToolsListFiles(requestMsg,
                                  maxResultBufferSize,
+                                 eventQueue,
                                  &resultValue);
          deleteResultValue = TRUE;
          break;
@@ -133,7 +133,8 @@ ToolsCoreDumpProperty(ToolsAppCtx *ctx,
 
 
 /**
- * State dump callback for GuestRPC applications.
+ * State dump callback for GuestRPC applications. Also logs the dispatch
+ * statistics of the callback.
  *
  * @param[in]  ctx   The application context.
  * @param[in]  prov  Unused.
@@ -147,7 +148,22 @@ ToolsCoreDumpRPC(ToolsAppCtx *ctx,
 {
    if (reg != NULL) {
       RpcChannelCallback *cb = reg;
-      ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "RPC callback: %s\n", cb->name);
+      RpcChannelCallbackStats stats;
+
+      if (ctx->rpc != NULL &&
+          RpcChannel_GetCallbackStats(ctx->rpc, cb->name, &stats) &&
+          stats.calls > 0) {
+         ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN,
+                            "RPC callback: %s (%"G_GUINT64_FORMAT" calls, "
+                            "avg %"G_GUINT64_FORMAT" us, "
+                            "max %"G_GUINT64_FORMAT" us)\n",
+                            cb->name, stats.calls,
+                            stats.totalTimeUs / stats.calls,
+                            stats.maxTimeUs);
+      } else {
+         ToolsCore_LogState(TOOLS_STATE_LOG_PLUGIN, "RPC callback: %s\n",
+                            cb->name);
+      }
    }
 }
 
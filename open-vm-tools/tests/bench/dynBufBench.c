@@ -0,0 +1,170 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * dynBufBench.c --
+ *
+ *    Measures the throughput of appending small chunks to a DynBuf until
+ *    it holds 1 KB to 1 GB, with both growth policies DynBuf offers:
+ *
+ *    - linear:    a plain DynBuf, which doubles up to 256 KB and then grows
+ *                 by DYNBUF_DEFAULT_MAX_GROWTH at a time.
+ *    - geometric: a DynBuf set to DYNBUF_UNBOUNDED_GROWTH with
+ *                 DynBuf_SetMaxGrowth(), which always doubles.
+ *
+ *    Buffers smaller than MIN_BYTES_TIMED are filled repeatedly, so each
+ *    measurement appends at least that much. How far apart geometric and
+ *    linear growth are depends mostly on whether realloc() can grow large
+ *    blocks in place; glibc can, with mremap().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "dynbuf.h"
+
+#define MIN_SIZE            1024
+#define DEFAULT_MAX_SIZE    ((size_t)1 << 30)
+#define DEFAULT_CHUNK_SIZE  64
+#define MAX_CHUNK_SIZE      4096
+#define MIN_BYTES_TIMED     ((size_t)64 << 20)
+
+typedef enum {
+   GROW_LINEAR,
+   GROW_GEOMETRIC,
+} GrowMode;
+
+static char chunk[MAX_CHUNK_SIZE];
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AppendUntil --
+ *
+ *    Append chunkSize byte chunks to a new buffer of the given kind until
+ *    it holds size bytes, and repeat with a new buffer until at least
+ *    MIN_BYTES_TIMED were appended.
+ *
+ * Results:
+ *    Throughput in MB/s, or -1 if an append failed.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+AppendUntil(GrowMode mode,       // IN: kind of buffer
+            size_t size,         // IN: bytes to append
+            size_t chunkSize)    // IN: bytes per append
+{
+   size_t reps = MAX(MIN_BYTES_TIMED / size, 1);
+   VmTimeType start;
+   VmTimeType elapsed;
+   size_t i;
+
+   start = Hostinfo_SystemTimerNS();
+   for (i = 0; i < reps; i++) {
+      DynBuf buf;
+      Bool ok = TRUE;
+      size_t done;
+
+      DynBuf_Init(&buf);
+      if (mode == GROW_GEOMETRIC) {
+         DynBuf_SetMaxGrowth(&buf, DYNBUF_UNBOUNDED_GROWTH);
+      }
+
+      for (done = 0; ok && done < size; done += chunkSize) {
+         ok = DynBuf_Append(&buf, chunk, chunkSize);
+      }
+
+      DynBuf_Destroy(&buf);
+
+      if (!ok) {
+         fprintf(stderr, "Append failed after %"FMTSZ"u bytes\n", done);
+         return -1;
+      }
+   }
+   elapsed = Hostinfo_SystemTimerNS() - start;
+
+   return (double)size * reps / (1024 * 1024) /
+          ((double)MAX(elapsed, 1) / 1e9);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    usage: dynBufBench [maxSize [chunkSize]]
+ *
+ * Results:
+ *    EXIT_SUCCESS or EXIT_FAILURE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   size_t maxSize = DEFAULT_MAX_SIZE;
+   size_t chunkSize = DEFAULT_CHUNK_SIZE;
+   size_t size;
+   size_t i;
+
+   if (argc > 1) {
+      maxSize = MAX(strtoull(argv[1], NULL, 0), MIN_SIZE);
+   }
+   if (argc > 2) {
+      chunkSize = MIN(MAX(strtoul(argv[2], NULL, 0), 1), MAX_CHUNK_SIZE);
+   }
+
+   for (i = 0; i < sizeof chunk; i++) {
+      chunk[i] = (char)i;
+   }
+
+   /* Warm up the heap once before timing. */
+   if (AppendUntil(GROW_LINEAR, MIN_SIZE, chunkSize) < 0) {
+      return EXIT_FAILURE;
+   }
+
+   printf("%"FMTSZ"u byte appends, MB/s\n", chunkSize);
+   printf("%12s %12s %12s\n", "size", "linear", "geometric");
+   for (size = MIN_SIZE; size <= maxSize; size *= 4) {
+      double linear = AppendUntil(GROW_LINEAR, size, chunkSize);
+      double geometric = AppendUntil(GROW_GEOMETRIC, size, chunkSize);
+
+      if (linear < 0 || geometric < 0) {
+         return EXIT_FAILURE;
+      }
+
+      printf("%12"FMTSZ"u %12.1f %12.1f\n", size, linear, geometric);
+   }
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,375 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hashTableBench.c --
+ *
+ *    Measures insert, lookup and delete cost of HashTable (lib/misc) and
+ *    HashMap (lib/hashMap) as the number of entries grows from 1k to 1M.
+ *
+ *    Every table starts out with MIN_BUCKETS buckets, as most callers
+ *    create them, so inserts include growing the table. Lookups and
+ *    deletes go through the keys in a shuffled order, so they are not
+ *    helped by the insertion order. Each lookup pass also checks that
+ *    every key is found with the value it was inserted with.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "util.h"
+#include "hashTable.h"
+#include "hashMap.h"
+
+#define MIN_ENTRIES         1000
+#define DEFAULT_MAX_ENTRIES (1000 * 1000)
+#define MIN_BUCKETS         16
+#define KEY_LEN             16
+
+typedef struct BenchResult {
+   double insertNs;
+   double lookupNs;
+   double deleteNs;
+} BenchResult;
+
+static char *strKeys;
+static uint32 *order;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * StrKey --
+ *
+ *    The i-th string key.
+ *
+ * Results:
+ *    The key.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static const char *
+StrKey(uint32 i)  // IN: key index
+{
+   return strKeys + (size_t)i * KEY_LEN;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * IntKey --
+ *
+ *    The i-th integer key, shaped like the heap pointers HASH_INT_KEY tables
+ *    are usually keyed on.
+ *
+ * Results:
+ *    The key.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+IntKey(uint32 i)  // IN: key index
+{
+   return (void *)(uintptr_t)(0x10000000 + (uintptr_t)i * 64);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * MakeKeys --
+ *
+ *    Format numEntries string keys and allocate the order array.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Sets strKeys and order.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+MakeKeys(uint32 numEntries)  // IN: number of keys
+{
+   uint32 i;
+
+   strKeys = Util_SafeMalloc((size_t)numEntries * KEY_LEN);
+   order = Util_SafeMalloc(numEntries * sizeof *order);
+   for (i = 0; i < numEntries; i++) {
+      snprintf(strKeys + (size_t)i * KEY_LEN, KEY_LEN, "key%08u", i);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * ShuffleOrder --
+ *
+ *    Fill order with a shuffled permutation of the first numEntries keys.
+ *    A fixed LCG drives the Fisher-Yates shuffle, so every run uses the
+ *    same order.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Sets order[0 .. numEntries - 1].
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+ShuffleOrder(uint32 numEntries)  // IN: number of keys
+{
+   uint32 seed = 1;
+   uint32 i;
+
+   for (i = 0; i < numEntries; i++) {
+      order[i] = i;
+   }
+   for (i = numEntries - 1; i > 0; i--) {
+      uint32 j;
+      uint32 tmp;
+
+      seed = seed * 1103515245 + 12345;
+      j = seed % (i + 1);
+      tmp = order[i];
+      order[i] = order[j];
+      order[j] = tmp;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BenchHashTable --
+ *
+ *    Insert, look up and delete numEntries keys in a HashTable of the
+ *    given key type.
+ *
+ * Results:
+ *    TRUE on success, FALSE if an operation failed. The time per operation
+ *    of each phase is returned in result.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchHashTable(int keyType,           // IN: HASH_*_KEY
+               uint32 numEntries,     // IN: number of entries
+               BenchResult *result)   // OUT: time per operation
+{
+   HashTable *ht = HashTable_Alloc(MIN_BUCKETS, keyType, NULL);
+   Bool intKeys = keyType == HASH_INT_KEY;
+   VmTimeType start;
+   Bool ok = FALSE;
+   uint32 i;
+
+#define HT_KEY(i) (intKeys ? IntKey(i) : (const void *)StrKey(i))
+
+   start = Hostinfo_SystemTimerNS();
+   for (i = 0; i < numEntries; i++) {
+      if (!HashTable_Insert(ht, HT_KEY(i), (void *)(uintptr_t)i)) {
+         fprintf(stderr, "HashTable insert %u failed\n", i);
+         goto exit;
+      }
+   }
+   result->insertNs = (double)(Hostinfo_SystemTimerNS() - start) / numEntries;
+
+   start = Hostinfo_SystemTimerNS();
+   for (i = 0; i < numEntries; i++) {
+      void *value;
+
+      if (!HashTable_Lookup(ht, HT_KEY(order[i]), &value) ||
+          (uintptr_t)value != order[i]) {
+         fprintf(stderr, "HashTable lookup %u failed\n", order[i]);
+         goto exit;
+      }
+   }
+   result->lookupNs = (double)(Hostinfo_SystemTimerNS() - start) / numEntries;
+
+   start = Hostinfo_SystemTimerNS();
+   for (i = 0; i < numEntries; i++) {
+      if (!HashTable_Delete(ht, HT_KEY(order[i]))) {
+         fprintf(stderr, "HashTable delete %u failed\n", order[i]);
+         goto exit;
+      }
+   }
+   result->deleteNs = (double)(Hostinfo_SystemTimerNS() - start) / numEntries;
+
+#undef HT_KEY
+
+   ok = HashTable_GetNumElements(ht) == 0;
+
+exit:
+   HashTable_Free(ht);
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BenchHashMap --
+ *
+ *    Insert, look up and delete numEntries uint32 keys in a HashMap.
+ *
+ * Results:
+ *    TRUE on success, FALSE if an operation failed. The time per operation
+ *    of each phase is returned in result.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchHashMap(uint32 numEntries,     // IN: number of entries
+             BenchResult *result)   // OUT: time per operation
+{
+   HashMap *map = HashMap_AllocMap(MIN_BUCKETS, sizeof(uint32),
+                                   sizeof(uint32));
+   VmTimeType start;
+   Bool ok = FALSE;
+   uint32 i;
+
+   start = Hostinfo_SystemTimerNS();
+   for (i = 0; i < numEntries; i++) {
+      if (!HashMap_Put(map, &i, &i)) {
+         fprintf(stderr, "HashMap put %u failed\n", i);
+         goto exit;
+      }
+   }
+   result->insertNs = (double)(Hostinfo_SystemTimerNS() - start) / numEntries;
+
+   start = Hostinfo_SystemTimerNS();
+   for (i = 0; i < numEntries; i++) {
+      uint32 *value = HashMap_Get(map, &order[i]);
+
+      if (value == NULL || *value != order[i]) {
+         fprintf(stderr, "HashMap get %u failed\n", order[i]);
+         goto exit;
+      }
+   }
+   result->lookupNs = (double)(Hostinfo_SystemTimerNS() - start) / numEntries;
+
+   start = Hostinfo_SystemTimerNS();
+   for (i = 0; i < numEntries; i++) {
+      if (!HashMap_Remove(map, &order[i])) {
+         fprintf(stderr, "HashMap remove %u failed\n", order[i]);
+         goto exit;
+      }
+   }
+   result->deleteNs = (double)(Hostinfo_SystemTimerNS() - start) / numEntries;
+
+   ok = HashMap_Count(map) == 0;
+
+exit:
+   HashMap_DestroyMap(map);
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    usage: hashTableBench [maxEntries]
+ *
+ * Results:
+ *    EXIT_SUCCESS or EXIT_FAILURE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   uint32 maxEntries = DEFAULT_MAX_ENTRIES;
+   uint32 numEntries;
+   int ret = EXIT_FAILURE;
+
+   if (argc > 1) {
+      maxEntries = MAX(strtoul(argv[1], NULL, 0), MIN_ENTRIES);
+   }
+
+   MakeKeys(maxEntries);
+
+   printf("%-18s %10s %14s %14s %14s\n", "table", "entries",
+          "insert (ns)", "lookup (ns)", "delete (ns)");
+   for (numEntries = MIN_ENTRIES; numEntries <= maxEntries;
+        numEntries *= 10) {
+      static const struct {
+         const char *name;
+         int keyType;
+      } tables[] = {
+         { "HashTable/string", HASH_STRING_KEY },
+         { "HashTable/istring", HASH_ISTRING_KEY },
+         { "HashTable/int", HASH_INT_KEY },
+      };
+      BenchResult result;
+      uint32 i;
+
+      ShuffleOrder(numEntries);
+      for (i = 0; i < ARRAYSIZE(tables); i++) {
+         if (!BenchHashTable(tables[i].keyType, numEntries, &result)) {
+            goto exit;
+         }
+         printf("%-18s %10u %14.1f %14.1f %14.1f\n", tables[i].name,
+                numEntries, result.insertNs, result.lookupNs,
+                result.deleteNs);
+      }
+
+      if (!BenchHashMap(numEntries, &result)) {
+         goto exit;
+      }
+      printf("%-18s %10u %14.1f %14.1f %14.1f\n", "HashMap/uint32",
+             numEntries, result.insertNs, result.lookupNs, result.deleteNs);
+   }
+   ret = EXIT_SUCCESS;
+
+exit:
+   free(strKeys);
+   free(order);
+   return ret;
+}
@@ -0,0 +1,498 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsBench.c --
+ *
+ *    Minimal in-process HGFS client for the HGFS server benchmarks.
+ *
+ *    Requests are V3 operations with the legacy request header, sent to
+ *    the server the way the guest backdoor channel does it: the reply is
+ *    complete when the session's receive callback returns.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmware.h"
+#include "util.h"
+#include "hgfsServer.h"
+#include "hgfsServerPolicy.h"
+#include "hgfsBench.h"
+
+
+/*
+ * Clients sharing a session use distinct request id ranges, so a reply
+ * can't be mistaken for that of another client.
+ */
+#define HGFS_BENCH_ID_SHIFT   20
+
+struct HgfsBenchClient {
+   HgfsServerChannelCallbacks channelCbTable;
+   void *serverSession;
+   HgfsBenchClient *owner;        // Client that connected the session
+   uint32 numShares;              // Clients created by HgfsBench_Share
+   HgfsHandle nextId;
+   size_t replySize;
+   char request[HGFS_LARGE_PACKET_MAX];
+   char reply[HGFS_LARGE_PACKET_MAX];
+};
+
+static HgfsServerCallbacks *gServerCbTable;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsBenchSend --
+ *
+ *    Channel send callback: the reply is already in the buffer of the
+ *    client that sent the request, just record its size.
+ *
+ *    The channel belongs to the client that connected the session, but
+ *    clients sharing the session send requests on it too. The reply
+ *    buffer tells which one this reply is for.
+ *
+ * Results:
+ *    TRUE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+HgfsBenchSend(void *data,            // IN: client owning the session
+              HgfsPacket *packet,    // IN/OUT: packet
+              HgfsSendFlags flags)   // IN: send flags
+{
+   HgfsBenchClient *client = (HgfsBenchClient *)
+      ((char *)packet->replyPacket - offsetof(HgfsBenchClient, reply));
+
+   ASSERT(client->owner == data);
+
+   client->replySize = MIN(packet->replyPacketDataSize, sizeof client->reply);
+
+   if (!(flags & HGFS_SEND_NO_COMPLETE)) {
+      gServerCbTable->session.sendComplete(packet, client->serverSession);
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsBench_Init --
+ *
+ *    Starts the HGFS server with the guest's "root" share.
+ *
+ * Results:
+ *    TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsBench_Init(uint32 maxCachedOpenNodes)   // IN: server's open fd cache
+{
+   static HgfsServerMgrCallbacks mgrCb;
+   static HgfsServerConfig config;
+
+   config.flags = HGFS_CONFIG_SHARE_ALL_HOST_DRIVES_ENABLED |
+                  HGFS_CONFIG_VOL_INFO_MIN;
+   config.maxCachedOpenNodes = maxCachedOpenNodes;
+
+   if (!HgfsServerPolicy_Init(NULL, NULL, &mgrCb.enumResources)) {
+      return FALSE;
+   }
+
+   if (!HgfsServer_InitState(&gServerCbTable, &config, &mgrCb)) {
+      HgfsServerPolicy_Cleanup();
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsBench_Exit --
+ *
+ *    Stops the HGFS server.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+HgfsBench_Exit(void)
+{
+   HgfsServer_ExitState();
+   HgfsServerPolicy_Cleanup();
+   gServerCbTable = NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsBench_Connect --
+ *
+ *    Creates a client with its own server session.
+ *
+ * Results:
+ *    The client, NULL if the server refused the connection.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+HgfsBenchClient *
+HgfsBench_Connect(void)
+{
+   static HgfsServerChannelData capabilities = { 0, HGFS_LARGE_PACKET_MAX };
+   HgfsBenchClient *client = Util_SafeCalloc(1, sizeof *client);
+
+   client->owner = client;
+   client->channelCbTable.send = HgfsBenchSend;
+   if (!gServerCbTable->session.connect(client,
+                                        &client->channelCbTable,
+                                        &capabilities,
+                                        &client->serverSession)) {
+      free(client);
+      return NULL;
+   }
+
+   return client;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsBench_Share --
+ *
+ *    Creates a client that sends its requests on the server session of
+ *    owner, with its own request and reply buffers. Requests of clients
+ *    sharing a session may be in the server at the same time.
+ *
+ * Results:
+ *    The client.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+HgfsBenchClient *
+HgfsBench_Share(HgfsBenchClient *owner)  // IN/OUT: client owning the session
+{
+   HgfsBenchClient *client = Util_SafeCalloc(1, sizeof *client);
+
+   ASSERT(owner->owner == owner);
+
+   client->owner = owner;
+   client->serverSession = owner->serverSession;
+   client->nextId = ++owner->numShares << HGFS_BENCH_ID_SHIFT;
+
+   return client;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsBench_Disconnect --
+ *
+ *    Frees the client. If it connected its server session, closes the
+ *    session too; clients sharing it must be disconnected first.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+HgfsBench_Disconnect(HgfsBenchClient *client)  // IN: client
+{
+   if (client->owner == client) {
+      gServerCbTable->session.disconnect(client->serverSession);
+      gServerCbTable->session.close(client->serverSession);
+   }
+   free(client);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsBenchTransact --
+ *
+ *    Sends the request whose arguments were built after the header in
+ *    client->request, and waits for its reply.
+ *
+ * Results:
+ *    The reply status. On success, *result points to the reply arguments.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static HgfsStatus
+HgfsBenchTransact(HgfsBenchClient *client,  // IN: client
+                  HgfsOp op,                // IN: operation
+                  size_t argsSize,          // IN: size of the arguments
+                  size_t resultSize,        // IN: expected reply size
+                  const void **result)      // OUT: reply arguments
+{
+   HgfsRequest *header = (HgfsRequest *)client->request;
+   const HgfsReply *reply = (const HgfsReply *)client->reply;
+   HgfsPacket packet;
+
+   header->id = client->nextId++;
+   header->op = op;
+
+   memset(&packet, 0, sizeof packet);
+   packet.iov[0].va = client->request;
+   packet.iov[0].len = sizeof *header + argsSize;
+   packet.iovCount = 1;
+   packet.metaPacket = client->request;
+   packet.metaPacketDataSize = packet.iov[0].len;
+   packet.metaPacketSize = packet.iov[0].len;
+   packet.replyPacket = client->reply;
+   packet.replyPacketSize = sizeof client->reply;
+   packet.state |= HGFS_STATE_CLIENT_REQUEST;
+
+   client->replySize = 0;
+   gServerCbTable->session.receive(&packet, client->serverSession);
+
+   if (client->replySize < sizeof *reply || reply->id != header->id) {
+      return HGFS_STATUS_PROTOCOL_ERROR;
+   }
+   if (reply->status != HGFS_STATUS_SUCCESS) {
+      return reply->status;
+   }
+   if (client->replySize < sizeof *reply + resultSize) {
+      return HGFS_STATUS_PROTOCOL_ERROR;
+   }
+
+   if (NULL != result) {
+      *result = reply + 1;
+   }
+   return HGFS_STATUS_SUCCESS;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsBench_Open --
+ *
+ *    Opens an existing file for reading through the "root" share.
+ *
+ * Results:
+ *    The reply status, and the file's handle on success.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+HgfsStatus
+HgfsBench_Open(HgfsBenchClient *client,  // IN: client
+               const char *path,         // IN: absolute path
+               HgfsHandle *file)         // OUT: handle
+{
+   HgfsRequestOpenV3 *args =
+      (HgfsRequestOpenV3 *)(client->request + sizeof(HgfsRequest));
+   size_t maxNameLen = sizeof client->request - sizeof(HgfsRequest) -
+                       sizeof *args;
+   const HgfsReplyOpenV3 *result;
+   char *name = args->fileName.name;
+   size_t nameLen;
+   HgfsStatus status;
+
+   memset(args, 0, sizeof *args);
+   args->mask = HGFS_OPEN_VALID_MODE | HGFS_OPEN_VALID_FLAGS;
+   args->mode = HGFS_OPEN_MODE_READ_ONLY;
+   args->flags = HGFS_OPEN;
+
+   /*
+    * Cross-platform name: the share name followed by the path components,
+    * NUL separated.
+    */
+   nameLen = strlen(HGFS_SERVER_POLICY_ROOT_SHARE_NAME);
+   memcpy(name, HGFS_SERVER_POLICY_ROOT_SHARE_NAME, nameLen);
+   while (*path != '\0') {
+      size_t len;
+
+      path += strspn(path, "/");
+      len = strcspn(path, "/");
+      if (len == 0) {
+         break;
+      }
+      if (nameLen + 1 + len > maxNameLen) {
+         return HGFS_STATUS_NAME_TOO_LONG;
+      }
+      name[nameLen++] = '\0';
+      memcpy(name + nameLen, path, len);
+      nameLen += len;
+      path += len;
+   }
+   name[nameLen] = '\0';
+   args->fileName.length = nameLen;
+   args->fileName.caseType = HGFS_FILE_NAME_DEFAULT_CASE;
+   args->fileName.fid = HGFS_INVALID_HANDLE;
+
+   status = HgfsBenchTransact(client, HGFS_OP_OPEN_V3, sizeof *args + nameLen,
+                              sizeof *result, (const void **)&result);
+   if (status == HGFS_STATUS_SUCCESS) {
+      *file = result->file;
+   }
+   return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsBench_Getattr --
+ *
+ *    Gets the attributes of an open file by its handle.
+ *
+ * Results:
+ *    The reply status.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+HgfsStatus
+HgfsBench_Getattr(HgfsBenchClient *client,  // IN: client
+                  HgfsHandle file)          // IN: handle
+{
+   HgfsRequestGetattrV3 *args =
+      (HgfsRequestGetattrV3 *)(client->request + sizeof(HgfsRequest));
+
+   memset(args, 0, sizeof *args);
+   args->hints = HGFS_ATTR_HINT_USE_FILE_DESC;
+   args->fileName.flags = HGFS_FILE_NAME_USE_FILE_DESC;
+   args->fileName.fid = file;
+
+   return HgfsBenchTransact(client, HGFS_OP_GETATTR_V3, sizeof *args,
+                            sizeof(HgfsReplyGetattrV3), NULL);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsBench_Read --
+ *
+ *    Reads from an open file.
+ *
+ * Results:
+ *    The reply status, and the number of bytes read on success.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+HgfsStatus
+HgfsBench_Read(HgfsBenchClient *client,  // IN: client
+               HgfsHandle file,          // IN: handle
+               uint64 offset,            // IN: file offset
+               uint32 size,              // IN: bytes to read
+               uint32 *actualSize)       // OUT: bytes read
+{
+   HgfsRequestReadV3 *args =
+      (HgfsRequestReadV3 *)(client->request + sizeof(HgfsRequest));
+   const HgfsReplyReadV3 *result;
+   HgfsStatus status;
+
+   memset(args, 0, sizeof *args);
+   args->file = file;
+   args->offset = offset;
+   args->requiredSize = size;
+
+   status = HgfsBenchTransact(client, HGFS_OP_READ_V3, sizeof *args,
+                              offsetof(HgfsReplyReadV3, payload),
+                              (const void **)&result);
+   if (status == HGFS_STATUS_SUCCESS) {
+      *actualSize = result->actualSize;
+   }
+   return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsBench_Close --
+ *
+ *    Closes an open file.
+ *
+ * Results:
+ *    The reply status.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+HgfsStatus
+HgfsBench_Close(HgfsBenchClient *client,  // IN: client
+                HgfsHandle file)          // IN: handle
+{
+   HgfsRequestCloseV3 *args =
+      (HgfsRequestCloseV3 *)(client->request + sizeof(HgfsRequest));
+
+   memset(args, 0, sizeof *args);
+   args->file = file;
+
+   return HgfsBenchTransact(client, HGFS_OP_CLOSE_V3, sizeof *args, 0, NULL);
+}
@@ -0,0 +1,56 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsBench.h --
+ *
+ *    Minimal in-process HGFS client for the HGFS server benchmarks. A
+ *    client either connects its own server session or shares the session
+ *    of another client. Sessions use a synchronous channel, like the
+ *    backdoor channel used in the guest.
+ */
+
+#ifndef _HGFS_BENCH_H_
+#define _HGFS_BENCH_H_
+
+#include "vm_basic_types.h"
+#include "hgfsProto.h"
+
+typedef struct HgfsBenchClient HgfsBenchClient;
+
+Bool HgfsBench_Init(uint32 maxCachedOpenNodes);
+void HgfsBench_Exit(void);
+
+HgfsBenchClient *HgfsBench_Connect(void);
+HgfsBenchClient *HgfsBench_Share(HgfsBenchClient *owner);
+void HgfsBench_Disconnect(HgfsBenchClient *client);
+
+HgfsStatus HgfsBench_Open(HgfsBenchClient *client,
+                          const char *path,
+                          HgfsHandle *file);
+HgfsStatus HgfsBench_Getattr(HgfsBenchClient *client,
+                             HgfsHandle file);
+HgfsStatus HgfsBench_Read(HgfsBenchClient *client,
+                          HgfsHandle file,
+                          uint64 offset,
+                          uint32 size,
+                          uint32 *actualSize);
+HgfsStatus HgfsBench_Close(HgfsBenchClient *client,
+                           HgfsHandle file);
+
+#endif // _HGFS_BENCH_H_
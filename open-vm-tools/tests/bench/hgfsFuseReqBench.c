@@ -0,0 +1,435 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsFuseReqBench.c --
+ *
+ *    Measures the per request cost of the vmhgfs-fuse request layer for
+ *    N = 1, 2, 4, ... threads issuing small operations in parallel.
+ *
+ *    The benchmark links vmhgfs-fuse's request.c against a transport that
+ *    completes every request at once from a prebuilt reply packet, the way
+ *    the backdoor channel hands its reply buffer to HgfsCompleteReq. What
+ *    is measured is therefore the request allocation, the request id, the
+ *    header packing and the reply copy, not the channel.
+ *
+ *    For each thread count it reports, in thousands of operations per
+ *    second over all threads:
+ *
+ *    getattr      getattr requests, requests recycled by HgfsFreeRequest.
+ *    getattr/mal  getattr requests, requests released with free(), so each
+ *                 one is malloced as before the per-thread pool.
+ *    read/copy    reads whose reply is copied into the packet and then into
+ *                 the caller's buffer, as before the zero-copy read.
+ *    read/zc      reads whose data goes straight into the caller's buffer.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "module.h"
+#include "hostinfo.h"
+#include "util.h"
+
+#define DEFAULT_MAX_THREADS   16
+#define DEFAULT_READ_SIZE     4096
+#define DEFAULT_MSECS         1000
+
+typedef enum {
+   BENCH_GETATTR,
+   BENCH_GETATTR_MALLOC,
+   BENCH_READ_COPY,
+   BENCH_READ_ZEROCOPY,
+   BENCH_MAX
+} BenchMode;
+
+typedef struct Worker {
+   pthread_t thread;
+   BenchMode mode;
+   VmTimeType deadline;
+   pthread_barrier_t *start;
+   uint64 ops;
+   Bool failed;
+} Worker;
+
+/* Globals vmhgfs-fuse's main.c and session.c would otherwise provide. */
+static HgfsFuseState benchState;
+HgfsFuseState *gState = &benchState;
+#ifdef VMX86_DEVEL
+int LOGLEVEL_THRESHOLD = 0;
+#endif
+
+static uint32 readSize = DEFAULT_READ_SIZE;
+static char getattrReply[sizeof(HgfsHeader) + sizeof(HgfsReplyGetattrV3)];
+static char readReply[HGFS_LARGE_PACKET_MAX];
+static size_t readReplySize;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsCreateSession --
+ *
+ *    Stub for session.c, the benchmark never reports a stale session.
+ *
+ * Results:
+ *    0.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+HgfsCreateSession(void)
+{
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsTransportSendRequest --
+ *
+ *    Stub for transport.c. Completes the request at once with the
+ *    prebuilt reply for its opcode.
+ *
+ * Results:
+ *    0 on success, -EPROTO for an opcode the benchmark does not issue.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+HgfsTransportSendRequest(HgfsReq *req)  // IN/OUT: Outgoing request
+{
+   HgfsHeader *header = (HgfsHeader *)HGFS_REQ_PAYLOAD(req);
+
+   switch (header->op) {
+   case HGFS_OP_GETATTR_V3:
+      HgfsCompleteReq(req, getattrReply, sizeof getattrReply);
+      return 0;
+   case HGFS_OP_READ_V3:
+      HgfsCompleteReq(req, readReply, readReplySize);
+      return 0;
+   default:
+      return -EPROTO;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BuildReplies --
+ *
+ *    Fill in the reply packets the stub transport completes requests
+ *    with.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+BuildReplies(void)
+{
+   HgfsHeader *header;
+   HgfsReplyReadV3 *reply;
+
+   header = (HgfsHeader *)getattrReply;
+   header->version = HGFS_HEADER_VERSION;
+   header->dummy = HGFS_OP_NEW_HEADER;
+   header->headerSize = sizeof *header;
+   header->packetSize = sizeof getattrReply;
+   header->op = HGFS_OP_GETATTR_V3;
+   header->status = HGFS_STATUS_SUCCESS;
+   header->flags = HGFS_PACKET_FLAG_REPLY;
+
+   readReplySize = sizeof *header + offsetof(HgfsReplyReadV3, payload) +
+                   readSize;
+   header = (HgfsHeader *)readReply;
+   header->version = HGFS_HEADER_VERSION;
+   header->dummy = HGFS_OP_NEW_HEADER;
+   header->headerSize = sizeof *header;
+   header->packetSize = readReplySize;
+   header->op = HGFS_OP_READ_V3;
+   header->status = HGFS_STATUS_SUCCESS;
+   header->flags = HGFS_PACKET_FLAG_REPLY;
+   reply = (HgfsReplyReadV3 *)(readReply + sizeof *header);
+   reply->actualSize = readSize;
+   memset(reply->payload, 'x', readSize);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DoOp --
+ *
+ *    Issue one request through the request layer, the way file.c does.
+ *
+ * Results:
+ *    TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+DoOp(BenchMode mode,  // IN: operation to issue
+     char *buf)       // OUT: read destination
+{
+   HgfsReq *req;
+   Bool isRead = mode == BENCH_READ_COPY || mode == BENCH_READ_ZEROCOPY;
+   size_t dataOffset = HgfsGetReplyHeaderSize() +
+                       offsetof(HgfsReplyReadV3, payload);
+   Bool result = FALSE;
+
+   req = HgfsGetNewRequest();
+   if (req == NULL) {
+      return FALSE;
+   }
+
+   if (isRead) {
+      HgfsRequestReadV3 *request = HgfsGetRequestPayload(req);
+
+      request->file = 1;
+      request->offset = 0;
+      request->requiredSize = readSize;
+      request->reserved = 0;
+      req->payloadSize = sizeof *request + HgfsGetRequestHeaderSize();
+      if (mode == BENCH_READ_ZEROCOPY) {
+         req->replyData = buf;
+         req->replyDataOffset = dataOffset;
+         req->replyDataSize = readSize;
+      }
+      HgfsPackHeader(req, HGFS_OP_READ_V3);
+   } else {
+      HgfsRequestGetattrV3 *request = HgfsGetRequestPayload(req);
+
+      memset(request, 0, sizeof *request);
+      request->hints = HGFS_ATTR_HINT_USE_FILE_DESC;
+      request->fileName.fid = 1;
+      req->payloadSize = sizeof *request + HgfsGetRequestHeaderSize();
+      HgfsPackHeader(req, HGFS_OP_GETATTR_V3);
+   }
+
+   if (HgfsSendRequest(req) != 0 ||
+       HgfsGetReplyStatus(req) != HGFS_STATUS_SUCCESS) {
+      goto out;
+   }
+
+   if (isRead) {
+      HgfsReplyReadV3 *reply = HgfsGetReplyPayload(req);
+
+      if (reply->actualSize != readSize) {
+         goto out;
+      }
+      if (mode == BENCH_READ_COPY) {
+         memcpy(buf, reply->payload, reply->actualSize);
+      }
+   }
+   result = TRUE;
+
+out:
+   if (mode == BENCH_GETATTR_MALLOC) {
+      free(req);
+   } else {
+      HgfsFreeRequest(req);
+   }
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * WorkerThread --
+ *
+ *    Issues requests of the worker's mode until the deadline.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+WorkerThread(void *data)  // IN: worker
+{
+   Worker *worker = data;
+   char *buf = Util_SafeMalloc(readSize);
+
+   pthread_barrier_wait(worker->start);
+
+   do {
+      unsigned int i;
+
+      /* Check the clock every few requests only. */
+      for (i = 0; i < 64; i++) {
+         if (!DoOp(worker->mode, buf)) {
+            worker->failed = TRUE;
+            goto exit;
+         }
+      }
+      worker->ops += i;
+   } while (Hostinfo_SystemTimerNS() < worker->deadline);
+
+exit:
+   free(buf);
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * RunMode --
+ *
+ *    Run numThreads workers of one mode for msecs milliseconds.
+ *
+ * Results:
+ *    Thousands of operations per second over all workers, or -1 on
+ *    failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+RunMode(BenchMode mode,        // IN: operation to issue
+        uint32 numThreads,     // IN: number of workers
+        uint32 msecs)          // IN: duration
+{
+   Worker *workers = Util_SafeCalloc(numThreads, sizeof *workers);
+   pthread_barrier_t start;
+   VmTimeType deadline;
+   uint64 ops = 0;
+   Bool failed = FALSE;
+   uint32 i;
+
+   pthread_barrier_init(&start, NULL, numThreads);
+   deadline = Hostinfo_SystemTimerNS() + msecs * 1000000ULL;
+   for (i = 0; i < numThreads; i++) {
+      workers[i].mode = mode;
+      workers[i].deadline = deadline;
+      workers[i].start = &start;
+      if (pthread_create(&workers[i].thread, NULL, WorkerThread,
+                         &workers[i]) != 0) {
+         fprintf(stderr, "Could not create worker thread\n");
+         exit(EXIT_FAILURE);
+      }
+   }
+   for (i = 0; i < numThreads; i++) {
+      pthread_join(workers[i].thread, NULL);
+      ops += workers[i].ops;
+      failed |= workers[i].failed;
+   }
+   pthread_barrier_destroy(&start);
+   free(workers);
+
+   return failed ? -1 : (double)ops / msecs;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    usage: hgfsFuseReqBench [maxThreads [readSize [msecs]]]
+ *
+ * Results:
+ *    EXIT_SUCCESS or EXIT_FAILURE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   static const char *names[BENCH_MAX] = {
+      "getattr", "getattr/mal", "read/copy", "read/zc",
+   };
+   uint32 maxThreads = DEFAULT_MAX_THREADS;
+   uint32 msecs = DEFAULT_MSECS;
+   uint32 numThreads;
+   BenchMode mode;
+
+   if (argc > 1) {
+      maxThreads = MAX(strtoul(argv[1], NULL, 0), 1);
+   }
+   if (argc > 2) {
+      readSize = strtoul(argv[2], NULL, 0);
+      readSize = MAX(MIN(readSize, HGFS_LARGE_IO_MAX), 1);
+   }
+   if (argc > 3) {
+      msecs = MAX(strtoul(argv[3], NULL, 0), 1);
+   }
+
+   gState->sessionEnabled = TRUE;
+   gState->headerVersion = HGFS_HEADER_VERSION;
+   gState->sessionId = 1;
+   BuildReplies();
+
+   printf("read size %u bytes, kops/s over all threads\n", readSize);
+   printf("%8s", "threads");
+   for (mode = 0; mode < BENCH_MAX; mode++) {
+      printf(" %12s", names[mode]);
+   }
+   printf("\n");
+
+   for (numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+      printf("%8u", numThreads);
+      for (mode = 0; mode < BENCH_MAX; mode++) {
+         double kops = RunMode(mode, numThreads, msecs);
+
+         if (kops < 0) {
+            fprintf(stderr, "\n%s requests failed\n", names[mode]);
+            return EXIT_FAILURE;
+         }
+         printf(" %12.1f", kops);
+      }
+      printf("\n");
+   }
+
+   return EXIT_SUCCESS;
+}
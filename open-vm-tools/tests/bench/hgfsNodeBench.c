@@ -0,0 +1,232 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsNodeBench.c --
+ *
+ *    Measures the cost of handle based HGFS requests as the number of
+ *    open file nodes in a session grows from 16 to 64k.
+ *
+ *    All files stay open, so the session's node array holds one node per
+ *    file. The timed requests are getattrs by handle on the most recently
+ *    opened files, which are still in the server's open fd cache: the
+ *    cost measured is the request path plus the handle to node lookup,
+ *    not reopening files.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "util.h"
+#include "hgfsServer.h"
+#include "hgfsBench.h"
+
+#define MIN_NODES          16
+#define DEFAULT_MAX_NODES  (64 * 1024)
+#define DEFAULT_ITERATIONS (200 * 1000)
+#define HOT_NODES          16
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CreateFiles --
+ *
+ *    Creates numFiles empty files in dir.
+ *
+ * Results:
+ *    TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+CreateFiles(const char *dir,    // IN: directory
+            uint32 numFiles)    // IN: number of files
+{
+   uint32 i;
+
+   for (i = 0; i < numFiles; i++) {
+      char path[PATH_MAX];
+      int fd;
+
+      snprintf(path, sizeof path, "%s/%08u", dir, i);
+      fd = open(path, O_CREAT | O_WRONLY, 0600);
+      if (fd < 0) {
+         fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+         return FALSE;
+      }
+      close(fd);
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * RemoveFiles --
+ *
+ *    Removes the files created by CreateFiles and the directory.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+RemoveFiles(const char *dir,    // IN: directory
+            uint32 numFiles)    // IN: number of files
+{
+   uint32 i;
+
+   for (i = 0; i < numFiles; i++) {
+      char path[PATH_MAX];
+
+      snprintf(path, sizeof path, "%s/%08u", dir, i);
+      unlink(path);
+   }
+   rmdir(dir);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    usage: hgfsNodeBench [maxNodes [iterations]]
+ *
+ * Results:
+ *    EXIT_SUCCESS or EXIT_FAILURE.
+ *
+ * Side effects:
+ *    Creates and removes maxNodes files in a temporary directory.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   char dir[] = "/tmp/hgfsNodeBench.XXXXXX";
+   uint32 maxNodes = DEFAULT_MAX_NODES;
+   uint32 iterations = DEFAULT_ITERATIONS;
+   HgfsBenchClient *client;
+   HgfsHandle *handles;
+   uint32 numOpen = 0;
+   uint32 numNodes;
+   int ret = EXIT_FAILURE;
+
+   if (argc > 1) {
+      maxNodes = MAX(strtoul(argv[1], NULL, 0), MIN_NODES);
+   }
+   if (argc > 2) {
+      iterations = MAX(strtoul(argv[2], NULL, 0), 1);
+   }
+
+   if (mkdtemp(dir) == NULL) {
+      fprintf(stderr, "Could not create a temporary directory: %s\n",
+              strerror(errno));
+      return EXIT_FAILURE;
+   }
+   if (!CreateFiles(dir, maxNodes)) {
+      goto exit;
+   }
+
+   if (!HgfsBench_Init(HGFS_MAX_CACHED_FILENODES)) {
+      fprintf(stderr, "Could not start the HGFS server\n");
+      goto exit;
+   }
+   client = HgfsBench_Connect();
+   if (client == NULL) {
+      fprintf(stderr, "Could not connect to the HGFS server\n");
+      HgfsBench_Exit();
+      goto exit;
+   }
+
+   handles = Util_SafeMalloc(maxNodes * sizeof *handles);
+
+   printf("%10s %14s %16s\n", "nodes", "open (us/op)", "getattr (ns/op)");
+   for (numNodes = MIN_NODES; numNodes <= maxNodes; numNodes *= 4) {
+      VmTimeType start;
+      VmTimeType openTime;
+      VmTimeType getattrTime;
+      uint32 opened = numNodes - numOpen;
+      uint32 i;
+
+      start = Hostinfo_SystemTimerNS();
+      for (; numOpen < numNodes; numOpen++) {
+         char path[PATH_MAX];
+         HgfsStatus status;
+
+         snprintf(path, sizeof path, "%s/%08u", dir, numOpen);
+         status = HgfsBench_Open(client, path, &handles[numOpen]);
+         if (status != HGFS_STATUS_SUCCESS) {
+            fprintf(stderr, "Open of %s failed: %d\n", path, status);
+            goto disconnect;
+         }
+      }
+      openTime = Hostinfo_SystemTimerNS() - start;
+
+      start = Hostinfo_SystemTimerNS();
+      for (i = 0; i < iterations; i++) {
+         HgfsHandle file = handles[numOpen - 1 - i % HOT_NODES];
+         HgfsStatus status = HgfsBench_Getattr(client, file);
+
+         if (status != HGFS_STATUS_SUCCESS) {
+            fprintf(stderr, "Getattr failed: %d\n", status);
+            goto disconnect;
+         }
+      }
+      getattrTime = Hostinfo_SystemTimerNS() - start;
+
+      printf("%10u %14.2f %16.1f\n", numNodes,
+             (double)openTime / opened / 1000,
+             (double)getattrTime / iterations);
+   }
+   ret = EXIT_SUCCESS;
+
+disconnect:
+   while (numOpen > 0) {
+      HgfsBench_Close(client, handles[--numOpen]);
+   }
+   free(handles);
+   HgfsBench_Disconnect(client);
+   HgfsBench_Exit();
+
+exit:
+   RemoveFiles(dir, maxNodes);
+   return ret;
+}
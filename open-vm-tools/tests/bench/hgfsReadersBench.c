@@ -0,0 +1,314 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * hgfsReadersBench.c --
+ *
+ *    Drives N concurrent readers through the HGFS server and reports the
+ *    aggregate read throughput for N = 1, 2, 4, ...
+ *
+ *    Each reader is a thread reading the same file sequentially, through
+ *    its own handle, in HGFS_LARGE_IO_MAX sized requests. The readers are
+ *    run twice: once all sending their requests on one server session,
+ *    which is how concurrent guest requests reach the server, and once
+ *    with a session each, for comparison.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "util.h"
+#include "hgfsServer.h"
+#include "hgfsBench.h"
+
+#define DEFAULT_MAX_READERS   16
+#define DEFAULT_SECONDS       3
+#define FILE_SIZE             (64 * 1024 * 1024)
+#define READ_SIZE             HGFS_LARGE_IO_MAX
+
+typedef struct Reader {
+   pthread_t thread;
+   HgfsBenchClient *client;   // Shared session client, NULL to connect
+   const char *path;
+   VmTimeType deadline;
+   pthread_barrier_t *start;
+   uint64 bytesRead;
+   Bool failed;
+} Reader;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CreateFile --
+ *
+ *    Creates the file the readers read, FILE_SIZE bytes large.
+ *
+ * Results:
+ *    TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+CreateFile(const char *path)  // IN: file to create
+{
+   static char buf[1024 * 1024];
+   Bool result = TRUE;
+   size_t written;
+   int fd;
+
+   fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+   if (fd < 0) {
+      fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+      return FALSE;
+   }
+
+   memset(buf, 'x', sizeof buf);
+   for (written = 0; written < FILE_SIZE; written += sizeof buf) {
+      if (write(fd, buf, sizeof buf) != sizeof buf) {
+         fprintf(stderr, "Could not write %s: %s\n", path, strerror(errno));
+         result = FALSE;
+         break;
+      }
+   }
+
+   close(fd);
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * ReaderThread --
+ *
+ *    Reads the file sequentially, wrapping around at its end, until the
+ *    deadline. Connects a session of its own unless the reader was given
+ *    a client.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+ReaderThread(void *data)  // IN: reader
+{
+   Reader *reader = data;
+   HgfsBenchClient *client = reader->client;
+   HgfsHandle file = HGFS_INVALID_HANDLE;
+   uint64 offset = 0;
+
+   if (client == NULL) {
+      client = HgfsBench_Connect();
+   }
+   if (client == NULL ||
+       HgfsBench_Open(client, reader->path, &file) != HGFS_STATUS_SUCCESS) {
+      reader->failed = TRUE;
+   }
+
+   pthread_barrier_wait(reader->start);
+   if (reader->failed) {
+      goto exit;
+   }
+
+   while (Hostinfo_SystemTimerNS() < reader->deadline) {
+      uint32 actualSize;
+
+      if (HgfsBench_Read(client, file, offset, READ_SIZE,
+                         &actualSize) != HGFS_STATUS_SUCCESS) {
+         reader->failed = TRUE;
+         break;
+      }
+      reader->bytesRead += actualSize;
+      offset += actualSize;
+      if (actualSize < READ_SIZE) {
+         offset = 0;
+      }
+   }
+
+   HgfsBench_Close(client, file);
+
+exit:
+   if (client != NULL && reader->client == NULL) {
+      HgfsBench_Disconnect(client);
+   }
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * RunReaders --
+ *
+ *    Runs numReaders readers of path for the given time, on one shared
+ *    session or on a session each.
+ *
+ * Results:
+ *    Aggregate throughput in MB/s, or -1 if a reader failed.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+RunReaders(const char *path,       // IN: file to read
+           uint32 numReaders,      // IN: number of readers
+           uint32 seconds,         // IN: how long to read
+           Bool shareSession)      // IN: one session for all readers
+{
+   Reader *readers = Util_SafeCalloc(numReaders, sizeof *readers);
+   HgfsBenchClient *owner = NULL;
+   pthread_barrier_t start;
+   VmTimeType deadline;
+   uint64 bytesRead = 0;
+   Bool failed = FALSE;
+   uint32 i;
+
+   if (shareSession) {
+      owner = HgfsBench_Connect();
+      if (owner == NULL) {
+         free(readers);
+         return -1;
+      }
+      for (i = 0; i < numReaders; i++) {
+         readers[i].client = HgfsBench_Share(owner);
+      }
+   }
+
+   pthread_barrier_init(&start, NULL, numReaders);
+   deadline = Hostinfo_SystemTimerNS() + seconds * 1000000000ULL;
+   for (i = 0; i < numReaders; i++) {
+      readers[i].path = path;
+      readers[i].deadline = deadline;
+      readers[i].start = &start;
+      if (pthread_create(&readers[i].thread, NULL, ReaderThread,
+                         &readers[i]) != 0) {
+         fprintf(stderr, "Could not create reader thread\n");
+         exit(EXIT_FAILURE);
+      }
+   }
+   for (i = 0; i < numReaders; i++) {
+      pthread_join(readers[i].thread, NULL);
+      bytesRead += readers[i].bytesRead;
+      failed |= readers[i].failed;
+      if (readers[i].client != NULL) {
+         HgfsBench_Disconnect(readers[i].client);
+      }
+   }
+   pthread_barrier_destroy(&start);
+   free(readers);
+
+   if (owner != NULL) {
+      HgfsBench_Disconnect(owner);
+   }
+
+   return failed ? -1 : (double)bytesRead / seconds / (1024 * 1024);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    usage: hgfsReadersBench [maxReaders [seconds]]
+ *
+ * Results:
+ *    EXIT_SUCCESS or EXIT_FAILURE.
+ *
+ * Side effects:
+ *    Creates and removes a FILE_SIZE file in /tmp.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   char path[] = "/tmp/hgfsReadersBench.XXXXXX";
+   uint32 maxReaders = DEFAULT_MAX_READERS;
+   uint32 seconds = DEFAULT_SECONDS;
+   uint32 numReaders;
+   int ret = EXIT_FAILURE;
+   int fd;
+
+   if (argc > 1) {
+      maxReaders = MAX(strtoul(argv[1], NULL, 0), 1);
+   }
+   if (argc > 2) {
+      seconds = MAX(strtoul(argv[2], NULL, 0), 1);
+   }
+
+   fd = mkstemp(path);
+   if (fd < 0) {
+      fprintf(stderr, "Could not create a temporary file: %s\n",
+              strerror(errno));
+      return EXIT_FAILURE;
+   }
+   close(fd);
+   if (!CreateFile(path)) {
+      goto exit;
+   }
+
+   if (!HgfsBench_Init(HGFS_MAX_CACHED_FILENODES)) {
+      fprintf(stderr, "Could not start the HGFS server\n");
+      goto exit;
+   }
+
+   printf("%8s %20s %20s\n", "readers", "one session (MB/s)",
+          "session each (MB/s)");
+   for (numReaders = 1; numReaders <= maxReaders; numReaders *= 2) {
+      double shared = RunReaders(path, numReaders, seconds, TRUE);
+      double separate = RunReaders(path, numReaders, seconds, FALSE);
+
+      if (shared < 0 || separate < 0) {
+         fprintf(stderr, "Reading through the HGFS server failed\n");
+         HgfsBench_Exit();
+         goto exit;
+      }
+
+      printf("%8u %20.1f %20.1f\n", numReaders, shared, separate);
+   }
+   ret = EXIT_SUCCESS;
+
+   HgfsBench_Exit();
+
+exit:
+   unlink(path);
+   return ret;
+}
@@ -0,0 +1,155 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * perfMonBench.c --
+ *
+ *    Measures the per-sample CPU cost of the guestInfo perfMon collector,
+ *    GuestInfo_PerfMon, on the live /proc of the machine the benchmark
+ *    runs on. The cost reported is user and system CPU time per sample as
+ *    seen by getrusage(), along with the size of the encoded stats.
+ *
+ *    To compare two versions of the collector, build the benchmark with
+ *    each version of perfMonLinux.c; the encoded sizes should match.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "dynbuf.h"
+#include "guestInfoInt.h"
+
+#define DEFAULT_SAMPLES 5000
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TimevalToUS --
+ *
+ *    Convert a struct timeval to microseconds.
+ *
+ * Results:
+ *    The time in microseconds.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint64
+TimevalToUS(const struct timeval *tv)  // IN: time
+{
+   return (uint64)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * RunSamples --
+ *
+ *    Take samples with GuestInfo_PerfMon and print the CPU cost per
+ *    sample.
+ *
+ * Results:
+ *    TRUE on success, FALSE if a sample failed.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+RunSamples(uint32 samples)   // IN: number of samples
+{
+   struct rusage before;
+   struct rusage after;
+   size_t size = 0;
+   uint64 userUs;
+   uint64 sysUs;
+   uint32 i;
+
+   /*
+    * One sample more than timed: the first one sets up the collector. Each
+    * sample gets a fresh DynBuf, as in GuestInfoGather.
+    */
+   for (i = 0; i <= samples; i++) {
+      DynBuf statBuf;
+      Bool ok;
+
+      if (i == 1) {
+         getrusage(RUSAGE_SELF, &before);
+      }
+      DynBuf_Init(&statBuf);
+      ok = GuestInfo_PerfMon(&statBuf);
+      size = DynBuf_GetSize(&statBuf);
+      DynBuf_Destroy(&statBuf);
+      if (!ok) {
+         fprintf(stderr, "Sample %u failed\n", i);
+         return FALSE;
+      }
+   }
+   getrusage(RUSAGE_SELF, &after);
+
+   userUs = TimevalToUS(&after.ru_utime) - TimevalToUS(&before.ru_utime);
+   sysUs = TimevalToUS(&after.ru_stime) - TimevalToUS(&before.ru_stime);
+   printf("%12.1f %12.1f %12.1f %10"FMTSZ"u\n", (double)userUs / samples,
+          (double)sysUs / samples, (double)(userUs + sysUs) / samples, size);
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    usage: perfMonBench [samples]
+ *
+ * Results:
+ *    EXIT_SUCCESS or EXIT_FAILURE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   uint32 samples = DEFAULT_SAMPLES;
+
+   if (argc > 1) {
+      samples = MAX(strtoul(argv[1], NULL, 0), 1);
+   }
+
+   printf("%u samples, CPU time per sample\n", samples);
+   printf("%12s %12s %12s %10s\n", "user (us)", "system (us)", "total (us)",
+          "bytes");
+
+   return RunSamples(samples) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,339 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * procMgrBench.c --
+ *
+ *    Measures ProcMgr process enumeration on a synthetic /proc tree as the
+ *    number of processes grows from 100 to 10k, so the numbers do not
+ *    depend on what happens to run on the machine.
+ *
+ *    Each fake /proc/<pid> has a cmdline, status and stat file. One in
+ *    KTHREAD_EVERY has an empty cmdline, like a kernel thread, so its name
+ *    is read from status. The tree also has a few non-pid entries, which
+ *    the enumeration has to skip. For reference, the live /proc is
+ *    listed with ProcMgr_ListProcesses as well.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "procMgr.h"
+
+#define MIN_PROCS            100
+#define DEFAULT_MAX_PROCS    10000
+#define DEFAULT_ITERATIONS   20
+#define KTHREAD_EVERY        8
+#define FIRST_PID            1000
+
+static const char *procFiles[] = { "cmdline", "status", "stat" };
+static const char *nonPidEntries[] = { "self", "meminfo", "sys" };
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * WriteFile --
+ *
+ *    Create dir/name with the given contents.
+ *
+ * Results:
+ *    TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+WriteFile(const char *dir,    // IN: directory
+          const char *name,   // IN: file name
+          const char *data,   // IN: contents
+          size_t size)        // IN: size of contents
+{
+   char path[PATH_MAX];
+   Bool result;
+   int fd;
+
+   snprintf(path, sizeof path, "%s/%s", dir, name);
+   fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+   if (fd < 0) {
+      fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+      return FALSE;
+   }
+   result = write(fd, data, size) == (ssize_t)size;
+   if (!result) {
+      fprintf(stderr, "Could not write %s: %s\n", path, strerror(errno));
+   }
+   close(fd);
+   return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CreateProc --
+ *
+ *    Create the fake /proc/<pid> directory of the given pid in root.
+ *
+ * Results:
+ *    TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+CreateProc(const char *root,  // IN: fake /proc
+           uint32 pid)        // IN: pid
+{
+   char dir[PATH_MAX];
+   char cmdLine[256];
+   char status[256];
+   char stat[512];
+   int cmdLineLen = 0;
+   int len;
+
+   snprintf(dir, sizeof dir, "%s/%u", root, pid);
+   if (mkdir(dir, 0700) != 0) {
+      fprintf(stderr, "Could not create %s: %s\n", dir, strerror(errno));
+      return FALSE;
+   }
+
+   if (pid % KTHREAD_EVERY != 0) {
+      /* Arguments are NUL separated, including the last one. */
+      cmdLineLen = snprintf(cmdLine, sizeof cmdLine,
+                            "/usr/sbin/daemon%u%c--config%c"
+                            "/etc/daemon%u.conf%c",
+                            pid, '\0', '\0', pid, '\0');
+      len = snprintf(status, sizeof status,
+                     "Name:\tdaemon%u\nState:\tS (sleeping)\nPid:\t%u\n",
+                     pid, pid);
+   } else {
+      len = snprintf(status, sizeof status,
+                     "Name:\tkworker/%u:0\nState:\tI (idle)\nPid:\t%u\n",
+                     pid, pid);
+   }
+   if (!WriteFile(dir, "cmdline", cmdLine, cmdLineLen) ||
+       !WriteFile(dir, "status", status, len)) {
+      return FALSE;
+   }
+
+   /* Field 22 is the start time, in clock ticks since boot. */
+   len = snprintf(stat, sizeof stat,
+                  "%u (daemon %u) S 1 %u %u 0 -1 4194560 1234 0 0 0 "
+                  "12 34 0 0 20 0 1 0 %u 12345678 456 "
+                  "18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 0 17 "
+                  "0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+                  pid, pid, pid, pid, 1000 + pid);
+
+   return WriteFile(dir, "stat", stat, len);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * RemoveTree --
+ *
+ *    Remove the fake /proc created by main.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+RemoveTree(const char *root,    // IN: fake /proc
+           uint32 numProcs)     // IN: pids created
+{
+   char path[PATH_MAX];
+   uint32 i;
+   uint32 j;
+
+   for (i = 0; i < numProcs; i++) {
+      for (j = 0; j < ARRAYSIZE(procFiles); j++) {
+         snprintf(path, sizeof path, "%s/%u/%s", root, FIRST_PID + i,
+                  procFiles[j]);
+         unlink(path);
+      }
+      snprintf(path, sizeof path, "%s/%u", root, FIRST_PID + i);
+      rmdir(path);
+   }
+   for (j = 0; j < ARRAYSIZE(nonPidEntries); j++) {
+      snprintf(path, sizeof path, "%s/%s", root, nonPidEntries[j]);
+      unlink(path);
+   }
+   rmdir(root);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * ListProcs --
+ *
+ *    List the processes of the tree open at procFd, or of /proc if procFd
+ *    is -1, iterations times.
+ *
+ * Results:
+ *    Microseconds per listing, or -1 if a listing failed or did not
+ *    return expected processes. expected is ignored for /proc.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+ListProcs(int procFd,         // IN: fake /proc or -1
+          uint32 expected,    // IN: number of processes in the tree
+          uint32 iterations)  // IN: number of listings
+{
+   VmTimeType start = Hostinfo_SystemTimerNS();
+   uint32 i;
+
+   for (i = 0; i < iterations; i++) {
+      ProcMgrProcInfoArray *procList;
+      size_t count;
+
+      procList = procFd == -1 ? ProcMgr_ListProcesses()
+                              : ProcMgr_ListProcessesAt(procFd);
+      if (procList == NULL) {
+         fprintf(stderr, "Listing processes failed\n");
+         return -1;
+      }
+      count = ProcMgrProcInfoArray_Count(procList);
+      ProcMgr_FreeProcList(procList);
+      if (procFd != -1 && count != expected) {
+         fprintf(stderr, "Listed %"FMTSZ"u processes, expected %u\n",
+                 count, expected);
+         return -1;
+      }
+   }
+
+   return (double)(Hostinfo_SystemTimerNS() - start) / iterations / 1000;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    usage: procMgrBench [maxProcs [iterations]]
+ *
+ * Results:
+ *    EXIT_SUCCESS or EXIT_FAILURE.
+ *
+ * Side effects:
+ *    Creates and removes a fake /proc in a temporary directory.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   char root[] = "/tmp/procMgrBench.XXXXXX";
+   uint32 maxProcs = DEFAULT_MAX_PROCS;
+   uint32 iterations = DEFAULT_ITERATIONS;
+   uint32 numProcs = 0;
+   uint32 target;
+   int ret = EXIT_FAILURE;
+   int procFd = -1;
+   double us;
+   uint32 i;
+
+   if (argc > 1) {
+      maxProcs = MAX(strtoul(argv[1], NULL, 0), MIN_PROCS);
+   }
+   if (argc > 2) {
+      iterations = MAX(strtoul(argv[2], NULL, 0), 1);
+   }
+
+   if (mkdtemp(root) == NULL) {
+      fprintf(stderr, "Could not create a temporary directory: %s\n",
+              strerror(errno));
+      return EXIT_FAILURE;
+   }
+   for (i = 0; i < ARRAYSIZE(nonPidEntries); i++) {
+      if (!WriteFile(root, nonPidEntries[i], "", 0)) {
+         goto exit;
+      }
+   }
+   procFd = open(root, O_RDONLY | O_DIRECTORY);
+   if (procFd < 0) {
+      fprintf(stderr, "Could not open %s: %s\n", root, strerror(errno));
+      goto exit;
+   }
+
+   printf("%-10s %10s %14s %16s\n", "tree", "processes", "list (us)",
+          "per process (us)");
+   for (target = MIN_PROCS; target <= maxProcs; target *= 10) {
+      for (; numProcs < target; numProcs++) {
+         if (!CreateProc(root, FIRST_PID + numProcs)) {
+            numProcs++;
+            goto exit;
+         }
+      }
+
+      /* Warm up the dentry cache and the owner lookup once. */
+      if (ListProcs(procFd, numProcs, 1) < 0) {
+         goto exit;
+      }
+      us = ListProcs(procFd, numProcs, iterations);
+      if (us < 0) {
+         goto exit;
+      }
+      printf("%-10s %10u %14.1f %16.2f\n", "synthetic", numProcs, us,
+             us / numProcs);
+   }
+
+   us = ListProcs(-1, 0, iterations);
+   if (us < 0) {
+      goto exit;
+   }
+   printf("%-10s %10s %14.1f\n", "/proc", "-", us);
+   ret = EXIT_SUCCESS;
+
+exit:
+   if (procFd >= 0) {
+      close(procFd);
+   }
+   RemoveTree(root, numProcs);
+   return ret;
+}
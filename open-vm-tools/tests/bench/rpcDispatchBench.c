@@ -0,0 +1,365 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * rpcDispatchBench.c --
+ *
+ *    Replays a TCLO message stream through RpcChannel_Dispatch and reports
+ *    the cost per message.
+ *
+ *    The stream is either read from a file, one message per line, or is a
+ *    built-in sample shaped like what the VMX sends to a running vmtoolsd.
+ *    Every command vmtoolsd commonly registers gets a handler that does
+ *    nothing, so the numbers are the dispatch overhead alone.
+ *
+ *    For reference, the same stream also goes through a copy of the old
+ *    dispatch path, which strdup()ed the command name with
+ *    StrUtil_GetNextToken and looked it up in a g_str_hash table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vmware.h"
+#include "hostinfo.h"
+#include "strutil.h"
+#include "vmware/tools/guestrpc.h"
+
+#define DEFAULT_ITERATIONS 200
+
+static const char *benchCommands[] = {
+   "reset",
+   "ping",
+   "Capabilities_Register",
+   "Set_Option",
+   "OS_PowerOn",
+   "OS_Resume",
+   "OS_Suspend",
+   "OS_Halt",
+   "OS_Reboot",
+   "Time_Synchronize",
+   "vmx.capability.unified_loop",
+   "vix.command",
+   "Resolution_Set",
+   "DisplayTopology_Set",
+   "DisplayTopologyModes_Set",
+   "deployPkg.begin",
+   "deployPkg.deploy",
+   "vmsupport.start",
+   "f",
+   "copypaste.hg.data.set",
+   "dnd.ungrab",
+   "unity.enter",
+   "unity.exit",
+   "unity.window.show",
+};
+
+static const char *benchStream[] = {
+   "reset",
+   "ping",
+   "Capabilities_Register",
+   "Set_Option broadcastIP 1",
+   "Set_Option synctime 0",
+   "Set_Option enableDnD 1",
+   "Set_Option copypaste 1",
+   "Set_Option toolScripts.afterPowerOn 1",
+   "ping",
+   "vmx.capability.unified_loop toolbox",
+   "Time_Synchronize 0",
+   "vix.command \"GuestInfo\" 1 0 0 1234",
+   "Resolution_Set 1024 768",
+   "ping",
+   "DisplayTopology_Set 1 , 0 0 1024 768",
+   "vix.command \"ListProcesses\" 1 0 0 1235",
+   "ping",
+   "unity.window.show 42",
+   "ping",
+   "Set_Option enableMessageBusTunnel 0",
+};
+
+static char **stream;
+static size_t *streamLens;
+static size_t streamCount;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BenchCallback --
+ *
+ *    Handler registered for every command, does nothing.
+ *
+ * Results:
+ *    TRUE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static gboolean
+BenchCallback(RpcInData *data)  // IN/OUT: RPC data
+{
+   return RPCIN_SETRETVALS(data, "", TRUE);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * LoadStream --
+ *
+ *    Read the messages to replay from a file, one per line, or use the
+ *    built-in sample if path is NULL.
+ *
+ * Results:
+ *    TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *    Sets stream, streamLens and streamCount.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+LoadStream(const char *path)  // IN: recorded stream or NULL
+{
+   GPtrArray *msgs = g_ptr_array_new();
+   size_t i;
+
+   if (path == NULL) {
+      for (i = 0; i < ARRAYSIZE(benchStream); i++) {
+         g_ptr_array_add(msgs, g_strdup(benchStream[i]));
+      }
+   } else {
+      char line[4096];
+      FILE *f = fopen(path, "r");
+
+      if (f == NULL) {
+         fprintf(stderr, "Could not open %s\n", path);
+         g_ptr_array_free(msgs, TRUE);
+         return FALSE;
+      }
+      while (fgets(line, sizeof line, f) != NULL) {
+         line[strcspn(line, "\r\n")] = '\0';
+         if (line[0] != '\0') {
+            g_ptr_array_add(msgs, g_strdup(line));
+         }
+      }
+      fclose(f);
+   }
+
+   streamCount = msgs->len;
+   stream = (char **) g_ptr_array_free(msgs, FALSE);
+   streamLens = g_new(size_t, streamCount);
+   for (i = 0; i < streamCount; i++) {
+      streamLens[i] = strlen(stream[i]);
+   }
+   return streamCount > 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * OldDispatch --
+ *
+ *    The dispatch path RpcChannel_Dispatch used before looking up commands
+ *    in place: copy the name out, look it up by string, free it.
+ *
+ * Results:
+ *    Whether the command was handled.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static gboolean
+OldDispatch(GHashTable *rpcs,  // IN: name to RpcChannelCallback
+            RpcInData *data)   // IN/OUT: RPC data
+{
+   unsigned int index = 0;
+   char *name = StrUtil_GetNextToken(&index, data->args, " ");
+   RpcChannelCallback *rpc;
+   gboolean status;
+   size_t nameLen;
+
+   if (name == NULL) {
+      return RPCIN_SETRETVALS(data, "Bad command", FALSE);
+   }
+
+   rpc = g_hash_table_lookup(rpcs, name);
+   if (rpc == NULL) {
+      status = RPCIN_SETRETVALS(data, "Unknown Command", FALSE);
+      goto exit;
+   }
+
+   nameLen = strlen(name);
+   data->name = name;
+   data->args = data->args + nameLen;
+   data->argsSize -= nameLen;
+   data->clientData = rpc->clientData;
+   status = rpc->callback(data);
+
+exit:
+   data->name = NULL;
+   free(name);
+   return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Replay --
+ *
+ *    Replay the stream iterations times, with either RpcChannel_Dispatch
+ *    or OldDispatch.
+ *
+ * Results:
+ *    Nanoseconds per message, or -1 if a message was not handled.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Replay(RpcChannel *chan,       // IN: channel, or NULL for OldDispatch
+       GHashTable *oldRpcs,    // IN: table for OldDispatch
+       uint32 iterations)      // IN: passes over the stream
+{
+   VmTimeType start = Hostinfo_SystemTimerNS();
+   uint32 i;
+   size_t j;
+
+   for (i = 0; i < iterations; i++) {
+      for (j = 0; j < streamCount; j++) {
+         RpcInData data;
+         gboolean ok;
+
+         memset(&data, 0, sizeof data);
+         data.args = stream[j];
+         data.argsSize = streamLens[j];
+         if (chan != NULL) {
+            data.clientData = chan;
+            ok = RpcChannel_Dispatch(&data);
+         } else {
+            ok = OldDispatch(oldRpcs, &data);
+         }
+         if (!ok) {
+            fprintf(stderr, "Message not handled: %s\n", stream[j]);
+            return -1;
+         }
+      }
+   }
+
+   return (double)(Hostinfo_SystemTimerNS() - start) /
+          ((double)iterations * streamCount);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    usage: rpcDispatchBench [iterations [streamFile]]
+ *
+ * Results:
+ *    EXIT_SUCCESS or EXIT_FAILURE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   uint32 iterations = DEFAULT_ITERATIONS;
+   RpcChannelCallback rpcs[ARRAYSIZE(benchCommands)];
+   GHashTable *oldRpcs;
+   RpcChannel *chan;
+   double newNs;
+   double oldNs;
+   size_t i;
+
+   if (argc > 1) {
+      iterations = MAX(strtoul(argv[1], NULL, 0), 1);
+   }
+   if (!LoadStream(argc > 2 ? argv[2] : NULL)) {
+      fprintf(stderr, "No messages to replay\n");
+      return EXIT_FAILURE;
+   }
+
+   chan = RpcChannel_Create();
+   oldRpcs = g_hash_table_new(g_str_hash, g_str_equal);
+   memset(rpcs, 0, sizeof rpcs);
+   for (i = 0; i < ARRAYSIZE(benchCommands); i++) {
+      rpcs[i].name = benchCommands[i];
+      rpcs[i].callback = BenchCallback;
+      RpcChannel_RegisterCallback(chan, &rpcs[i]);
+      g_hash_table_insert(oldRpcs, (gpointer) rpcs[i].name, &rpcs[i]);
+   }
+
+   /* Warm up both paths once before timing. */
+   if (Replay(chan, NULL, 1) < 0 || Replay(NULL, oldRpcs, 1) < 0) {
+      return EXIT_FAILURE;
+   }
+   newNs = Replay(chan, NULL, iterations);
+   oldNs = Replay(NULL, oldRpcs, iterations);
+
+   printf("%"FMTSZ"u messages x %u iterations\n", streamCount, iterations);
+   printf("%-24s %10.1f ns/msg\n", "RpcChannel_Dispatch", newNs);
+   printf("%-24s %10.1f ns/msg\n", "strdup + g_str_hash", oldNs);
+
+   for (i = 0; i < ARRAYSIZE(benchCommands); i++) {
+      RpcChannelCallbackStats stats;
+
+      if (RpcChannel_GetCallbackStats(chan, rpcs[i].name, &stats) &&
+          stats.calls > 0) {
+         printf("   %-28s %10"G_GUINT64_FORMAT" calls, "
+                "max %"G_GUINT64_FORMAT" us\n",
+                rpcs[i].name, stats.calls, stats.maxTimeUs);
+      }
+   }
+
+   /*
+    * The channel is not destroyed: it was never set up with
+    * RpcChannel_Setup, which RpcChannel_Destroy expects.
+    */
+   for (i = 0; i < ARRAYSIZE(benchCommands); i++) {
+      RpcChannel_UnregisterCallback(chan, &rpcs[i]);
+   }
+   g_hash_table_destroy(oldRpcs);
+   for (i = 0; i < streamCount; i++) {
+      g_free(stream[i]);
+   }
+   g_free(stream);
+   g_free(streamLens);
+
+   return EXIT_SUCCESS;
+}
@@ -446,6 +446,52 @@ CertVerify_CertToX509String(const gchar *pemCert)
 }
 
 
+/*
+ ******************************************************************************
+ * CertVerify_CertFingerprint --                                         */ /**
+ *
+ * Computes the SHA-256 fingerprint of a PEM certificate.  Any PEM
+ * delimiters and whitespace are ignored, so two certs have the same
+ * fingerprint whenever their decoded contents are identical.
+ *
+ * @param[in]  pemCert      The certificate in PEM format.
+ *
+ * @return Allocated string containing the fingerprint in hex, or NULL
+ *         on failure.
+ *
+ ******************************************************************************
+ */
+
+gchar *
+CertVerify_CertFingerprint(const gchar *pemCert)
+{
+   gchar *cleanCert;
+   guchar *binCert;
+   gsize len;
+   unsigned char md[EVP_MAX_MD_SIZE];
+   unsigned int mdLen;
+   gchar *retVal = NULL;
+   unsigned int i;
+
+   cleanCert = CertVerify_StripPEMCert(pemCert);
+   binCert = g_base64_decode(cleanCert, &len);
+
+   if (EVP_Digest(binCert, len, md, &mdLen, EVP_sha256(), NULL)) {
+      retVal = g_malloc(mdLen * 2 + 1);
+      for (i = 0; i < mdLen; i++) {
+         g_snprintf(retVal + i * 2, 3, "%02x", md[i]);
+      }
+   } else {
+      VerifyDumpSSLErrors();
+   }
+
+   g_free(cleanCert);
+   g_free(binCert);
+
+   return retVal;
+}
+
+
 /*
  ******************************************************************************
  * CertVerify_IsWellFormedPEMCert --                                     */ /**
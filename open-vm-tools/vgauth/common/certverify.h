@@ -58,4 +58,6 @@ gchar * CertVerify_StripPEMCert(const gchar *pemCert);
 
 gchar * CertVerify_CertToX509String(const gchar *pemCert);
 
+gchar * CertVerify_CertFingerprint(const gchar *pemCert);
+
 #endif // _CERTVERIFY_H_
@@ -93,6 +93,7 @@ loglevel=normal
 enableLogging=true
 enableCoreDumps=true
 clockSkewAdjustment = 300
+samlTokenCacheSize = 128
 
 [ticket]
 ticketTTL=3600
@@ -136,6 +137,8 @@ msgCatalog = /etc/vmware-tools/vgauth/messages
 #define VGAUTH_PREF_ALIASSTORE_DIR         "aliasStoreDir"
 /** The number of seconds slack allowed in either direction in SAML token date checks. */
 #define VGAUTH_PREF_CLOCK_SKEW_SECS        "clockSkewAdjustment"
+/** Number of verified SAML tokens remembered in memory; 0 disables caching. */
+#define VGAUTH_PREF_SAML_TOKEN_CACHE_SIZE  "samlTokenCacheSize"
 
 /** Ticket group name. */
 #define VGAUTH_PREF_GROUP_NAME_TICKET      "ticket"
@@ -190,5 +193,7 @@ msgCatalog = /etc/vmware-tools/vgauth/messages
 
 #define VGAUTH_PREF_DEFAULT_CLOCK_SKEW_SECS (300)
 
+#define VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_SIZE 128
+
 #endif // _PREFS_H_
 
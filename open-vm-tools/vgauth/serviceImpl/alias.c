@@ -35,6 +35,9 @@
 #include "VGAuthLog.h"
 #else
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 #endif
 
 #include "serviceInt.h"
@@ -69,6 +72,26 @@
 
 static gchar *aliasStoreRootDir = DEFAULT_ALIASSTORE_ROOT_DIR;
 
+/*
+ * Parsed alias and mapping files, keyed by file name.  An entry is dropped
+ * when inotify reports a change to its file, or, when the store isn't
+ * being watched, when the file's attributes no longer match the ones it
+ * was read with.
+ */
+typedef struct AliasCacheEntry {
+   ServiceAliasStore *store;
+   struct stat statBuf;
+} AliasCacheEntry;
+
+static GHashTable *aliasCache = NULL;
+#ifdef __linux__
+static int aliasCacheWatchFd = -1;
+
+#define ALIASCACHE_WATCH_EVENTS (IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE |  \
+                                 IN_DELETE | IN_MODIFY | IN_MOVED_FROM |    \
+                                 IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
 #ifdef _WIN32
 /*
  * Still used to create the Alias directory; passed through to
@@ -1837,6 +1860,538 @@ cleanup:
    return VGAUTH_E_OK;
 }
 
+
+/*
+ ******************************************************************************
+ * AliasStoreNew --                                                      */ /**
+ *
+ * Wraps the contents of an alias or mapping file in a ServiceAliasStore,
+ * indexing its entries by certificate fingerprint.  Exactly one of aList
+ * and maList is used, and ownership of it passes to the store.
+ *
+ * @param[in]   num             The number of entries.
+ * @param[in]   aList           The Aliases of a per-user file, or NULL.
+ * @param[in]   maList          The entries of the mapping file, or NULL.
+ *
+ * @return The new store, with one reference.
+ *
+ ******************************************************************************
+ */
+
+static ServiceAliasStore *
+AliasStoreNew(int num,
+              ServiceAlias *aList,
+              ServiceMappedAlias *maList)
+{
+   ServiceAliasStore *store = g_malloc0(sizeof *store);
+   int i;
+
+   store->refCount = 1;
+   store->num = num;
+   store->aList = aList;
+   store->maList = maList;
+   store->certIndex = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, NULL);
+
+   /*
+    * Walk backwards so each list of indices ends up in file order, which
+    * keeps lookups returning matches in the order a linear scan would.
+    */
+   for (i = num - 1; i >= 0; i--) {
+      const gchar *pemCert = (NULL != aList) ? aList[i].pemCert :
+                                               maList[i].pemCert;
+      gchar *fingerprint = CertVerify_CertFingerprint(pemCert);
+      GSList *indices;
+
+      if (NULL == fingerprint) {
+         Warning("%s: failed to fingerprint cert #%d\n", __FUNCTION__, i);
+         continue;
+      }
+
+      /*
+       * The hash table doesn't own the lists, so replacing a value
+       * won't free the tail it is now prepended to.
+       */
+      indices = g_hash_table_lookup(store->certIndex, fingerprint);
+      indices = g_slist_prepend(indices, GINT_TO_POINTER(i));
+      g_hash_table_insert(store->certIndex, fingerprint, indices);
+   }
+
+   return store;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasStoreFreeIndex --                                                */ /**
+ *
+ * GHFunc to free a list of indices in a store's certIndex.
+ *
+ * @param[in]   key             The fingerprint.
+ * @param[in]   value           The GSList of indices.
+ * @param[in]   userData        Unused.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasStoreFreeIndex(gpointer key,
+                    gpointer value,
+                    gpointer userData)
+{
+   g_slist_free((GSList *) value);
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceAliasReleaseStore --                                           */ /**
+ *
+ * Drops a reference to a ServiceAliasStore, freeing it along with its
+ * contents when the last reference goes away.
+ *
+ * @param[in]   store           The store.  May be NULL.
+ *
+ ******************************************************************************
+ */
+
+void
+ServiceAliasReleaseStore(ServiceAliasStore *store)
+{
+   if (NULL == store) {
+      return;
+   }
+
+   ASSERT(store->refCount > 0);
+   if (--store->refCount > 0) {
+      return;
+   }
+
+   if (NULL != store->aList) {
+      ServiceAliasFreeAliasList(store->num, store->aList);
+   }
+   if (NULL != store->maList) {
+      ServiceAliasFreeMappedAliasList(store->num, store->maList);
+   }
+   g_hash_table_foreach(store->certIndex, AliasStoreFreeIndex, NULL);
+   g_hash_table_destroy(store->certIndex);
+   g_free(store);
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceAliasStoreFindCert --                                          */ /**
+ *
+ * Finds the entries of a store holding a certificate.
+ *
+ * @param[in]   store           The store to search.
+ * @param[in]   fingerprint     The cert's fingerprint, as returned by
+ *                              CertVerify_CertFingerprint().  May be NULL.
+ *
+ * @return A GSList of the matching indices into the store's aList or maList
+ *         in file order, or NULL if there are none.  The list belongs to
+ *         the store.
+ *
+ ******************************************************************************
+ */
+
+GSList *
+ServiceAliasStoreFindCert(const ServiceAliasStore *store,
+                          const gchar *fingerprint)
+{
+   if (NULL == fingerprint) {
+      return NULL;
+   }
+
+   return g_hash_table_lookup(store->certIndex, fingerprint);
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheEntryFree --                                                */ /**
+ *
+ * GDestroyNotify for the values of aliasCache.
+ *
+ * @param[in]   data            The AliasCacheEntry.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheEntryFree(gpointer data)
+{
+   AliasCacheEntry *entry = data;
+
+   ServiceAliasReleaseStore(entry->store);
+   g_free(entry);
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheGetTable --                                                 */ /**
+ *
+ * Returns aliasCache, creating it if needed.
+ *
+ * @return The alias cache.
+ *
+ ******************************************************************************
+ */
+
+static GHashTable *
+AliasCacheGetTable(void)
+{
+   if (NULL == aliasCache) {
+      aliasCache = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         g_free, AliasCacheEntryFree);
+   }
+
+   return aliasCache;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheRemove --                                                   */ /**
+ *
+ * Drops any cached contents of a file.
+ *
+ * @param[in]   fileName        The alias or mapping file.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheRemove(const gchar *fileName)
+{
+   if (NULL != aliasCache) {
+      g_hash_table_remove(aliasCache, fileName);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheStatMatches --                                              */ /**
+ *
+ * Checks whether a file looks unchanged since it was cached.  The inode
+ * number catches the rename done when the service rewrites a file, the
+ * change time catches ownership and permission changes, and the size and
+ * modification time catch edits in place.
+ *
+ * @param[in]   cached          The attributes the cached copy was read with.
+ * @param[in]   current         The file's current attributes.
+ *
+ * @return TRUE if the cached copy can still be used.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+AliasCacheStatMatches(const struct stat *cached,
+                      const struct stat *current)
+{
+   return cached->st_dev == current->st_dev &&
+          cached->st_ino == current->st_ino &&
+          cached->st_mode == current->st_mode &&
+          cached->st_uid == current->st_uid &&
+          cached->st_gid == current->st_gid &&
+          cached->st_size == current->st_size &&
+          cached->st_mtime == current->st_mtime &&
+          cached->st_ctime == current->st_ctime;
+}
+
+
+#ifdef __linux__
+/*
+ ******************************************************************************
+ * AliasCacheStopWatching --                                             */ /**
+ *
+ * Stops using inotify for the alias store and drops the cache, after which
+ * cached files are validated against their attributes instead.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheStopWatching(void)
+{
+   if (aliasCacheWatchFd >= 0) {
+      close(aliasCacheWatchFd);
+      aliasCacheWatchFd = -1;
+   }
+   if (NULL != aliasCache) {
+      g_hash_table_remove_all(aliasCache);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheProcessEvents --                                            */ /**
+ *
+ * Reads any pending inotify events for the alias store and drops the
+ * cached contents of the files they name.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheProcessEvents(void)
+{
+   char buf[4096]
+      __attribute__ ((aligned(__alignof__(struct inotify_event))));
+   ssize_t len;
+   char *p;
+
+   if (aliasCacheWatchFd < 0) {
+      return;
+   }
+
+   for (;;) {
+      len = read(aliasCacheWatchFd, buf, sizeof buf);
+      if (len < 0) {
+         if (EINTR == errno) {
+            continue;
+         }
+         if (EAGAIN != errno) {
+            Warning("%s: failed to read inotify events (%d)\n",
+                    __FUNCTION__, errno);
+            AliasCacheStopWatching();
+         }
+         return;
+      } else if (len == 0) {
+         return;
+      }
+
+      for (p = buf; p < buf + len; ) {
+         const struct inotify_event *ev = (const struct inotify_event *) p;
+
+         p += sizeof *ev + ev->len;
+
+         if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+            Warning("%s: alias store directory '%s' went away; "
+                    "no longer watching it\n", __FUNCTION__,
+                    aliasStoreRootDir);
+            AliasCacheStopWatching();
+            return;
+         } else if (ev->mask & IN_Q_OVERFLOW) {
+            g_hash_table_remove_all(aliasCache);
+         } else if (ev->len > 0) {
+            gchar *fileName = g_strdup_printf("%s"DIRSEP"%s",
+                                              aliasStoreRootDir,
+                                              ev->name);
+
+            AliasCacheRemove(fileName);
+            g_free(fileName);
+         }
+      }
+   }
+}
+#endif   // __linux__
+
+
+/*
+ ******************************************************************************
+ * AliasCacheInit --                                                     */ /**
+ *
+ * Sets up the alias cache, watching the alias store with inotify where
+ * it is available.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheInit(void)
+{
+   AliasCacheGetTable();
+
+#ifdef __linux__
+   if (aliasCacheWatchFd >= 0) {
+      return;
+   }
+
+   aliasCacheWatchFd = inotify_init();
+   if (aliasCacheWatchFd < 0) {
+      Warning("%s: inotify_init() failed (%d); "
+              "alias files will be checked for changes on each use\n",
+              __FUNCTION__, errno);
+      return;
+   }
+
+   if (fcntl(aliasCacheWatchFd, F_SETFL, O_NONBLOCK) < 0 ||
+       fcntl(aliasCacheWatchFd, F_SETFD, FD_CLOEXEC) < 0 ||
+       inotify_add_watch(aliasCacheWatchFd, aliasStoreRootDir,
+                         ALIASCACHE_WATCH_EVENTS) < 0) {
+      Warning("%s: failed to watch '%s' (%d); "
+              "alias files will be checked for changes on each use\n",
+              __FUNCTION__, aliasStoreRootDir, errno);
+      close(aliasCacheWatchFd);
+      aliasCacheWatchFd = -1;
+   }
+#endif
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheGet --                                                      */ /**
+ *
+ * Returns the contents of an alias or mapping file, from the cache if
+ * the file hasn't changed since it was last read.
+ *
+ * Only files that exist and hold entries are cached.  Checking for a
+ * missing file costs no more than validating a cache entry would, and a
+ * file that can't be used (bad permissions, say) must be re-read, and
+ * audited, on every attempt.
+ *
+ * @param[in]   fileName        The file to load.
+ * @param[in]   userName        The owner of a per-user alias file, or NULL
+ *                              for the mapping file.
+ * @param[out]  store           The file's contents.  The caller should call
+ *                              ServiceAliasReleaseStore() when done.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+AliasCacheGet(const gchar *fileName,
+              const gchar *userName,
+              ServiceAliasStore **store)
+{
+   GHashTable *cache = AliasCacheGetTable();
+   AliasCacheEntry *entry;
+   struct stat statBuf;
+   gboolean haveStat;
+   int num = 0;
+   ServiceAlias *aList = NULL;
+   ServiceMappedAlias *maList = NULL;
+   VGAuthError err;
+
+   *store = NULL;
+
+#ifdef __linux__
+   AliasCacheProcessEvents();
+
+   entry = g_hash_table_lookup(cache, fileName);
+   if (NULL != entry && aliasCacheWatchFd >= 0) {
+      entry->store->refCount++;
+      *store = entry->store;
+      return VGAUTH_E_OK;
+   }
+#else
+   entry = g_hash_table_lookup(cache, fileName);
+#endif
+
+   /*
+    * Take the attributes before reading the file, so that a change made
+    * while it is being read is noticed next time.
+    */
+   haveStat = (g_lstat(fileName, &statBuf) == 0);
+
+   if (NULL != entry) {
+      if (haveStat && AliasCacheStatMatches(&entry->statBuf, &statBuf)) {
+         entry->store->refCount++;
+         *store = entry->store;
+         return VGAUTH_E_OK;
+      }
+      g_hash_table_remove(cache, fileName);
+   }
+
+   if (NULL != userName) {
+      err = AliasLoadAliases(userName, &num, &aList);
+   } else {
+      err = AliasLoadMapped(&num, &maList);
+   }
+   if (VGAUTH_E_OK != err) {
+      return err;
+   }
+
+   *store = AliasStoreNew(num, aList, maList);
+
+   if (haveStat && num > 0) {
+      entry = g_malloc(sizeof *entry);
+      entry->store = *store;
+      entry->store->refCount++;
+      entry->statBuf = statBuf;
+      g_hash_table_insert(cache, g_strdup(fileName), entry);
+   }
+
+   return VGAUTH_E_OK;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceAliasGetAliasStore --                                          */ /**
+ *
+ * Returns the parsed contents of userName's alias file.  Unlike
+ * ServiceAliasQueryAliases(), this shares the cached copy rather than
+ * duplicating it.
+ *
+ * @param[in]   userName        The user whose store is to be used.
+ * @param[out]  store           The user's Aliases.  The caller should call
+ *                              ServiceAliasReleaseStore() when done.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+ServiceAliasGetAliasStore(const gchar *userName,
+                          ServiceAliasStore **store)
+{
+   VGAuthError err;
+   gchar *aliasFilename = ServiceUserNameToAliasStoreFileName(userName);
+
+   err = AliasCacheGet(aliasFilename, userName, store);
+   if (VGAUTH_E_OK != err) {
+      Warning("%s: failed to load Aliases for '%s'\n", __FUNCTION__, userName);
+   }
+
+   g_free(aliasFilename);
+   return err;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceAliasGetMappedStore --                                         */ /**
+ *
+ * Returns the parsed contents of the mapping file.  Unlike
+ * ServiceAliasQueryMappedAliases(), this shares the cached copy rather
+ * than duplicating it.
+ *
+ * @param[out]  store           The mapped aliases.  The caller should call
+ *                              ServiceAliasReleaseStore() when done.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+ServiceAliasGetMappedStore(ServiceAliasStore **store)
+{
+   VGAuthError err;
+   gchar *mapFilename = g_strdup_printf("%s"DIRSEP"%s",
+                                        aliasStoreRootDir,
+                                        ALIASSTORE_MAPFILE_NAME);
+
+   err = AliasCacheGet(mapFilename, NULL, store);
+   if (VGAUTH_E_OK != err) {
+      Warning("%s: failed to load mapped aliases\n", __FUNCTION__);
+   }
+
+   g_free(mapFilename);
+   return err;
+}
+
 /*
  ******************************************************************************
  * AliasSafeRenameFiles --                                               */ /**
@@ -2348,6 +2903,23 @@ cleanup:
    }
 
 done:
+   /*
+    * Whatever happened, the files may have changed underneath the cache.
+    */
+   {
+      gchar *aliasFilename = ServiceUserNameToAliasStoreFileName(userName);
+
+      AliasCacheRemove(aliasFilename);
+      g_free(aliasFilename);
+   }
+   if (updateMap) {
+      gchar *mapFilename = g_strdup_printf("%s"DIRSEP"%s",
+                                           aliasStoreRootDir,
+                                           ALIASSTORE_MAPFILE_NAME);
+
+      AliasCacheRemove(mapFilename);
+      g_free(mapFilename);
+   }
    g_free(tmpAliasFilename);
    g_free(tmpMapFilename);
    return err;
@@ -2955,6 +3527,81 @@ done:
 }
 
 
+/*
+ ******************************************************************************
+ * AliasCopyAliasList --                                                 */ /**
+ *
+ * Duplicates an array of ServiceAlias.
+ *
+ * @param[in]   num     The size of the array.
+ * @param[in]   aList   The list of ServiceAlias.
+ *
+ * @return The copy.  The caller should call ServiceAliasFreeAliasList()
+ *         when done.
+ *
+ ******************************************************************************
+ */
+
+static ServiceAlias *
+AliasCopyAliasList(int num,
+                   const ServiceAlias *aList)
+{
+   ServiceAlias *copy = g_malloc0(sizeof(ServiceAlias) * num);
+   int i;
+   int j;
+
+   for (i = 0; i < num; i++) {
+      copy[i].pemCert = g_strdup(aList[i].pemCert);
+      copy[i].num = aList[i].num;
+      copy[i].infos = g_malloc0(sizeof(ServiceAliasInfo) * aList[i].num);
+      for (j = 0; j < aList[i].num; j++) {
+         ServiceAliasCopyAliasInfoContents(&(aList[i].infos[j]),
+                                           &(copy[i].infos[j]));
+      }
+   }
+
+   return copy;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCopyMappedAliasList --                                           */ /**
+ *
+ * Duplicates an array of ServiceMappedAlias.
+ *
+ * @param[in]   num     The size of the array.
+ * @param[in]   maList  The list of ServiceMappedAlias.
+ *
+ * @return The copy.  The caller should call
+ *         ServiceAliasFreeMappedAliasList() when done.
+ *
+ ******************************************************************************
+ */
+
+static ServiceMappedAlias *
+AliasCopyMappedAliasList(int num,
+                         const ServiceMappedAlias *maList)
+{
+   ServiceMappedAlias *copy = g_malloc0(sizeof(ServiceMappedAlias) * num);
+   int i;
+   int j;
+
+   for (i = 0; i < num; i++) {
+      copy[i].pemCert = g_strdup(maList[i].pemCert);
+      copy[i].userName = g_strdup(maList[i].userName);
+      copy[i].num = maList[i].num;
+      copy[i].subjects = g_malloc0(sizeof(ServiceSubject) * maList[i].num);
+      for (j = 0; j < maList[i].num; j++) {
+         copy[i].subjects[j].type = maList[i].subjects[j].type;
+         copy[i].subjects[j].name = g_strdup(maList[i].subjects[j].name);
+      }
+   }
+
+   return copy;
+}
+
+
 /*
  ******************************************************************************
  * ServiceAliasQueryAliases --                                           */ /**
@@ -2976,6 +3623,7 @@ ServiceAliasQueryAliases(const gchar *userName,
                          ServiceAlias **aList)
 {
    VGAuthError err;
+   ServiceAliasStore *store;
 
    *num = 0;
    *aList = NULL;
@@ -2996,11 +3644,15 @@ ServiceAliasQueryAliases(const gchar *userName,
    }
 #endif
 
-   err = AliasLoadAliases(userName, num, aList);
+   err = ServiceAliasGetAliasStore(userName, &store);
    if (VGAUTH_E_OK != err) {
-      Warning("%s: failed to load Aliases for '%s'\n", __FUNCTION__, userName);
+      return err;
    }
 
+   *num = store->num;
+   *aList = AliasCopyAliasList(store->num, store->aList);
+   ServiceAliasReleaseStore(store);
+
    return err;
 }
 
@@ -3024,15 +3676,20 @@ ServiceAliasQueryMappedAliases(int *num,
                                ServiceMappedAlias **maList)
 {
    VGAuthError err;
+   ServiceAliasStore *store;
 
    *num = 0;
    *maList = NULL;
 
-   err = AliasLoadMapped(num, maList);
+   err = ServiceAliasGetMappedStore(&store);
    if (VGAUTH_E_OK != err) {
-      Warning("%s: failed to load mapped aliases\n", __FUNCTION__);
+      return err;
    }
 
+   *num = store->num;
+   *maList = AliasCopyMappedAliasList(store->num, store->maList);
+   ServiceAliasReleaseStore(store);
+
    return err;
 }
 
@@ -3282,5 +3939,7 @@ ServiceAliasInitAliasStore(void)
       return VGAUTH_E_FAIL;
    }
 
+   AliasCacheInit();
+
    return err;
 }
@@ -23,10 +23,13 @@
  */
 
 #include <iostream>
+#include <map>
 #include <memory>
 #include <sstream>
 #include <vector>
 
+#include <openssl/evp.h>
+
 #undef WIN32_LEAN_AND_MEAN  // XSEC unconditionally redefines this
 #include <xsec/dsig/DSIGKeyInfoX509.hpp>
 #include <xsec/dsig/DSIGReference.hpp>
@@ -49,30 +52,16 @@
 #include <xercesc/validators/common/Grammar.hpp>
 
 /*
- * XXX
- *
- * Optimization idea: stash a hash (SHA512) of a valid token, and bypass
- * the full assertion process when we see that token again. The expiration
- * date of the token must also be saved off (and beware the time skew issue).
- *
- * Note that there's some extra complexity here:
- *
- * 1 - AddAlias sets up a cert/user mapping
- * 2 - a SAML token is used (and cached) using this cert/user combo
- * 3 - RemoveAlias removes the combo
- * 4 - the cached token still works
- *
- * So the cache should only bypass the token validation, not the certificate
- * check in ServiceVerifyAndCheckTrustCertChainForSubject()
- *
- * Also TBD is how much this buys us in the real world.  With short
- * token lifetimes, its less interesting.  Its also possible that
- * it will have no measureable affect because the token verification
- * will be lost in the noise of the API plumbing from VC->hostd->VMX->tools.
- *
- * The security folks have signed off on this, so long as we store only
- * in memory.
- *
+ * Verified tokens are remembered, keyed by a SHA-256 digest of their text,
+ * so that a token presented again within its validity window skips the
+ * schema validation and signature check.  Only the token verification is
+ * bypassed: the cert chain is still checked against the alias store on
+ * every use, so removing an alias takes effect immediately even for a
+ * token that is already cached.
+ *
+ * The cache is only held in memory, is bounded by the samlTokenCacheSize
+ * pref, and never holds tokens that lack a NotOnOrAfter time or that are
+ * marked OneTimeUse.
  */
 
 /*
@@ -191,6 +180,27 @@ static XMLGrammarPool *pool = NULL;
 
 static int clockSkewAdjustment = VGAUTH_PREF_DEFAULT_CLOCK_SKEW_SECS;
 
+/**
+ * A token that passed SAMLVerifyAssertion(), along with its results.
+ */
+struct SAMLCacheEntry {
+   SAMLTokenData token;
+   vector<string> certs;
+   glong expiry;              // last second the token is valid, skew included
+   guint64 lastUse;
+};
+
+/*
+ * Log the token cache hit rate after this many lookups.
+ */
+#define SAML_TOKEN_CACHE_STATS_INTERVAL 1000
+
+static map<string, SAMLCacheEntry> tokenCache;
+static unsigned int tokenCacheSize = VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_SIZE;
+static guint64 tokenCacheClock = 0;
+static unsigned int tokenCacheHits = 0;
+static unsigned int tokenCacheMisses = 0;
+
 static bool SAMLLoadSchema(XercesDOMParser &parser,
                            const SAMLGlibString &schemaDir,
                            const char *filename);
@@ -204,7 +214,7 @@ static bool SAMLCheckConditions(const DOMDocument *doc,
                                 SAMLTokenData &token);
 
 static bool SAMLCheckTimeAttr(const DOMElement *elem, const char *attrName,
-                              bool beforeNow);
+                              bool beforeNow, SAMLTokenData &token);
 
 static bool SAMLCheckAudience(const XMLCh *audience);
 
@@ -219,6 +229,8 @@ static DOMElement *SAMLFindChildByName(const DOMElement *elem,
 static auto_ptr<DSIGKeyInfoX509> SAMLFindKey(const XSECEnv &secEnv,
                                              const DOMElement *sigElem);
 
+static void SAMLInitTokenCachePrefs();
+
 
 /*
  ******************************************************************************
@@ -251,6 +263,8 @@ SAML_Init()
       Log("%s: Allowing %d of clock skew for SAML date validation\n",
           __FUNCTION__, clockSkewAdjustment);
 
+      SAMLInitTokenCachePrefs();
+
       return VGAUTH_E_OK;
    } catch (const XMLException& e) {
       SAMLStringWrapper msg(e.getMessage());
@@ -347,6 +361,7 @@ void
 SAML_Shutdown()
 {
    try {
+      SAMLFlushTokenCache();
       delete pool;
       pool = NULL;
       XSECPlatformUtils::Terminate();
@@ -381,6 +396,12 @@ SAML_Reload()
 
    delete pool;
    pool = myPool.release();
+
+   /*
+    * Tokens were verified against the old schemas.
+    */
+   SAMLFlushTokenCache();
+   SAMLInitTokenCachePrefs();
 }
 
 
@@ -529,7 +550,7 @@ SAML_VerifyBearerTokenAndChain(const char *xmlText,
       ServiceSubject subj;
       int i;
 
-      err = SAMLVerifyAssertion(xmlText, token, certs);
+      err = SAMLVerifyAssertionCached(xmlText, token, certs);
       if (VGAUTH_E_OK != err) {
          return err;
       }
@@ -664,6 +685,231 @@ SAMLVerifyAssertion(const char *xmlText,
 }
 
 
+/*
+ ******************************************************************************
+ * SAMLInitTokenCachePrefs --                                            */ /**
+ *
+ * Reads the size of the verified token cache from the preferences.
+ *
+ ******************************************************************************
+ */
+
+static void
+SAMLInitTokenCachePrefs()
+{
+   int size = Pref_GetInt(gPrefs, VGAUTH_PREF_SAML_TOKEN_CACHE_SIZE,
+                          VGAUTH_PREF_GROUP_NAME_SERVICE,
+                          VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_SIZE);
+
+   tokenCacheSize = (size > 0) ? size : 0;
+   Log("%s: Caching up to %u verified SAML tokens\n", __FUNCTION__,
+       tokenCacheSize);
+}
+
+
+/*
+ ******************************************************************************
+ * SAMLTokenCacheLogStats --                                             */ /**
+ *
+ * Logs the token cache hit rate since the last call, and resets it.
+ *
+ ******************************************************************************
+ */
+
+static void
+SAMLTokenCacheLogStats()
+{
+   unsigned int lookups = tokenCacheHits + tokenCacheMisses;
+
+   if (0 == lookups) {
+      return;
+   }
+
+   Log("SAML token cache: %u hits, %u misses (%u%% hit rate), "
+       "%u tokens cached\n", tokenCacheHits, tokenCacheMisses,
+       (unsigned int) ((100ULL * tokenCacheHits) / lookups),
+       (unsigned int) tokenCache.size());
+
+   tokenCacheHits = 0;
+   tokenCacheMisses = 0;
+}
+
+
+/*
+ ******************************************************************************
+ * SAMLFlushTokenCache --                                                */ /**
+ *
+ * Forgets all verified tokens.
+ *
+ ******************************************************************************
+ */
+
+void
+SAMLFlushTokenCache()
+{
+   SAMLTokenCacheLogStats();
+   tokenCache.clear();
+}
+
+
+/*
+ ******************************************************************************
+ * SAMLTokenDigest --                                                    */ /**
+ *
+ * Computes the key used to look up a token in the cache.
+ *
+ * @param[in]  xmlText   The text of the SAML assertion.
+ *
+ * @return The SHA-256 digest of xmlText, or an empty string on failure.
+ *
+ ******************************************************************************
+ */
+
+static string
+SAMLTokenDigest(const char *xmlText)
+{
+   unsigned char md[EVP_MAX_MD_SIZE];
+   unsigned int mdLen;
+
+   if (!EVP_Digest(xmlText, strlen(xmlText), md, &mdLen, EVP_sha256(),
+                   NULL)) {
+      Warning("%s: Failed to compute token digest.\n", __FUNCTION__);
+      return string();
+   }
+
+   return string(reinterpret_cast<const char *>(md), mdLen);
+}
+
+
+/*
+ ******************************************************************************
+ * SAMLTokenCacheAdd --                                                  */ /**
+ *
+ * Remembers a verified token.  If the cache is full, expired tokens are
+ * dropped, and then the least recently used one if that wasn't enough.
+ *
+ * @param[in]  key       The token's digest.
+ * @param[in]  token     The data extracted from the token.
+ * @param[in]  certs     The cert chain that signed the token.
+ * @param[in]  now       The current time, in seconds.
+ *
+ ******************************************************************************
+ */
+
+static void
+SAMLTokenCacheAdd(const string &key,
+                  const SAMLTokenData &token,
+                  const vector<string> &certs,
+                  glong now)
+{
+   map<string, SAMLCacheEntry>::iterator it;
+
+   /*
+    * Without an expiry time there's no point at which we'd have to check
+    * the token again, so leave those to the full verification, along with
+    * any token that is already past its expiry.
+    */
+   if (token.oneTimeUse || 0 == token.notOnOrAfter ||
+       token.notOnOrAfter + clockSkewAdjustment < now) {
+      return;
+   }
+
+   if (tokenCache.size() >= tokenCacheSize) {
+      map<string, SAMLCacheEntry>::iterator lru = tokenCache.end();
+
+      for (it = tokenCache.begin(); it != tokenCache.end(); ) {
+         if (it->second.expiry < now) {
+            tokenCache.erase(it++);
+            continue;
+         }
+         if (lru == tokenCache.end() ||
+             it->second.lastUse < lru->second.lastUse) {
+            lru = it;
+         }
+         ++it;
+      }
+
+      if (tokenCache.size() >= tokenCacheSize) {
+         ASSERT(lru != tokenCache.end());
+         tokenCache.erase(lru);
+      }
+   }
+
+   SAMLCacheEntry &entry = tokenCache[key];
+
+   entry.token = token;
+   entry.certs = certs;
+   entry.expiry = token.notOnOrAfter + clockSkewAdjustment;
+   entry.lastUse = ++tokenCacheClock;
+}
+
+
+/*
+ ******************************************************************************
+ * SAMLVerifyAssertionCached --                                          */ /**
+ *
+ * Same as SAMLVerifyAssertion(), but returns the results of an earlier
+ * verification of the same token if it is still within its validity window.
+ *
+ * @param[in]  xmlText   The text of the SAML assertion.
+ * @param[out] token     The interesting bits extracted from the xmlText.
+ * @param[out] certs     If the SAML assertion is verified, then this will
+ *                       contain the certificate chain for the issuer.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+SAMLVerifyAssertionCached(const char *xmlText,
+                          SAMLTokenData &token,
+                          vector<string> &certs)
+{
+   VGAuthError err;
+   GTimeVal now;
+   string key;
+
+   if (0 == tokenCacheSize) {
+      return SAMLVerifyAssertion(xmlText, token, certs);
+   }
+
+   g_get_current_time(&now);
+   key = SAMLTokenDigest(xmlText);
+
+   if (!key.empty()) {
+      map<string, SAMLCacheEntry>::iterator it = tokenCache.find(key);
+
+      if (it != tokenCache.end()) {
+         if (now.tv_sec <= it->second.expiry) {
+            it->second.lastUse = ++tokenCacheClock;
+            token = it->second.token;
+            certs = it->second.certs;
+            tokenCacheHits++;
+            Debug("%s: Using cached verification of token for '%s'\n",
+                  __FUNCTION__, token.subjectName.c_str());
+            err = VGAUTH_E_OK;
+            goto done;
+         }
+         tokenCache.erase(it);
+      }
+   }
+
+   tokenCacheMisses++;
+   err = SAMLVerifyAssertion(xmlText, token, certs);
+   if (VGAUTH_E_OK == err && !key.empty()) {
+      SAMLTokenCacheAdd(key, token, certs, now.tv_sec);
+   }
+
+done:
+   if (tokenCacheHits + tokenCacheMisses >= SAML_TOKEN_CACHE_STATS_INTERVAL) {
+      SAMLTokenCacheLogStats();
+   }
+
+   return err;
+}
+
+
 /*
  ******************************************************************************
  * SAMLValidateSchemaAndParse --                                         */ /**
@@ -814,8 +1060,9 @@ SAMLCheckSubject(const DOMDocument *doc,
       subjConfirmData = SAMLFindChildByName(child, name);
       g_free(name);
       if (NULL != subjConfirmData) {
-         if (!SAMLCheckTimeAttr(subjConfirmData, "NotBefore", true) ||
-             !SAMLCheckTimeAttr(subjConfirmData, "NotOnOrAfter", false)) {
+         if (!SAMLCheckTimeAttr(subjConfirmData, "NotBefore", true, token) ||
+             !SAMLCheckTimeAttr(subjConfirmData, "NotOnOrAfter", false,
+                                token)) {
             Debug("%s: subjConfirmData time check failed\n", __FUNCTION__);
             continue;
          }
@@ -883,8 +1130,8 @@ SAMLCheckConditions(const DOMDocument *doc,
       return true;
    }
 
-   if (!SAMLCheckTimeAttr(conditions, "NotBefore", true) ||
-       !SAMLCheckTimeAttr(conditions, "NotOnOrAfter", false)) {
+   if (!SAMLCheckTimeAttr(conditions, "NotBefore", true, token) ||
+       !SAMLCheckTimeAttr(conditions, "NotOnOrAfter", false, token)) {
       return false;
    }
 
@@ -917,9 +1164,9 @@ SAMLCheckConditions(const DOMDocument *doc,
     */
 
    /*
-    * <OneTimeUse> element is specified to disallow caching. We don't
-    * cache, so it doesn't affect out validation.
-    * However, we need to communicate it to clients so they do not cache.
+    * <OneTimeUse> element is specified to disallow caching.  Such tokens
+    * are kept out of our token cache, and we need to communicate it to
+    * clients so they do not cache.
     */
    name = g_strdup_printf("%sOneTimeUse", token.ns.c_str());
    token.oneTimeUse = (SAMLFindChildByName(conditions, name)
@@ -942,10 +1189,14 @@ SAMLCheckConditions(const DOMDocument *doc,
  * Checks that the given attribute with the given name is a timestamp and
  * compares it against the current time.
  *
- * @param[in]  elem         The element containing the attribute.
- * @param[in]  attrName     The name of the attribute.
- * @param[in]  notBefore    Whether the condition given by the attribute
- *                          should be in the past or 'now' (true).
+ * A NotOnOrAfter time that passes the check is also recorded in the
+ * token, if it is the earliest one seen so far.
+ *
+ * @param[in]     elem         The element containing the attribute.
+ * @param[in]     attrName     The name of the attribute.
+ * @param[in]     notBefore    Whether the condition given by the attribute
+ *                             should be in the past or 'now' (true).
+ * @param[in/out] token        The token being verified.
  *
  ******************************************************************************
  */
@@ -953,7 +1204,8 @@ SAMLCheckConditions(const DOMDocument *doc,
 static bool
 SAMLCheckTimeAttr(const DOMElement *elem,
                   const char *attrName,
-                  bool notBefore)
+                  bool notBefore,
+                  SAMLTokenData &token)
 {
    const XMLCh *timeAttr = elem->getAttribute(MAKE_UNICODE_STRING(attrName));
    if ((NULL == timeAttr) || (0 == *timeAttr)) {
@@ -1002,6 +1254,11 @@ SAMLCheckTimeAttr(const DOMElement *elem,
       return false;
    }
 
+   if (!notBefore &&
+       (0 == token.notOnOrAfter || attrTime.tv_sec < token.notOnOrAfter)) {
+      token.notOnOrAfter = attrTime.tv_sec;
+   }
+
    return true;
 }
 
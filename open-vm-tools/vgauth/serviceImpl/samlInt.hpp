@@ -125,11 +125,19 @@ private:
  * Holds data extracted from a SAML token.
  */
 struct SAMLTokenData {
+   SAMLTokenData() :
+      oneTimeUse(false),
+      isSSOToken(false),
+      notOnOrAfter(0)
+   {
+   }
+
    string subjectName;
    vector<string> issuerCerts;
    bool oneTimeUse;
    bool isSSOToken;           // set if token came from VMware SSO server
    string ns;
+   glong notOnOrAfter;        // earliest NotOnOrAfter seen, or 0 if none
 };
 
 
@@ -138,4 +146,10 @@ auto_ptr<XMLGrammarPool> SAMLCreateAndPopulateGrammarPool();
 VGAuthError SAMLVerifyAssertion(const char *xmlText,
                                 SAMLTokenData &token,
                                 vector<string> &certs);
+
+VGAuthError SAMLVerifyAssertionCached(const char *xmlText,
+                                      SAMLTokenData &token,
+                                      vector<string> &certs);
+
+void SAMLFlushTokenCache();
 #endif // ifndef _SAMLINT_H_
@@ -188,6 +188,19 @@ typedef struct _ServiceMappedAlias {
    gchar *userName;
 } ServiceMappedAlias;
 
+/*
+ * A parsed alias or mapping file, as kept by the alias store cache.
+ * Readers must treat it as read-only and drop their reference with
+ * ServiceAliasReleaseStore().
+ */
+typedef struct _ServiceAliasStore {
+   int refCount;
+   int num;
+   ServiceAlias *aList;             // set for a per-user alias file
+   ServiceMappedAlias *maList;      // set for the mapping file
+   GHashTable *certIndex;           // cert fingerprint -> GSList of indices
+} ServiceAliasStore;
+
 /*
  * Possible types of validation.
  */
@@ -327,6 +340,16 @@ void ServiceAliasCopyAliasInfoContents(const ServiceAliasInfo *src,
 
 void ServiceAliasFreeMappedAliasList(int num, ServiceMappedAlias *maList);
 
+VGAuthError ServiceAliasGetAliasStore(const gchar *userName,
+                                      ServiceAliasStore **store);
+
+VGAuthError ServiceAliasGetMappedStore(ServiceAliasStore **store);
+
+GSList *ServiceAliasStoreFindCert(const ServiceAliasStore *store,
+                                  const gchar *fingerprint);
+
+void ServiceAliasReleaseStore(ServiceAliasStore *store);
+
 gboolean ServiceAliasIsSubjectEqual(ServiceSubjectType t1,
                                     ServiceSubjectType t2,
                                     const gchar *n1,
@@ -95,10 +95,14 @@ ServiceVerifyAndCheckTrustCertChainForSubject(int numCerts,
                                               ServiceAliasInfo **verifyAi)
 {
    VGAuthError err;
+   ServiceAliasStore *mapStore = NULL;
+   ServiceAliasStore *aliasStore = NULL;
    int numMapped = 0;
    ServiceMappedAlias *maList = NULL;
    int numStoreCerts = 0;
    ServiceAlias *aList = NULL;
+   gchar **fingerprints = NULL;
+   GSList *l;
    int matchIdIdx = -1;
    int matchSiIdx = -1;
    ServiceAliasInfo *ai;
@@ -119,16 +123,28 @@ ServiceVerifyAndCheckTrustCertChainForSubject(int numCerts,
    ASSERT(subj);
    ASSERT(numCerts > 0);
 
+   /*
+    * The alias store is indexed by cert fingerprint, so each cert in the
+    * chain is looked up directly rather than compared against every
+    * stored cert.
+    */
+   fingerprints = g_malloc0(sizeof(*fingerprints) * numCerts);
+   for (i = 0; i < numCerts; i++) {
+      fingerprints[i] = CertVerify_CertFingerprint(pemCertChain[i]);
+   }
+
    /*
     * If we have no userName, look through the mapping file for a match
     * from the cert chain.
     */
    if (NULL == userName || *userName == '\0') {
-      err = ServiceAliasQueryMappedAliases(&numMapped, &maList);
+      err = ServiceAliasGetMappedStore(&mapStore);
 
       if (VGAUTH_E_OK != err) {
          goto done;
       }
+      numMapped = mapStore->num;
+      maList = mapStore->maList;
       if (0 == numMapped) {
          /*
           * No username, no mapped certs, no chance.
@@ -142,34 +158,33 @@ ServiceVerifyAndCheckTrustCertChainForSubject(int numCerts,
        * Search for a match in the mapped store.
        */
       for (i = 0; i < numCerts; i++) {
-         for (j = 0; j < numMapped; j++) {
-            if (ServiceComparePEMCerts(pemCertChain[i], maList[j].pemCert)) {
-               /*
-                * Make sure we don't have multiple matches with different users.
-                * Two possible scenarios that can trigger this:
-                * - the mapping file could be inconsistent
-                * - the chain coming in could have more than one cert that
-                *   exists in the mapping file, belonging to different users
-                */
-               if ((NULL != queryUserName) &&
-                   g_strcmp0(queryUserName, maList[j].userName) != 0) {
-                  Warning("%s: found more than one user in map file chain\n",
-                          __FUNCTION__);
-                  err = VGAUTH_E_MULTIPLE_MAPPINGS;
-                  goto done;
-               }
+         for (l = ServiceAliasStoreFindCert(mapStore, fingerprints[i]);
+              l != NULL; l = l->next) {
+            j = GPOINTER_TO_INT(l->data);
+            /*
+             * Make sure we don't have multiple matches with different users.
+             * Two possible scenarios that can trigger this:
+             * - the mapping file could be inconsistent
+             * - the chain coming in could have more than one cert that
+             *   exists in the mapping file, belonging to different users
+             */
+            if ((NULL != queryUserName) &&
+                g_strcmp0(queryUserName, maList[j].userName) != 0) {
+               Warning("%s: found more than one user in map file chain\n",
+                       __FUNCTION__);
+               err = VGAUTH_E_MULTIPLE_MAPPINGS;
+               goto done;
+            }
 
-               for (k = 0; k < maList[j].num; k++) {
-                  if ((maList[j].subjects[k].type == SUBJECT_TYPE_ANY) ||
-                      ServiceAliasIsSubjectEqual(subj->type,
-                                                 maList[j].subjects[k].type,
-                                                 subj->name,
-                                                 maList[j].subjects[k].name)) {
-                     queryUserName = g_strdup(maList[j].userName);
-                     break;
-                  }
+            for (k = 0; k < maList[j].num; k++) {
+               if ((maList[j].subjects[k].type == SUBJECT_TYPE_ANY) ||
+                   ServiceAliasIsSubjectEqual(subj->type,
+                                              maList[j].subjects[k].type,
+                                              subj->name,
+                                              maList[j].subjects[k].name)) {
+                  queryUserName = g_strdup(maList[j].userName);
+                  break;
                }
-
             }
          }
       }
@@ -209,10 +224,12 @@ ServiceVerifyAndCheckTrustCertChainForSubject(int numCerts,
       goto done;
    }
 
-   err = ServiceAliasQueryAliases(queryUserName, &numStoreCerts, &aList);
+   err = ServiceAliasGetAliasStore(queryUserName, &aliasStore);
    if (VGAUTH_E_OK != err) {
       goto done;
    }
+   numStoreCerts = aliasStore->num;
+   aList = aliasStore->aList;
 
    /*
     * Dump the store cert chain for debugging purposes.
@@ -236,40 +253,40 @@ ServiceVerifyAndCheckTrustCertChainForSubject(int numCerts,
       int foundSubjectIdx;
 
       foundTrusted = FALSE;
-      for (j = 0; j < numStoreCerts; j++) {
-         if (ServiceComparePEMCerts(pemCertChain[i], aList[j].pemCert)) {
+      for (l = ServiceAliasStoreFindCert(aliasStore, fingerprints[i]);
+           l != NULL; l = l->next) {
+         j = GPOINTER_TO_INT(l->data);
+         /*
+          * Remember the root cert, so we can return its AliasInfo
+          * if all checks out.
+          */
+         matchIdIdx = j;
+         foundAnyIdx = -1;
+         foundSubjectIdx = -1;
+
+         for (k = 0; k < aList[j].num; k++) {
+            if (aList[j].infos[k].type == SUBJECT_TYPE_ANY) {
+               foundAnyIdx = k;
+            } else if (ServiceAliasIsSubjectEqual(subj->type,
+                                                  aList[j].infos[k].type,
+                                                  subj->name,
+                                                  aList[j].infos[k].name)) {
+               foundSubjectIdx = k;
+            }
+         }
+         if ((foundSubjectIdx >= 0) || (foundAnyIdx >= 0)) {
+            numTrusted++;
+            trustedCerts = g_realloc(trustedCerts,
+                                     numTrusted * sizeof(*trustedCerts));
+            trustedCerts[numTrusted - 1] = g_strdup(pemCertChain[i]);
+            foundTrusted = TRUE;
             /*
-             * Remember the root cert, so we can return its AliasInfo
-             * if all checks out.
+             * Remember the matching ai, so we can return its comment
+             * if all checks out.  Note that a specific subject match takes
+             * precendence over an ANY match.
              */
-            matchIdIdx = j;
-            foundAnyIdx = -1;
-            foundSubjectIdx = -1;
-
-            for (k = 0; k < aList[j].num; k++) {
-               if (aList[j].infos[k].type == SUBJECT_TYPE_ANY) {
-                  foundAnyIdx = k;
-               } else if (ServiceAliasIsSubjectEqual(subj->type,
-                                                     aList[j].infos[k].type,
-                                                     subj->name,
-                                                     aList[j].infos[k].name)) {
-                  foundSubjectIdx = k;
-               }
-            }
-            if ((foundSubjectIdx >= 0) || (foundAnyIdx >= 0)) {
-               numTrusted++;
-               trustedCerts = g_realloc(trustedCerts,
-                                        numTrusted * sizeof(*trustedCerts));
-               trustedCerts[numTrusted - 1] = g_strdup(pemCertChain[i]);
-               foundTrusted = TRUE;
-               /*
-                * Remember the matching ai, so we can return its comment
-                * if all checks out.  Note that a specific subject match takes
-                * precendence over an ANY match.
-                */
-               matchSiIdx = (foundSubjectIdx >= 0) ?
-                  foundSubjectIdx : foundAnyIdx;
-            }
+            matchSiIdx = (foundSubjectIdx >= 0) ?
+               foundSubjectIdx : foundAnyIdx;
          }
       }
       if (!foundTrusted) {
@@ -333,9 +350,16 @@ ServiceVerifyAndCheckTrustCertChainForSubject(int numCerts,
    queryUserName = NULL;
 
 done:
-   ServiceAliasFreeMappedAliasList(numMapped, maList);
+   ServiceAliasReleaseStore(mapStore);
+
+   ServiceAliasReleaseStore(aliasStore);
 
-   ServiceAliasFreeAliasList(numStoreCerts, aList);
+   if (NULL != fingerprints) {
+      for (i = 0; i < numCerts; i++) {
+         g_free(fingerprints[i]);
+      }
+      g_free(fingerprints);
+   }
 
    for (i = 0; i < numTrusted; i++) {
       g_free(trustedCerts[i]);
@@ -20,16 +20,21 @@
  * cache.c --
  *
  * Module-specific components of the vmhgfs driver.
+ *
+ * The attribute cache is a hash table keyed by the HGFS absolute path. It
+ * is split into shards, each with its own lock, hash buckets and LRU list,
+ * so that concurrent getattr calls on different paths rarely contend.
+ * Entries expire CACHE_TIMEOUT seconds after they were last set and the
+ * least recently used entry of a shard is evicted when the shard is full.
  */
+#include <time.h>
 #include "module.h"
-#if !defined(__FreeBSD__) && !defined(__SOLARIS__)
-#include <glib.h>
-#endif
 #define CACHE_TIMEOUT 5
-#define CACHE_PURGE_TIME 10
 #define CACHE_PURGE_SLEEP_TIME 30
 #define HASH_THRESHOLD_SIZE (2046 * 4)
-#define HASH_PURGE_SIZE (HASH_THRESHOLD_SIZE / 2)
+#define HGFS_ATTR_CACHE_SHARDS 16                /* Must be a power of 2. */
+#define HGFS_ATTR_CACHE_BUCKETS 256              /* Per shard, power of 2. */
+#define HGFS_ATTR_CACHE_SHARD_MAX (HASH_THRESHOLD_SIZE / HGFS_ATTR_CACHE_SHARDS)
 #include "cache.h"
 
 /*
@@ -37,61 +42,61 @@
  */
 
 typedef struct HgfsAttrCache {
-   HgfsAttrInfo attr; /* Attribute of a file or directory */
-   uint64 changeTime; /* time the attribute was last updated */
-   struct list_head list; /* used in linked list implementation */
-   char path[0];      /* path of the file corresponding the the attr */
+   HgfsAttrInfo attr;          /* Attribute of a file or directory */
+   uint64 expireTime;          /* monotonic time after which attr is stale */
+   uint32 hash;                /* hash of path */
+   struct list_head hashList;  /* links in the shard's hash bucket */
+   struct list_head lruList;   /* links in the shard's LRU list */
+   char path[0];               /* path of the file corresponding the the attr */
 } HgfsAttrCache;
 
+typedef struct HgfsAttrCacheShard {
+   pthread_mutex_t lock;                   /* protects everything below */
+   struct list_head buckets[HGFS_ATTR_CACHE_BUCKETS];
+   struct list_head lru;                   /* most recently used first */
+   uint32 numEntries;
+   HgfsAttrCacheStats stats;
+} HgfsAttrCacheShard;
 
-/* Head of the list */
-struct HgfsAttrCache attrList;
-
-/*Lock for accessing the attribute cache*/
-static pthread_mutex_t HgfsAttrCacheLock = PTHREAD_MUTEX_INITIALIZER;
-
-/*
- * Lists are used to manage attribute cache in Solaris and FreeBSD,
- * HashTables are used in Linux. HashTables perform better and hence
- * once newer version of glib with hash tables are packaged for Solaris
- * and FreeBSD, this section will go away.
- */
+static HgfsAttrCacheShard attrCache[HGFS_ATTR_CACHE_SHARDS];
 
-#if defined(__FreeBSD__) || defined(__SOLARIS__)
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsInitCache
+ * HgfsAttrCacheNow
  *
- *    Initializes the list attrList to cache attributes.
+ *    Current monotonic time in seconds, used for entry expiry so that
+ *    changes to the wall clock do not affect the cache.
  *
  * Results:
- *    None
+ *    Seconds since an unspecified starting point.
  *
  * Side effects:
  *    None
  *
  *----------------------------------------------------------------------
- *
  */
 
-void
-HgfsInitCache()
+static uint64
+HgfsAttrCacheNow(void)
 {
-   INIT_LIST_HEAD(&attrList.list);
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsGetAttrCache
+ * HgfsAttrCacheHash
  *
- *    Retrieves the attr from the list for a given path.
+ *    FNV-1a hash of the first len characters of a path.
  *
  * Results:
- *    0 on success else -1 on error
+ *    The hash value.
  *
  * Side effects:
  *    None
@@ -99,48 +104,57 @@ HgfsInitCache()
  *----------------------------------------------------------------------
  */
 
-int
-HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
-                 HgfsAttrInfo *attr) //IN: Attribute for a given path
+static uint32
+HgfsAttrCacheHash(const char *path,  //IN: Path of file or directory
+                  size_t len)        //IN: Length of path
 {
-   HgfsAttrCache *tmp;
-   int res = -1;
-   int diff;
+   uint32 hash = 2166136261U;
+   size_t i;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
+   for (i = 0; i < len; i++) {
+      hash ^= (unsigned char)path[i];
+      hash *= 16777619U;
+   }
+   return hash;
+}
 
-   attrList.changeTime = HGFS_GET_TIME(time(NULL));
-   list_for_each_entry(tmp, &attrList.list, list) {
-      LOG(4, ("tmp->path = %d\n", tmp->path));
-      if (strcmp(path, tmp->path) == 0) {
-         LOG(4, ("cache hit. path = %s\n", tmp->path));
 
-         diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheShardOf
+ *
+ *    Map a hash value to its shard and bucket.
+ *
+ * Results:
+ *    The shard, and the bucket within it in *bucket.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
 
-         LOG(4, ("time since last updated is %d seconds\n", diff));
-         if (diff <= CACHE_TIMEOUT) {
-            *attr = tmp->attr;
-            res = 0;
-         }
-         break;
-      }
-   }
+static HgfsAttrCacheShard *
+HgfsAttrCacheShardOf(uint32 hash,               //IN: Hash of the path
+                     struct list_head **bucket) //OUT: Hash bucket
+{
+   HgfsAttrCacheShard *shard = &attrCache[hash & (HGFS_ATTR_CACHE_SHARDS - 1)];
 
-out:
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
-   return res;
+   *bucket = &shard->buckets[(hash >> 16) & (HGFS_ATTR_CACHE_BUCKETS - 1)];
+   return shard;
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsSetAttrCache
+ * HgfsAttrCacheFind
  *
- *    Updates the list with the given (key, attr)pair.
+ *    Look up an entry in a hash bucket. Called with the shard lock held.
  *
  * Results:
- *    0 on success else negative value on error
+ *    The entry, or NULL if the path is not cached.
  *
  * Side effects:
  *    None
@@ -148,49 +162,59 @@ out:
  *----------------------------------------------------------------------
  */
 
-int
-HgfsSetAttrCache(const char* path,   //IN: Path of file or directory
-                 HgfsAttrInfo *attr) //IN: Attribute for a given path
+static HgfsAttrCache *
+HgfsAttrCacheFind(struct list_head *bucket, //IN: Hash bucket
+                  uint32 hash,              //IN: Hash of path
+                  const char *path,         //IN: Path of file or directory
+                  size_t len)               //IN: Length of path
 {
    HgfsAttrCache *tmp;
-   int res = 0;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-
-   attrList.changeTime = HGFS_GET_TIME(time(NULL));
-   list_for_each_entry (tmp, &attrList.list, list) {
-      if (strcmp(path, tmp->path) == 0) {
-         tmp->attr = *attr;
-         tmp->changeTime = HGFS_GET_TIME(time(NULL));
-         LOG(4, ("cache entry updated. path = %s\n", tmp->path));
-         goto out;
+   list_for_each_entry(tmp, bucket, hashList) {
+      if (tmp->hash == hash &&
+          strncmp(tmp->path, path, len) == 0 &&
+          tmp->path[len] == '\0') {
+         return tmp;
       }
    }
+   return NULL;
+}
 
-   tmp = malloc(sizeof(HgfsAttrCache) + strlen(path) + 1);
-   if (tmp == NULL) {
-      res = -ENOMEM;
-      goto out;
-   }
-   INIT_LIST_HEAD(&tmp->list);
-   Str_Strcpy(tmp->path, path, strlen(path) + 1);
-   tmp->attr = *attr;
-   tmp->changeTime = HGFS_GET_TIME(time(NULL));
-   list_add(&tmp->list, &attrList.list);
-   LOG(4, ("cache entry added. path = %s\n", tmp->path));
 
-out:
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
-   return res;
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsAttrCacheFree
+ *
+ *    Unlink an entry from its shard and free it. Called with the shard
+ *    lock held.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsAttrCacheFree(HgfsAttrCacheShard *shard, //IN: Shard of the entry
+                  HgfsAttrCache *entry)      //IN: Entry to free
+{
+   list_del(&entry->hashList);
+   list_del(&entry->lruList);
+   shard->numEntries--;
+   free(entry);
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsInvalidateAttrCache
+ * HgfsAttrCacheRemove
  *
- *    Invalidate the attribute list entry for a given path.
+ *    Remove the entry for the first len characters of path, if any.
  *
  * Results:
  *    None
@@ -201,32 +225,33 @@ out:
  *----------------------------------------------------------------------
  */
 
-void
-HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
+static void
+HgfsAttrCacheRemove(const char *path, //IN: Path of file or directory
+                    size_t len)       //IN: Length of path
 {
+   uint32 hash = HgfsAttrCacheHash(path, len);
+   struct list_head *bucket;
+   HgfsAttrCacheShard *shard = HgfsAttrCacheShardOf(hash, &bucket);
    HgfsAttrCache *tmp;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-
-   list_for_each_entry (tmp, &attrList.list, list) {
-      if (strcmp(path, tmp->path) == 0) {
-         list_del(&tmp->list);
-         free(tmp);
-         break;
-      }
+   pthread_mutex_lock(&shard->lock);
+   tmp = HgfsAttrCacheFind(bucket, hash, path, len);
+   if (tmp != NULL) {
+      LOG(4, ("cache entry invalidated. path = %s\n", tmp->path));
+      HgfsAttrCacheFree(shard, tmp);
+      shard->stats.invalidations++;
    }
-
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   pthread_mutex_unlock(&shard->lock);
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * HgfsPurgeCache:
+ * HgfsAttrCacheRemoveParent
  *
- *    This routine is called by an independent thread to purge the cache,
- *    deletion is based on time of last update.
+ *    Remove the entry of the directory containing path, whose size, link
+ *    count and times change when an entry is added, removed or renamed.
  *
  * Results:
  *    None
@@ -237,57 +262,51 @@ HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
  *----------------------------------------------------------------------
  */
 
-void*
-HgfsPurgeCache(void* unused) //IN: Thread argument
+static void
+HgfsAttrCacheRemoveParent(const char *path) //IN: Path of file or directory
 {
-   HgfsAttrCache *tmp;
-   HgfsAttrCache *prev;
-   int diff;
+   const char *sep = strrchr(path, '/');
 
-   while (1)
-   {
-      sleep(CACHE_PURGE_SLEEP_TIME);
-
-      pthread_mutex_lock(&HgfsAttrCacheLock);
-
-      list_for_each_entry_safe (tmp, prev, &attrList.list, list) {
-         diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
-         if (diff > CACHE_PURGE_TIME) {
-            list_del (&tmp->list);
-            free (tmp);
-         }
-      }
-
-      pthread_mutex_unlock(&HgfsAttrCacheLock);
+   if (sep == NULL) {
+      return;
    }
-   return 0;
+   HgfsAttrCacheRemove(path, sep == path ? 1 : sep - path);
 }
 
-#else
-
-
-GHashTable *g_hash_table;
 
 /*
  *----------------------------------------------------------------------
  *
  * HgfsInitCache
  *
- *    Creates a hash table with string as a key.
+ *    Initializes the shards of the attribute cache.
  *
  * Results:
  *    None
  *
  * Side effects:
  *    None
- *----------------------------------------------------------------------
  *
+ *----------------------------------------------------------------------
  */
 
 void
 HgfsInitCache()
 {
-   g_hash_table = g_hash_table_new(g_str_hash, g_str_equal);
+   unsigned int i;
+   unsigned int j;
+
+   for (i = 0; i < HGFS_ATTR_CACHE_SHARDS; i++) {
+      HgfsAttrCacheShard *shard = &attrCache[i];
+
+      pthread_mutex_init(&shard->lock, NULL);
+      for (j = 0; j < HGFS_ATTR_CACHE_BUCKETS; j++) {
+         INIT_LIST_HEAD(&shard->buckets[j]);
+      }
+      INIT_LIST_HEAD(&shard->lru);
+      shard->numEntries = 0;
+      memset(&shard->stats, 0, sizeof shard->stats);
+   }
 }
 
 
@@ -296,13 +315,13 @@ HgfsInitCache()
  *
  * HgfsGetAttrCache
  *
- *    Retrieves the attr from the HashTable for a given path.
+ *    Retrieves the attr from the cache for a given path.
  *
  * Results:
  *    0 on success else -1 on error
  *
  * Side effects:
- *    None
+ *    The entry becomes the most recently used one of its shard.
  *
  *----------------------------------------------------------------------
  */
@@ -311,25 +330,33 @@ int
 HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
                  HgfsAttrInfo *attr) //IN: Attribute for a given path
 {
+   size_t len = strlen(path);
+   uint32 hash = HgfsAttrCacheHash(path, len);
+   struct list_head *bucket;
+   HgfsAttrCacheShard *shard = HgfsAttrCacheShardOf(hash, &bucket);
    HgfsAttrCache *tmp;
    int res = -1;
-   int diff;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
+   pthread_mutex_lock(&shard->lock);
 
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
-   if (tmp != NULL) {
+   tmp = HgfsAttrCacheFind(bucket, hash, path, len);
+   if (tmp == NULL) {
+      shard->stats.misses++;
+   } else if (HgfsAttrCacheNow() > tmp->expireTime) {
+      LOG(4, ("cache entry expired. path = %s\n", tmp->path));
+      HgfsAttrCacheFree(shard, tmp);
+      shard->stats.expired++;
+      shard->stats.misses++;
+   } else {
       LOG(4, ("cache hit. path = %s\n", tmp->path));
-
-      diff = (HGFS_GET_TIME(time(NULL)) - tmp->changeTime) / 10000000;
-      LOG(4, ("time since last updated is %d seconds\n", diff));
-      if ( diff <= CACHE_TIMEOUT ) {
-         *attr = tmp->attr;
-         res = 0;
-      }
+      list_del(&tmp->lruList);
+      list_add(&tmp->lruList, &shard->lru);
+      *attr = tmp->attr;
+      shard->stats.hits++;
+      res = 0;
    }
 
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   pthread_mutex_unlock(&shard->lock);
    return res;
 }
 
@@ -339,7 +366,8 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
  *
  * HgfsSetAttrCache
  *
- *    Updates the HashTable with the given (key, attr) pair.
+ *    Updates the cache with the given (key, attr) pair, evicting the
+ *    least recently used entry of the shard if it is full.
  *
  * Results:
  *    0 on success else negative value on error
@@ -351,35 +379,51 @@ HgfsGetAttrCache(const char* path,   //IN: Path of file or directory
  */
 
 int
-HgfsSetAttrCache(const char* path,         //IN: Path of file or directory
-                 HgfsAttrInfo *attr)       //IN: Attribute for a given path
+HgfsSetAttrCache(const char* path,   //IN: Path of file or directory
+                 HgfsAttrInfo *attr) //IN: Attribute for a given path
 {
+   size_t len = strlen(path);
+   uint32 hash = HgfsAttrCacheHash(path, len);
+   struct list_head *bucket;
+   HgfsAttrCacheShard *shard = HgfsAttrCacheShardOf(hash, &bucket);
    HgfsAttrCache *tmp;
    int res = 0;
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
+   pthread_mutex_lock(&shard->lock);
 
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
+   tmp = HgfsAttrCacheFind(bucket, hash, path, len);
    if (tmp != NULL) {
-      tmp->attr = *attr;
-      tmp->changeTime = HGFS_GET_TIME(time(NULL));
-      goto out;
-   }
+      list_del(&tmp->lruList);
+      LOG(4, ("cache entry updated. path = %s\n", tmp->path));
+   } else {
+      if (shard->numEntries >= HGFS_ATTR_CACHE_SHARD_MAX) {
+         HgfsAttrCache *victim = list_entry(shard->lru.prev, HgfsAttrCache,
+                                            lruList);
+
+         LOG(4, ("cache entry evicted. path = %s\n", victim->path));
+         HgfsAttrCacheFree(shard, victim);
+         shard->stats.evictions++;
+      }
 
-   tmp = malloc(sizeof(HgfsAttrCache) + strlen(path) + 1);
-   if (tmp == NULL) {
-      return -ENOMEM;
-      goto out;
+      tmp = malloc(sizeof(HgfsAttrCache) + len + 1);
+      if (tmp == NULL) {
+         res = -ENOMEM;
+         goto out;
+      }
+      memcpy(tmp->path, path, len + 1);
+      tmp->hash = hash;
+      list_add(&tmp->hashList, bucket);
+      shard->numEntries++;
+      shard->stats.inserts++;
+      LOG(4, ("cache entry added. path = %s\n", tmp->path));
    }
 
-   Str_Strcpy(tmp->path, path, strlen(path) + 1);
    tmp->attr = *attr;
-   tmp->changeTime = HGFS_GET_TIME(time(NULL));
-
-   g_hash_table_insert(g_hash_table, (gpointer)tmp->path, (gpointer)tmp);
+   tmp->expireTime = HgfsAttrCacheNow() + CACHE_TIMEOUT;
+   list_add(&tmp->lruList, &shard->lru);
 
 out:
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
+   pthread_mutex_unlock(&shard->lock);
    return res;
 }
 
@@ -389,7 +433,7 @@ out:
  *
  * HgfsInvalidateAttrCache
  *
- *    Invalidate the HashTable entry for a path.
+ *    Invalidate the cache entry for a path.
  *
  * Results:
  *    None
@@ -403,24 +447,124 @@ out:
 void
 HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
 {
-   HgfsAttrCache *tmp;
+   HgfsAttrCacheRemove(path, strlen(path));
+}
 
-   pthread_mutex_lock(&HgfsAttrCacheLock);
-   tmp = (HgfsAttrCache *)g_hash_table_lookup(g_hash_table, path);
-   if (tmp != NULL) {
-      tmp->changeTime = 0;
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInvalidateAttrCacheName
+ *
+ *    Invalidate the cache entries for a path and for the directory that
+ *    contains it. Used when a name is created or removed.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsInvalidateAttrCacheName(const char* path)  //IN: Path to file
+{
+   HgfsAttrCacheRemove(path, strlen(path));
+   HgfsAttrCacheRemoveParent(path);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsInvalidateAttrCacheTree
+ *
+ *    Invalidate the cache entries for a path, everything below it and
+ *    the directory that contains it. Used when a directory is renamed or
+ *    removed, which implicitly changes all paths underneath.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsInvalidateAttrCacheTree(const char* path)  //IN: Path to directory
+{
+   size_t len = strlen(path);
+   unsigned int i;
+
+   HgfsInvalidateAttrCacheName(path);
+
+   for (i = 0; i < HGFS_ATTR_CACHE_SHARDS; i++) {
+      HgfsAttrCacheShard *shard = &attrCache[i];
+      HgfsAttrCache *tmp;
+      HgfsAttrCache *next;
+
+      pthread_mutex_lock(&shard->lock);
+      list_for_each_entry_safe(tmp, next, &shard->lru, lruList) {
+         if (strncmp(tmp->path, path, len) == 0 && tmp->path[len] == '/') {
+            HgfsAttrCacheFree(shard, tmp);
+            shard->stats.invalidations++;
+         }
+      }
+      pthread_mutex_unlock(&shard->lock);
    }
-   pthread_mutex_unlock(&HgfsAttrCacheLock);
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsGetAttrCacheStats
+ *
+ *    Sum the counters of all shards.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HgfsGetAttrCacheStats(HgfsAttrCacheStats *stats) //OUT: Cache counters
+{
+   unsigned int i;
+
+   memset(stats, 0, sizeof *stats);
+   for (i = 0; i < HGFS_ATTR_CACHE_SHARDS; i++) {
+      HgfsAttrCacheShard *shard = &attrCache[i];
+
+      pthread_mutex_lock(&shard->lock);
+      stats->hits += shard->stats.hits;
+      stats->misses += shard->stats.misses;
+      stats->expired += shard->stats.expired;
+      stats->inserts += shard->stats.inserts;
+      stats->evictions += shard->stats.evictions;
+      stats->invalidations += shard->stats.invalidations;
+      stats->entries += shard->numEntries;
+      pthread_mutex_unlock(&shard->lock);
+   }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
  * HgfsPurgeCache
  *
  *    This routine is called by an independent thread to purge the cache,
- *    for performance reasons, the deletion is done in random based
- *    on the order of iteration.
+ *    removing expired entries so that paths which are not looked up
+ *    again do not hold memory until they are evicted.
  *
  * Results:
  *    None
@@ -434,25 +578,27 @@ HgfsInvalidateAttrCache(const char* path)      //IN: Path to file
 void*
 HgfsPurgeCache(void* unused)      //IN: Thread argument
 {
-   gpointer key, value;
-   GHashTableIter iter;
-
    while (1) {
-      sleep(CACHE_PURGE_SLEEP_TIME);
+      uint64 now;
+      unsigned int i;
 
-      pthread_mutex_lock(&HgfsAttrCacheLock);
+      sleep(CACHE_PURGE_SLEEP_TIME);
 
-      if (g_hash_table_size(g_hash_table) >= HASH_THRESHOLD_SIZE) {
-         g_hash_table_iter_init(&iter, g_hash_table);
-         while (g_hash_table_iter_next(&iter, &key, &value) &&
-               (g_hash_table_size(g_hash_table) >= HASH_PURGE_SIZE)) {
-            g_hash_table_iter_remove(&iter);
-            free(value);
+      now = HgfsAttrCacheNow();
+      for (i = 0; i < HGFS_ATTR_CACHE_SHARDS; i++) {
+         HgfsAttrCacheShard *shard = &attrCache[i];
+         HgfsAttrCache *tmp;
+         HgfsAttrCache *prev;
+
+         pthread_mutex_lock(&shard->lock);
+         list_for_each_entry_safe(tmp, prev, &shard->lru, lruList) {
+            if (now > tmp->expireTime) {
+               HgfsAttrCacheFree(shard, tmp);
+               shard->stats.expired++;
+            }
          }
+         pthread_mutex_unlock(&shard->lock);
       }
-
-      pthread_mutex_unlock(&HgfsAttrCacheLock);
    }
    return 0;
 }
-#endif
@@ -25,10 +25,29 @@
 #ifndef _HGFS_DRIVER_CACHE_H_
 #define _HGFS_DRIVER_CACHE_H_
 
+/*
+ * Attribute cache counters, reported through HGFS_CACHE_STATS_PATH.
+ */
+typedef struct HgfsAttrCacheStats {
+   uint64 hits;           /* lookups answered from the cache */
+   uint64 misses;         /* lookups that had to go to the server */
+   uint64 expired;        /* entries dropped because their TTL passed */
+   uint64 inserts;        /* entries added */
+   uint64 evictions;      /* entries dropped to make room */
+   uint64 invalidations;  /* entries dropped by namespace changes */
+   uint64 entries;        /* entries currently cached */
+} HgfsAttrCacheStats;
+
+/* Read-only file at the root of the mount reporting the cache counters. */
+#define HGFS_CACHE_STATS_PATH "/.vmhgfs-cache-stats"
+
 int HgfsGetAttrCache(const char* path, HgfsAttrInfo *attr);
 int HgfsSetAttrCache(const char* path, HgfsAttrInfo *attr);
 void HgfsInitCache();
 void* HgfsPurgeCache(void*);
 void HgfsInvalidateAttrCache(const char* path);
+void HgfsInvalidateAttrCacheName(const char* path);
+void HgfsInvalidateAttrCacheTree(const char* path);
+void HgfsGetAttrCacheStats(HgfsAttrCacheStats *stats);
 
 #endif
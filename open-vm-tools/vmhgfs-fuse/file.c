@@ -519,8 +519,8 @@ HgfsCreate(const char *path,          //IN: Path to a file
  *    Do one read request. Called by HgfsRead, possibly multiple times
  *    if the size of the read is too big to be handled by one server request.
  *
- *    We send a "Read" request to the server with the given handle.
- *
+ *    We send a "Read" request to the server with the given handle. The
+ *    data part of the reply is copied by the transport straight into buf.
  *
  * Results:
  *    Returns the number of bytes read on success, or an error on failure.
@@ -543,6 +543,8 @@ HgfsDoRead(HgfsHandle handle,  // IN:  Handle for this file
    uint32 actualSize = 0;
    char *payload = NULL;
    HgfsStatus replyStatus;
+   Bool zeroCopy = TRUE;
+   size_t dataOffset;
 
    ASSERT(NULL != buf);
 
@@ -566,6 +568,7 @@ HgfsDoRead(HgfsHandle handle,  // IN:  Handle for this file
       requestV3->reserved = 0;
 
       req->payloadSize = sizeof(*requestV3) + HgfsGetRequestHeaderSize();
+      dataOffset = HgfsGetReplyHeaderSize() + offsetof(HgfsReplyReadV3, payload);
 
    } else {
       HgfsRequestRead *request;
@@ -575,6 +578,15 @@ HgfsDoRead(HgfsHandle handle,  // IN:  Handle for this file
       request->offset = offset;
       request->requiredSize = count;
       req->payloadSize = sizeof *request;
+      dataOffset = offsetof(HgfsReplyRead, payload);
+   }
+
+   if (zeroCopy) {
+      req->replyData = buf;
+      req->replyDataOffset = dataOffset;
+      req->replyDataSize = count;
+   } else {
+      req->replyData = NULL;
    }
 
    /* Fill in header here as payloadSize needs to be there. */
@@ -614,9 +626,21 @@ HgfsDoRead(HgfsHandle handle,  // IN:  Handle for this file
             goto out;
          }
 
+         if (req->replyData == NULL) {
+            memcpy(buf, payload, actualSize);
+            LOG(8, ("Copied %u\n", actualSize));
+         } else if (payload != HGFS_REQ_PAYLOAD(req) + dataOffset) {
+            /*
+             * The reply header is not the one we expected, e.g. the session
+             * was lost, so the data was split at the wrong offset. Reissue
+             * the read without a reply data buffer.
+             */
+            LOG(4, ("Unexpected reply layout, retrying with a copy\n"));
+            zeroCopy = FALSE;
+            goto retry;
+         }
+
          /* Return result. */
-         memcpy(buf, payload, actualSize);
-         LOG(8, ("Copied %u\n", actualSize));
          result = actualSize;
          break;
 
@@ -103,6 +103,76 @@ freeAbsPath(char *abspath)  // IN
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * isCacheStatsPath
+ *
+ *    Check whether a path relative to the mount names the attribute
+ *    cache statistics file.
+ *
+ * Results:
+ *    TRUE if it does, FALSE otherwise.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+isCacheStatsPath(const char *path) // IN
+{
+   return strcmp(path, HGFS_CACHE_STATS_PATH) == 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * readCacheStats
+ *
+ *    Format the attribute cache counters and copy the requested range
+ *    of the text into buf.
+ *
+ * Results:
+ *    Number of bytes copied.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+readCacheStats(char *buf,     // OUT
+               size_t size,   // IN
+               off_t offset)  // IN
+{
+   HgfsAttrCacheStats stats;
+   char text[512];
+   int len;
+
+   HgfsGetAttrCacheStats(&stats);
+   len = Str_Snprintf(text, sizeof text,
+                      "hits %"FMT64"u\n"
+                      "misses %"FMT64"u\n"
+                      "expired %"FMT64"u\n"
+                      "inserts %"FMT64"u\n"
+                      "evictions %"FMT64"u\n"
+                      "invalidations %"FMT64"u\n"
+                      "entries %"FMT64"u\n",
+                      stats.hits, stats.misses, stats.expired, stats.inserts,
+                      stats.evictions, stats.invalidations, stats.entries);
+   if (len < 0 || offset >= len) {
+      return 0;
+   }
+   len = MIN((size_t)(len - offset), size);
+   memcpy(buf, text + offset, len);
+   return len;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -131,6 +201,14 @@ hgfs_getattr(const char *path,    //IN: path of a file/directory
    int res;
 
    LOG(4, ("Entry(path = %s)\n", path));
+   if (isCacheStatsPath(path)) {
+      memset(stbuf, 0, sizeof *stbuf);
+      stbuf->st_mode = S_IFREG | S_IRUSR | S_IRGRP | S_IROTH;
+      stbuf->st_nlink = 1;
+      LOG(4, ("Exit(0)\n"));
+      return 0;
+   }
+
    res = getAbsPath(path, &abspath);
    if (res < 0) {
       goto exit;
@@ -242,12 +320,18 @@ hgfs_access(const char *path,  //IN: Path to a file.
    int res;
 
    LOG(4, ("Entry(path = %s, mask = %#o)\n", path, mask));
+   if (isCacheStatsPath(path)) {
+      res = (mask & (W_OK | X_OK)) ? -EACCES : 0;
+      LOG(4, ("Exit(%d)\n", res));
+      return res;
+   }
+
    res = getAbsPath(path, &abspath);
    if (res < 0) {
       goto exit;
    }
 
-   res = HgfsGetAttrCache(path, attr);
+   res = HgfsGetAttrCache(abspath, attr);
    LOG(4, ("Retrieve attr from cache. result = %d \n", res));
    if (res != 0) {
       /* Retrieve new complete attribute settings and update the cache. */
@@ -458,6 +542,9 @@ hgfs_mkdir(const char *path,  //IN: path to a new dir
    }
 
    res = HgfsMkdir(abspath, mode);
+   if (res == 0) {
+      HgfsInvalidateAttrCacheName(abspath);
+   }
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -495,7 +582,7 @@ hgfs_unlink(const char *path) //IN: path to a file
    }
 
    res = HgfsDelete(abspath, HGFS_OP_DELETE_FILE);
-   HgfsInvalidateAttrCache(abspath);
+   HgfsInvalidateAttrCacheName(abspath);
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -533,7 +620,7 @@ hgfs_rmdir(const char *path) //IN: path to a dir
    }
 
    res = HgfsDelete(abspath, HGFS_OP_DELETE_DIR);
-   HgfsInvalidateAttrCache(abspath);
+   HgfsInvalidateAttrCacheTree(abspath);
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -577,6 +664,9 @@ hgfs_symlink(const char *from,      //IN: from path
    }
 
    res = HgfsSymlink(absto, absfrom);
+   if (res == 0) {
+      HgfsInvalidateAttrCacheName(absto);
+   }
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -621,7 +711,8 @@ hgfs_rename(const char *from,  //IN: from path name
    }
 
    res = HgfsRename(absfrom, absto);
-   HgfsInvalidateAttrCache(absfrom);
+   HgfsInvalidateAttrCacheTree(absfrom);
+   HgfsInvalidateAttrCacheTree(absto);
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -992,6 +1083,18 @@ hgfs_open(const char *path,          //IN: path to a file
    int res;
 
    LOG(4, ("Entry(path = %s)\n", path));
+   if (isCacheStatsPath(path)) {
+      if ((fi->flags & O_ACCMODE) != O_RDONLY) {
+         LOG(4, ("Exit(%d)\n", -EACCES));
+         return -EACCES;
+      }
+      /* The contents change on every read, bypass the page cache. */
+      fi->fh = HGFS_INVALID_HANDLE;
+      fi->direct_io = 1;
+      LOG(4, ("Exit(0)\n"));
+      return 0;
+   }
+
    res = getAbsPath(path, &abspath);
    if (res < 0) {
       goto exit;
@@ -1037,6 +1140,9 @@ hgfs_create(const char *path,          //IN: path to a file
    }
 
    res = HgfsCreate(abspath, mode, fi);
+   if (res == 0) {
+      HgfsInvalidateAttrCacheName(abspath);
+   }
 
 exit:
    LOG(4, ("Exit(%d)\n", res));
@@ -1074,6 +1180,12 @@ hgfs_read(const char *path,          //IN: path to a file
 
    LOG(4, ("Entry(path = %s, fi->fh = %#"FMT64"x, %#"FMTSZ"x bytes @ %#"FMT64"x)\n",
            path, fi->fh, size, offset));
+   if (isCacheStatsPath(path)) {
+      res = readCacheStats(buf, size, offset);
+      LOG(4, ("Exit(%d)\n", res));
+      return res;
+   }
+
    res = getAbsPath(path, &abspath);
    if (res < 0) {
       goto exit;
@@ -1206,6 +1318,11 @@ hgfs_release(const char *path,                //IN: path to a file
    int res;
 
    LOG(4, ("Entry(path = %s, fi->fh = %#"FMT64"x)\n", path, fi->fh));
+   if (isCacheStatsPath(path)) {
+      LOG(4, ("Exit(0)\n"));
+      return 0;
+   }
+
    res = getAbsPath(path, &abspath);
    if (res < 0) {
       goto exit;
@@ -29,9 +29,123 @@
 #include "transport.h"
 #include "fsutil.h"
 #include "vm_assert.h"
+#include "vm_atomic.h"
 
-static HgfsHandle hgfsIdCounter;
-pthread_mutex_t hgfsIdLock = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * Freed requests are kept on a small per-thread list and handed out again
+ * by the next HgfsGetNewRequest on the same thread, so that the common
+ * case neither touches the allocator nor takes a shared lock. The lists
+ * are released when their thread exits.
+ */
+#define HGFS_REQ_POOL_THREAD_MAX 4
+
+typedef struct HgfsReqPool {
+   struct list_head freeList;
+   unsigned int numFree;
+} HgfsReqPool;
+
+static Atomic_uint32 hgfsIdCounter;
+static pthread_key_t hgfsReqPoolKey;
+static pthread_once_t hgfsReqPoolOnce = PTHREAD_ONCE_INIT;
+static Bool hgfsReqPoolKeyValid;
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqPoolDestroy --
+ *
+ *    Thread exit destructor, frees the requests cached by the thread.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReqPoolDestroy(void *data)  // IN: Pool of the exiting thread
+{
+   HgfsReqPool *pool = data;
+   HgfsReq *req;
+   HgfsReq *next;
+
+   list_for_each_entry_safe(req, next, &pool->freeList, list) {
+      free(req);
+   }
+   free(pool);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqPoolInit --
+ *
+ *    Create the key for the per-thread request pools.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+HgfsReqPoolInit(void)
+{
+   hgfsReqPoolKeyValid =
+      pthread_key_create(&hgfsReqPoolKey, HgfsReqPoolDestroy) == 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HgfsReqPoolGet --
+ *
+ *    Return the request pool of the calling thread, creating it on
+ *    first use.
+ *
+ * Results:
+ *    The pool, or NULL if it could not be created.
+ *
+ * Side effects:
+ *    None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static HgfsReqPool *
+HgfsReqPoolGet(void)
+{
+   HgfsReqPool *pool;
+
+   pthread_once(&hgfsReqPoolOnce, HgfsReqPoolInit);
+   if (!hgfsReqPoolKeyValid) {
+      return NULL;
+   }
+
+   pool = pthread_getspecific(hgfsReqPoolKey);
+   if (pool == NULL) {
+      pool = malloc(sizeof *pool);
+      if (pool == NULL) {
+         return NULL;
+      }
+      INIT_LIST_HEAD(&pool->freeList);
+      pool->numFree = 0;
+      if (pthread_setspecific(hgfsReqPoolKey, pool) != 0) {
+         free(pool);
+         return NULL;
+      }
+   }
+   return pool;
+}
 
 
 /*
@@ -39,7 +153,8 @@ pthread_mutex_t hgfsIdLock = PTHREAD_MUTEX_INITIALIZER;
  *
  * HgfsGetNewRequest --
  *
- *    Get a new request structure off the free list and initialize it.
+ *    Get a new request structure off the thread's free list, or
+ *    allocate one, and initialize it.
  *
  * Results:
  *    On success the new struct is returned with all fields
@@ -55,22 +170,29 @@ HgfsReq *
 HgfsGetNewRequest(void)
 {
    HgfsReq *req = NULL;
+   HgfsReqPool *pool = HgfsReqPoolGet();
 
-   req = (HgfsReq*)malloc(sizeof(HgfsReq));
-   if (req == NULL) {
-      LOG(4, ("Can't allocate memory.\n"));
-      return NULL;
+   if (pool != NULL && !list_empty(&pool->freeList)) {
+      req = list_entry(pool->freeList.next, HgfsReq, list);
+      list_del(&req->list);
+      pool->numFree--;
+   } else {
+      req = (HgfsReq*)malloc(sizeof(HgfsReq));
+      if (req == NULL) {
+         LOG(4, ("Can't allocate memory.\n"));
+         return NULL;
+      }
    }
    INIT_LIST_HEAD(&req->list);
    req->payloadSize = 0;
+   req->replyData = NULL;
+   req->replyDataOffset = 0;
+   req->replyDataSize = 0;
    req->state = HGFS_REQ_STATE_ALLOCATED;
    /* Setup the packet prefix. */
    memcpy(req->packet, HGFS_SYNC_REQREP_CLIENT_CMD,
           HGFS_SYNC_REQREP_CLIENT_CMD_LEN);
-   pthread_mutex_lock(&hgfsIdLock);
-   req->id = hgfsIdCounter;
-   hgfsIdCounter++;
-   pthread_mutex_unlock(&hgfsIdLock);
+   req->id = Atomic_ReadInc32(&hgfsIdCounter);
 
    return req;
 }
@@ -331,7 +453,8 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
  *
  * HgfsFreeRequest --
  *
- *    Free an HGFS request.
+ *    Free an HGFS request, keeping it on the thread's free list for reuse
+ *    if the list is not full.
  *
  * Results:
  *    None
@@ -345,7 +468,20 @@ HgfsSendRequest(HgfsReq *req)       // IN/OUT: Outgoing request
 void
 HgfsFreeRequest(HgfsReq *req) // IN: Request to free
 {
-   free(req);
+   HgfsReqPool *pool;
+
+   if (req == NULL) {
+      return;
+   }
+
+   pool = HgfsReqPoolGet();
+   if (pool != NULL && pool->numFree < HGFS_REQ_POOL_THREAD_MAX) {
+      ASSERT(list_empty(&req->list));
+      list_add(&req->list, &pool->freeList);
+      pool->numFree++;
+   } else {
+      free(req);
+   }
 }
 
 
@@ -419,7 +555,8 @@ out:
  * HgfsCompleteReq --
  *
  *    Copies the reply packet into the request structure and wakes up
- *    the associated client.
+ *    the associated client. If the request has a reply data buffer the
+ *    data part of the reply is copied there directly.
  *
  * Results:
  *    None
@@ -439,7 +576,13 @@ HgfsCompleteReq(HgfsReq *req,       // IN: Request
    ASSERT(reply);
    ASSERT(replySize <= HGFS_LARGE_PACKET_MAX);
 
-   memcpy(HGFS_REQ_PAYLOAD(req), reply, replySize);
+   if (req->replyData != NULL && replySize > req->replyDataOffset) {
+      memcpy(HGFS_REQ_PAYLOAD(req), reply, req->replyDataOffset);
+      memcpy(req->replyData, reply + req->replyDataOffset,
+             MIN(replySize - req->replyDataOffset, req->replyDataSize));
+   } else {
+      memcpy(HGFS_REQ_PAYLOAD(req), reply, replySize);
+   }
    req->payloadSize = replySize;
    req->state = HGFS_REQ_STATE_COMPLETED;
    if (!list_empty(&req->list)) {
@@ -103,6 +103,15 @@ typedef struct HgfsReq {
    /* Total size of the payload.*/
    size_t payloadSize;
 
+   /*
+    * Optional destination for the data part of the reply. When set, reply
+    * bytes past replyDataOffset are copied straight into replyData, up to
+    * replyDataSize bytes, instead of into packet.
+    */
+   char *replyData;
+   size_t replyDataOffset;
+   size_t replyDataSize;
+
    /*
     * Packet of data, for both incoming and outgoing messages.
     * Include room for the command.
@@ -301,6 +301,13 @@ HgfsTransportBeforeExitingRecvThread(void)
  *
  *     Sends the request via channel communication.
  *
+ *     Requests are sent one at a time, under gHgfsActiveChannelLock. The
+ *     only channel is the backdoor, which completes the request inside
+ *     its send callback, under the channel's connLock. There is never
+ *     more than one request on the wire, so keeping several reads or
+ *     writes in flight, or matching out of order replies, first needs a
+ *     channel that returns from send before the reply arrives.
+ *
  * Results:
  *     Zero on success, non-zero error on failure.
  *